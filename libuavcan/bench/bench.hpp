@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#pragma once
+
+#include <ctime>
+#include <cstdlib>
+#include <vector>
+#include <uavcan/std.hpp>
+
+/**
+ * Minimal benchmarking harness for libuavcan.
+ *
+ * Every benchmark is a function that performs the requested number of iterations of the measured operation.
+ * The harness calls the function with a growing number of iterations until the run takes long enough to be
+ * measured reliably, then reports the time per iteration. The setup performed before the measured loop should
+ * be excluded with @ref State::resetTimer().
+ *
+ * Usage:
+ *     BENCHMARK(Group, Name)
+ *     {
+ *         ...setup...
+ *         state.resetTimer();
+ *         for (uint64_t i = 0; i < state.getIterations(); i++)
+ *         {
+ *             ...measured operation...
+ *         }
+ *         state.setBytesProcessed(...);    // Optional
+ *     }
+ */
+namespace bench
+{
+
+inline uint64_t getMonotonicNSec()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+    {
+        std::abort();
+    }
+    return uint64_t(ts.tv_sec) * 1000000000ULL + uint64_t(ts.tv_nsec);
+}
+
+class State
+{
+    const uint64_t iterations_;
+    uint64_t started_at_;
+    uint64_t stopped_at_;
+    uint64_t bytes_processed_;
+    uint64_t items_processed_;
+    bool failed_;
+
+public:
+    explicit State(uint64_t iterations)
+        : iterations_(iterations)
+        , started_at_(getMonotonicNSec())
+        , stopped_at_(0)
+        , bytes_processed_(0)
+        , items_processed_(0)
+        , failed_(false)
+    { }
+
+    uint64_t getIterations() const { return iterations_; }
+
+    /**
+     * Excludes the time spent before the call from the measurement.
+     */
+    void resetTimer() { started_at_ = getMonotonicNSec(); }
+
+    /**
+     * Excludes the time spent after the call from the measurement. Optional.
+     */
+    void stopTimer() { stopped_at_ = getMonotonicNSec(); }
+
+    /**
+     * Total number of bytes/items processed by all iterations; used to report the throughput.
+     */
+    void setBytesProcessed(uint64_t bytes) { bytes_processed_ = bytes; }
+    void setItemsProcessed(uint64_t items) { items_processed_ = items; }
+
+    /**
+     * Marks the benchmark as failed, e.g. if the measured operation returned an error.
+     */
+    void setFailed() { failed_ = true; }
+
+    uint64_t getElapsedNSec() const
+    {
+        const uint64_t stopped_at = (stopped_at_ > 0) ? stopped_at_ : getMonotonicNSec();
+        return (stopped_at > started_at_) ? (stopped_at - started_at_) : 0;
+    }
+    uint64_t getBytesProcessed() const { return bytes_processed_; }
+    uint64_t getItemsProcessed() const { return items_processed_; }
+    bool hasFailed() const { return failed_; }
+};
+
+typedef void (*BenchmarkFunction)(State&);
+
+struct BenchmarkInfo
+{
+    const char* name;
+    BenchmarkFunction function;
+};
+
+inline std::vector<BenchmarkInfo>& getRegistry()
+{
+    static std::vector<BenchmarkInfo> registry;
+    return registry;
+}
+
+struct Registrator
+{
+    Registrator(const char* name, BenchmarkFunction function)
+    {
+        BenchmarkInfo info;
+        info.name = name;
+        info.function = function;
+        getRegistry().push_back(info);
+    }
+};
+
+/**
+ * Prevents the compiler from optimizing away a computation whose result is otherwise unused.
+ */
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+#if defined(__GNUC__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+}
+
+#define BENCHMARK(group, name) \
+    static void bench_##group##_##name(::bench::State& state); \
+    static ::bench::Registrator bench_registrator_##group##_##name(#group "." #name, &bench_##group##_##name); \
+    static void bench_##group##_##name(::bench::State& state)
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#pragma once
+
+#include <deque>
+#include <uavcan/driver/can.hpp>
+#include <uavcan/driver/system_clock.hpp>
+#include <uavcan/node/abstract_node.hpp>
+#include <uavcan/helpers/heap_based_pool_allocator.hpp>
+#include "bench.hpp"
+
+namespace bench
+{
+/**
+ * Real monotonic clock; the UTC time is the same as the monotonic time.
+ */
+class SystemClock : public uavcan::ISystemClock
+{
+public:
+    virtual uavcan::MonotonicTime getMonotonic() const
+    {
+        return uavcan::MonotonicTime::fromUSec(getMonotonicNSec() / 1000U);
+    }
+
+    virtual uavcan::UtcTime getUtc() const
+    {
+        return uavcan::UtcTime::fromUSec(getMonotonicNSec() / 1000U);
+    }
+
+    virtual void adjustUtc(uavcan::UtcDuration) { }
+};
+
+/**
+ * Single-interface CAN driver that delivers every transmitted frame to the linked driver instantly.
+ * It never blocks and never runs out of TX buffers, so that the measurements reflect only the cost of the stack.
+ */
+class CanDriver : public uavcan::ICanDriver, public uavcan::ICanIface, uavcan::Noncopyable
+{
+    struct RxItem
+    {
+        uavcan::CanFrame frame;
+        uavcan::CanIOFlags flags;
+    };
+
+    const uavcan::ISystemClock& clock_;
+    CanDriver* peer_;
+    std::deque<RxItem> rx_queue_;
+
+public:
+    explicit CanDriver(const uavcan::ISystemClock& clock)
+        : clock_(clock)
+        , peer_(NULL)
+    { }
+
+    void linkTogether(CanDriver& other)
+    {
+        peer_ = &other;
+        other.peer_ = this;
+    }
+
+    void pushRx(const uavcan::CanFrame& frame, uavcan::CanIOFlags flags = 0)
+    {
+        RxItem item;
+        item.frame = frame;
+        item.flags = flags;
+        rx_queue_.push_back(item);
+    }
+
+    bool popRx(uavcan::CanFrame& out_frame)
+    {
+        if (rx_queue_.empty())
+        {
+            return false;
+        }
+        out_frame = rx_queue_.front().frame;
+        rx_queue_.pop_front();
+        return true;
+    }
+
+    unsigned getNumPendingRxFrames() const { return unsigned(rx_queue_.size()); }
+
+    virtual uavcan::ICanIface* getIface(uavcan::uint8_t iface_index) { return (iface_index == 0) ? this : NULL; }
+
+    virtual uavcan::uint8_t getNumIfaces() const { return 1; }
+
+    virtual uavcan::int16_t select(uavcan::CanSelectMasks& inout_masks,
+                                   const uavcan::CanFrame* (&)[uavcan::MaxCanIfaces],
+                                   uavcan::MonotonicTime)
+    {
+        inout_masks.read = uavcan::uint8_t(inout_masks.read & (rx_queue_.empty() ? 0U : 1U));
+        inout_masks.write = uavcan::uint8_t(inout_masks.write & 1U);
+        return 1;
+    }
+
+    virtual uavcan::int16_t send(const uavcan::CanFrame& frame, uavcan::MonotonicTime, uavcan::CanIOFlags flags)
+    {
+        if (peer_ != NULL)
+        {
+            peer_->pushRx(frame);
+        }
+        if (flags & uavcan::CanIOFlagLoopback)
+        {
+            pushRx(frame, uavcan::CanIOFlagLoopback);
+        }
+        return 1;
+    }
+
+    virtual uavcan::int16_t receive(uavcan::CanFrame& out_frame, uavcan::MonotonicTime& out_ts_monotonic,
+                                    uavcan::UtcTime& out_ts_utc, uavcan::CanIOFlags& out_flags)
+    {
+        if (rx_queue_.empty())
+        {
+            return 0;
+        }
+        out_frame = rx_queue_.front().frame;
+        out_flags = rx_queue_.front().flags;
+        rx_queue_.pop_front();
+        out_ts_monotonic = clock_.getMonotonic();
+        out_ts_utc = clock_.getUtc();
+        return 1;
+    }
+
+    virtual uavcan::int16_t configureFilters(const uavcan::CanFilterConfig*, uavcan::uint16_t) { return 0; }
+    virtual uavcan::uint16_t getNumFilters() const { return 0; }
+    virtual uavcan::uint64_t getErrorCount() const { return 0; }
+};
+
+/**
+ * Bare node without the standard protocol services.
+ */
+class Node : public uavcan::INode
+{
+    uavcan::HeapBasedPoolAllocator<uavcan::MemPoolBlockSize> pool_;
+    uavcan::Scheduler scheduler_;
+    unsigned internal_failure_count_;
+
+public:
+    Node(uavcan::ICanDriver& can_driver, uavcan::ISystemClock& clock, uavcan::NodeID self_node_id)
+        : pool_(1024)
+        , scheduler_(can_driver, pool_, clock)
+        , internal_failure_count_(0)
+    {
+        setNodeID(self_node_id);
+    }
+
+    virtual void registerInternalFailure(const char*) { internal_failure_count_++; }
+
+    virtual uavcan::IPoolAllocator& getAllocator() { return pool_; }
+    virtual uavcan::Scheduler& getScheduler() { return scheduler_; }
+    virtual const uavcan::Scheduler& getScheduler() const { return scheduler_; }
+
+    unsigned getInternalFailureCount() const { return internal_failure_count_; }
+};
+
+}
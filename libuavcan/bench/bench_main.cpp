@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ *
+ * Benchmark runner. Results are printed one per line in JSON (default), so they can be collected and compared
+ * across commits with bench/compare.py, or as a human readable table.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "bench.hpp"
+
+namespace
+{
+
+struct Options
+{
+    std::string filter;
+    uint64_t min_time_ns;
+    bool text;
+    bool list;
+
+    Options()
+        : min_time_ns(500000000ULL)
+        , text(false)
+        , list(false)
+    { }
+};
+
+struct Result
+{
+    uint64_t iterations;
+    uint64_t elapsed_ns;
+    double bytes_per_second;
+    double items_per_second;
+    bool failed;
+};
+
+bool compareByName(const bench::BenchmarkInfo& a, const bench::BenchmarkInfo& b)
+{
+    return std::strcmp(a.name, b.name) < 0;
+}
+
+Result run(const bench::BenchmarkInfo& info, uint64_t min_time_ns)
+{
+    static const uint64_t MaxIterations = 1000000000ULL;
+
+    uint64_t iterations = 1;
+    while (true)
+    {
+        bench::State state(iterations);
+        info.function(state);
+        const uint64_t elapsed_ns = state.getElapsedNSec();
+
+        if (state.hasFailed() || (elapsed_ns >= min_time_ns) || (iterations >= MaxIterations))
+        {
+            Result res;
+            res.iterations = iterations;
+            res.elapsed_ns = elapsed_ns;
+            res.failed = state.hasFailed();
+            const double seconds = (elapsed_ns > 0) ? (double(elapsed_ns) * 1e-9) : 1e-9;
+            res.bytes_per_second = double(state.getBytesProcessed()) / seconds;
+            res.items_per_second = double(state.getItemsProcessed()) / seconds;
+            return res;
+        }
+
+        // Aiming slightly above the minimum time to avoid an extra round
+        uint64_t next = (elapsed_ns > 0) ? uint64_t(double(iterations) * 1.4 * double(min_time_ns) /
+                                                    double(elapsed_ns)) : (iterations * 100U);
+        next = std::max(next, iterations * 2U);
+        next = std::min(next, iterations * 100U);
+        iterations = std::min(next, MaxIterations);
+    }
+}
+
+void printJson(const char* name, const Result& res)
+{
+    std::printf("{\"name\": \"%s\", \"iterations\": %llu, \"ns_per_iteration\": %.3f",
+                name, static_cast<unsigned long long>(res.iterations),
+                double(res.elapsed_ns) / double(res.iterations));
+    if (res.bytes_per_second > 0)
+    {
+        std::printf(", \"bytes_per_second\": %.1f", res.bytes_per_second);
+    }
+    if (res.items_per_second > 0)
+    {
+        std::printf(", \"items_per_second\": %.1f", res.items_per_second);
+    }
+    std::printf(", \"failed\": %s}\n", res.failed ? "true" : "false");
+    std::fflush(stdout);
+}
+
+void printText(const char* name, const Result& res)
+{
+    std::printf("%-44s %12llu %14.3f ns", name, static_cast<unsigned long long>(res.iterations),
+                double(res.elapsed_ns) / double(res.iterations));
+    if (res.bytes_per_second > 0)
+    {
+        std::printf(" %10.2f MB/s", res.bytes_per_second * 1e-6);
+    }
+    if (res.items_per_second > 0)
+    {
+        std::printf(" %12.1f items/s", res.items_per_second);
+    }
+    std::printf("%s\n", res.failed ? "  FAILED" : "");
+    std::fflush(stdout);
+}
+
+bool parseOptions(int argc, const char** argv, Options& out)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* const arg = argv[i];
+        if (std::strncmp(arg, "--filter=", 9) == 0)
+        {
+            out.filter = arg + 9;
+        }
+        else if (std::strncmp(arg, "--min-time-ms=", 14) == 0)
+        {
+            out.min_time_ns = uint64_t(std::strtoul(arg + 14, NULL, 10)) * 1000000ULL;
+        }
+        else if (std::strcmp(arg, "--text") == 0)
+        {
+            out.text = true;
+        }
+        else if (std::strcmp(arg, "--list") == 0)
+        {
+            out.list = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, const char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::fprintf(stderr,
+                     "Usage: %s [--filter=<substring>] [--min-time-ms=<ms>] [--text] [--list]\n"
+                     "By default, results are printed one per line in JSON.\n", argv[0]);
+        return 1;
+    }
+
+    int retval = 0;
+    // Static initialization order is unspecified, so the output is sorted to make it comparable across builds
+    std::vector<bench::BenchmarkInfo> registry = bench::getRegistry();
+    std::sort(registry.begin(), registry.end(), compareByName);
+
+    for (std::vector<bench::BenchmarkInfo>::const_iterator it = registry.begin(); it != registry.end(); ++it)
+    {
+        if (!options.filter.empty() && (std::string(it->name).find(options.filter) == std::string::npos))
+        {
+            continue;
+        }
+        if (options.list)
+        {
+            std::printf("%s\n", it->name);
+            continue;
+        }
+
+        const Result res = run(*it, options.min_time_ns);
+        if (options.text)
+        {
+            printText(it->name, res);
+        }
+        else
+        {
+            printJson(it->name, res);
+        }
+        if (res.failed)
+        {
+            retval = 1;
+        }
+    }
+    return retval;
+}
@@ -0,0 +1,59 @@
+#!/usr/bin/env python
+#
+# Compares two result files produced by libuavcan_bench, e.g.:
+#   ./libuavcan_bench > before.json
+#   ./libuavcan_bench > after.json
+#   bench/compare.py before.json after.json
+# Supported Python versions: 3.2+, 2.7.
+#
+# Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+#
+
+from __future__ import division, absolute_import, print_function, unicode_literals
+import sys, json, argparse
+
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line:
+                entry = json.loads(line)
+                results[entry['name']] = entry
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare two libuavcan_bench result files')
+    parser.add_argument('baseline', help='results of the baseline build')
+    parser.add_argument('contender', help='results of the build being evaluated')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='slowdown in percent that is reported as a regression (default 10)')
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    contender = load(args.contender)
+
+    num_regressions = 0
+    print('%-44s %14s %14s %9s' % ('Benchmark', 'Baseline, ns', 'Contender, ns', 'Change'))
+    for name in sorted(set(baseline) | set(contender)):
+        if name not in baseline or name not in contender:
+            print('%-44s %s' % (name, 'only in ' + (args.baseline if name in baseline else args.contender)))
+            continue
+        old = baseline[name]['ns_per_iteration']
+        new = contender[name]['ns_per_iteration']
+        change = (new - old) / old * 100 if old > 0 else 0
+        note = ''
+        if contender[name].get('failed'):
+            note = '  FAILED'
+            num_regressions += 1
+        elif change > args.threshold:
+            note = '  REGRESSION'
+            num_regressions += 1
+        print('%-44s %14.3f %14.3f %+8.1f%%%s' % (name, old, new, change, note))
+
+    return 1 if num_regressions else 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <uavcan/marshal/types.hpp>
+#include <uavcan/transport/transfer_buffer.hpp>
+#include "bench.hpp"
+
+namespace
+{
+
+typedef uavcan::IntegerSpec<8, uavcan::SignednessUnsigned, uavcan::CastModeTruncate> UInt8;
+typedef uavcan::FloatSpec<16, uavcan::CastModeSaturate> Float16;
+typedef uavcan::Array<UInt8, uavcan::ArrayModeDynamic, 255> ByteArray;
+typedef uavcan::Array<Float16, uavcan::ArrayModeStatic, 32> Float16Array;
+
+/**
+ * A typical mix of scalar fields; 7 fields, 148 bits.
+ */
+int encodeScalars(uavcan::ScalarCodec& codec, uint32_t seed)
+{
+    int res = codec.encode<12>(uint16_t(seed));
+    res = (res > 0) ? codec.encode<1>(uint8_t(seed & 1U)) : res;
+    res = (res > 0) ? codec.encode<32>(seed) : res;
+    res = (res > 0) ? codec.encode<3>(int8_t(-1)) : res;
+    res = (res > 0) ? codec.encode<20>(int32_t(seed) - 123456) : res;
+    res = (res > 0) ? codec.encode<64>(uint64_t(seed) << 20) : res;
+    res = (res > 0) ? codec.encode<16>(int16_t(seed)) : res;
+    return res;
+}
+
+int decodeScalars(uavcan::ScalarCodec& codec, uint64_t& out_checksum)
+{
+    uint16_t u12 = 0;
+    uint8_t u1 = 0;
+    uint32_t u32 = 0;
+    int8_t i3 = 0;
+    int32_t i20 = 0;
+    uint64_t u64 = 0;
+    int16_t i16 = 0;
+    int res = codec.decode<12>(u12);
+    res = (res > 0) ? codec.decode<1>(u1) : res;
+    res = (res > 0) ? codec.decode<32>(u32) : res;
+    res = (res > 0) ? codec.decode<3>(i3) : res;
+    res = (res > 0) ? codec.decode<20>(i20) : res;
+    res = (res > 0) ? codec.decode<64>(u64) : res;
+    res = (res > 0) ? codec.decode<16>(i16) : res;
+    out_checksum += u12 + u1 + u32 + uint64_t(int64_t(i3)) + uint64_t(int64_t(i20)) + u64 + uint64_t(int64_t(i16));
+    return res;
+}
+
+}
+
+BENCHMARK(Marshal, BitArrayCopyAligned)
+{
+    uint8_t src[64];
+    uint8_t dst[64];
+    for (unsigned i = 0; i < sizeof(src); i++)
+    {
+        src[i] = uint8_t(i * 7U);
+    }
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        uavcan::bitarrayCopy(src, 0, sizeof(src) * 8U, dst, 0);
+        bench::doNotOptimize(dst);
+    }
+    state.setBytesProcessed(state.getIterations() * sizeof(src));
+}
+
+BENCHMARK(Marshal, BitArrayCopyUnaligned)
+{
+    uint8_t src[65];
+    uint8_t dst[65];
+    for (unsigned i = 0; i < sizeof(src); i++)
+    {
+        src[i] = uint8_t(i * 7U);
+    }
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        uavcan::bitarrayCopy(src, 3, 512, dst, 5);
+        bench::doNotOptimize(dst);
+    }
+    state.setBytesProcessed(state.getIterations() * 64U);
+}
+
+BENCHMARK(Marshal, ScalarCodecEncode)
+{
+    uavcan::StaticTransferBuffer<32> buf;
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        uavcan::BitStream stream(buf);
+        uavcan::ScalarCodec codec(stream);
+        if (encodeScalars(codec, uint32_t(i)) <= 0)
+        {
+            state.setFailed();
+            break;
+        }
+    }
+    state.setItemsProcessed(state.getIterations() * 7U);
+}
+
+BENCHMARK(Marshal, ScalarCodecDecode)
+{
+    uavcan::StaticTransferBuffer<32> buf;
+    {
+        uavcan::BitStream stream(buf);
+        uavcan::ScalarCodec codec(stream);
+        (void)encodeScalars(codec, 0xDEADBEEFU);
+    }
+
+    uint64_t checksum = 0;
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        uavcan::BitStream stream(buf);
+        uavcan::ScalarCodec codec(stream);
+        if (decodeScalars(codec, checksum) <= 0)
+        {
+            state.setFailed();
+            break;
+        }
+    }
+    bench::doNotOptimize(checksum);
+    state.setItemsProcessed(state.getIterations() * 7U);
+}
+
+BENCHMARK(Marshal, ByteArrayEncode)
+{
+    ByteArray array;
+    for (unsigned i = 0; i < ByteArray::MaxSize; i++)
+    {
+        array.push_back(uint8_t(i));
+    }
+    uavcan::StaticTransferBuffer<ByteArray::MaxSize + 1> buf;
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        uavcan::BitStream stream(buf);
+        uavcan::ScalarCodec codec(stream);
+        if (ByteArray::encode(array, codec, uavcan::TailArrayOptDisabled) <= 0)
+        {
+            state.setFailed();
+            break;
+        }
+    }
+    state.setBytesProcessed(state.getIterations() * ByteArray::MaxSize);
+}
+
+BENCHMARK(Marshal, ByteArrayDecode)
+{
+    ByteArray array;
+    for (unsigned i = 0; i < ByteArray::MaxSize; i++)
+    {
+        array.push_back(uint8_t(i));
+    }
+    uavcan::StaticTransferBuffer<ByteArray::MaxSize + 1> buf;
+    {
+        uavcan::BitStream stream(buf);
+        uavcan::ScalarCodec codec(stream);
+        (void)ByteArray::encode(array, codec, uavcan::TailArrayOptDisabled);
+    }
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        uavcan::BitStream stream(buf);
+        uavcan::ScalarCodec codec(stream);
+        if ((ByteArray::decode(array, codec, uavcan::TailArrayOptDisabled) <= 0) ||
+            (array.size() != ByteArray::MaxSize))
+        {
+            state.setFailed();
+            break;
+        }
+    }
+    state.setBytesProcessed(state.getIterations() * ByteArray::MaxSize);
+}
+
+BENCHMARK(Marshal, Float16ArrayEncode)
+{
+    Float16Array array;
+    for (unsigned i = 0; i < Float16Array::MaxSize; i++)
+    {
+        array[uint8_t(i)] = float(i) * 0.37F - 3.0F;
+    }
+    uavcan::StaticTransferBuffer<Float16Array::MaxSize * 2> buf;
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        uavcan::BitStream stream(buf);
+        uavcan::ScalarCodec codec(stream);
+        if (Float16Array::encode(array, codec, uavcan::TailArrayOptDisabled) <= 0)
+        {
+            state.setFailed();
+            break;
+        }
+    }
+    state.setItemsProcessed(state.getIterations() * Float16Array::MaxSize);
+}
+
+BENCHMARK(Marshal, Float16ArrayDecode)
+{
+    Float16Array array;
+    for (unsigned i = 0; i < Float16Array::MaxSize; i++)
+    {
+        array[uint8_t(i)] = float(i) * 0.37F - 3.0F;
+    }
+    uavcan::StaticTransferBuffer<Float16Array::MaxSize * 2> buf;
+    {
+        uavcan::BitStream stream(buf);
+        uavcan::ScalarCodec codec(stream);
+        (void)Float16Array::encode(array, codec, uavcan::TailArrayOptDisabled);
+    }
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        uavcan::BitStream stream(buf);
+        uavcan::ScalarCodec codec(stream);
+        if (Float16Array::decode(array, codec, uavcan::TailArrayOptDisabled) <= 0)
+        {
+            state.setFailed();
+            break;
+        }
+    }
+    bench::doNotOptimize(array);
+    state.setItemsProcessed(state.getIterations() * Float16Array::MaxSize);
+}
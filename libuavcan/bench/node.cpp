@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <uavcan/node/publisher.hpp>
+#include <uavcan/node/subscriber.hpp>
+#include <uavcan/node/service_client.hpp>
+#include <uavcan/node/service_server.hpp>
+#include <root_ns_a/MavlinkMessage.hpp>
+#include <root_ns_a/StringService.hpp>
+#include "bench_drivers.hpp"
+
+namespace
+{
+
+struct Network
+{
+    bench::SystemClock clock;
+    bench::CanDriver can_a;
+    bench::CanDriver can_b;
+    bench::Node a;
+    bench::Node b;
+
+    Network()
+        : can_a(clock)
+        , can_b(clock)
+        , a(can_a, clock, uavcan::NodeID(1))
+        , b(can_b, clock, uavcan::NodeID(2))
+    {
+        can_a.linkTogether(can_b);
+    }
+
+    bool hasFailed() const { return (a.getInternalFailureCount() + b.getInternalFailureCount()) > 0; }
+};
+
+struct MessageCounter
+{
+    uint64_t* counter;
+
+    MessageCounter(uint64_t* c = NULL) : counter(c) { }
+
+    void operator()(const root_ns_a::MavlinkMessage&) const { (*counter)++; }
+};
+
+struct StringServer
+{
+    void operator()(const uavcan::ReceivedDataStructure<root_ns_a::StringService::Request>& request,
+                    uavcan::ServiceResponseDataStructure<root_ns_a::StringService::Response>& response) const
+    {
+        response.string_response = request.string_request;
+    }
+};
+
+struct StringClientCallback
+{
+    uint64_t* counter;
+
+    StringClientCallback(uint64_t* c = NULL) : counter(c) { }
+
+    void operator()(const uavcan::ServiceCallResult<root_ns_a::StringService>& result) const
+    {
+        if (result.isSuccessful())
+        {
+            (*counter)++;
+        }
+    }
+};
+
+/**
+ * Every iteration publishes one message and spins the subscribing node once.
+ */
+void runPublishSubscribe(bench::State& state, unsigned payload_len)
+{
+    Network nwk;
+
+    uavcan::Publisher<root_ns_a::MavlinkMessage> publisher(nwk.a);
+    uint64_t num_received = 0;
+    uavcan::Subscriber<root_ns_a::MavlinkMessage, MessageCounter> subscriber(nwk.b);
+    if ((publisher.init() < 0) || (subscriber.start(MessageCounter(&num_received)) < 0))
+    {
+        state.setFailed();
+        return;
+    }
+
+    root_ns_a::MavlinkMessage msg;
+    for (unsigned i = 0; i < payload_len; i++)
+    {
+        msg.payload.push_back(uint8_t(i));
+    }
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        msg.seq = uint8_t(i);
+        if ((publisher.broadcast(msg) < 0) || (nwk.b.spinOnce() < 0))
+        {
+            state.setFailed();
+            break;
+        }
+    }
+    state.stopTimer();
+
+    if ((num_received != state.getIterations()) || nwk.hasFailed())
+    {
+        state.setFailed();
+    }
+    state.setItemsProcessed(state.getIterations());
+}
+
+}
+
+BENCHMARK(Node, PublishSubscribeSingleFrame)
+{
+    runPublishSubscribe(state, 2);
+}
+
+BENCHMARK(Node, PublishSubscribeMultiFrame)
+{
+    runPublishSubscribe(state, 255);
+}
+
+/**
+ * Every iteration performs a complete service call: request, server callback, response, client callback.
+ */
+BENCHMARK(Node, ServiceRoundTrip)
+{
+    Network nwk;
+
+    uavcan::ServiceServer<root_ns_a::StringService, StringServer> server(nwk.b);
+    uint64_t num_responses = 0;
+    uavcan::ServiceClient<root_ns_a::StringService, StringClientCallback> client(nwk.a);
+    if ((server.start(StringServer()) < 0) || (client.init() < 0))
+    {
+        state.setFailed();
+        return;
+    }
+    client.setCallback(StringClientCallback(&num_responses));
+
+    root_ns_a::StringService::Request request;
+    request.string_request = "Hello world";
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        if ((client.call(nwk.b.getNodeID(), request) < 0) ||
+            (nwk.b.spinOnce() < 0) ||
+            (nwk.a.spinOnce() < 0))
+        {
+            state.setFailed();
+            break;
+        }
+    }
+    state.stopTimer();
+
+    if ((num_responses != state.getIterations()) || nwk.hasFailed())
+    {
+        state.setFailed();
+    }
+    state.setItemsProcessed(state.getIterations());
+}
@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <vector>
+#include <uavcan/transport/crc.hpp>
+#include <uavcan/transport/frame.hpp>
+#include <uavcan/transport/can_io.hpp>
+#include <uavcan/transport/dispatcher.hpp>
+#include <uavcan/transport/transfer_listener.hpp>
+#include <uavcan/transport/transfer_sender.hpp>
+#include <uavcan/helpers/heap_based_pool_allocator.hpp>
+#include "bench_drivers.hpp"
+
+namespace
+{
+
+const uavcan::DataTypeID BenchDataTypeID(20000);
+
+uavcan::DataTypeDescriptor makeDataTypeDescriptor(uavcan::DataTypeID dtid)
+{
+    return uavcan::DataTypeDescriptor(uavcan::DataTypeKindMessage, dtid,
+                                      uavcan::DataTypeSignature(0x123456789ABCDEFULL + dtid.get()), "bench.Data");
+}
+
+/**
+ * Counts the received transfers and their payload.
+ */
+class CountingListener : public uavcan::TransferListener
+{
+    uint64_t num_transfers_;
+    uint64_t num_bytes_;
+
+    virtual void handleIncomingTransfer(uavcan::IncomingTransfer& transfer)
+    {
+        uint8_t buf[8];
+        int offset = 0;
+        while (true)
+        {
+            const int res = transfer.read(unsigned(offset), buf, sizeof(buf));
+            if (res <= 0)
+            {
+                break;
+            }
+            offset += res;
+        }
+        num_bytes_ += uint64_t(offset);
+        num_transfers_++;
+    }
+
+public:
+    CountingListener(uavcan::TransferPerfCounter& perf, const uavcan::DataTypeDescriptor& data_type,
+                     uavcan::IPoolAllocator& allocator)
+        : uavcan::TransferListener(perf, data_type, 512, allocator)
+        , num_transfers_(0)
+        , num_bytes_(0)
+    { }
+
+    uint64_t getNumTransfers() const { return num_transfers_; }
+    uint64_t getNumBytes() const { return num_bytes_; }
+};
+
+/**
+ * Produces the CAN frames of one message transfer for every transfer ID, using the library's own TransferSender.
+ */
+std::vector<std::vector<uavcan::CanFrame> > makeTransfers(uavcan::DataTypeID dtid, unsigned payload_len)
+{
+    bench::SystemClock clock;
+    uavcan::HeapBasedPoolAllocator<uavcan::MemPoolBlockSize> pool(1024);
+    bench::CanDriver driver(clock);
+    bench::CanDriver capture(clock);
+    driver.linkTogether(capture);
+
+    uavcan::Dispatcher dispatcher(driver, pool, clock);
+    dispatcher.setNodeID(uavcan::NodeID(42));
+    const uavcan::DataTypeDescriptor descriptor = makeDataTypeDescriptor(dtid);
+    const uavcan::TransferSender sender(dispatcher, descriptor, uavcan::CanTxQueue::Volatile);
+
+    std::vector<uint8_t> payload(payload_len);
+    for (unsigned i = 0; i < payload_len; i++)
+    {
+        payload[i] = uint8_t(i * 13U);
+    }
+
+    const uavcan::MonotonicTime tx_deadline = clock.getMonotonic() + uavcan::MonotonicDuration::fromMSec(1000);
+
+    std::vector<std::vector<uavcan::CanFrame> > transfers;
+    for (uint8_t tid = 0; tid <= uavcan::TransferID::Max; tid++)
+    {
+        const int res = sender.send(&payload[0], payload_len, tx_deadline, uavcan::MonotonicTime(),
+                                    uavcan::TransferTypeMessageBroadcast, uavcan::NodeID::Broadcast,
+                                    uavcan::TransferID(tid));
+        if (res < 0)
+        {
+            std::abort();
+        }
+        transfers.push_back(std::vector<uavcan::CanFrame>());
+        uavcan::CanFrame frame;
+        while (capture.popRx(frame))
+        {
+            transfers.back().push_back(frame);
+        }
+    }
+    return transfers;
+}
+
+}
+
+BENCHMARK(Transport, Crc8Bytes)
+{
+    const uint8_t data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        uavcan::TransferCRC crc;
+        crc.add(data, sizeof(data));
+        bench::doNotOptimize(crc);
+    }
+    state.setBytesProcessed(state.getIterations() * sizeof(data));
+}
+
+BENCHMARK(Transport, Crc256Bytes)
+{
+    uint8_t data[256];
+    for (unsigned i = 0; i < sizeof(data); i++)
+    {
+        data[i] = uint8_t(i);
+    }
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        uavcan::TransferCRC crc;
+        crc.add(data, sizeof(data));
+        bench::doNotOptimize(crc);
+    }
+    state.setBytesProcessed(state.getIterations() * sizeof(data));
+}
+
+BENCHMARK(Transport, FrameCompile)
+{
+    const uint8_t payload[7] = { 1, 2, 3, 4, 5, 6, 7 };
+    uavcan::Frame frame(BenchDataTypeID, uavcan::TransferTypeMessageBroadcast, uavcan::NodeID(42),
+                        uavcan::NodeID::Broadcast, uavcan::TransferID(3));
+    frame.setPayload(payload, sizeof(payload));
+    frame.setStartOfTransfer(true);
+    frame.setEndOfTransfer(true);
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        uavcan::CanFrame can_frame;
+        if (!frame.compile(can_frame))
+        {
+            state.setFailed();
+            break;
+        }
+        bench::doNotOptimize(can_frame);
+    }
+}
+
+BENCHMARK(Transport, FrameParse)
+{
+    const uint8_t payload[7] = { 1, 2, 3, 4, 5, 6, 7 };
+    uavcan::Frame frame(BenchDataTypeID, uavcan::TransferTypeMessageBroadcast, uavcan::NodeID(42),
+                        uavcan::NodeID::Broadcast, uavcan::TransferID(3));
+    frame.setPayload(payload, sizeof(payload));
+    frame.setStartOfTransfer(true);
+    frame.setEndOfTransfer(true);
+    uavcan::CanFrame can_frame;
+    (void)frame.compile(can_frame);
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        uavcan::Frame parsed;
+        if (!parsed.parse(can_frame))
+        {
+            state.setFailed();
+            break;
+        }
+        bench::doNotOptimize(parsed);
+    }
+}
+
+/**
+ * Every iteration pushes 16 frames of different priorities and pops them in the order of priority.
+ */
+BENCHMARK(Transport, TxQueuePushPop16)
+{
+    static const unsigned BatchSize = 16;
+
+    bench::SystemClock clock;
+    uavcan::HeapBasedPoolAllocator<uavcan::MemPoolBlockSize> pool(1024);
+    uavcan::CanTxQueue queue(pool, clock, 1024);
+
+    const uint8_t payload[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    std::vector<uavcan::CanFrame> frames;
+    for (unsigned i = 0; i < BatchSize; i++)
+    {
+        const uint32_t id = ((i * 7919U) % 1000U) | uavcan::CanFrame::FlagEFF;
+        frames.push_back(uavcan::CanFrame(id, payload, sizeof(payload)));
+    }
+    const uavcan::MonotonicTime deadline = clock.getMonotonic() + uavcan::MonotonicDuration::fromMSec(60 * 1000);
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        for (unsigned k = 0; k < BatchSize; k++)
+        {
+            queue.push(frames[k], deadline, uavcan::CanTxQueue::Volatile, 0);
+        }
+        for (unsigned k = 0; k < BatchSize; k++)
+        {
+            uavcan::CanTxQueue::Entry* entry = queue.peek();
+            if (entry == NULL)
+            {
+                state.setFailed();
+                return;
+            }
+            queue.remove(entry);
+        }
+    }
+    state.setItemsProcessed(state.getIterations() * BatchSize);
+}
+
+/**
+ * Single-frame transfers are delivered through the dispatcher to one of 32 registered message listeners.
+ */
+BENCHMARK(Transport, DispatchSingleFrame)
+{
+    static const unsigned NumListeners = 32;
+
+    bench::SystemClock clock;
+    uavcan::HeapBasedPoolAllocator<uavcan::MemPoolBlockSize> pool(1024);
+    bench::CanDriver driver(clock);
+    uavcan::Dispatcher dispatcher(driver, pool, clock);
+    dispatcher.setNodeID(uavcan::NodeID(1));
+
+    uavcan::TransferPerfCounter perf;
+    std::vector<uavcan::DataTypeDescriptor> descriptors;
+    for (unsigned i = 0; i < NumListeners; i++)
+    {
+        descriptors.push_back(makeDataTypeDescriptor(uavcan::DataTypeID(uint16_t(BenchDataTypeID.get() + i))));
+    }
+    std::vector<CountingListener*> listeners;
+    for (unsigned i = 0; i < NumListeners; i++)
+    {
+        listeners.push_back(new CountingListener(perf, descriptors[i], pool));
+        (void)dispatcher.registerMessageListener(listeners.back());
+    }
+
+    // The listener in the middle of the list
+    const uavcan::DataTypeID target_dtid(uint16_t(BenchDataTypeID.get() + NumListeners / 2));
+    const std::vector<std::vector<uavcan::CanFrame> > transfers = makeTransfers(target_dtid, 4);
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        driver.pushRx(transfers[i % transfers.size()].front());
+        if (dispatcher.spinOnce() < 0)
+        {
+            state.setFailed();
+            break;
+        }
+    }
+    state.stopTimer();
+
+    if (listeners[NumListeners / 2]->getNumTransfers() != state.getIterations())
+    {
+        state.setFailed();
+    }
+    state.setItemsProcessed(state.getIterations());
+
+    for (unsigned i = 0; i < NumListeners; i++)
+    {
+        dispatcher.unregisterMessageListener(listeners[i]);
+        delete listeners[i];
+    }
+}
+
+/**
+ * Every iteration reassembles one 255-byte transfer that arrives in 37 frames.
+ */
+BENCHMARK(Transport, ReassemblyMultiFrame)
+{
+    static const unsigned PayloadLen = 255;
+
+    bench::SystemClock clock;
+    uavcan::HeapBasedPoolAllocator<uavcan::MemPoolBlockSize> pool(1024);
+    uavcan::TransferPerfCounter perf;
+    const uavcan::DataTypeDescriptor descriptor = makeDataTypeDescriptor(BenchDataTypeID);
+    CountingListener listener(perf, descriptor, pool);
+
+    const std::vector<std::vector<uavcan::CanFrame> > transfers = makeTransfers(BenchDataTypeID, PayloadLen);
+
+    // Parsing is benchmarked separately
+    std::vector<std::vector<uavcan::Frame> > parsed_transfers;
+    for (unsigned i = 0; i < transfers.size(); i++)
+    {
+        parsed_transfers.push_back(std::vector<uavcan::Frame>());
+        for (unsigned k = 0; k < transfers[i].size(); k++)
+        {
+            uavcan::Frame frame;
+            (void)frame.parse(transfers[i][k]);
+            parsed_transfers.back().push_back(frame);
+        }
+    }
+
+    // The receiver requires the timestamps to grow, so they are synthesized rather than taken from the clock
+    uavcan::MonotonicTime ts_mono = clock.getMonotonic();
+
+    state.resetTimer();
+    for (uint64_t i = 0; i < state.getIterations(); i++)
+    {
+        const std::vector<uavcan::Frame>& frames = parsed_transfers[i % parsed_transfers.size()];
+        for (unsigned k = 0; k < frames.size(); k++)
+        {
+            ts_mono += uavcan::MonotonicDuration::fromUSec(10);
+            listener.handleFrame(uavcan::RxFrame(frames[k], ts_mono, uavcan::UtcTime(), 0));
+        }
+    }
+    state.stopTimer();
+
+    if ((listener.getNumTransfers() != state.getIterations()) ||
+        (listener.getNumBytes() != state.getIterations() * PayloadLen))
+    {
+        state.setFailed();
+    }
+    state.setBytesProcessed(state.getIterations() * PayloadLen);
+}
@@ -100,6 +100,19 @@
 # define UAVCAN_TINY 0
 #endif
 
+/**
+ * Library components tag their pool allocations with the owner (see uavcan::PoolAllocationOwner), so that memory
+ * usage can be attributed to them by uavcan::InstrumentedPoolAllocator. This costs one proxy object per component
+ * and one extra virtual call per allocation. Disabled by default in tiny mode.
+ */
+#ifndef UAVCAN_POOL_ALLOCATION_ACCOUNTING
+# if UAVCAN_TINY
+#  define UAVCAN_POOL_ALLOCATION_ACCOUNTING 0
+# else
+#  define UAVCAN_POOL_ALLOCATION_ACCOUNTING 1
+# endif
+#endif
+
 /**
  * Disable the global data type registry, which can save some space on embedded systems.
  */
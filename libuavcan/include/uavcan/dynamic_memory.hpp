@@ -15,6 +15,53 @@
 
 namespace uavcan
 {
+/**
+ * Identifies the library component that owns a dynamically allocated block.
+ * This is used for per-component memory accounting; refer to @ref InstrumentedPoolAllocator.
+ */
+struct UAVCAN_EXPORT PoolAllocationOwner
+{
+    enum Kind
+    {
+        KindUnspecified,
+        KindCanTxQueue,                 ///< Index is the CAN interface index
+        KindOutgoingTransferRegistry,
+        KindMessageTransferBuffers,     ///< Index is the data type ID
+        KindServiceTransferBuffers,     ///< Index is the data type ID
+        KindMessageTransferReceivers,   ///< Index is the data type ID
+        KindServiceTransferReceivers,   ///< Index is the data type ID
+        KindServiceCalls,               ///< Index is the data type ID
+        KindDeferredTransfers,          ///< Index is the data type ID
+        KindDeferredResponses,          ///< Index is the data type ID
+        NumKinds
+    };
+
+    uint16_t index;
+    uint8_t kind;
+
+    PoolAllocationOwner()
+        : index(0)
+        , kind(KindUnspecified)
+    { }
+
+    PoolAllocationOwner(Kind arg_kind, uint16_t arg_index = 0)
+        : index(arg_index)
+        , kind(uint8_t(arg_kind))
+    { }
+
+    bool operator==(const PoolAllocationOwner& rhs) const { return (kind == rhs.kind) && (index == rhs.index); }
+    bool operator!=(const PoolAllocationOwner& rhs) const { return !operator==(rhs); }
+
+    /**
+     * Returns a human-readable name of the owner kind, e.g. "CanTxQueue".
+     */
+    static const char* getKindName(Kind kind);
+
+#if UAVCAN_TOSTRING
+    std::string toString() const;
+#endif
+};
+
 /**
  * This interface is used by other library components that need dynamic memory.
  */
@@ -26,6 +73,23 @@ public:
     virtual void* allocate(std::size_t size) = 0;
     virtual void deallocate(const void* ptr) = 0;
 
+    /**
+     * Same as @ref allocate() and @ref deallocate(), but also specify the owner of the block.
+     * The owner is used by instrumented allocators for memory accounting (see @ref InstrumentedPoolAllocator).
+     * Allocators that don't need this information don't have to override these methods.
+     * A block must be deallocated with the same owner that was used for its allocation.
+     */
+    virtual void* allocateForOwner(std::size_t size, PoolAllocationOwner owner)
+    {
+        (void)owner;
+        return allocate(size);
+    }
+    virtual void deallocateForOwner(const void* ptr, PoolAllocationOwner owner)
+    {
+        (void)owner;
+        deallocate(ptr);
+    }
+
     /**
      * Returns the maximum number of blocks this allocator can allocate.
      */
@@ -106,6 +170,197 @@ public:
     }
 };
 
+/**
+ * Multi-size-class pool allocator (slab allocator).
+ *
+ * Unlike @ref PoolAllocator, which serves every request with a block of the same size, this allocator rounds
+ * the requested size up to the nearest size class and serves it from a slab dedicated to that size class.
+ * Size classes are multiples of @ref MemPoolAlignment, up to the slab size. Slabs are carved from one static
+ * arena on demand, so the split of the arena between size classes adapts to the application automatically.
+ * A slab, once assigned to a size class, is never returned back to the arena.
+ *
+ * This allows to fit more small objects (e.g. CAN TX queue entries) into the same amount of memory,
+ * and also allows to allocate objects that are larger than @ref MemPoolBlockSize.
+ *
+ * The block capacity reported via @ref getBlockCapacity() is expressed in blocks of @ref MemPoolBlockSize,
+ * so that the quotas computed by the library (e.g. for the TX queues) stay the same as with @ref PoolAllocator.
+ *
+ * Thread safety is configured the same way as for @ref PoolAllocator.
+ *
+ * @tparam PoolSize             Size of the arena, in bytes.
+ * @tparam SlabSize             Size of one slab, in bytes; this is also the largest allocation that can be served.
+ *                              Must be a multiple of @ref MemPoolAlignment.
+ * @tparam RaiiSynchronizer     Optional RAII lock type, see @ref PoolAllocator.
+ */
+template <std::size_t PoolSize,
+          std::size_t SlabSize = 256,
+          typename RaiiSynchronizer = char>
+class UAVCAN_EXPORT SlabPoolAllocator : public IPoolAllocator,
+                                        Noncopyable
+{
+    struct Node
+    {
+        Node* next;
+    };
+
+public:
+    static const uint16_t NumSlabs = PoolSize / SlabSize;
+    static const uint8_t NumSizeClasses = SlabSize / MemPoolAlignment;
+
+private:
+    Node* free_lists_[NumSizeClasses];
+    uint8_t slab_size_classes_[NumSlabs];       ///< Size class index per slab; only valid for carved slabs
+    uint16_t num_carved_slabs_;
+
+    uint16_t used_blocks_;
+    uint16_t max_used_blocks_;
+    uint32_t used_bytes_;
+    uint32_t max_used_bytes_;
+
+    union
+    {
+         uint8_t bytes[NumSlabs * SlabSize];
+         long double _aligner1;
+         long long _aligner2;
+         Node _aligner3;
+    } pool_;
+
+    static uint8_t sizeToSizeClass(std::size_t size)
+    {
+        return static_cast<uint8_t>((size + MemPoolAlignment - 1U) / MemPoolAlignment - 1U);
+    }
+
+    bool carveSlab(uint8_t size_class);
+
+public:
+    SlabPoolAllocator();
+
+    virtual void* allocate(std::size_t size);
+    virtual void deallocate(const void* ptr);
+
+    virtual uint16_t getBlockCapacity() const
+    {
+        return static_cast<uint16_t>(min<std::size_t>((NumSlabs * SlabSize) / MemPoolBlockSize, 0xFFFFU));
+    }
+
+    /**
+     * Returns the size of the block that will be used to serve an allocation of the given size.
+     * Returns zero if the requested size is too large for this allocator.
+     */
+    static std::size_t getBlockSizeForAllocationSize(std::size_t size)
+    {
+        if (size > SlabSize)
+        {
+            return 0;
+        }
+        return (unsigned(sizeToSizeClass(size)) + 1U) * MemPoolAlignment;
+    }
+
+    /**
+     * Return the number of blocks that are currently allocated, regardless of their size class.
+     */
+    uint16_t getNumUsedBlocks() const
+    {
+        RaiiSynchronizer lock;
+        (void)lock;
+        return used_blocks_;
+    }
+
+    /**
+     * Returns the maximum number of blocks that were ever allocated at the same time.
+     */
+    uint16_t getPeakNumUsedBlocks() const
+    {
+        RaiiSynchronizer lock;
+        (void)lock;
+        return max_used_blocks_;
+    }
+
+    /**
+     * Return the number of bytes that are currently allocated, including the size class rounding overhead.
+     */
+    uint32_t getNumUsedBytes() const
+    {
+        RaiiSynchronizer lock;
+        (void)lock;
+        return used_bytes_;
+    }
+
+    /**
+     * Returns the maximum number of bytes that were ever allocated at the same time.
+     */
+    uint32_t getPeakNumUsedBytes() const
+    {
+        RaiiSynchronizer lock;
+        (void)lock;
+        return max_used_bytes_;
+    }
+
+    /**
+     * Returns the number of slabs that were not yet assigned to any size class.
+     */
+    uint16_t getNumFreeSlabs() const
+    {
+        RaiiSynchronizer lock;
+        (void)lock;
+        return static_cast<uint16_t>(NumSlabs - num_carved_slabs_);
+    }
+};
+
+/**
+ * Attaches the owner tag to all allocations made through this object.
+ * Library components that need dynamic memory wrap the allocator they were given into this class, so that
+ * allocations can be attributed to them (see @ref PoolAllocationOwner).
+ * If UAVCAN_POOL_ALLOCATION_ACCOUNTING is disabled, the tag is discarded and this class degenerates into a plain
+ * reference to the wrapped allocator.
+ */
+#if UAVCAN_POOL_ALLOCATION_ACCOUNTING
+class UAVCAN_EXPORT TaggedPoolAllocator : public IPoolAllocator
+{
+    IPoolAllocator& allocator_;
+    PoolAllocationOwner owner_;
+
+public:
+    TaggedPoolAllocator(IPoolAllocator& allocator, PoolAllocationOwner owner)
+        : allocator_(allocator)
+        , owner_(owner)
+    { }
+
+    virtual void* allocate(std::size_t size);
+    virtual void deallocate(const void* ptr);
+
+    virtual uint16_t getBlockCapacity() const;
+
+    /**
+     * The owner can be changed only while there are no blocks allocated through this object.
+     */
+    PoolAllocationOwner getOwner() const { return owner_; }
+    void setOwner(PoolAllocationOwner owner) { owner_ = owner; }
+};
+#else
+class UAVCAN_EXPORT TaggedPoolAllocator
+{
+    IPoolAllocator& allocator_;
+
+public:
+    TaggedPoolAllocator(IPoolAllocator& allocator, PoolAllocationOwner owner)
+        : allocator_(allocator)
+    {
+        (void)owner;
+    }
+
+    void* allocate(std::size_t size) { return allocator_.allocate(size); }
+    void deallocate(const void* ptr) { allocator_.deallocate(ptr); }
+
+    uint16_t getBlockCapacity() const { return allocator_.getBlockCapacity(); }
+
+    PoolAllocationOwner getOwner() const { return PoolAllocationOwner(); }
+    void setOwner(PoolAllocationOwner owner) { (void)owner; }
+
+    operator IPoolAllocator&() { return allocator_; }
+};
+#endif
+
 /**
  * Limits the maximum number of blocks that can be allocated in a given allocator.
  */
@@ -127,6 +382,9 @@ public:
     virtual void* allocate(std::size_t size);
     virtual void deallocate(const void* ptr);
 
+    virtual void* allocateForOwner(std::size_t size, PoolAllocationOwner owner);
+    virtual void deallocateForOwner(const void* ptr, PoolAllocationOwner owner);
+
     virtual uint16_t getBlockCapacity() const;
 };
 
@@ -201,6 +459,132 @@ void PoolAllocator<PoolSize, BlockSize, RaiiSynchronizer>::deallocate(const void
     used_--;
 }
 
+/*
+ * SlabPoolAllocator<>
+ */
+template <std::size_t PoolSize, std::size_t SlabSize, typename RaiiSynchronizer>
+const uint16_t SlabPoolAllocator<PoolSize, SlabSize, RaiiSynchronizer>::NumSlabs;
+
+template <std::size_t PoolSize, std::size_t SlabSize, typename RaiiSynchronizer>
+const uint8_t SlabPoolAllocator<PoolSize, SlabSize, RaiiSynchronizer>::NumSizeClasses;
+
+template <std::size_t PoolSize, std::size_t SlabSize, typename RaiiSynchronizer>
+SlabPoolAllocator<PoolSize, SlabSize, RaiiSynchronizer>::SlabPoolAllocator() :
+    num_carved_slabs_(0),
+    used_blocks_(0),
+    max_used_blocks_(0),
+    used_bytes_(0),
+    max_used_bytes_(0)
+{
+    // Every block must be properly aligned, therefore slabs must be aligned too.
+    StaticAssert<(SlabSize % MemPoolAlignment == 0)>::check();
+    StaticAssert<((SlabSize / MemPoolAlignment) <= 0xFFU)>::check();
+    StaticAssert<((PoolSize / SlabSize) > 0)>::check();
+    StaticAssert<((PoolSize / SlabSize) <= 0xFFFFU)>::check();
+
+    for (unsigned i = 0; i < NumSizeClasses; i++)
+    {
+        free_lists_[i] = NULL;
+    }
+    (void)std::memset(slab_size_classes_, 0, sizeof(slab_size_classes_));
+    (void)std::memset(pool_.bytes, 0, sizeof(pool_.bytes));
+}
+
+template <std::size_t PoolSize, std::size_t SlabSize, typename RaiiSynchronizer>
+bool SlabPoolAllocator<PoolSize, SlabSize, RaiiSynchronizer>::carveSlab(uint8_t size_class)
+{
+    if (num_carved_slabs_ >= NumSlabs)
+    {
+        return false;
+    }
+
+    const std::size_t block_size = (unsigned(size_class) + 1U) * MemPoolAlignment;
+    const std::size_t num_blocks = SlabSize / block_size;
+    UAVCAN_ASSERT(num_blocks > 0);
+
+    uint8_t* const slab = pool_.bytes + std::size_t(num_carved_slabs_) * SlabSize;
+    slab_size_classes_[num_carved_slabs_] = size_class;
+    num_carved_slabs_++;
+
+    // Blocks are linked in the address order, so that the first allocations come from the beginning of the slab
+    Node* next = free_lists_[size_class];
+    for (std::size_t i = num_blocks; i > 0; i--)
+    {
+        Node* const node = reinterpret_cast<Node*>(slab + (i - 1U) * block_size);
+        node->next = next;
+        next = node;
+    }
+    free_lists_[size_class] = next;
+    return true;
+}
+
+template <std::size_t PoolSize, std::size_t SlabSize, typename RaiiSynchronizer>
+void* SlabPoolAllocator<PoolSize, SlabSize, RaiiSynchronizer>::allocate(std::size_t size)
+{
+    if (size > SlabSize)
+    {
+        return NULL;
+    }
+    const uint8_t size_class = sizeToSizeClass((size > 0) ? size : 1U);
+
+    RaiiSynchronizer lock;
+    (void)lock;
+
+    if (free_lists_[size_class] == NULL)
+    {
+        if (!carveSlab(size_class))
+        {
+            return NULL;
+        }
+    }
+
+    Node* const pmem = free_lists_[size_class];
+    free_lists_[size_class] = pmem->next;
+
+    // Statistics
+    UAVCAN_ASSERT(used_blocks_ < 0xFFFFU);
+    used_blocks_++;
+    if (used_blocks_ > max_used_blocks_)
+    {
+        max_used_blocks_ = used_blocks_;
+    }
+    used_bytes_ += (unsigned(size_class) + 1U) * MemPoolAlignment;
+    if (used_bytes_ > max_used_bytes_)
+    {
+        max_used_bytes_ = used_bytes_;
+    }
+
+    return pmem;
+}
+
+template <std::size_t PoolSize, std::size_t SlabSize, typename RaiiSynchronizer>
+void SlabPoolAllocator<PoolSize, SlabSize, RaiiSynchronizer>::deallocate(const void* ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    const std::size_t offset = std::size_t(static_cast<const uint8_t*>(ptr) - pool_.bytes);
+    const std::size_t slab_index = offset / SlabSize;
+
+    RaiiSynchronizer lock;
+    (void)lock;
+
+    UAVCAN_ASSERT(slab_index < num_carved_slabs_);
+    const uint8_t size_class = slab_size_classes_[slab_index];
+    UAVCAN_ASSERT(((offset % SlabSize) % ((unsigned(size_class) + 1U) * MemPoolAlignment)) == 0);
+
+    Node* const p = static_cast<Node*>(const_cast<void*>(ptr));
+    p->next = free_lists_[size_class];
+    free_lists_[size_class] = p;
+
+    // Statistics
+    UAVCAN_ASSERT(used_blocks_ > 0);
+    used_blocks_--;
+    used_bytes_ -= (unsigned(size_class) + 1U) * MemPoolAlignment;
+}
+
 }
 
 #endif // UAVCAN_DYNAMIC_MEMORY_HPP_INCLUDED
@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#ifndef UAVCAN_HELPERS_INSTRUMENTED_POOL_ALLOCATOR_HPP_INCLUDED
+#define UAVCAN_HELPERS_INSTRUMENTED_POOL_ALLOCATOR_HPP_INCLUDED
+
+#include <uavcan/build_config.hpp>
+#include <uavcan/debug.hpp>
+#include <uavcan/dynamic_memory.hpp>
+
+namespace uavcan
+{
+/**
+ * Memory usage of one owner, as tracked by @ref InstrumentedPoolAllocator.
+ */
+struct UAVCAN_EXPORT PoolAllocationOwnerStats
+{
+    PoolAllocationOwner owner;
+    uint16_t num_used_blocks;           ///< Number of blocks that are currently allocated by this owner
+    uint16_t peak_num_used_blocks;      ///< Maximum number of blocks that were ever allocated at the same time
+    uint32_t num_failed_allocations;    ///< Number of allocation requests that could not be served
+
+    PoolAllocationOwnerStats()
+        : num_used_blocks(0)
+        , peak_num_used_blocks(0)
+        , num_failed_allocations(0)
+    { }
+
+    explicit PoolAllocationOwnerStats(PoolAllocationOwner arg_owner)
+        : owner(arg_owner)
+        , num_used_blocks(0)
+        , peak_num_used_blocks(0)
+        , num_failed_allocations(0)
+    { }
+};
+
+/**
+ * Implement this interface to get notified when the pool cannot serve an allocation request.
+ * The handler is invoked from the context of the failed allocation, so it should return quickly.
+ */
+class UAVCAN_EXPORT IPoolExhaustionListener
+{
+public:
+    virtual ~IPoolExhaustionListener() { }
+
+    virtual void handlePoolExhaustion(PoolAllocationOwner owner, std::size_t requested_size) = 0;
+};
+
+/**
+ * This wrapper keeps track of memory usage per owner (TX queue per interface, transfer buffers per data type,
+ * receivers, the outgoing transfer registry, service calls, etc.; see @ref PoolAllocationOwner).
+ * All allocations are forwarded to the wrapped allocator.
+ *
+ * Usage:
+ *     uavcan::PoolAllocator<PoolSize, uavcan::MemPoolBlockSize> pool;
+ *     uavcan::InstrumentedPoolAllocator<> instrumented_pool(pool);
+ *     uavcan::Node<> node(can_driver, system_clock, instrumented_pool);
+ *
+ * The number of distinct owners that can be tracked is limited by the template parameter MaxOwners.
+ * Once the limit is reached, allocations of new owners are accounted under the owner of kind Unspecified,
+ * which always occupies the first entry of the table.
+ *
+ * Owner lookup is linear in the number of tracked owners, so this wrapper is intended for diagnostics.
+ * Library components tag their allocations only if UAVCAN_POOL_ALLOCATION_ACCOUNTING is enabled; otherwise
+ * everything is accounted under the owner of kind Unspecified.
+ *
+ * Thread safety can be configured via the RAII lock type, the same way as for @ref PoolAllocator.
+ * The lock only protects the statistics; the wrapped allocator must be thread safe on its own if needed.
+ */
+template <unsigned MaxOwners = 64,
+          typename RaiiSynchronizer = char>
+class UAVCAN_EXPORT InstrumentedPoolAllocator : public IPoolAllocator,
+                                                Noncopyable
+{
+    IPoolAllocator& allocator_;
+    IPoolExhaustionListener* exhaustion_listener_;
+
+    PoolAllocationOwnerStats owners_[MaxOwners];
+    unsigned num_owners_;
+
+    uint16_t num_used_blocks_;
+    uint16_t peak_num_used_blocks_;
+    uint32_t num_failed_allocations_;
+
+    /**
+     * Owners that did not fit the table are accounted under the first entry, see @ref findOrAddOwner().
+     */
+    PoolAllocationOwnerStats& findOwner(PoolAllocationOwner owner)
+    {
+        for (unsigned i = 0; i < num_owners_; i++)
+        {
+            if (owners_[i].owner == owner)
+            {
+                return owners_[i];
+            }
+        }
+        return owners_[0];
+    }
+
+    PoolAllocationOwnerStats& findOrAddOwner(PoolAllocationOwner owner)
+    {
+        PoolAllocationOwnerStats& existing = findOwner(owner);
+        if (existing.owner == owner)
+        {
+            return existing;
+        }
+        if (num_owners_ < MaxOwners)
+        {
+            owners_[num_owners_] = PoolAllocationOwnerStats(owner);
+            return owners_[num_owners_++];
+        }
+        UAVCAN_TRACE("InstrumentedPoolAllocator", "Owner table is full");
+        return owners_[0];
+    }
+
+public:
+    explicit InstrumentedPoolAllocator(IPoolAllocator& allocator)
+        : allocator_(allocator)
+        , exhaustion_listener_(NULL)
+        , num_owners_(1)
+        , num_used_blocks_(0)
+        , peak_num_used_blocks_(0)
+        , num_failed_allocations_(0)
+    {
+        StaticAssert<(MaxOwners > 0)>::check();
+        owners_[0] = PoolAllocationOwnerStats(PoolAllocationOwner());
+    }
+
+    virtual void* allocate(std::size_t size)
+    {
+        return allocateForOwner(size, PoolAllocationOwner());
+    }
+
+    virtual void deallocate(const void* ptr)
+    {
+        deallocateForOwner(ptr, PoolAllocationOwner());
+    }
+
+    virtual void* allocateForOwner(std::size_t size, PoolAllocationOwner owner)
+    {
+        void* const ptr = allocator_.allocateForOwner(size, owner);
+        IPoolExhaustionListener* listener = NULL;
+        {
+            RaiiSynchronizer lock;
+            (void)lock;
+
+            PoolAllocationOwnerStats& stats = findOrAddOwner(owner);
+            if (ptr != NULL)
+            {
+                stats.num_used_blocks++;
+                stats.peak_num_used_blocks = max(stats.peak_num_used_blocks, stats.num_used_blocks);
+                num_used_blocks_++;
+                peak_num_used_blocks_ = max(peak_num_used_blocks_, num_used_blocks_);
+            }
+            else
+            {
+                stats.num_failed_allocations++;
+                num_failed_allocations_++;
+                listener = exhaustion_listener_;
+            }
+        }
+        if (listener != NULL)
+        {
+            listener->handlePoolExhaustion(owner, size);
+        }
+        return ptr;
+    }
+
+    virtual void deallocateForOwner(const void* ptr, PoolAllocationOwner owner)
+    {
+        if (ptr == NULL)
+        {
+            return;
+        }
+        allocator_.deallocateForOwner(ptr, owner);
+
+        RaiiSynchronizer lock;
+        (void)lock;
+
+        PoolAllocationOwnerStats& stats = findOwner(owner);     // Blocks are never freed by unknown owners
+        UAVCAN_ASSERT(stats.num_used_blocks > 0);
+        UAVCAN_ASSERT(num_used_blocks_ > 0);
+        if (stats.num_used_blocks > 0)
+        {
+            stats.num_used_blocks--;
+        }
+        if (num_used_blocks_ > 0)
+        {
+            num_used_blocks_--;
+        }
+    }
+
+    virtual uint16_t getBlockCapacity() const { return allocator_.getBlockCapacity(); }
+
+    /**
+     * The listener will be invoked every time the wrapped allocator fails to serve a request.
+     * Pass NULL to remove the listener.
+     */
+    IPoolExhaustionListener* getExhaustionListener() const { return exhaustion_listener_; }
+    void setExhaustionListener(IPoolExhaustionListener* listener) { exhaustion_listener_ = listener; }
+
+    /**
+     * Owners can be traversed by index, from zero to getNumOwners() - 1.
+     * The first entry always belongs to the owner of kind Unspecified.
+     * If the index is out of range, an empty entry will be returned.
+     */
+    unsigned getNumOwners() const
+    {
+        RaiiSynchronizer lock;
+        (void)lock;
+        return num_owners_;
+    }
+    PoolAllocationOwnerStats getOwnerStatsByIndex(unsigned index) const
+    {
+        RaiiSynchronizer lock;
+        (void)lock;
+        return (index < num_owners_) ? owners_[index] : PoolAllocationOwnerStats();
+    }
+
+    /**
+     * Returns the stats of the specified owner; if the owner is not tracked, an empty entry will be returned.
+     */
+    PoolAllocationOwnerStats getOwnerStats(PoolAllocationOwner owner) const
+    {
+        RaiiSynchronizer lock;
+        (void)lock;
+        for (unsigned i = 0; i < num_owners_; i++)
+        {
+            if (owners_[i].owner == owner)
+            {
+                return owners_[i];
+            }
+        }
+        return PoolAllocationOwnerStats(owner);
+    }
+
+    /**
+     * Totals across all owners.
+     */
+    uint16_t getNumUsedBlocks() const
+    {
+        RaiiSynchronizer lock;
+        (void)lock;
+        return num_used_blocks_;
+    }
+    uint16_t getPeakNumUsedBlocks() const
+    {
+        RaiiSynchronizer lock;
+        (void)lock;
+        return peak_num_used_blocks_;
+    }
+    uint32_t getNumFailedAllocations() const
+    {
+        RaiiSynchronizer lock;
+        (void)lock;
+        return num_failed_allocations_;
+    }
+
+    IPoolAllocator& getWrappedAllocator() { return allocator_; }
+};
+
+}
+
+#endif // UAVCAN_HELPERS_INSTRUMENTED_POOL_ALLOCATOR_HPP_INCLUDED
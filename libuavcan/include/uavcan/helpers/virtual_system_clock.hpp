@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#ifndef UAVCAN_HELPERS_VIRTUAL_SYSTEM_CLOCK_HPP_INCLUDED
+#define UAVCAN_HELPERS_VIRTUAL_SYSTEM_CLOCK_HPP_INCLUDED
+
+#include <uavcan/build_config.hpp>
+#include <uavcan/time.hpp>
+#include <uavcan/driver/system_clock.hpp>
+#include <uavcan/util/templates.hpp>
+
+namespace uavcan
+{
+/**
+ * Discrete-event time base for simulations and benchmarks.
+ *
+ * The time does not flow by itself; it is advanced explicitly by the simulation driver, typically straight to
+ * the next event, so that hours of simulated time can be processed in seconds. It never goes backwards.
+ * The resolution is one nanosecond, which is enough to model the bit timing of a CAN bus precisely.
+ *
+ * Nodes do not read this object directly; every simulated node has its own @ref VirtualSystemClock instead.
+ */
+class UAVCAN_EXPORT VirtualTime : Noncopyable
+{
+    uint64_t nsec_;
+
+public:
+    explicit VirtualTime(uint64_t initial_nsec = 0)
+        : nsec_(initial_nsec)
+    { }
+
+    uint64_t getNSec() const { return nsec_; }
+
+    /**
+     * Virtual time rounded down to microseconds.
+     */
+    MonotonicTime getMonotonic() const { return MonotonicTime::fromUSec(nsec_ / 1000U); }
+
+    /**
+     * Attempts to move the time backwards are ignored.
+     */
+    void advanceTo(uint64_t nsec)
+    {
+        if (nsec > nsec_)
+        {
+            nsec_ = nsec;
+        }
+    }
+
+    void advance(MonotonicDuration duration)
+    {
+        if (duration.isPositive())
+        {
+            advanceTo(nsec_ + uint64_t(duration.toUSec()) * 1000U);
+        }
+    }
+};
+
+/**
+ * System clock of a simulated node, driven by a shared @ref VirtualTime.
+ *
+ * The monotonic time of the node equals the virtual time plus a constant offset, which allows to model nodes
+ * that were started at different moments. The UTC time additionally drifts with the specified rate, and it can
+ * be adjusted by the node itself (e.g. by the time synchronization slave), just like a real UTC clock.
+ *
+ * Both clocks have one microsecond resolution.
+ */
+class UAVCAN_EXPORT VirtualSystemClock : public ISystemClock, Noncopyable
+{
+    const VirtualTime& time_;
+    uint64_t monotonic_offset_usec_;
+    int64_t utc_offset_usec_;               ///< Includes all adjustments
+    int32_t utc_drift_ppm_;
+    UtcDuration last_utc_adjustment_;
+    uint32_t num_utc_adjustments_;
+
+public:
+    explicit VirtualSystemClock(const VirtualTime& time,
+                                uint64_t monotonic_offset_usec = 0,
+                                int64_t utc_offset_usec = 0,
+                                int32_t utc_drift_ppm = 0)
+        : time_(time)
+        , monotonic_offset_usec_(monotonic_offset_usec)
+        , utc_offset_usec_(utc_offset_usec)
+        , utc_drift_ppm_(utc_drift_ppm)
+        , num_utc_adjustments_(0)
+    { }
+
+    const VirtualTime& getVirtualTime() const { return time_; }
+
+    virtual MonotonicTime getMonotonic() const
+    {
+        return MonotonicTime::fromUSec(time_.getNSec() / 1000U + monotonic_offset_usec_);
+    }
+
+    virtual UtcTime getUtc() const
+    {
+        const int64_t base = int64_t(time_.getNSec() / 1000U);
+        const int64_t utc = base + (base * utc_drift_ppm_) / 1000000 + utc_offset_usec_;
+        return UtcTime::fromUSec((utc > 0) ? uint64_t(utc) : 0U);
+    }
+
+    virtual void adjustUtc(UtcDuration adjustment)
+    {
+        utc_offset_usec_ += adjustment.toUSec();
+        last_utc_adjustment_ = adjustment;
+        num_utc_adjustments_++;
+    }
+
+    /**
+     * Converts a monotonic timestamp of this node into the virtual time, in nanoseconds.
+     * Timestamps that precede the start of the virtual time map to zero; the maximum timestamp maps to the
+     * maximum virtual time.
+     */
+    uint64_t toVirtualNSec(MonotonicTime ts) const
+    {
+        const uint64_t usec = ts.toUSec();
+        if (usec <= monotonic_offset_usec_)
+        {
+            return 0;
+        }
+        const uint64_t virtual_usec = usec - monotonic_offset_usec_;
+        if (virtual_usec >= NumericTraits<uint64_t>::max() / 1000U)
+        {
+            return NumericTraits<uint64_t>::max();
+        }
+        return virtual_usec * 1000U;
+    }
+
+    uint64_t getMonotonicOffset() const { return monotonic_offset_usec_; }
+
+    /**
+     * The UTC time remains continuous when the drift rate changes.
+     */
+    int32_t getUtcDrift() const { return utc_drift_ppm_; }
+    void setUtcDrift(int32_t ppm)
+    {
+        const int64_t base = int64_t(time_.getNSec() / 1000U);
+        utc_offset_usec_ += (base * utc_drift_ppm_) / 1000000 - (base * ppm) / 1000000;
+        utc_drift_ppm_ = ppm;
+    }
+
+    UtcDuration getLastUtcAdjustment() const { return last_utc_adjustment_; }
+    uint32_t getNumUtcAdjustments() const { return num_utc_adjustments_; }
+};
+
+}
+
+#endif // UAVCAN_HELPERS_VIRTUAL_SYSTEM_CLOCK_HPP_INCLUDED
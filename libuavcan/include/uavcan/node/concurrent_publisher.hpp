@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#ifndef UAVCAN_NODE_CONCURRENT_PUBLISHER_HPP_INCLUDED
+#define UAVCAN_NODE_CONCURRENT_PUBLISHER_HPP_INCLUDED
+
+#include <uavcan/build_config.hpp>
+#include <uavcan/node/publisher.hpp>
+#include <uavcan/node/scheduler.hpp>
+
+#if !defined(UAVCAN_CPP_VERSION) || !defined(UAVCAN_CPP11)
+# error UAVCAN_CPP_VERSION
+#endif
+
+#if UAVCAN_CPP_VERSION >= UAVCAN_CPP11
+
+#include <atomic>
+#include <cstring>
+
+namespace uavcan
+{
+/**
+ * Message publisher that can be used from any thread, not only from the thread that spins the node.
+ *
+ * The calling thread serializes the message and puts it into a bounded lock-free MPSC queue;
+ * the publisher never allocates memory, and the calling thread never blocks on a lock.
+ * The node thread drains the queue from @ref Scheduler::spin() and broadcasts the transfers in FIFO order,
+ * assigning transfer ID as usual. Hence the worst case delay between the call and the actual transmission is
+ * defined by the deadline resolution of the scheduler (see @ref Scheduler::setDeadlineResolution()).
+ *
+ * The object itself must be constructed and destroyed in the node thread. All configuration methods
+ * (priority, TX timeout, etc.) also may only be called from the node thread.
+ *
+ * Note that this class requires lock-free std::atomic<uint32_t> support on the target platform.
+ *
+ * @tparam DataType_        Message data type
+ * @tparam QueueCapacity    Maximum number of transfers that can wait for transmission; must be a power of two.
+ */
+template <typename DataType_, unsigned QueueCapacity = 8>
+class UAVCAN_EXPORT ConcurrentPublisher : protected GenericPublisher<DataType_, DataType_>,
+                                          private SpinHandler
+{
+    typedef GenericPublisher<DataType_, DataType_> BaseType;
+
+public:
+    typedef DataType_ DataType; ///< Message data type
+
+private:
+    enum { MaxPayloadLen = BitLenToByteLen<DataType::MaxBitLen>::Result };
+
+    struct Slot
+    {
+        std::atomic<uint32_t> sequence;
+        uint16_t payload_len;
+        uint8_t payload[(MaxPayloadLen > 0) ? MaxPayloadLen : 1];
+    };
+
+    std::atomic<uint32_t> tail_;                ///< Shared among producers
+    uint32_t head_;                             ///< Node thread only
+    std::atomic<uint32_t> num_dropped_;
+    uint32_t num_failed_;
+    Slot slots_[QueueCapacity];
+
+    virtual void handleSpin(MonotonicTime)
+    {
+        while (true)
+        {
+            Slot& slot = slots_[head_ % QueueCapacity];
+            if (slot.sequence.load(std::memory_order_acquire) != (head_ + 1))
+            {
+                break;
+            }
+
+            StaticTransferBufferImpl buffer(slot.payload, static_cast<uint16_t>(sizeof(slot.payload)));
+            buffer.setMaxWritePos(slot.payload_len);
+
+            int res = BaseType::init();
+            if (res >= 0)
+            {
+                res = GenericPublisherBase::genericPublish(buffer, TransferTypeMessageBroadcast, NodeID::Broadcast,
+                                                           NULL, MonotonicTime());
+            }
+            if (res < 0)
+            {
+                UAVCAN_TRACE("ConcurrentPublisher", "Failed to publish %s: %i", DataType::getDataTypeFullName(), res);
+                num_failed_++;
+            }
+
+            slot.sequence.store(head_ + QueueCapacity, std::memory_order_release);
+            head_++;
+        }
+    }
+
+public:
+    explicit ConcurrentPublisher(INode& node,
+                                 MonotonicDuration tx_timeout = getDefaultTxTimeout(),
+                                 MonotonicDuration max_transfer_interval =
+                                     TransferSender::getDefaultMaxTransferInterval())
+        : BaseType(node, tx_timeout, max_transfer_interval)
+        , SpinHandler(node.getScheduler())
+        , tail_(0)
+        , head_(0)
+        , num_dropped_(0)
+        , num_failed_(0)
+    {
+        StaticAssert<DataTypeKind(DataType::DataTypeKind) == DataTypeKindMessage>::check();
+        StaticAssert<(QueueCapacity > 1) && ((QueueCapacity & (QueueCapacity - 1)) == 0)>::check();
+
+        for (unsigned i = 0; i < QueueCapacity; i++)
+        {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+            slots_[i].payload_len = 0;
+        }
+        SpinHandler::start();
+    }
+
+    /**
+     * Serializes the message and enqueues it for broadcasting. Can be called from any thread.
+     * This method never blocks and never allocates memory.
+     * Returns negative error code; -ErrMemory means that the queue is full and the message has been dropped.
+     */
+    int broadcast(const DataType& message)
+    {
+        typename BaseType::Buffer buffer;
+        const int encode_res = BaseType::doEncode(message, buffer);
+        if (encode_res < 0)
+        {
+            return encode_res;
+        }
+
+        uint32_t pos = tail_.load(std::memory_order_relaxed);
+        Slot* slot = NULL;
+        while (true)
+        {
+            slot = &slots_[pos % QueueCapacity];
+            const int32_t diff = static_cast<int32_t>(slot->sequence.load(std::memory_order_acquire) - pos);
+            if (diff == 0)
+            {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                num_dropped_.fetch_add(1, std::memory_order_relaxed);
+                return -ErrMemory;
+            }
+            else
+            {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->payload_len = buffer.getMaxWritePos();
+        (void)std::memcpy(slot->payload, buffer.getRawPtr(), buffer.getMaxWritePos());
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return 0;
+    }
+
+    static MonotonicDuration getDefaultTxTimeout() { return Publisher<DataType>::getDefaultTxTimeout(); }
+
+    /**
+     * Number of messages that were rejected by @ref broadcast() because the queue was full.
+     * Can be called from any thread.
+     */
+    uint32_t getNumDroppedMessages() const { return num_dropped_.load(std::memory_order_relaxed); }
+
+    /**
+     * Number of messages that were dequeued but could not be published (e.g. because of a TX queue overflow).
+     * Node thread only.
+     */
+    uint32_t getNumFailedMessages() const { return num_failed_; }
+
+    /**
+     * Init method can be called prior first publication, but it's not necessary
+     * because the publisher will be automatically initialized from the node thread.
+     */
+    using BaseType::init;
+
+    using BaseType::allowAnonymousTransfers;
+    using BaseType::getTransferSender;
+    using BaseType::getMinTxTimeout;
+    using BaseType::getMaxTxTimeout;
+    using BaseType::getTxTimeout;
+    using BaseType::setTxTimeout;
+    using BaseType::getPriority;
+    using BaseType::setPriority;
+    using BaseType::getNode;
+};
+
+}
+
+#endif
+
+#endif // UAVCAN_NODE_CONCURRENT_PUBLISHER_HPP_INCLUDED
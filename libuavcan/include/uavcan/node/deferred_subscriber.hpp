@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#ifndef UAVCAN_NODE_DEFERRED_SUBSCRIBER_HPP_INCLUDED
+#define UAVCAN_NODE_DEFERRED_SUBSCRIBER_HPP_INCLUDED
+
+#include <uavcan/build_config.hpp>
+#include <uavcan/node/generic_subscriber.hpp>
+#include <uavcan/node/scheduler.hpp>
+#include <uavcan/transport/transfer_buffer.hpp>
+
+#if !defined(UAVCAN_CPP_VERSION) || !defined(UAVCAN_CPP11)
+# error UAVCAN_CPP_VERSION
+#endif
+
+#if UAVCAN_CPP_VERSION >= UAVCAN_CPP11
+# include <functional>
+#endif
+
+namespace uavcan
+{
+/**
+ * Received transfer that has been copied out of the transport layer; see @ref DeferredTransferQueue.
+ */
+class UAVCAN_EXPORT DeferredIncomingTransfer : public IncomingTransfer
+{
+    const ITransferBuffer& payload_;
+    const bool anonymous_;
+
+public:
+    DeferredIncomingTransfer(MonotonicTime ts_mono, UtcTime ts_utc, TransferPriority transfer_priority,
+                             TransferType transfer_type, TransferID transfer_id, NodeID source_node_id,
+                             uint8_t iface_index, bool anonymous, const ITransferBuffer& payload)
+        : IncomingTransfer(ts_mono, ts_utc, transfer_priority, transfer_type, transfer_id, source_node_id,
+                           iface_index)
+        , payload_(payload)
+        , anonymous_(anonymous)
+    { }
+
+    virtual int read(unsigned offset, uint8_t* data, unsigned len) const
+    {
+        return payload_.read(offset, data, len);
+    }
+
+    virtual bool isAnonymousTransfer() const { return anonymous_; }
+};
+
+/**
+ * Implement this interface to process transfers extracted from @ref DeferredTransferQueue.
+ */
+class UAVCAN_EXPORT IDeferredTransferHandler
+{
+public:
+    virtual ~IDeferredTransferHandler() { }
+
+    virtual void handleDeferredTransfer(IncomingTransfer& transfer) = 0;
+};
+
+/**
+ * Bounded FIFO of raw received transfers.
+ * Transfer metadata and payload are copied into blocks allocated from the pool, so the original transfer
+ * (and the RX buffers of the transport layer) can be released immediately.
+ * Both push and pop are O(1), not counting the payload copying.
+ */
+class UAVCAN_EXPORT DeferredTransferQueue : Noncopyable
+{
+    struct Entry : public LinkedListNode<Entry>
+    {
+        MonotonicTime ts_mono;
+        UtcTime ts_utc;
+        TransferBufferManagerEntry* payload;
+        TransferPriority priority;
+        uint8_t transfer_type;
+        TransferID transfer_id;
+        NodeID src_node_id;
+        uint8_t iface_index;
+        bool anonymous;
+
+        Entry()
+            : payload(NULL)
+            , transfer_type(0)
+            , iface_index(0)
+            , anonymous(false)
+        { }
+    };
+
+    IPoolAllocator& allocator_;
+    Entry* head_;
+    Entry* tail_;
+    const uint16_t max_payload_len_;
+    uint16_t max_depth_;
+    uint16_t depth_;
+    uint16_t peak_depth_;
+    uint32_t num_dropped_;
+
+    void destroy(Entry* entry);
+
+public:
+    DeferredTransferQueue(IPoolAllocator& allocator, uint16_t max_payload_len, uint16_t max_depth)
+        : allocator_(allocator)
+        , head_(NULL)
+        , tail_(NULL)
+        , max_payload_len_(max_payload_len)
+        , max_depth_(max_depth)
+        , depth_(0)
+        , peak_depth_(0)
+        , num_dropped_(0)
+    {
+        IsDynamicallyAllocatable<Entry>::check();
+    }
+
+    ~DeferredTransferQueue() { clear(); }
+
+    /**
+     * Copies the transfer into the end of the queue.
+     * If the queue is full or there's not enough memory, the transfer will be dropped.
+     * Returns negative error code.
+     */
+    int push(const IncomingTransfer& transfer);
+
+    /**
+     * Removes the oldest transfer from the queue and passes it to the handler.
+     * The handler is allowed to modify the queue (e.g. clear it).
+     * Returns false if the queue is empty.
+     */
+    bool pop(IDeferredTransferHandler& handler);
+
+    /**
+     * Drops all pending transfers.
+     */
+    void clear();
+
+    bool isEmpty() const { return head_ == NULL; }
+
+    uint16_t getDepth() const { return depth_; }
+    uint16_t getPeakDepth() const { return peak_depth_; }
+    uint32_t getNumDroppedTransfers() const { return num_dropped_; }
+
+    uint16_t getMaxDepth() const { return max_depth_; }
+    void setMaxDepth(uint16_t max_depth) { max_depth_ = max_depth; }
+};
+
+/**
+ * Subscriber that does not invoke the callback from the context of the frame processing in the dispatcher.
+ * Instead, every received transfer is copied in raw form into a bounded queue allocated from the node's pool,
+ * and the callbacks are executed later by the node thread, once the IO processing is done
+ * (see @ref SpinHandler). A slow callback therefore does not prevent the library from reading the driver's
+ * RX queues, at the cost of some extra memory and latency.
+ *
+ * Messages are decoded right before the callback is invoked, so the queue holds only the payload bytes.
+ * If the queue is full, new transfers are dropped.
+ *
+ * The number of callbacks executed per spin iteration can be limited in order to keep the IO responsive
+ * while the backlog is being processed.
+ *
+ * Note that the callbacks are never executed from other threads, because the library is not thread safe.
+ *
+ * @tparam DataType_        Message data type.
+ * @tparam Callback_        Same as for @ref Subscriber.
+ */
+template <typename DataType_,
+#if UAVCAN_CPP_VERSION >= UAVCAN_CPP11
+          typename Callback_ = std::function<void (const ReceivedDataStructure<DataType_>&)>
+#else
+          typename Callback_ = void (*)(const ReceivedDataStructure<DataType_>&)
+#endif
+          >
+class UAVCAN_EXPORT DeferredSubscriber
+    : public GenericSubscriber<DataType_, DataType_, TransferListener>
+    , private SpinHandler
+    , private IDeferredTransferHandler
+{
+public:
+    typedef Callback_ Callback;
+    typedef DataType_ DataType;
+
+    enum { DefaultMaxQueueDepth = 16 };
+
+private:
+    typedef GenericSubscriber<DataType_, DataType_, TransferListener> BaseType;
+
+    Callback callback_;
+    TaggedPoolAllocator allocator_;
+    DeferredTransferQueue queue_;
+    uint16_t max_callbacks_per_spin_;
+    uint32_t num_executed_callbacks_;
+    MonotonicDuration max_latency_;
+    uint64_t latency_sum_usec_;
+
+    virtual void handleIncomingTransfer(IncomingTransfer& transfer)
+    {
+        if (queue_.push(transfer) < 0)
+        {
+            UAVCAN_TRACE("DeferredSubscriber", "Transfer dropped; dtname=%s", DataType::getDataTypeFullName());
+        }
+        transfer.release();
+    }
+
+    virtual void handleDeferredTransfer(IncomingTransfer& transfer)
+    {
+        const MonotonicDuration latency =
+            BaseType::getNode().getMonotonicTime() - transfer.getMonotonicTimestamp();
+        if (latency > max_latency_)
+        {
+            max_latency_ = latency;
+        }
+        latency_sum_usec_ += static_cast<uint64_t>(max(latency, MonotonicDuration()).toUSec());
+        num_executed_callbacks_++;
+
+        BaseType::handleIncomingTransfer(transfer);
+    }
+
+    virtual void handleReceivedDataStruct(ReceivedDataStructure<DataType_>& msg)
+    {
+        if (coerceOrFallback<bool>(callback_, true))
+        {
+            callback_(msg);
+        }
+        else
+        {
+            handleFatalError("Sub clbk");
+        }
+    }
+
+    virtual void handleSpin(MonotonicTime)
+    {
+        unsigned num_callbacks = 0;
+        while ((max_callbacks_per_spin_ == 0) || (num_callbacks < max_callbacks_per_spin_))
+        {
+            if (!queue_.pop(*this))
+            {
+                break;
+            }
+            num_callbacks++;
+        }
+    }
+
+public:
+    explicit DeferredSubscriber(INode& node, uint16_t max_queue_depth = DefaultMaxQueueDepth)
+        : BaseType(node)
+        , SpinHandler(node.getScheduler())
+        , callback_()
+        , allocator_(node.getAllocator(), PoolAllocationOwner(PoolAllocationOwner::KindDeferredTransfers))
+        , queue_(allocator_, BitLenToByteLen<DataType::MaxBitLen>::Result, max_queue_depth)
+        , max_callbacks_per_spin_(0)
+        , num_executed_callbacks_(0)
+        , latency_sum_usec_(0)
+    {
+        StaticAssert<DataTypeKind(DataType::DataTypeKind) == DataTypeKindMessage>::check();
+    }
+
+    virtual ~DeferredSubscriber() { stop(); }
+
+    /**
+     * Begin receiving messages.
+     * Each message will be passed to the application via the callback, from the node thread, after IO.
+     * Returns negative error code.
+     */
+    int start(const Callback& callback)
+    {
+        stop();
+
+        if (!coerceOrFallback<bool>(callback, true))
+        {
+            UAVCAN_TRACE("DeferredSubscriber", "Invalid callback");
+            return -ErrInvalidParam;
+        }
+        callback_ = callback;
+
+        const int res = BaseType::startAsMessageListener();
+        if (res >= 0)
+        {
+            allocator_.setOwner(PoolAllocationOwner(PoolAllocationOwner::KindDeferredTransfers,
+                                                    BaseType::getTransferListener()->getDataTypeDescriptor().getID()
+                                                                                    .get()));
+            SpinHandler::start();
+        }
+        return res;
+    }
+
+    /**
+     * Terminates the subscription; pending messages are discarded.
+     */
+    void stop()
+    {
+        BaseType::stop();
+        SpinHandler::stop();
+        queue_.clear();
+    }
+
+    /**
+     * Maximum number of callbacks that will be executed per one spin iteration; zero means no limit (default).
+     */
+    uint16_t getMaxCallbacksPerSpin() const { return max_callbacks_per_spin_; }
+    void setMaxCallbacksPerSpin(uint16_t value) { max_callbacks_per_spin_ = value; }
+
+    /**
+     * Maximum number of messages waiting for their callbacks. Messages that don't fit will be dropped.
+     */
+    uint16_t getMaxQueueDepth() const { return queue_.getMaxDepth(); }
+    void setMaxQueueDepth(uint16_t value) { queue_.setMaxDepth(value); }
+
+    /**
+     * Queue statistics.
+     */
+    uint16_t getQueueDepth() const { return queue_.getDepth(); }
+    uint16_t getPeakQueueDepth() const { return queue_.getPeakDepth(); }
+    uint32_t getNumDroppedMessages() const { return queue_.getNumDroppedTransfers(); }
+
+    /**
+     * Callback latency is measured from the reception timestamp of the transfer to the moment when
+     * its callback is invoked.
+     */
+    uint32_t getNumExecutedCallbacks() const { return num_executed_callbacks_; }
+    MonotonicDuration getMaxCallbackLatency() const { return max_latency_; }
+    MonotonicDuration getAverageCallbackLatency() const
+    {
+        return (num_executed_callbacks_ > 0) ?
+               MonotonicDuration::fromUSec(static_cast<int64_t>(latency_sum_usec_ / num_executed_callbacks_)) :
+               MonotonicDuration();
+    }
+
+    using BaseType::allowAnonymousTransfers;
+    using BaseType::getFailureCount;
+};
+
+}
+
+#endif // UAVCAN_NODE_DEFERRED_SUBSCRIBER_HPP_INCLUDED
@@ -89,10 +89,6 @@ class UAVCAN_EXPORT GenericPublisher : public GenericPublisherBase
         ZeroTransferBuffer() : StaticTransferBufferImpl(NULL, 0) { }
     };
 
-    typedef typename Select<DataStruct::MaxBitLen == 0,
-                            ZeroTransferBuffer,
-                            StaticTransferBuffer<BitLenToByteLen<DataStruct::MaxBitLen>::Result> >::Result Buffer;
-
     enum
     {
         Qos = (DataTypeKind(DataSpec::DataTypeKind) == DataTypeKindMessage) ?
@@ -101,11 +97,20 @@ class UAVCAN_EXPORT GenericPublisher : public GenericPublisherBase
 
     int checkInit();
 
-    int doEncode(const DataStruct& message, ITransferBuffer& buffer) const;
-
     int genericPublish(const DataStruct& message, TransferType transfer_type, NodeID dst_node_id,
                        TransferID* tid, MonotonicTime blocking_deadline);
 
+protected:
+    typedef typename Select<DataStruct::MaxBitLen == 0,
+                            ZeroTransferBuffer,
+                            StaticTransferBuffer<BitLenToByteLen<DataStruct::MaxBitLen>::Result> >::Result Buffer;
+
+    /**
+     * Serializes the message into the buffer. This method does not access the state of the publisher,
+     * so it can be invoked from any thread.
+     */
+    int doEncode(const DataStruct& message, ITransferBuffer& buffer) const;
+
 public:
     /**
      * @param max_transfer_interval     Maximum expected time interval between subsequent publications. Leave default.
@@ -151,8 +151,6 @@ class UAVCAN_EXPORT GenericSubscriber : public GenericSubscriberBase
 
     int checkInit();
 
-    void handleIncomingTransfer(IncomingTransfer& transfer);
-
     int genericStart(bool (Dispatcher::*registration_method)(TransferListener*));
 
 protected:
@@ -170,6 +168,12 @@ protected:
 
     virtual ~GenericSubscriber() { stop(); }
 
+    /**
+     * Decodes the transfer and passes the result to @ref handleReceivedDataStruct().
+     * Can be overridden in order to postpone the processing; see @ref DeferredSubscriber.
+     */
+    virtual void handleIncomingTransfer(IncomingTransfer& transfer);
+
     virtual void handleReceivedDataStruct(ReceivedDataStructure<DataStruct>&) = 0;
 
     int startAsMessageListener()
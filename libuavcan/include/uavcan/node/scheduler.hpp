@@ -57,6 +57,33 @@ public:
     MonotonicTime getEarliestDeadline() const;
 };
 
+/**
+ * Spin handlers are invoked by the scheduler once per spin iteration, from the thread that spins the node.
+ * This allows to process events that were produced outside of the node thread (e.g. by other threads),
+ * with the worst case latency defined by the deadline resolution of the scheduler.
+ */
+class UAVCAN_EXPORT SpinHandler : public LinkedListNode<SpinHandler>, Noncopyable
+{
+protected:
+    Scheduler& scheduler_;
+
+    explicit SpinHandler(Scheduler& scheduler)
+        : scheduler_(scheduler)
+    { }
+
+    virtual ~SpinHandler() { stop(); }
+
+public:
+    virtual void handleSpin(MonotonicTime current) = 0;
+
+    void start();
+    void stop();
+
+    bool isRunning() const;
+
+    Scheduler& getScheduler() const { return scheduler_; }
+};
+
 /**
  * This class distributes processing time between library components (IO handling, deadline callbacks, ...).
  */
@@ -71,6 +98,7 @@ class UAVCAN_EXPORT Scheduler : Noncopyable
     enum { MaxCleanupPeriodMs = 10000 };
 
     DeadlineScheduler deadline_scheduler_;
+    LinkedListRoot<SpinHandler> spin_handlers_;
     Dispatcher dispatcher_;
     MonotonicTime prev_cleanup_ts_;
     MonotonicDuration deadline_resolution_;
@@ -90,6 +118,7 @@ class UAVCAN_EXPORT Scheduler : Noncopyable
 
     MonotonicTime computeDispatcherSpinDeadline(MonotonicTime spin_deadline) const;
     void pollCleanup(MonotonicTime mono_ts, uint32_t num_frames_processed_with_last_spin);
+    void pollSpinHandlers(MonotonicTime mono_ts);
 
 public:
     Scheduler(ICanDriver& can_driver, IPoolAllocator& allocator, ISystemClock& sysclock)
@@ -116,6 +145,14 @@ public:
 
     DeadlineScheduler& getDeadlineScheduler() { return deadline_scheduler_; }
 
+    /**
+     * Spin handlers are not ordered; see @ref SpinHandler.
+     */
+    void addSpinHandler(SpinHandler* sh);
+    void removeSpinHandler(SpinHandler* sh);
+    bool hasSpinHandler(const SpinHandler* sh) const;
+    unsigned getNumSpinHandlers() const { return spin_handlers_.getLength(); }
+
     Dispatcher& getDispatcher()             { return dispatcher_; }
     const Dispatcher& getDispatcher() const { return dispatcher_; }
 
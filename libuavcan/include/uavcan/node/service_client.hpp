@@ -6,7 +6,8 @@
 #define UAVCAN_NODE_SERVICE_CLIENT_HPP_INCLUDED
 
 #include <uavcan/build_config.hpp>
-#include <uavcan/util/multiset.hpp>
+#include <uavcan/dynamic_memory.hpp>
+#include <uavcan/util/placement_new.hpp>
 #include <uavcan/node/generic_publisher.hpp>
 #include <uavcan/node/generic_subscriber.hpp>
 
@@ -120,9 +121,16 @@ class ServiceClientBase : protected ITransferAcceptanceFilter
     const DataTypeDescriptor* data_type_descriptor_;  ///< This will be initialized at the time of first call
 
 protected:
+    class CallRegistry;
+
     class CallState : DeadlineHandler
     {
+        friend class CallRegistry;
+
+        // The fields are ordered to minimize padding, since the object must fit a pool block
         ServiceClientBase& owner_;
+        CallState* next_;               ///< Next call to the same server, see @ref CallRegistry
+        const MonotonicTime started_at_;
         const ServiceCallID id_;
         bool timed_out_;
 
@@ -132,6 +140,8 @@ protected:
         CallState(INode& node, ServiceClientBase& owner, ServiceCallID call_id)
             : DeadlineHandler(node.getScheduler())
             , owner_(owner)
+            , next_(NULL)
+            , started_at_(node.getMonotonicTime())
             , id_(call_id)
             , timed_out_(false)
         {
@@ -141,42 +151,105 @@ protected:
 
         ServiceCallID getCallID() const { return id_; }
 
+        MonotonicTime getStartTime() const { return started_at_; }
+
         bool hasTimedOut() const { return timed_out_; }
+    };
 
-        static bool hasTimedOutPredicate(const CallState& cs) { return cs.hasTimedOut(); }
+    /**
+     * Pending calls indexed by server node ID. Calls addressed to the same server are chained in the order of
+     * creation, so that a response can be matched with its call in constant time, regardless of the number of
+     * servers the calls are addressed to. Call states and index blocks are allocated from the pool; index blocks
+     * are released once they become empty.
+     */
+    class CallRegistry : ::uavcan::Noncopyable
+    {
+        enum { NumSlotsPerBlock = MemPoolBlockSize / sizeof(CallState*) };
+        enum { NumBlocks = (NodeID::Max + NumSlotsPerBlock) / NumSlotsPerBlock };
 
-        bool operator==(const CallState& rhs) const
+        struct IndexBlock
         {
-            return (&owner_ == &rhs.owner_) && (id_ == rhs.id_);
+            CallState* slots[NumSlotsPerBlock];
+        };
+
+        IPoolAllocator& allocator_;
+        IndexBlock* blocks_[NumBlocks];
+        unsigned size_;
+
+        CallState** findSlot(NodeID server_node_id) const;
+        CallState** findOrCreateSlot(NodeID server_node_id);
+        void releaseBlockIfEmpty(NodeID server_node_id);
+        void unlinkAndDestroy(CallState** slot, CallState* prev, CallState* state);
+
+    public:
+        explicit CallRegistry(IPoolAllocator& allocator)
+            : allocator_(allocator)
+            , size_(0)
+        {
+            StaticAssert<(NumSlotsPerBlock > 0)>::check();
+            IsDynamicallyAllocatable<CallState>::check();
+            IsDynamicallyAllocatable<IndexBlock>::check();
+            fill_n(blocks_, unsigned(NumBlocks), static_cast<IndexBlock*>(NULL));
         }
-    };
 
-    struct CallStateMatchingPredicate
-    {
-        const ServiceCallID id;
-        CallStateMatchingPredicate(ServiceCallID reference) : id(reference) { }
-        bool operator()(const CallState& state) const { return (state.getCallID() == id) && !state.hasTimedOut(); }
-    };
+        ~CallRegistry() { clear(); }
 
-    struct ServerSearchPredicate
-    {
-        const NodeID server_node_id;
-        ServerSearchPredicate(NodeID nid) : server_node_id(nid) { }
-        bool operator()(const CallState& state) const { return state.getCallID().server_node_id == server_node_id; }
+        /**
+         * Returns NULL if there's not enough memory.
+         */
+        CallState* add(INode& node, ServiceClientBase& owner, ServiceCallID call_id);
+
+        /**
+         * Looks for the oldest call with this ID that has not timed out yet.
+         */
+        const CallState* find(ServiceCallID call_id) const;
+
+        /**
+         * Removes the oldest call with this ID that has not timed out yet; returns false if there's no such call.
+         */
+        bool remove(ServiceCallID call_id);
+
+        /**
+         * Removes the oldest timed out call addressed to this server; returns false if there's no such call.
+         */
+        bool removeTimedOut(NodeID server_node_id, ServiceCallID& out_call_id);
+
+        bool hasCallsToServer(NodeID server_node_id) const
+        {
+            CallState* const* const slot = findSlot(server_node_id);
+            return (slot != NULL) && (*slot != NULL);
+        }
+
+        /**
+         * Complexity is O(N).
+         */
+        const CallState* getByIndex(unsigned index) const;
+
+        void clear();
+
+        unsigned getSize() const { return size_; }
+        bool isEmpty() const { return size_ == 0; }
     };
 
     MonotonicDuration request_timeout_;
+    TaggedPoolAllocator call_registry_allocator_;   ///< Owner index is updated once the data type ID is known
 
     ServiceClientBase(INode& node)
         : DeadlineHandler(node.getScheduler())
         , data_type_descriptor_(NULL)
         , request_timeout_(getDefaultRequestTimeout())
+        , call_registry_allocator_(node.getAllocator(), PoolAllocationOwner(PoolAllocationOwner::KindServiceCalls))
     { }
 
     virtual ~ServiceClientBase() { }
 
     int prepareToCall(INode& node, const char* dtname, NodeID server_node_id, ServiceCallID& out_call_id);
 
+    /**
+     * Reports the round trip time of a completed call to the latency statistics, if they are enabled.
+     */
+    void sampleRoundTripLatency(const CallState* call_state);
+
 public:
     /**
      * It's not recommended to override default timeouts.
@@ -231,32 +304,6 @@ private:
     typedef GenericPublisher<DataType, RequestType> PublisherType;
     typedef GenericSubscriber<DataType, ResponseType, TransferListenerWithFilter> SubscriberType;
 
-    typedef Multiset<CallState> CallRegistry;
-
-    struct TimeoutCallbackCaller
-    {
-        ServiceClient& owner;
-
-        TimeoutCallbackCaller(ServiceClient& arg_owner) : owner(arg_owner) { }
-
-        void operator()(const CallState& state)
-        {
-            if (state.hasTimedOut())
-            {
-                UAVCAN_TRACE("ServiceClient::TimeoutCallbackCaller", "Timeout from nid=%d, tid=%d, dtname=%s",
-                             int(state.getCallID().server_node_id.get()), int(state.getCallID().transfer_id.get()),
-                             DataType::getDataTypeFullName());
-
-                typename SubscriberType::ReceivedDataStructureSpec rx_struct; // Default-initialized
-
-                ServiceCallResultType result(ServiceCallResultType::ErrorTimeout, state.getCallID(),
-                                             rx_struct);    // Mutable!
-
-                owner.invokeCallback(result);
-            }
-        }
-    };
-
     CallRegistry call_registry_;
 
     PublisherType publisher_;
@@ -280,7 +327,7 @@ public:
     explicit ServiceClient(INode& node, const Callback& callback = Callback())
         : SubscriberType(node)
         , ServiceClientBase(node)
-        , call_registry_(node.getAllocator())
+        , call_registry_(ServiceClientBase::call_registry_allocator_)
         , publisher_(node, getDefaultRequestTimeout())
         , callback_(callback)
     {
@@ -342,12 +389,13 @@ public:
 
     /**
      * Checks whether there's currently a pending call addressed to the specified node ID.
+     * Complexity is O(1).
      */
     bool hasPendingCallToServer(NodeID server_node_id) const;
 
     /**
      * This method allows to traverse pending calls. If the index is out of range, an invalid call ID will be returned.
-     * Warning: average complexity is O(index); worst case complexity is O(size).
+     * Calls are ordered by server node ID. Warning: complexity is O(size).
      */
     ServiceCallID getCallIDByIndex(unsigned index) const;
 
@@ -358,14 +406,14 @@ public:
     void setCallback(const Callback& cb) { callback_ = cb; }
 
     /**
-     * Complexity is O(N) of number of pending calls.
-     * Note that the number of pending calls will not be updated until the callback is executed.
+     * Complexity is O(1).
+     * Note that a call is removed right before its callback is executed.
      */
     unsigned getNumPendingCalls() const { return call_registry_.getSize(); }
 
     /**
      * Complexity is O(1).
-     * Note that the number of pending calls will not be updated until the callback is executed.
+     * Note that a call is removed right before its callback is executed.
      */
     bool hasPendingCalls() const { return !call_registry_.isEmpty(); }
 
@@ -420,8 +468,7 @@ bool ServiceClient<DataType_, Callback_>::shouldAcceptFrame(const RxFrame& frame
 {
     UAVCAN_ASSERT(frame.getTransferType() == TransferTypeServiceResponse); // Other types filtered out by dispatcher
 
-    return NULL != call_registry_.find(CallStateMatchingPredicate(ServiceCallID(frame.getSrcNodeID(),
-                                                                                frame.getTransferID())));
+    return NULL != call_registry_.find(ServiceCallID(frame.getSrcNodeID(), frame.getTransferID()));
 
 }
 
@@ -431,6 +478,7 @@ void ServiceClient<DataType_, Callback_>::handleReceivedDataStruct(ReceivedDataS
     UAVCAN_ASSERT(response.getTransferType() == TransferTypeServiceResponse);
 
     ServiceCallID call_id(response.getSrcNodeID(), response.getTransferID());
+    sampleRoundTripLatency(call_registry_.find(call_id));
     cancelCall(call_id);
     ServiceCallResultType result(ServiceCallResultType::Success, call_id, response);    // Mutable!
     invokeCallback(result);
@@ -442,15 +490,25 @@ void ServiceClient<DataType_, Callback_>::handleDeadline(MonotonicTime)
 {
     UAVCAN_TRACE("ServiceClient", "Shared deadline event received");
     /*
-     * Invoking callbacks for timed out call state objects.
+     * Removing timed out call state objects and invoking their callbacks.
+     * Each call is removed before its callback is invoked, so the callback is free to make new calls.
      */
-    TimeoutCallbackCaller callback_caller(*this);
-    call_registry_.template forEach<TimeoutCallbackCaller&>(callback_caller);
-    /*
-     * Removing timed out objects.
-     * This operation cannot be merged with the previous one because that will not work with recursive calls.
-     */
-    call_registry_.removeAllWhere(&CallState::hasTimedOutPredicate);
+    for (uint8_t nid = 1; nid <= NodeID::Max; nid++)
+    {
+        ServiceCallID call_id;
+        while (call_registry_.removeTimedOut(nid, call_id))
+        {
+            UAVCAN_TRACE("ServiceClient", "Timeout from nid=%d, tid=%d, dtname=%s",
+                         int(call_id.server_node_id.get()), int(call_id.transfer_id.get()),
+                         DataType::getDataTypeFullName());
+
+            typename SubscriberType::ReceivedDataStructureSpec rx_struct; // Default-initialized
+
+            ServiceCallResultType result(ServiceCallResultType::ErrorTimeout, call_id, rx_struct);    // Mutable!
+
+            invokeCallback(result);
+        }
+    }
     /*
      * Subscriber does not need to be registered if we don't have any pending calls.
      * Removing it makes processing of incoming frames a bit faster.
@@ -474,8 +532,7 @@ int ServiceClient<DataType_, Callback_>::addCallState(ServiceCallID call_id)
         }
     }
 
-    if (NULL == call_registry_.template emplace<INode&, ServiceClientBase&, ServiceCallID>(SubscriberType::getNode(),
-                                                                                           *this, call_id))
+    if (NULL == call_registry_.add(SubscriberType::getNode(), *this, call_id))
     {
         SubscriberType::stop();
         return -ErrMemory;
@@ -553,7 +610,7 @@ int ServiceClient<DataType_, Callback_>::call(NodeID server_node_id, const Reque
 template <typename DataType_, typename Callback_>
 void ServiceClient<DataType_, Callback_>::cancelCall(ServiceCallID call_id)
 {
-    call_registry_.removeFirstWhere(CallStateMatchingPredicate(call_id));
+    (void)call_registry_.remove(call_id);
     if (call_registry_.isEmpty())
     {
         SubscriberType::stop();
@@ -570,7 +627,7 @@ void ServiceClient<DataType_, Callback_>::cancelAllCalls()
 template <typename DataType_, typename Callback_>
 bool ServiceClient<DataType_, Callback_>::hasPendingCallToServer(NodeID server_node_id) const
 {
-    return NULL != call_registry_.find(ServerSearchPredicate(server_node_id));
+    return call_registry_.hasCallsToServer(server_node_id);
 }
 
 template <typename DataType_, typename Callback_>
@@ -6,8 +6,11 @@
 #define UAVCAN_NODE_SERVICE_SERVER_HPP_INCLUDED
 
 #include <uavcan/build_config.hpp>
+#include <uavcan/dynamic_memory.hpp>
 #include <uavcan/node/generic_publisher.hpp>
 #include <uavcan/node/generic_subscriber.hpp>
+#include <uavcan/node/scheduler.hpp>
+#include <uavcan/util/templates.hpp>
 
 #if !defined(UAVCAN_CPP_VERSION) || !defined(UAVCAN_CPP11)
 # error UAVCAN_CPP_VERSION
@@ -61,12 +64,145 @@ public:
     bool isResponseEnabled() const { return _enabled_; }
 };
 
+/**
+ * Identifies a service request whose response has been deferred; see @ref ServiceServer::deferResponse().
+ * This is a plain value object, it can be copied freely.
+ */
+class UAVCAN_EXPORT ServiceResponseToken
+{
+    NodeID client_node_id_;
+    TransferID transfer_id_;
+    TransferPriority priority_;
+    MonotonicTime deadline_;
+
+public:
+    ServiceResponseToken() { }
+
+    ServiceResponseToken(NodeID client_node_id, TransferID transfer_id, TransferPriority priority,
+                         MonotonicTime deadline)
+        : client_node_id_(client_node_id)
+        , transfer_id_(transfer_id)
+        , priority_(priority)
+        , deadline_(deadline)
+    { }
+
+    /**
+     * Default constructed token is invalid.
+     */
+    bool isValid() const { return client_node_id_.isUnicast(); }
+
+    NodeID getClientNodeID() const { return client_node_id_; }
+    TransferID getTransferID() const { return transfer_id_; }
+    TransferPriority getPriority() const { return priority_; }
+
+    /**
+     * The response must be sent before this time, otherwise the token expires.
+     */
+    MonotonicTime getDeadline() const { return deadline_; }
+
+    bool operator==(const ServiceResponseToken& rhs) const
+    {
+        return (client_node_id_ == rhs.client_node_id_) && (transfer_id_ == rhs.transfer_id_) &&
+               (priority_ == rhs.priority_) && (deadline_ == rhs.deadline_);
+    }
+    bool operator!=(const ServiceResponseToken& rhs) const { return !operator==(rhs); }
+};
+
+/**
+ * Keeps track of deferred service responses; this is an internal class of @ref ServiceServer.
+ * Every pending response takes one block from the pool. Pending responses are discarded once their
+ * deadline expires.
+ */
+class UAVCAN_EXPORT DeferredResponseRegistry : DeadlineHandler
+{
+    struct Entry : public LinkedListNode<Entry>
+    {
+        ServiceResponseToken token;
+
+        explicit Entry(const ServiceResponseToken& arg_token) : token(arg_token) { }
+    };
+
+    TaggedPoolAllocator allocator_;
+    LinkedListRoot<Entry> list_;
+    MonotonicDuration timeout_;
+    uint32_t num_timed_out_;
+
+    void destroy(Entry* entry);
+    void restartTimer();
+
+    virtual void handleDeadline(MonotonicTime current);
+
+public:
+    explicit DeferredResponseRegistry(INode& node)
+        : DeadlineHandler(node.getScheduler())
+        , allocator_(node.getAllocator(), PoolAllocationOwner(PoolAllocationOwner::KindDeferredResponses))
+        , timeout_(getDefaultTimeout())
+        , num_timed_out_(0)
+    {
+        IsDynamicallyAllocatable<Entry>::check();
+    }
+
+    virtual ~DeferredResponseRegistry() { clear(); }
+
+    /**
+     * Owner index for the memory accounting. Pending responses, if any, are discarded.
+     */
+    void setDataTypeID(DataTypeID dtid);
+
+    /**
+     * The deadline is computed from the reception timestamp of the request.
+     * Returns an invalid token if there's not enough memory.
+     */
+    ServiceResponseToken add(NodeID client_node_id, TransferID transfer_id, TransferPriority priority,
+                             MonotonicTime request_timestamp);
+
+    /**
+     * Returns false if the token is not pending, i.e. it has been removed already or it has expired.
+     */
+    bool remove(const ServiceResponseToken& token);
+
+    void clear();
+
+    unsigned getNumPending() const { return list_.getLength(); }
+    uint32_t getNumTimedOut() const { return num_timed_out_; }
+
+    /**
+     * Matches the default request timeout of @ref ServiceClient.
+     */
+    static MonotonicDuration getDefaultTimeout() { return MonotonicDuration::fromMSec(500); }
+
+    MonotonicDuration getTimeout() const { return timeout_; }
+    void setTimeout(MonotonicDuration timeout) { timeout_ = timeout; }
+};
+
+/**
+ * Takes the place of @ref DeferredResponseRegistry in servers that can't defer responses, so that they don't pay
+ * for the timer and the allocator proxy; this is an internal class of @ref ServiceServer.
+ */
+class UAVCAN_EXPORT NullDeferredResponseRegistry
+{
+public:
+    explicit NullDeferredResponseRegistry(INode&) { }
+
+    void setDataTypeID(DataTypeID) { }
+    void clear() { }
+
+    unsigned getNumPending() const { return 0; }
+    uint32_t getNumTimedOut() const { return 0; }
+};
+
 /**
  * Use this class to implement UAVCAN service servers.
  *
  * Note that the references passed to the callback may point to stack-allocated objects, which means that the
  * references get invalidated once the callback returns.
  *
+ * The response can also be sent later, from the node thread, if it can't be computed within the callback (e.g. if
+ * it requires disk IO that is executed in a background thread). In order to do that, the server must be
+ * instantiated with EnableDeferredResponses_ set, and the callback must call @ref deferResponse(); the returned
+ * token must be passed to @ref respond() together with the response before the deadline expires. Pending responses
+ * that missed the deadline are discarded, because the client would ignore them anyway.
+ *
  * @tparam DataType_        Service data type.
  *
  * @tparam Callback_        Service calls will be delivered through the callback of this type, and service
@@ -77,6 +213,10 @@ public:
  *                          In C++11 mode this type defaults to std::function<>.
  *                          In C++03 mode this type defaults to a plain function pointer; use binder to
  *                          call member functions as callbacks.
+ *
+ * @tparam EnableDeferredResponses_     Whether the server supports @ref deferResponse() and related methods.
+ *                                      Disabled by default, since it takes extra memory for every server;
+ *                                      the deferral methods fail to compile if it is disabled.
  */
 template <typename DataType_,
 #if UAVCAN_CPP_VERSION >= UAVCAN_CPP11
@@ -86,6 +226,7 @@ template <typename DataType_,
           typename Callback_ = void (*)(const ReceivedDataStructure<typename DataType_::Request>&,
                                         ServiceResponseDataStructure<typename DataType_::Response>&)
 #endif
+          , bool EnableDeferredResponses_ = false
           >
 class UAVCAN_EXPORT ServiceServer
     : public GenericSubscriber<DataType_, typename DataType_::Request, TransferListener>
@@ -99,11 +240,32 @@ public:
 private:
     typedef GenericSubscriber<DataType, RequestType, TransferListener> SubscriberType;
     typedef GenericPublisher<DataType, ResponseType> PublisherType;
+    typedef typename Select<EnableDeferredResponses_,
+                            DeferredResponseRegistry,
+                            NullDeferredResponseRegistry>::Result DeferredResponseRegistryType;
 
     PublisherType publisher_;
     Callback callback_;
+    DeferredResponseRegistryType deferred_responses_;
+    const ReceivedDataStructure<RequestType>* current_request_;  ///< Non-NULL only while the callback is running
+    bool current_response_deferred_;
     uint32_t response_failure_count_;
 
+    int publishResponse(const ResponseType& response, NodeID client_node_id, TransferID transfer_id,
+                        TransferPriority priority)
+    {
+        publisher_.setPriority(priority);      // Responding at the same priority.
+
+        const int res = publisher_.publish(response, TransferTypeServiceResponse, client_node_id, transfer_id);
+        if (res < 0)
+        {
+            UAVCAN_TRACE("ServiceServer", "Response publication failure: %i", res);
+            publisher_.getNode().getDispatcher().getTransferPerfCounter().addError();
+            response_failure_count_++;
+        }
+        return res;
+    }
+
     virtual void handleReceivedDataStruct(ReceivedDataStructure<RequestType>& request)
     {
         UAVCAN_ASSERT(request.getTransferType() == TransferTypeServiceRequest);
@@ -113,25 +275,24 @@ private:
         if (coerceOrFallback<bool>(callback_, true))
         {
             UAVCAN_ASSERT(response.isResponseEnabled());  // Enabled by default
+            current_request_ = &request;
+            current_response_deferred_ = false;
             callback_(request, response);
+            current_request_ = NULL;
         }
         else
         {
             handleFatalError("Srv serv clbk");
         }
 
-        if (response.isResponseEnabled())
+        if (current_response_deferred_)
         {
-            publisher_.setPriority(request.getPriority());      // Responding at the same priority.
-
-            const int res = publisher_.publish(response, TransferTypeServiceResponse, request.getSrcNodeID(),
-                                               request.getTransferID());
-            if (res < 0)
-            {
-                UAVCAN_TRACE("ServiceServer", "Response publication failure: %i", res);
-                publisher_.getNode().getDispatcher().getTransferPerfCounter().addError();
-                response_failure_count_++;
-            }
+            current_response_deferred_ = false;
+            UAVCAN_TRACE("ServiceServer", "Response was deferred by the application");
+        }
+        else if (response.isResponseEnabled())
+        {
+            (void)publishResponse(response, request.getSrcNodeID(), request.getTransferID(), request.getPriority());
         }
         else
         {
@@ -144,6 +305,9 @@ public:
         : SubscriberType(node)
         , publisher_(node, getDefaultTxTimeout())
         , callback_()
+        , deferred_responses_(node)
+        , current_request_(NULL)
+        , current_response_deferred_(false)
         , response_failure_count_(0)
     {
         UAVCAN_ASSERT(getTxTimeout() == getDefaultTxTimeout());  // Making sure it is valid
@@ -154,6 +318,7 @@ public:
     /**
      * Starts the server.
      * Incoming service requests will be passed to the application via the callback.
+     * If the server is already running, it will be restarted; pending deferred responses are discarded.
      */
     int start(const Callback& callback)
     {
@@ -172,13 +337,93 @@ public:
             UAVCAN_TRACE("ServiceServer", "Publisher initialization failure: %i", publisher_res);
             return publisher_res;
         }
-        return SubscriberType::startAsServiceRequestListener();
+        const int res = SubscriberType::startAsServiceRequestListener();
+        if (res >= 0)
+        {
+            deferred_responses_.setDataTypeID(SubscriberType::getTransferListener()->getDataTypeDescriptor().getID());
+        }
+        return res;
     }
 
     /**
-     * Stops the server.
+     * Stops the server. Pending deferred responses are discarded.
      */
-    using SubscriberType::stop;
+    void stop()
+    {
+        SubscriberType::stop();
+        deferred_responses_.clear();
+    }
+
+    /**
+     * Can be called only from the server callback. The response that was passed to the callback will not be sent;
+     * instead, the application shall send the response later via @ref respond(), using the returned token.
+     * If there's not enough memory, the returned token will be invalid, and the response will be sent
+     * immediately as usual, so the callback should fill it in anyway.
+     */
+    ServiceResponseToken deferResponse()
+    {
+        StaticAssert<EnableDeferredResponses_>::check();
+        if (current_request_ == NULL)
+        {
+            UAVCAN_ASSERT(0);
+            return ServiceResponseToken();
+        }
+        const ServiceResponseToken token =
+            deferred_responses_.add(current_request_->getSrcNodeID(), current_request_->getTransferID(),
+                                    current_request_->getPriority(), current_request_->getMonotonicTimestamp());
+        if (token.isValid())
+        {
+            current_response_deferred_ = true;
+        }
+        else
+        {
+            UAVCAN_TRACE("ServiceServer", "Failed to defer the response");
+        }
+        return token;
+    }
+
+    /**
+     * Sends the response for a request that was deferred via @ref deferResponse().
+     * Each token can be used only once. This method can be called from within the server callback as well.
+     * Returns negative error code; -ErrInvalidParam means that the token is not valid, has been used already,
+     * or has expired.
+     */
+    int respond(const ServiceResponseToken& token, const ResponseType& response)
+    {
+        StaticAssert<EnableDeferredResponses_>::check();
+        if (!deferred_responses_.remove(token))
+        {
+            UAVCAN_TRACE("ServiceServer", "Unknown or expired response token");
+            return -ErrInvalidParam;
+        }
+        return publishResponse(response, token.getClientNodeID(), token.getTransferID(), token.getPriority());
+    }
+
+    /**
+     * Discards a deferred response without sending anything; the client will time out.
+     * Returns false if the token is not pending.
+     */
+    bool cancelResponse(const ServiceResponseToken& token)
+    {
+        StaticAssert<EnableDeferredResponses_>::check();
+        return deferred_responses_.remove(token);
+    }
+
+    /**
+     * Deferred responses must be sent within this time since the request was received.
+     */
+    MonotonicDuration getDeferredResponseTimeout() const
+    {
+        StaticAssert<EnableDeferredResponses_>::check();
+        return deferred_responses_.getTimeout();
+    }
+    void setDeferredResponseTimeout(MonotonicDuration timeout)
+    {
+        StaticAssert<EnableDeferredResponses_>::check();
+        deferred_responses_.setTimeout(timeout);
+    }
+
+    unsigned getNumPendingResponses() const { return deferred_responses_.getNumPending(); }
 
     static MonotonicDuration getDefaultTxTimeout() { return MonotonicDuration::fromMSec(1000); }
     static MonotonicDuration getMinTxTimeout() { return PublisherType::getMinTxTimeout(); }
@@ -194,6 +439,11 @@ public:
      */
     uint32_t getRequestFailureCount() const { return SubscriberType::getFailureCount(); }
     uint32_t getResponseFailureCount() const { return response_failure_count_; }
+
+    /**
+     * Number of deferred responses that were discarded because the application failed to send them in time.
+     */
+    uint32_t getNumTimedOutResponses() const { return deferred_responses_.getNumTimedOut(); }
 };
 
 }
@@ -7,6 +7,7 @@
 
 #include <uavcan/build_config.hpp>
 #include <uavcan/debug.hpp>
+#include <uavcan/util/templates.hpp>
 #include <uavcan/protocol/dynamic_node_id_server/storage_marshaller.hpp>
 #include <uavcan/protocol/dynamic_node_id_server/event.hpp>
 #include <uavcan/util/bitset.hpp>
@@ -20,6 +21,11 @@ namespace centralized
 /**
  * This class transparently replicates its state to the storage backend, keeping the most recent state in memory.
  * Writes are slow, reads are instantaneous.
+ *
+ * Allocations are indexed by unique ID in memory, so lookups never touch the storage. To make the index
+ * recoverable, the storage keeps the unique ID of every allocated node ID in addition to the node ID of every
+ * unique ID. Allocations stored by older versions lack the former; while there are any, lookups that miss
+ * the index fall back to the storage.
  */
 class Storage
 {
@@ -28,11 +34,41 @@ class Storage
                   BitLenToByteLen<NodeID::Max + 1>::Result>
             OccupationMaskArray;
 
+    enum { NumUniqueIDBuckets = 32 };
+
     IStorageBackend& storage_;
     OccupationMask occupation_mask_;
 
+    /*
+     * Search index. Chains are linked through node IDs; zero terminates a chain, since it is never allocated.
+     */
+    OccupationMask indexed_mask_;           ///< Node IDs with known unique ID; a subset of the occupation mask
+    UniqueID unique_ids_[NodeID::Max + 1];
+    uint8_t unique_id_next_[NodeID::Max + 1];
+    uint8_t unique_id_heads_[NumUniqueIDBuckets];
+
     static IStorageBackend::String getOccupationMaskKey() { return "occupation_mask"; }
 
+    static IStorageBackend::String makeUniqueIDKey(NodeID node_id)
+    {
+        IStorageBackend::String str;
+        // "node42_unique_id"
+        str += "node";
+        str.appendFormatted("%d", int(node_id.get()));
+        str += "_unique_id";
+        return str;
+    }
+
+    static uint8_t computeUniqueIDBucket(const UniqueID& unique_id)
+    {
+        uint32_t hash = 2166136261U;                    // FNV-1a
+        for (uint8_t i = 0; i < unique_id.size(); i++)
+        {
+            hash = (hash ^ unique_id[i]) * 16777619U;
+        }
+        return static_cast<uint8_t>(hash & (NumUniqueIDBuckets - 1U));
+    }
+
     static OccupationMask maskFromArray(const OccupationMaskArray& array)
     {
         OccupationMask mask;
@@ -62,13 +98,65 @@ class Storage
         return array;
     }
 
+    void clearIndex()
+    {
+        indexed_mask_.reset();
+        fill(unique_id_heads_, unique_id_heads_ + NumUniqueIDBuckets, uint8_t(0));
+    }
+
+    void removeFromIndex(NodeID node_id)
+    {
+        uint8_t* link = &unique_id_heads_[computeUniqueIDBucket(unique_ids_[node_id.get()])];
+        while (*link != 0)
+        {
+            if (*link == node_id.get())
+            {
+                *link = unique_id_next_[node_id.get()];
+                break;
+            }
+            link = &unique_id_next_[*link];
+        }
+        indexed_mask_[node_id.get()] = false;
+    }
+
+    /**
+     * If the same unique ID is added more than once, the most recent entry will be found first.
+     */
+    void addToIndex(NodeID node_id, const UniqueID& unique_id)
+    {
+        UAVCAN_ASSERT(node_id.isUnicast());
+        if (indexed_mask_[node_id.get()])
+        {
+            removeFromIndex(node_id);
+        }
+        const uint8_t bucket = computeUniqueIDBucket(unique_id);
+        unique_ids_[node_id.get()] = unique_id;
+        unique_id_next_[node_id.get()] = unique_id_heads_[bucket];
+        unique_id_heads_[bucket] = node_id.get();
+        indexed_mask_[node_id.get()] = true;
+    }
+
+    NodeID findInIndex(const UniqueID& unique_id) const
+    {
+        for (uint8_t nid = unique_id_heads_[computeUniqueIDBucket(unique_id)]; nid != 0; nid = unique_id_next_[nid])
+        {
+            if (unique_ids_[nid] == unique_id)
+            {
+                return NodeID(nid);
+            }
+        }
+        return NodeID();
+    }
+
 public:
     Storage(IStorageBackend& storage) :
         storage_(storage)
-    { }
+    {
+        clearIndex();
+    }
 
     /**
-     * This method reads only the occupation mask from the storage.
+     * This method reads the occupation mask and the unique IDs of all allocated node IDs from the storage.
      */
     int init()
     {
@@ -76,6 +164,22 @@ public:
         OccupationMaskArray array;
         io.get(getOccupationMaskKey(), array);
         occupation_mask_ = maskFromArray(array);
+
+        clearIndex();
+        for (uint8_t nid = 1; nid <= NodeID::Max; nid++)
+        {
+            if (occupation_mask_[nid])
+            {
+                UniqueID unique_id;
+                if (io.get(makeUniqueIDKey(nid), unique_id) >= 0)
+                {
+                    addToIndex(nid, unique_id);
+                }
+            }
+        }
+
+        UAVCAN_TRACE("dynamic_node_id_server::centralized::Storage", "%u allocations, %u indexed",
+                     unsigned(occupation_mask_.count()), unsigned(indexed_mask_.count()));
         return 0;
     }
 
@@ -106,6 +210,20 @@ public:
             }
         }
 
+        // The reverse mapping must be stored before the mask, otherwise the index could not be restored
+        {
+            UniqueID unique_id_stored = unique_id;
+            int res = io.setAndGetBack(makeUniqueIDKey(node_id), unique_id_stored);
+            if (res < 0)
+            {
+                return res;
+            }
+            if (unique_id_stored != unique_id)
+            {
+                return -ErrFailure;
+            }
+        }
+
         // Updating the mask in the storage
         OccupationMask new_occupation_mask = occupation_mask_;
         new_occupation_mask[node_id.get()] = true;
@@ -121,17 +239,25 @@ public:
             return -ErrFailure;
         }
 
-        // Updating the cached mask only if the storage was updated successfully
+        // Updating the cached mask and the index only if the storage was updated successfully
         occupation_mask_ = new_occupation_mask;
+        addToIndex(node_id, unique_id);
 
         return 0;
     }
 
     /**
      * Returns an invalid node ID if there's no such allocation.
+     * The storage is not accessed unless it contains allocations that could not be indexed.
      */
     NodeID getNodeIDForUniqueID(const UniqueID& unique_id) const
     {
+        const NodeID indexed_node_id = findInIndex(unique_id);
+        if (indexed_node_id.isValid() || (indexed_mask_ == occupation_mask_))
+        {
+            return indexed_node_id;
+        }
+
         StorageMarshaller io(storage_);
         uint32_t node_id = 0;
         io.get(StorageMarshaller::convertUniqueIDToHex(unique_id), node_id);
@@ -141,6 +267,11 @@ public:
     bool isNodeIDOccupied(NodeID node_id) const { return occupation_mask_[node_id.get()]; }
 
     uint8_t getSize() const { return static_cast<uint8_t>(occupation_mask_.count()); }
+
+    /**
+     * Number of allocations that can be found without accessing the storage.
+     */
+    uint8_t getNumIndexedAllocations() const { return static_cast<uint8_t>(indexed_mask_.count()); }
 };
 
 }
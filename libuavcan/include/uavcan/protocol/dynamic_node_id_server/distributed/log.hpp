@@ -7,6 +7,7 @@
 
 #include <uavcan/build_config.hpp>
 #include <uavcan/debug.hpp>
+#include <uavcan/util/templates.hpp>
 #include <uavcan/protocol/dynamic_node_id_server/distributed/types.hpp>
 #include <uavcan/protocol/dynamic_node_id_server/storage_marshaller.hpp>
 #include <uavcan/protocol/dynamic_node_id_server/event.hpp>
@@ -21,6 +22,7 @@ namespace distributed
  * Raft log.
  * This class transparently replicates its state to the storage backend, keeping the most recent state in memory.
  * Writes are slow, reads are instantaneous.
+ * Entries are indexed by unique ID and by node ID, so that the allocator can find them in constant time.
  */
 class Log
 {
@@ -30,11 +32,23 @@ public:
     enum { Capacity = NodeID::Max + 1 };
 
 private:
+    enum { InvalidIndex = 0xFF };
+    enum { NumUniqueIDBuckets = Capacity };
+
     IStorageBackend& storage_;
     IEventTracer& tracer_;
     Entry entries_[Capacity];
     Index last_index_;             // Index zero always contains an empty entry
 
+    /*
+     * Search indexes. Every chain is ordered from higher to lower log index, so the first match is always the
+     * most recent entry. Entries are always added and removed at the end of the log, so chains are updated at the head.
+     */
+    Index node_id_heads_[NodeID::Max + 1];
+    Index node_id_next_[Capacity];
+    Index unique_id_heads_[NumUniqueIDBuckets];
+    Index unique_id_next_[Capacity];
+
     static IStorageBackend::String getLastIndexKey() { return "log_last_index"; }
 
     static IStorageBackend::String makeEntryKey(Index index, const char* postfix)
@@ -48,6 +62,54 @@ private:
         return str;
     }
 
+    static uint8_t computeUniqueIDBucket(const UniqueID& unique_id)
+    {
+        uint32_t hash = 2166136261U;                    // FNV-1a
+        for (uint8_t i = 0; i < unique_id.size(); i++)
+        {
+            hash = (hash ^ unique_id[i]) * 16777619U;
+        }
+        return static_cast<uint8_t>(hash & (NumUniqueIDBuckets - 1U));
+    }
+
+    void addToIndex(Index index)
+    {
+        const Entry& entry = entries_[index];
+        UAVCAN_ASSERT(entry.node_id <= NodeID::Max);
+
+        node_id_next_[index] = node_id_heads_[entry.node_id];
+        node_id_heads_[entry.node_id] = index;
+
+        const uint8_t bucket = computeUniqueIDBucket(entry.unique_id);
+        unique_id_next_[index] = unique_id_heads_[bucket];
+        unique_id_heads_[bucket] = index;
+    }
+
+    /**
+     * Only the last entry can be removed.
+     */
+    void removeFromIndex(Index index)
+    {
+        const Entry& entry = entries_[index];
+
+        UAVCAN_ASSERT(node_id_heads_[entry.node_id] == index);
+        node_id_heads_[entry.node_id] = node_id_next_[index];
+
+        const uint8_t bucket = computeUniqueIDBucket(entry.unique_id);
+        UAVCAN_ASSERT(unique_id_heads_[bucket] == index);
+        unique_id_heads_[bucket] = unique_id_next_[index];
+    }
+
+    void rebuildIndex()
+    {
+        fill(node_id_heads_, node_id_heads_ + NodeID::Max + 1, Index(InvalidIndex));
+        fill(unique_id_heads_, unique_id_heads_ + NumUniqueIDBuckets, Index(InvalidIndex));
+        for (int index = 0; index <= int(last_index_); index++)
+        {
+            addToIndex(Index(index));
+        }
+    }
+
     int readEntryFromStorage(Index index, Entry& out_entry)
     {
         const StorageMarshaller io(storage_);
@@ -128,6 +190,7 @@ private:
          * left in an inconsistent state.
          */
         last_index_ = 0;
+        rebuildIndex();
         uint32_t stored_index = 0;
         res = io.setAndGetBack(getLastIndexKey(), stored_index);
         if (res < 0)
@@ -147,7 +210,9 @@ public:
         : storage_(storage)
         , tracer_(tracer)
         , last_index_(0)
-    { }
+    {
+        rebuildIndex();
+    }
 
     int init()
     {
@@ -191,6 +256,8 @@ public:
             }
         }
 
+        rebuildIndex();
+
         UAVCAN_TRACE("dynamic_node_id_server::distributed::Log", "Restored %u log entries", unsigned(last_index_));
         return 0;
     }
@@ -199,39 +266,53 @@ public:
      * This method invokes storage IO.
      * Returned value indicates whether the entry was successfully appended.
      */
-    int append(const Entry& entry)
+    int append(const Entry& entry) { return append(&entry, 1); }
+
+    /**
+     * Appends several entries at once; the last index is written to the storage only once, after all entries.
+     * Either all entries are appended or none.
+     * This method invokes storage IO.
+     */
+    int append(const Entry* const entries, const uint8_t num_entries)
     {
-        if ((last_index_ + 1) >= Capacity)
+        if ((entries == NULL) || (num_entries == 0) || ((last_index_ + num_entries) >= Capacity))
         {
             return -ErrLogic;
         }
 
-        tracer_.onEvent(TraceRaftLogAppend, last_index_ + 1U);
-
-        // If next operations fail, we'll get a dangling entry, but it's absolutely OK.
-        int res = writeEntryToStorage(Index(last_index_ + 1), entry);
-        if (res < 0)
+        // If next operations fail, we'll get dangling entries, but it's absolutely OK.
+        for (uint8_t i = 0; i < num_entries; i++)
         {
-            return res;
+            tracer_.onEvent(TraceRaftLogAppend, last_index_ + 1U + i);
+
+            const int res = writeEntryToStorage(Index(last_index_ + 1U + i), entries[i]);
+            if (res < 0)
+            {
+                return res;
+            }
         }
 
         // Updating the last index
         StorageMarshaller io(storage_);
-        uint32_t new_last_index = last_index_ + 1U;
-        res = io.setAndGetBack(getLastIndexKey(), new_last_index);
+        uint32_t new_last_index = last_index_ + uint32_t(num_entries);
+        const int res = io.setAndGetBack(getLastIndexKey(), new_last_index);
         if (res < 0)
         {
             return res;
         }
-        if (new_last_index != last_index_ + 1U)
+        if (new_last_index != last_index_ + uint32_t(num_entries))
         {
             return -ErrFailure;
         }
-        entries_[new_last_index] = entry;
-        last_index_ = Index(new_last_index);
+        for (uint8_t i = 0; i < num_entries; i++)
+        {
+            last_index_++;
+            entries_[last_index_] = entries[i];
+            addToIndex(last_index_);
 
-        UAVCAN_TRACE("dynamic_node_id_server::distributed::Log", "New entry, index %u, node ID %u, term %u",
-                     unsigned(last_index_), unsigned(entry.node_id), unsigned(entry.term));
+            UAVCAN_TRACE("dynamic_node_id_server::distributed::Log", "New entry, index %u, node ID %u, term %u",
+                         unsigned(last_index_), unsigned(entries[i].node_id), unsigned(entries[i].term));
+        }
         return 0;
     }
 
@@ -266,7 +347,16 @@ public:
             }
             UAVCAN_TRACE("dynamic_node_id_server::distributed::Log", "Entries removed, last index %u --> %u",
                          unsigned(last_index_), unsigned(new_last_index));
-            last_index_ = Index(new_last_index);
+            while (last_index_ > new_last_index)
+            {
+                removeFromIndex(last_index_);
+                last_index_--;
+            }
+            if (last_index_ < new_last_index)
+            {
+                last_index_ = Index(new_last_index);
+                rebuildIndex();
+            }
         }
 
         // Removal operation leaves dangling entries in storage, it's OK
@@ -290,6 +380,41 @@ public:
 
     Index getLastIndex() const { return last_index_; }
 
+    /**
+     * These methods return the highest index of the entry with the specified unique ID or node ID.
+     * Returns false if there's no such entry. Note that entry 0 always exists and contains zero values.
+     * These methods do not use storage IO; complexity is constant.
+     */
+    bool findLastIndexByUniqueID(const UniqueID& unique_id, Index& out_index) const
+    {
+        for (Index i = unique_id_heads_[computeUniqueIDBucket(unique_id)]; i != InvalidIndex; i = unique_id_next_[i])
+        {
+            UAVCAN_ASSERT(i <= last_index_);
+            if (entries_[i].unique_id == unique_id)
+            {
+                out_index = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool findLastIndexByNodeID(NodeID node_id, Index& out_index) const
+    {
+        if (!node_id.isValid())
+        {
+            return false;
+        }
+        const Index i = node_id_heads_[node_id.get()];
+        if (i == InvalidIndex)
+        {
+            return false;
+        }
+        UAVCAN_ASSERT(i <= last_index_);
+        out_index = i;
+        return true;
+    }
+
     bool isOtherLogUpToDate(Index other_last_index, Term other_last_term) const
     {
         UAVCAN_ASSERT(last_index_ < Capacity);
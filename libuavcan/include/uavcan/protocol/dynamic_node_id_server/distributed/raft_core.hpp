@@ -60,8 +60,16 @@ public:
  *   - newer term in response (also switch to follower)
  *   - append entries request with term >= currentTerm
  *   - vote granted
+ *
+ * Log replication:
+ *   - The leader keeps up to several requests in flight per follower. New entries are sent as soon as they are
+ *     appended to the log, and the next request is sent as soon as the previous one is confirmed, so replication
+ *     is not limited by the update interval. The periodic update sends heartbeats.
+ *   - The follower defers responses to the append entries requests and writes all entries received during one
+ *     spin of the node into the log at once; the responses are sent once the entries are persisted.
  */
-class RaftCore : private TimerBase
+class RaftCore : private TimerBase,
+                 private SpinHandler
 {
 public:
     enum ServerState
@@ -88,6 +96,7 @@ private:
 
     struct PendingAppendEntriesFields
     {
+        ServiceCallID call_id;          ///< Invalid if the slot is free
         Log::Index prev_log_index;
         Log::Index num_entries;
 
@@ -101,6 +110,9 @@ private:
      * Constants
      */
     enum { MaxNumFollowers = ClusterManager::MaxClusterSize - 1 };
+    enum { AppendEntriesPipelineDepth = 4 };
+    enum { MaxPendingAppendEntriesCalls = MaxNumFollowers * AppendEntriesPipelineDepth };
+    enum { MaxStagedLogEntries = 8 };
 
     IEventTracer& tracer_;
     IRaftLeaderMonitor& leader_monitor_;
@@ -119,12 +131,21 @@ private:
     uint8_t next_server_index_;         ///< Next server to query AE from
     uint8_t num_votes_received_in_this_campaign_;
 
-    PendingAppendEntriesFields pending_append_entries_fields_;
+    PendingAppendEntriesFields pending_append_entries_fields_[MaxPendingAppendEntriesCalls];
+
+    /*
+     * Entries that were received by the follower but not yet written into the log, see @ref handleSpin()
+     */
+    Entry staged_entries_[MaxStagedLogEntries];
+    ServiceResponseToken staged_response_tokens_[MaxStagedLogEntries];
+    uint8_t num_staged_entries_;
+    uint8_t num_staged_response_tokens_;
+    Log::Index staged_leader_commit_;
 
     /*
      * Transport
      */
-    ServiceServer<AppendEntries, AppendEntriesCallback>         append_entries_srv_;
+    ServiceServer<AppendEntries, AppendEntriesCallback, true>   append_entries_srv_;
     ServiceClient<AppendEntries, AppendEntriesResponseCallback> append_entries_client_;
     ServiceServer<RequestVote, RequestVoteCallback>         request_vote_srv_;
     ServiceClient<RequestVote, RequestVoteResponseCallback> request_vote_client_;
@@ -153,12 +174,15 @@ private:
         UAVCAN_ASSERT(num_votes_received_in_this_campaign_ <= cluster_.getClusterSize());
 
         // Transport
-        UAVCAN_ASSERT(append_entries_client_.getNumPendingCalls() <= 1);
+        UAVCAN_ASSERT(append_entries_client_.getNumPendingCalls() <=
+                      unsigned(cluster_.getNumKnownServers()) * AppendEntriesPipelineDepth);
         UAVCAN_ASSERT(request_vote_client_.getNumPendingCalls() <= cluster_.getNumKnownServers());
         UAVCAN_ASSERT(server_state_ != ServerStateCandidate || !append_entries_client_.hasPendingCalls());
         UAVCAN_ASSERT(server_state_ != ServerStateLeader    || !request_vote_client_.hasPendingCalls());
         UAVCAN_ASSERT(server_state_ != ServerStateFollower  ||
                       (!append_entries_client_.hasPendingCalls() && !request_vote_client_.hasPendingCalls()));
+        UAVCAN_ASSERT(server_state_ == ServerStateFollower  || num_staged_entries_ == 0);
+        UAVCAN_ASSERT(num_staged_response_tokens_ <= num_staged_entries_);
     }
 
     void registerActivity()
@@ -256,58 +280,140 @@ private:
         }
     }
 
-    void updateLeader()
+    PendingAppendEntriesFields* findPendingAppendEntriesFields(const ServiceCallID call_id)
     {
-        if (append_entries_client_.hasPendingCalls())
+        for (unsigned i = 0; i < MaxPendingAppendEntriesCalls; i++)
         {
-            append_entries_client_.cancelAllCalls();    // Refer to the response callback to learn why
+            if (pending_append_entries_fields_[i].call_id == call_id)
+            {
+                return &pending_append_entries_fields_[i];
+            }
         }
+        return NULL;
+    }
 
-        if (cluster_.getClusterSize() > 1)
+    void cancelAppendEntriesCalls(const NodeID node_id)
+    {
+        for (unsigned i = 0; i < MaxPendingAppendEntriesCalls; i++)
         {
-            const NodeID node_id = cluster_.getRemoteServerNodeIDAtIndex(next_server_index_);
-            UAVCAN_ASSERT(node_id.isUnicast());
+            if (pending_append_entries_fields_[i].call_id.server_node_id == node_id)
+            {
+                append_entries_client_.cancelCall(pending_append_entries_fields_[i].call_id);
+                pending_append_entries_fields_[i] = PendingAppendEntriesFields();
+            }
+        }
+    }
 
-            next_server_index_++;
-            if (next_server_index_ >= cluster_.getNumKnownServers())
+    /**
+     * Sends one request starting from the specified index; the request will be empty if there's nothing to send.
+     * Returns the number of sent entries or negative error code.
+     */
+    int sendAppendEntries(const NodeID node_id, const Log::Index next_index)
+    {
+        PendingAppendEntriesFields* const fields = findPendingAppendEntriesFields(ServiceCallID());
+        if (fields == NULL)
+        {
+            UAVCAN_ASSERT(0);
+            return -ErrLogic;
+        }
+
+        AppendEntries::Request req;
+        req.term = persistent_state_.getCurrentTerm();
+        req.leader_commit = commit_index_;
+
+        req.prev_log_index = Log::Index(next_index - 1U);
+
+        const Entry* const entry = persistent_state_.getLog().getEntryAtIndex(req.prev_log_index);
+        if (entry == NULL)
+        {
+            UAVCAN_ASSERT(0);
+            handlePersistentStateUpdateError(-ErrLogic);
+            return -ErrLogic;
+        }
+
+        req.prev_log_term = entry->term;
+
+        for (Log::Index index = next_index; index <= persistent_state_.getLog().getLastIndex(); index++)
+        {
+            req.entries.push_back(*persistent_state_.getLog().getEntryAtIndex(index));
+            if (req.entries.size() == req.entries.capacity())
             {
-                next_server_index_ = 0;
+                break;
             }
+        }
 
-            AppendEntries::Request req;
-            req.term = persistent_state_.getCurrentTerm();
-            req.leader_commit = commit_index_;
+        ServiceCallID call_id;
+        const int res = append_entries_client_.call(node_id, req, call_id);
+        if (res < 0)
+        {
+            trace(TraceRaftAppendEntriesCallFailure, res);
+            return res;
+        }
 
-            req.prev_log_index = Log::Index(cluster_.getServerNextIndex(node_id) - 1U);
+        fields->call_id = call_id;
+        fields->prev_log_index = req.prev_log_index;
+        fields->num_entries = Log::Index(req.entries.size());
+        return int(req.entries.size());
+    }
 
-            const Entry* const entry = persistent_state_.getLog().getEntryAtIndex(req.prev_log_index);
-            if (entry == NULL)
+    /**
+     * Sends the entries the follower doesn't have yet, keeping the number of requests in flight within the limit.
+     * If the follower is up to date and there are no requests in flight, a heartbeat can be sent instead.
+     */
+    void replicateLog(const NodeID node_id, const bool send_heartbeat)
+    {
+        UAVCAN_ASSERT(server_state_ == ServerStateLeader);
+
+        /*
+         * Requests in flight are expected to succeed, so the next index is advanced past them
+         */
+        Log::Index next_index = cluster_.getServerNextIndex(node_id);
+        uint8_t num_pending = 0;
+        for (unsigned i = 0; i < MaxPendingAppendEntriesCalls; i++)
+        {
+            const PendingAppendEntriesFields& f = pending_append_entries_fields_[i];
+            if (f.call_id.server_node_id == node_id)
+            {
+                num_pending++;
+                next_index = max(next_index, Log::Index(f.prev_log_index + f.num_entries + 1U));
+            }
+        }
+
+        while ((num_pending < AppendEntriesPipelineDepth) &&
+               (next_index <= persistent_state_.getLog().getLastIndex()))
+        {
+            const int res = sendAppendEntries(node_id, next_index);
+            if (res <= 0)
             {
-                UAVCAN_ASSERT(0);
-                handlePersistentStateUpdateError(-ErrLogic);
                 return;
             }
+            next_index = Log::Index(next_index + res);
+            num_pending++;
+        }
+
+        if (send_heartbeat && (num_pending == 0))
+        {
+            (void)sendAppendEntries(node_id, next_index);
+        }
+    }
 
-            req.prev_log_term = entry->term;
+    void updateLeader()
+    {
+        if (cluster_.getClusterSize() > 1)
+        {
+            const NodeID node_id = cluster_.getRemoteServerNodeIDAtIndex(next_server_index_);
+            UAVCAN_ASSERT(node_id.isUnicast());
 
-            for (Log::Index index = cluster_.getServerNextIndex(node_id);
-                 index <= persistent_state_.getLog().getLastIndex();
-                 index++)
+            next_server_index_++;
+            if (next_server_index_ >= cluster_.getNumKnownServers())
             {
-                req.entries.push_back(*persistent_state_.getLog().getEntryAtIndex(index));
-                if (req.entries.size() == req.entries.capacity())
-                {
-                    break;
-                }
+                next_server_index_ = 0;
             }
 
-            pending_append_entries_fields_.num_entries = req.entries.size();
-            pending_append_entries_fields_.prev_log_index = req.prev_log_index;
-
-            const int res = append_entries_client_.call(node_id, req);
-            if (res < 0)
+            replicateLog(node_id, true);
+            if (server_state_ != ServerStateLeader)
             {
-                trace(TraceRaftAppendEntriesCallFailure, res);
+                return;
             }
         }
 
@@ -331,6 +437,11 @@ private:
         /*
          * Updating the current state
          */
+        if (server_state_ == ServerStateFollower)
+        {
+            flushStagedLogEntries();
+        }
+
         const ServerState old_state = server_state_;
         server_state_ = new_state;
 
@@ -344,6 +455,7 @@ private:
 
         request_vote_client_.cancelAllCalls();
         append_entries_client_.cancelAllCalls();
+        fill_n(pending_append_entries_fields_, unsigned(MaxPendingAppendEntriesCalls), PendingAppendEntriesFields());
 
         /*
          * Calling the switch handler
@@ -374,7 +486,7 @@ private:
         UAVCAN_ASSERT(server_state_ == ServerStateLeader);
         UAVCAN_ASSERT(commit_index_ <= persistent_state_.getLog().getLastIndex());
 
-        if (commit_index_ < persistent_state_.getLog().getLastIndex())
+        while (commit_index_ < persistent_state_.getLog().getLastIndex())
         {
             /*
              * Not all local entries are committed.
@@ -399,9 +511,81 @@ private:
                 // AT THIS POINT ALLOCATION IS COMPLETE
                 leader_monitor_.handleLogCommitOnLeader(*persistent_state_.getLog().getEntryAtIndex(commit_index_));
             }
+            else
+            {
+                break;
+            }
         }
     }
 
+    /**
+     * Writes the staged entries into the log and sends the deferred responses.
+     * If the log could not be updated, the responses will not be sent, the leader will assume that we're dead.
+     */
+    void flushStagedLogEntries()
+    {
+        if (num_staged_entries_ == 0)
+        {
+            return;
+        }
+
+        const int res = persistent_state_.getLog().append(staged_entries_, num_staged_entries_);
+        if (res < 0)
+        {
+            trace(TraceRaftPersistStateUpdateError, res);
+        }
+        else if (staged_leader_commit_ > commit_index_)
+        {
+            commit_index_ = min(staged_leader_commit_, persistent_state_.getLog().getLastIndex());
+            trace(TraceRaftCommitIndexUpdate, commit_index_);
+        }
+
+        AppendEntries::Response response;
+        response.term = persistent_state_.getCurrentTerm();
+        response.success = true;
+
+        for (uint8_t i = 0; i < num_staged_response_tokens_; i++)
+        {
+            if (res < 0)
+            {
+                (void)append_entries_srv_.cancelResponse(staged_response_tokens_[i]);
+            }
+            else
+            {
+                const int respond_res = append_entries_srv_.respond(staged_response_tokens_[i], response);
+                if (respond_res < 0)
+                {
+                    trace(TraceError, respond_res);
+                }
+            }
+        }
+
+        num_staged_entries_ = 0;
+        num_staged_response_tokens_ = 0;
+        staged_leader_commit_ = 0;
+    }
+
+    /**
+     * Whether the request can be appended to the staged entries; the term is checked separately.
+     */
+    bool canStageAppendEntriesRequest(const AppendEntries::Request& request) const
+    {
+        const Log::Index last_index = Log::Index(persistent_state_.getLog().getLastIndex() + num_staged_entries_);
+
+        if ((request.entries.size() == 0) ||
+            (request.prev_log_index != last_index) ||
+            (num_staged_response_tokens_ >= MaxStagedLogEntries) ||
+            ((num_staged_entries_ + request.entries.size()) > MaxStagedLogEntries) ||
+            ((last_index + request.entries.size()) >= Log::Capacity))
+        {
+            return false;
+        }
+
+        const Term prev_log_term = (num_staged_entries_ > 0) ? staged_entries_[num_staged_entries_ - 1].term :
+                                   persistent_state_.getLog().getEntryAtIndex(last_index)->term;
+        return prev_log_term == request.prev_log_term;
+    }
+
     void handleAppendEntriesRequest(const ReceivedDataStructure<AppendEntries::Request>& request,
                                     ServiceResponseDataStructure<AppendEntries::Response>& response)
     {
@@ -423,6 +607,15 @@ private:
 
         UAVCAN_ASSERT(response.isResponseEnabled());  // This is default
 
+        /*
+         * Requests that don't simply continue the staged entries are processed against the log
+         */
+        if ((num_staged_entries_ > 0) &&
+            ((request.term != persistent_state_.getCurrentTerm()) || !canStageAppendEntriesRequest(request)))
+        {
+            flushStagedLogEntries();
+        }
+
         /*
          * Checking if our current state is up to date.
          * The request will be ignored if persistent state cannot be updated.
@@ -465,6 +658,26 @@ private:
         registerActivity();
         switchState(ServerStateFollower);
 
+        /*
+         * Steps 2 to 5 for the entries that continue the log (or the staged entries) are executed later;
+         * the response is sent once the entries are persisted, see @ref flushStagedLogEntries().
+         */
+        if (canStageAppendEntriesRequest(request))
+        {
+            const ServiceResponseToken token = append_entries_srv_.deferResponse();
+            if (token.isValid())
+            {
+                for (uint8_t i = 0; i < request.entries.size(); i++)
+                {
+                    staged_entries_[num_staged_entries_++] = request.entries[i];
+                }
+                staged_response_tokens_[num_staged_response_tokens_++] = token;
+                staged_leader_commit_ = max(staged_leader_commit_, Log::Index(request.leader_commit));
+                return;
+            }
+            flushStagedLogEntries();        // Falling back to synchronous processing
+        }
+
         /*
          * Step 2
          * Reject the request if the assumed log index does not exist on the local node.
@@ -538,34 +751,62 @@ private:
         UAVCAN_ASSERT(server_state_ == ServerStateLeader);  // When state switches, all requests must be cancelled
         checkInvariants();
 
-        if (!result.isSuccessful())
+        const NodeID node_id = result.getCallID().server_node_id;
+
+        PendingAppendEntriesFields* const pending = findPendingAppendEntriesFields(result.getCallID());
+        if (pending == NULL)
         {
+            UAVCAN_ASSERT(0);
             return;
         }
+        const PendingAppendEntriesFields fields = *pending;
+        *pending = PendingAppendEntriesFields();
+
+        if (!result.isSuccessful())
+        {
+            return;                 // Will be retried from the periodic update handler
+        }
 
         if (result.getResponse().term > persistent_state_.getCurrentTerm())
         {
             tryIncrementCurrentTermFromResponse(result.getResponse().term);
+            return;
         }
-        else
+
+        if (result.getResponse().success)
         {
-            if (result.getResponse().success)
+            const Log::Index match_index = Log::Index(fields.prev_log_index + fields.num_entries);
+            if (match_index > cluster_.getServerMatchIndex(node_id))
             {
-                cluster_.incrementServerNextIndexBy(result.getCallID().server_node_id,
-                                                    pending_append_entries_fields_.num_entries);
-                cluster_.setServerMatchIndex(result.getCallID().server_node_id,
-                                             Log::Index(pending_append_entries_fields_.prev_log_index +
-                                                        pending_append_entries_fields_.num_entries));
+                cluster_.setServerMatchIndex(node_id, match_index);
             }
-            else
+            if (match_index >= cluster_.getServerNextIndex(node_id))
             {
-                cluster_.decrementServerNextIndex(result.getCallID().server_node_id);
-                trace(TraceRaftAppendEntriesRespUnsucfl, result.getCallID().server_node_id.get());
+                cluster_.incrementServerNextIndexBy(node_id,
+                                                    Log::Index(match_index + 1U - cluster_.getServerNextIndex(node_id)));
             }
+
+            propagateCommitIndex();
         }
+        else
+        {
+            trace(TraceRaftAppendEntriesRespUnsucfl, node_id.get());
 
-        pending_append_entries_fields_ = PendingAppendEntriesFields();
-        // Rest of the logic is implemented in periodic update handlers.
+            // The requests that follow this one can't succeed either
+            cancelAppendEntriesCalls(node_id);
+
+            // Rejection of a pipelined request doesn't mean that the follower is missing the confirmed entries
+            if ((fields.prev_log_index > 0) &&
+                (Log::Index(fields.prev_log_index + 1U) == cluster_.getServerNextIndex(node_id)))
+            {
+                cluster_.decrementServerNextIndex(node_id);
+            }
+        }
+
+        if (server_state_ == ServerStateLeader)
+        {
+            replicateLog(node_id, false);
+        }
     }
 
     void handleRequestVoteRequest(const ReceivedDataStructure<RequestVote::Request>& request,
@@ -574,6 +815,8 @@ private:
         checkInvariants();
         trace(TraceRaftVoteRequestReceived, request.getSrcNodeID().get());
 
+        flushStagedLogEntries();            // The staged entries must be considered when voting
+
         if (!cluster_.isKnownServer(request.getSrcNodeID()))
         {
             trace(TraceRaftRequestIgnored, request.getSrcNodeID().get());
@@ -669,8 +912,14 @@ private:
         // I'm no fan of asynchronous programming. At all.
     }
 
+    virtual void handleSpin(MonotonicTime)
+    {
+        flushStagedLogEntries();
+    }
+
     virtual void handleTimerEvent(const TimerEvent&)
     {
+        flushStagedLogEntries();
         checkInvariants();
 
         switch (server_state_)
@@ -704,6 +953,7 @@ public:
              IEventTracer& tracer,
              IRaftLeaderMonitor& leader_monitor)
         : TimerBase(node)
+        , SpinHandler(node.getScheduler())
         , tracer_(tracer)
         , leader_monitor_(leader_monitor)
         , persistent_state_(storage, tracer)
@@ -715,6 +965,9 @@ public:
         , server_state_(ServerStateFollower)
         , next_server_index_(0)
         , num_votes_received_in_this_campaign_(0)
+        , num_staged_entries_(0)
+        , num_staged_response_tokens_(0)
+        , staged_leader_commit_(0)
         , append_entries_srv_(node)
         , append_entries_client_(node)
         , request_vote_srv_(node)
@@ -736,6 +989,9 @@ public:
         next_server_index_ = 0;
         num_votes_received_in_this_campaign_ = 0;
         commit_index_ = 0;
+        num_staged_entries_ = 0;
+        num_staged_response_tokens_ = 0;
+        staged_leader_commit_ = 0;
 
         registerActivity();
 
@@ -801,6 +1057,7 @@ public:
                                                    update_interval));
 
         startPeriodic(update_interval);
+        SpinHandler::start();
 
         trace(TraceRaftCoreInited, update_interval.toUSec());
 
@@ -842,6 +1099,12 @@ public:
             if (res < 0)
             {
                 handlePersistentStateUpdateError(res);
+                return;
+            }
+
+            for (uint8_t i = 0; (i < cluster_.getNumKnownServers()) && (server_state_ == ServerStateLeader); i++)
+            {
+                replicateLog(cluster_.getRemoteServerNodeIDAtIndex(i), false);
             }
         }
         else
@@ -892,6 +1155,35 @@ public:
         return LazyConstructor<LogEntryInfo>();
     }
 
+    /**
+     * These methods return the most recent log entry with the specified unique ID or node ID, if any.
+     * The result is the same as that of @ref traverseLogFromEndUntil() with the corresponding predicate,
+     * but the complexity is constant rather than linear.
+     */
+    LazyConstructor<LogEntryInfo> findLogEntryByUniqueID(const UniqueID& unique_id) const
+    {
+        LazyConstructor<LogEntryInfo> ret;
+        Log::Index index = 0;
+        if (persistent_state_.getLog().findLastIndexByUniqueID(unique_id, index))
+        {
+            ret.construct<const Entry&, bool>(*persistent_state_.getLog().getEntryAtIndex(index),
+                                              index <= commit_index_);
+        }
+        return ret;
+    }
+
+    LazyConstructor<LogEntryInfo> findLogEntryByNodeID(NodeID node_id) const
+    {
+        LazyConstructor<LogEntryInfo> ret;
+        Log::Index index = 0;
+        if (persistent_state_.getLog().findLastIndexByNodeID(node_id, index))
+        {
+            ret.construct<const Entry&, bool>(*persistent_state_.getLog().getEntryAtIndex(index),
+                                              index <= commit_index_);
+        }
+        return ret;
+    }
+
     Log::Index getNumAllocations() const
     {
         // Remember that index zero contains a special-purpose entry that doesn't count as allocation
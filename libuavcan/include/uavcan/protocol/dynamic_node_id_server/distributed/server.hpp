@@ -27,34 +27,6 @@ class UAVCAN_EXPORT Server : IAllocationRequestHandler
                            , INodeDiscoveryHandler
                            , IRaftLeaderMonitor
 {
-    struct UniqueIDLogPredicate
-    {
-        const UniqueID unique_id;
-
-        UniqueIDLogPredicate(const UniqueID& uid)
-            : unique_id(uid)
-        { }
-
-        bool operator()(const RaftCore::LogEntryInfo& info) const
-        {
-            return info.entry.unique_id == unique_id;
-        }
-    };
-
-    struct NodeIDLogPredicate
-    {
-        const NodeID node_id;
-
-        NodeIDLogPredicate(const NodeID& nid)
-            : node_id(nid)
-        { }
-
-        bool operator()(const RaftCore::LogEntryInfo& info) const
-        {
-            return info.entry.node_id == node_id.get();
-        }
-    };
-
     /*
      * Constants
      */
@@ -107,8 +79,7 @@ class UAVCAN_EXPORT Server : IAllocationRequestHandler
          * and try to find the node that requested allocation. If the node is found, response will be sent;
          * otherwise the request will be ignored because only leader can add new allocations.
          */
-        const LazyConstructor<RaftCore::LogEntryInfo> result =
-            raft_core_.traverseLogFromEndUntil(UniqueIDLogPredicate(unique_id));
+        const LazyConstructor<RaftCore::LogEntryInfo> result = raft_core_.findLogEntryByUniqueID(unique_id);
 
          if (result.isConstructed())
          {
@@ -145,8 +116,7 @@ class UAVCAN_EXPORT Server : IAllocationRequestHandler
 
     virtual NodeAwareness checkNodeAwareness(NodeID node_id) const
     {
-        const LazyConstructor<RaftCore::LogEntryInfo> result =
-            raft_core_.traverseLogFromEndUntil(NodeIDLogPredicate(node_id));
+        const LazyConstructor<RaftCore::LogEntryInfo> result = raft_core_.findLogEntryByNodeID(node_id);
         if (result.isConstructed())
         {
             return result->committed ? NodeAwarenessKnownAndCommitted : NodeAwarenessKnownButNotCommitted;
@@ -159,7 +129,7 @@ class UAVCAN_EXPORT Server : IAllocationRequestHandler
 
     virtual void handleNewNodeDiscovery(const UniqueID* unique_id_or_null, NodeID node_id)
     {
-        if (raft_core_.traverseLogFromEndUntil(NodeIDLogPredicate(node_id)).isConstructed())
+        if (raft_core_.findLogEntryByNodeID(node_id).isConstructed())
         {
             UAVCAN_ASSERT(0);   // Such node is already known, the class that called this method should have known that
             return;
@@ -191,8 +161,7 @@ class UAVCAN_EXPORT Server : IAllocationRequestHandler
             return;
         }
 
-        const LazyConstructor<RaftCore::LogEntryInfo> result =
-            raft_core_.traverseLogFromEndUntil(NodeIDLogPredicate(node_.getNodeID()));
+        const LazyConstructor<RaftCore::LogEntryInfo> result = raft_core_.findLogEntryByNodeID(node_.getNodeID());
 
         if (!result.isConstructed())
         {
@@ -207,7 +176,7 @@ class UAVCAN_EXPORT Server : IAllocationRequestHandler
     {
         UAVCAN_TRACE("dynamic_node_id_server::distributed::Server",
                      "Testing if node ID %d is taken", int(node_id.get()));
-        return raft_core_.traverseLogFromEndUntil(NodeIDLogPredicate(node_id));
+        return raft_core_.findLogEntryByNodeID(node_id);
     }
 
     void allocateNewNode(const UniqueID& unique_id, const NodeID preferred_node_id)
@@ -265,7 +234,7 @@ public:
         own_unique_id_ = own_unique_id;
 
         const LazyConstructor<RaftCore::LogEntryInfo> own_log_entry =
-            raft_core_.traverseLogFromEndUntil(NodeIDLogPredicate(node_.getNodeID()));
+            raft_core_.findLogEntryByNodeID(node_.getNodeID());
 
         if (own_log_entry.isConstructed())
         {
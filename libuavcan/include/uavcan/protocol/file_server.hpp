@@ -18,6 +18,26 @@
 
 namespace uavcan
 {
+/**
+ * Asynchronous file server backends report completion of read operations via this interface;
+ * see @ref IFileServerBackend::startRead().
+ */
+class UAVCAN_EXPORT IFileReadCompletionHandler
+{
+public:
+    /**
+     * This method must be invoked from the node thread.
+     * @param token     The token that was passed to @ref IFileServerBackend::startRead().
+     * @param error     Same as the return value of @ref IFileServerBackend::read().
+     * @param data      The data that was read; can be NULL if the size is zero.
+     * @param size      Number of bytes read; must not exceed @ref IFileServerBackend::ReadSize.
+     */
+    virtual void handleReadCompletion(const ServiceResponseToken& token, int16_t error,
+                                      const uint8_t* data, uint16_t size) = 0;
+
+    virtual ~IFileReadCompletionHandler() { }
+};
+
 /**
  * The file server backend should implement this interface.
  * Note that error codes returned by these methods are defined in uavcan.protocol.file.Error; these are
@@ -59,6 +79,41 @@ public:
 
     // Methods below are optional.
 
+    /**
+     * Backends that can execute reads asynchronously (e.g. in other threads) should return true.
+     * In this case, the file server will use @ref startRead() instead of @ref read() when possible, so that
+     * slow storage does not block the node thread.
+     * Implementation of this method is NOT required; by default it returns false.
+     */
+    virtual bool isAsyncReadSupported() const { return false; }
+
+    /**
+     * Asynchronous backend for uavcan.protocol.file.Read.
+     * If the method returns true, the backend must read up to @ref ReadSize bytes, same as @ref read(),
+     * and then report the result via the handler exactly once, from the node thread.
+     * If the method returns false (e.g. if the backend is overloaded), the file server will fall back to @ref read().
+     * Implementation of this method is NOT required; by default it returns false.
+     */
+    virtual bool startRead(const Path& path, const uint64_t offset, const ServiceResponseToken& token,
+                           IFileReadCompletionHandler& handler)
+    {
+        (void)path;
+        (void)offset;
+        (void)token;
+        (void)handler;
+        return false;
+    }
+
+    /**
+     * Reads that were started with this handler must not be reported anymore.
+     * This method is invoked by the file server when it is being destroyed.
+     * Implementation of this method is required if @ref startRead() is implemented.
+     */
+    virtual void cancelReads(IFileReadCompletionHandler& handler)
+    {
+        (void)handler;
+    }
+
     /**
      * Backend for uavcan.protocol.file.Write.
      * Implementation of this method is NOT required; by default it returns uavcan.protocol.file.Error.NOT_IMPLEMENTED.
@@ -108,8 +163,11 @@ public:
  *      uavcan.protocol.file.GetInfo
  *      uavcan.protocol.file.Read
  * Also see @ref IFileServerBackend.
+ *
+ * If the backend supports asynchronous reads, responses to uavcan.protocol.file.Read are deferred until the
+ * backend reports completion (see @ref ServiceServer::deferResponse()).
  */
-class BasicFileServer
+class BasicFileServer : private IFileReadCompletionHandler
 {
     typedef MethodBinder<BasicFileServer*,
         void (BasicFileServer::*)(const protocol::file::GetInfo::Request&, protocol::file::GetInfo::Response&)>
@@ -120,14 +178,14 @@ class BasicFileServer
             ReadCallback;
 
     ServiceServer<protocol::file::GetInfo, GetInfoCallback> get_info_srv_;
-    ServiceServer<protocol::file::Read, ReadCallback> read_srv_;
+    ServiceServer<protocol::file::Read, ReadCallback, true> read_srv_;
 
     void handleGetInfo(const protocol::file::GetInfo::Request& req, protocol::file::GetInfo::Response& resp)
     {
         resp.error.value = backend_.getInfo(req.path.path, resp.size, resp.entry_type);
     }
 
-    void handleRead(const protocol::file::Read::Request& req, protocol::file::Read::Response& resp)
+    void performRead(const protocol::file::Read::Request& req, protocol::file::Read::Response& resp)
     {
         uint16_t inout_size = resp.data.capacity();
 
@@ -151,6 +209,53 @@ class BasicFileServer
         }
     }
 
+    void handleRead(const protocol::file::Read::Request& req, protocol::file::Read::Response& resp)
+    {
+        if (backend_.isAsyncReadSupported())
+        {
+            const ServiceResponseToken token = read_srv_.deferResponse();
+            if (token.isValid())
+            {
+                if (backend_.startRead(req.path.path, req.offset, token, *this))
+                {
+                    return;
+                }
+                // The response has been deferred already, so it has to be sent explicitly
+                performRead(req, resp);
+                (void)read_srv_.respond(token, resp);
+                return;
+            }
+        }
+        performRead(req, resp);
+    }
+
+    virtual void handleReadCompletion(const ServiceResponseToken& token, int16_t error,
+                                      const uint8_t* data, uint16_t size)
+    {
+        protocol::file::Read::Response resp;
+        resp.error.value = error;
+
+        if (resp.error.value == protocol::file::Error::OK)
+        {
+            if ((size > resp.data.capacity()) || ((data == NULL) && (size > 0)))
+            {
+                UAVCAN_ASSERT(0);
+                resp.error.value = protocol::file::Error::UNKNOWN_ERROR;
+            }
+            else
+            {
+                resp.data.resize(size);
+                (void)copy(data, data + size, resp.data.begin());
+            }
+        }
+
+        const int res = read_srv_.respond(token, resp);
+        if (res < 0)
+        {
+            UAVCAN_TRACE("BasicFileServer", "Failed to respond to async read: %i", res);
+        }
+    }
+
 protected:
     IFileServerBackend& backend_;       ///< Derived types can use it
 
@@ -161,6 +266,8 @@ public:
         , backend_(backend)
     { }
 
+    virtual ~BasicFileServer() { backend_.cancelReads(*this); }
+
     int start()
     {
         int res = get_info_srv_.start(GetInfoCallback(this, &BasicFileServer::handleGetInfo));
@@ -8,6 +8,7 @@
 #include <uavcan/build_config.hpp>
 #include <uavcan/debug.hpp>
 #include <uavcan/util/multiset.hpp>
+#include <uavcan/util/bitset.hpp>
 #include <uavcan/node/service_client.hpp>
 #include <uavcan/node/timer.hpp>
 #include <uavcan/protocol/node_status_monitor.hpp>
@@ -58,6 +59,30 @@ public:
     virtual ~INodeInfoListener() { }
 };
 
+/**
+ * Persistent storage of GetNodeInfo responses, which allows to avoid re-requesting node info from all nodes
+ * every time the application restarts. Refer to @ref NodeInfoRetriever::setCache() for details.
+ * The implementation is platform specific; e.g. for POSIX see uavcan_posix::FileNodeInfoCache.
+ */
+class UAVCAN_EXPORT INodeInfoCache
+{
+public:
+    /**
+     * Reads the cached response for the specified node, and the UTC time when it was cached.
+     * @return Non-negative on success, negative error code if there is no cached response.
+     */
+    virtual int get(NodeID node_id, protocol::GetNodeInfo::Response& out_node_info, UtcTime& out_cached_at) = 0;
+
+    /**
+     * Stores the response for the specified node, replacing the previously cached one.
+     * The cache time must be stored along with the response; it can be zero if the UTC time is not known.
+     * @return Non-negative on success, negative error code on failure.
+     */
+    virtual int put(NodeID node_id, const protocol::GetNodeInfo::Response& node_info, UtcTime cached_at) = 0;
+
+    virtual ~INodeInfoCache() { }
+};
+
 /**
  * This class automatically retrieves a response to GetNodeInfo once a node appears online or restarts.
  * It does a number of attempts in case if there's a communication failure before assuming that the node does not
@@ -86,6 +111,24 @@ public:
  *
  * Note that all nodes are queried in a round-robin fashion, regardless of their uptime, number of requests made, etc.
  *
+ * Optionally, the requests can be issued within a concurrency window instead, see @ref setMaxConcurrentRequests().
+ * In this mode the class keeps up to (window size) requests in flight, issuing the next request as soon as
+ * a response is received, rather than once per request interval. The window size adapts to the conditions:
+ *  - it grows by one with every response that arrives within the target latency, up to the configured maximum;
+ *  - it shrinks by one with every response that arrives later than that;
+ *  - it shrinks by one every request interval while the local CAN TX queue is not empty, i.e. the bus is busy.
+ * Timeouts do not affect the window, since they are normally caused by nodes that don't implement the service.
+ * This allows to discover a large number of nodes much faster than with the default request interval, e.g. after
+ * a bus-wide power-up.
+ *
+ * If a cache is configured (see @ref setCache()), nodes that appear online for the first time since the class
+ * was started are looked up in the cache before being queried. A cached response is used only if the node has not
+ * restarted since the response was cached, i.e. its current uptime is not lower than the uptime in the cached
+ * response plus the UTC time elapsed since the response was cached (with a tolerance of a few seconds, see
+ * CacheUptimeToleranceSec). If the elapsed time cannot be determined, e.g. because the UTC time is not known,
+ * the node is queried. Note that the software and hardware versions of a node cannot change without a restart.
+ * Every received response is written to the cache along with the current UTC time.
+ *
  * Events from this class can be routed to many listeners, @ref INodeInfoListener.
  */
 class UAVCAN_EXPORT NodeInfoRetriever : public NodeStatusMonitor
@@ -94,6 +137,13 @@ class UAVCAN_EXPORT NodeInfoRetriever : public NodeStatusMonitor
 public:
     enum { MaxNumRequestAttempts = 254 };
     enum { UnlimitedRequestAttempts = 0 };
+    enum { MaxConcurrentRequestsLimit = 16 };
+
+    /**
+     * Allowed discrepancy between the uptime reported by a node and the uptime expected from the cached response,
+     * which is due to the uptime resolution and the UTC time error.
+     */
+    enum { CacheUptimeToleranceSec = 2 };
 
 private:
     typedef MethodBinder<NodeInfoRetriever*,
@@ -158,6 +208,18 @@ private:
 
     enum { DefaultNumRequestAttempts = 16 };
     enum { DefaultTimerIntervalMSec = 40 };  ///< Read explanation in the class documentation
+    enum { DefaultTargetResponseLatencyMSec = 100 };
+
+    /**
+     * Start time of a pending request, needed to measure the response latency.
+     */
+    struct PendingRequest
+    {
+        MonotonicTime started_at;
+        uint8_t node_id;                        ///< Zero if the slot is free
+
+        PendingRequest() : node_id(0) { }
+    };
 
     /*
      * State
@@ -166,6 +228,9 @@ private:
 
     Multiset<INodeInfoListener*> listeners_;
 
+    INodeInfoCache* cache_;
+    BitSet<NodeID::Max + 1> cache_lookup_done_mask_;      ///< The cache is consulted only once per node
+
     ServiceClient<protocol::GetNodeInfo, GetNodeInfoResponseCallback> get_node_info_client_;
 
     MonotonicDuration request_interval_;
@@ -174,6 +239,26 @@ private:
 
     uint8_t num_attempts_;
 
+    /*
+     * Concurrency window; disabled if the maximum is zero
+     */
+    uint8_t max_concurrent_requests_;
+    uint8_t request_window_;
+    MonotonicDuration target_response_latency_;
+    PendingRequest pending_requests_[MaxConcurrentRequestsLimit];
+
+    /*
+     * Metrics
+     */
+    MonotonicTime discovery_started_at_;
+    MonotonicDuration last_discovery_duration_;
+    MonotonicDuration smoothed_response_latency_;
+    uint32_t num_responses_;
+    uint32_t num_failed_requests_;
+    uint32_t num_cache_hits_;
+    uint32_t num_cache_misses_;
+    bool discovery_in_progress_;
+
     /*
      * Methods
      */
@@ -187,8 +272,38 @@ private:
         return entries_[node_id.get() - 1];
     }
 
+    bool isWindowEnabled() const { return max_concurrent_requests_ > 0; }
+
+    bool isAnyRequestNeeded() const
+    {
+        for (unsigned i = 0; i < (sizeof(entries_) / sizeof(entries_[0])); i++)
+        {
+            if (entries_[i].request_needed)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void updateDiscoveryProgress()
+    {
+        if (discovery_in_progress_ && !isAnyRequestNeeded())
+        {
+            discovery_in_progress_ = false;
+            last_discovery_duration_ = get_node_info_client_.getNode().getMonotonicTime() - discovery_started_at_;
+            UAVCAN_TRACE("NodeInfoRetriever", "Discovery completed in %s sec",
+                         last_discovery_duration_.toString().c_str());
+        }
+    }
+
     void startTimerIfNotRunning()
     {
+        if (!discovery_in_progress_)
+        {
+            discovery_in_progress_ = true;
+            discovery_started_at_ = get_node_info_client_.getNode().getMonotonicTime();
+        }
         if (!TimerBase::isRunning())
         {
             TimerBase::startPeriodic(request_interval_);
@@ -228,29 +343,153 @@ private:
         return NodeID();        // No node could be found
     }
 
+    void sendRequest(NodeID node_id)
+    {
+        getEntry(node_id).updated_since_last_attempt = false;
+        const int res = get_node_info_client_.call(node_id, protocol::GetNodeInfo::Request());
+        if (res < 0)
+        {
+            get_node_info_client_.getNode().registerInternalFailure("NodeInfoRetriever GetNodeInfo call");
+            return;
+        }
+
+        for (unsigned i = 0; i < MaxConcurrentRequestsLimit; i++)
+        {
+            if (pending_requests_[i].node_id == 0)
+            {
+                pending_requests_[i].node_id = node_id.get();
+                pending_requests_[i].started_at = get_node_info_client_.getNode().getMonotonicTime();
+                break;
+            }
+        }
+        // If there's no free slot, the latency of this request will not be measured
+    }
+
+    /**
+     * Returns false if the latency of the request could not be measured.
+     */
+    bool takeResponseLatency(NodeID node_id, MonotonicDuration& out_latency)
+    {
+        for (unsigned i = 0; i < MaxConcurrentRequestsLimit; i++)
+        {
+            if (pending_requests_[i].node_id == node_id.get())
+            {
+                out_latency = get_node_info_client_.getNode().getMonotonicTime() - pending_requests_[i].started_at;
+                pending_requests_[i] = PendingRequest();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void updateRequestWindow(MonotonicDuration response_latency)
+    {
+        if (response_latency <= target_response_latency_)
+        {
+            request_window_ = min(static_cast<uint8_t>(request_window_ + 1U), max_concurrent_requests_);
+        }
+        else
+        {
+            request_window_ = max(static_cast<uint8_t>(request_window_ - 1U), static_cast<uint8_t>(1U));
+        }
+    }
+
+    /**
+     * Issues new requests until the window is full or there are no nodes to query.
+     * Returns false if no more requests are needed.
+     */
+    bool fillRequestWindow()
+    {
+        bool at_least_one_request_needed = false;
+        while (get_node_info_client_.getNumPendingCalls() < request_window_)
+        {
+            const NodeID next = pickNextNodeToQuery(at_least_one_request_needed);
+            if (!next.isUnicast())
+            {
+                break;
+            }
+            sendRequest(next);
+        }
+        return at_least_one_request_needed || (get_node_info_client_.getNumPendingCalls() >= request_window_);
+    }
+
+    bool isTxQueueBusy()
+    {
+        return get_node_info_client_.getNode().getDispatcher().getCanIOManager().makePendingTxMask() != 0;
+    }
+
     virtual void handleTimerEvent(const TimerEvent&)
     {
         bool at_least_one_request_needed = false;
-        const NodeID next = pickNextNodeToQuery(at_least_one_request_needed);
 
-        if (next.isUnicast())
+        if (isWindowEnabled())
         {
-            UAVCAN_ASSERT(at_least_one_request_needed);
-            getEntry(next).updated_since_last_attempt = false;
-            const int res = get_node_info_client_.call(next, protocol::GetNodeInfo::Request());
-            if (res < 0)
+            if (isTxQueueBusy() && (request_window_ > 1))
             {
-                get_node_info_client_.getNode().registerInternalFailure("NodeInfoRetriever GetNodeInfo call");
+                request_window_--;
+                UAVCAN_TRACE("NodeInfoRetriever", "TX queue is busy, window %d", int(request_window_));
             }
+            at_least_one_request_needed = fillRequestWindow();
         }
         else
         {
-            if (!at_least_one_request_needed)
+            const NodeID next = pickNextNodeToQuery(at_least_one_request_needed);
+            if (next.isUnicast())
             {
-                TimerBase::stop();
-                UAVCAN_TRACE("NodeInfoRetriever", "Timer stopped");
+                UAVCAN_ASSERT(at_least_one_request_needed);
+                sendRequest(next);
             }
         }
+
+        if (!at_least_one_request_needed)
+        {
+            TimerBase::stop();
+            UAVCAN_TRACE("NodeInfoRetriever", "Timer stopped");
+            updateDiscoveryProgress();
+        }
+    }
+
+    /**
+     * Returns true if the node info was found in the cache; the listeners will be notified in this case.
+     */
+    bool retrieveFromCache(const ReceivedDataStructure<protocol::NodeStatus>& msg)
+    {
+        const NodeID node_id = msg.getSrcNodeID();
+        cache_lookup_done_mask_[node_id.get()] = true;
+
+        protocol::GetNodeInfo::Response node_info;
+        UtcTime cached_at;
+        if (cache_->get(node_id, node_info, cached_at) < 0)
+        {
+            return false;
+        }
+
+        /*
+         * If the node hasn't restarted, its uptime must have grown by at least the time elapsed since caching.
+         * Checking only that the uptime has not decreased would accept nodes that restarted a short time ago.
+         */
+        const UtcTime now = get_node_info_client_.getNode().getUtcTime();
+        if (cached_at.isZero() || now.isZero() || (now < cached_at))
+        {
+            UAVCAN_TRACE("NodeInfoRetriever", "Cached info of node %d has unknown age", int(node_id.get()));
+            num_cache_misses_++;
+            return false;
+        }
+
+        const uint64_t elapsed_sec = uint64_t((now - cached_at).toUSec()) / 1000000U;
+        const uint64_t min_expected_uptime_sec = uint64_t(node_info.status.uptime_sec) + elapsed_sec;
+        if ((uint64_t(msg.uptime_sec) + CacheUptimeToleranceSec) < min_expected_uptime_sec)
+        {
+            UAVCAN_TRACE("NodeInfoRetriever", "Cached info of node %d is outdated", int(node_id.get()));
+            num_cache_misses_++;
+            return false;
+        }
+
+        UAVCAN_TRACE("NodeInfoRetriever", "Node info of node %d retrieved from the cache", int(node_id.get()));
+        num_cache_hits_++;
+        node_info.status = msg;                 // The cached status is obsolete
+        listeners_.forEach(NodeInfoRetrievedHandlerCaller(node_id, node_info));
+        return true;
     }
 
     virtual void handleNodeStatusChange(const NodeStatusChangeEvent& event)
@@ -296,14 +535,44 @@ private:
 
         listeners_.forEach(GenericHandlerCaller<const ReceivedDataStructure<protocol::NodeStatus>&>(
             &INodeInfoListener::handleNodeStatusMessage, msg));
+
+        if ((cache_ != NULL) && entry.request_needed && (entry.num_attempts_made == 0) &&
+            !cache_lookup_done_mask_[msg.getSrcNodeID().get()])
+        {
+            if (retrieveFromCache(msg))
+            {
+                entry.request_needed = false;   // The timer will stop itself
+                updateDiscoveryProgress();
+            }
+        }
+
+        if (isWindowEnabled() && entry.request_needed)
+        {
+            (void)fillRequestWindow();          // No need to wait for the timer if the window is not full
+        }
     }
 
     void handleGetNodeInfoResponse(const ServiceCallResult<protocol::GetNodeInfo>& result)
     {
         Entry& entry = getEntry(result.getCallID().server_node_id);
 
+        MonotonicDuration latency;
+        const bool latency_known = takeResponseLatency(result.getCallID().server_node_id, latency);
+
         if (result.isSuccessful())
         {
+            num_responses_++;
+            if (latency_known)
+            {
+                // Exponential moving average, same as the smoothed round trip time in TCP
+                smoothed_response_latency_ = smoothed_response_latency_.isZero() ? latency :
+                    MonotonicDuration::fromUSec((smoothed_response_latency_.toUSec() * 7 + latency.toUSec()) / 8);
+                if (isWindowEnabled())
+                {
+                    updateRequestWindow(latency);
+                }
+            }
+
             /*
              * Updating the uptime here allows to properly handle a corner case where the service response arrives
              * after the device has restarted and published its new NodeStatus (although it's unlikely to happen).
@@ -312,9 +581,20 @@ private:
             entry.request_needed = false;
             listeners_.forEach(NodeInfoRetrievedHandlerCaller(result.getCallID().server_node_id,
                                                               result.getResponse()));
+
+            if (cache_ != NULL)
+            {
+                const int res = cache_->put(result.getCallID().server_node_id, result.getResponse(),
+                                            get_node_info_client_.getNode().getUtcTime());
+                if (res < 0)
+                {
+                    UAVCAN_TRACE("NodeInfoRetriever", "Cache write failed: %d", res);
+                }
+            }
         }
         else
         {
+            num_failed_requests_++;
             if (num_attempts_ != UnlimitedRequestAttempts)
             {
                 entry.num_attempts_made++;
@@ -326,6 +606,12 @@ private:
                 }
             }
         }
+
+        if (isWindowEnabled())
+        {
+            (void)fillRequestWindow();
+        }
+        updateDiscoveryProgress();
     }
 
 public:
@@ -333,10 +619,19 @@ public:
         : NodeStatusMonitor(node)
         , TimerBase(node)
         , listeners_(node.getAllocator())
+        , cache_(NULL)
         , get_node_info_client_(node)
         , request_interval_(MonotonicDuration::fromMSec(DefaultTimerIntervalMSec))
         , last_picked_node_(1)
         , num_attempts_(DefaultNumRequestAttempts)
+        , max_concurrent_requests_(0)
+        , request_window_(0)
+        , target_response_latency_(MonotonicDuration::fromMSec(DefaultTargetResponseLatencyMSec))
+        , num_responses_(0)
+        , num_failed_requests_(0)
+        , num_cache_hits_(0)
+        , num_cache_misses_(0)
+        , discovery_in_progress_(false)
     { }
 
     /**
@@ -376,6 +671,11 @@ public:
         {
             entries_[i] = Entry();
         }
+        for (unsigned i = 0; i < MaxConcurrentRequestsLimit; i++)
+        {
+            pending_requests_[i] = PendingRequest();
+        }
+        discovery_in_progress_ = false;
         // It is not necessary to reset the last picked node index
     }
 
@@ -414,6 +714,13 @@ public:
 
     unsigned getNumListeners() const { return listeners_.getSize(); }
 
+    /**
+     * Configures the persistent cache of node info, see the class documentation. NULL disables the cache (default).
+     * The cache object must outlive this class.
+     */
+    void setCache(INodeInfoCache* cache) { cache_ = cache; }
+    INodeInfoCache* getCache() const { return cache_; }
+
     /**
      * Number of attempts to retrieve GetNodeInfo response before giving up on the assumption that the service is
      * not implemented.
@@ -446,6 +753,61 @@ public:
         }
     }
 
+    /**
+     * Maximum number of requests that can be in flight at the same time; see the class documentation.
+     * Zero disables the concurrency window, in which case the class issues one request per request interval.
+     * The window is disabled by default. The maximum is @ref MaxConcurrentRequestsLimit.
+     */
+    uint8_t getMaxConcurrentRequests() const { return max_concurrent_requests_; }
+    void setMaxConcurrentRequests(const uint8_t num)
+    {
+        max_concurrent_requests_ = min(static_cast<uint8_t>(MaxConcurrentRequestsLimit), num);
+        request_window_ = max_concurrent_requests_;
+    }
+
+    /**
+     * Current size of the adaptive concurrency window; zero if the window is disabled.
+     */
+    uint8_t getRequestWindow() const { return request_window_; }
+
+    /**
+     * The concurrency window shrinks if responses take longer than this.
+     */
+    MonotonicDuration getTargetResponseLatency() const { return target_response_latency_; }
+    void setTargetResponseLatency(const MonotonicDuration latency)
+    {
+        if (latency.isPositive())
+        {
+            target_response_latency_ = latency;
+        }
+        else
+        {
+            UAVCAN_ASSERT(0);
+        }
+    }
+
+    /**
+     * Time to full discovery: from the moment when a request became needed while there were no other requests
+     * needed, until the moment when all nodes either responded or were recognized as not supporting GetNodeInfo.
+     * Returns zero if no discovery has been completed yet.
+     */
+    MonotonicDuration getLastDiscoveryDuration() const { return last_discovery_duration_; }
+
+    /**
+     * Exponential moving average of the GetNodeInfo response latency.
+     */
+    MonotonicDuration getSmoothedResponseLatency() const { return smoothed_response_latency_; }
+
+    uint32_t getNumResponses() const { return num_responses_; }
+    uint32_t getNumFailedRequests() const { return num_failed_requests_; }
+
+    /**
+     * Number of nodes whose info was taken from the cache, and the number of nodes whose cached info was found
+     * to be outdated.
+     */
+    uint32_t getNumCacheHits() const { return num_cache_hits_; }
+    uint32_t getNumCacheMisses() const { return num_cache_misses_; }
+
     /**
      * These methods are needed mostly for testing.
      */
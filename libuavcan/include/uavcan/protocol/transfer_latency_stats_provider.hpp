@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#ifndef UAVCAN_PROTOCOL_TRANSFER_LATENCY_STATS_PROVIDER_HPP_INCLUDED
+#define UAVCAN_PROTOCOL_TRANSFER_LATENCY_STATS_PROVIDER_HPP_INCLUDED
+
+#include <uavcan/build_config.hpp>
+#include <uavcan/node/service_server.hpp>
+#include <uavcan/util/method_binder.hpp>
+#include <uavcan/transport/transfer_latency_stats.hpp>
+
+namespace uavcan
+{
+/**
+ * This class provides the latency statistics collected on the local node, see @ref TransferLatencyStats.
+ *
+ * The standard data type set has no service for that, so the application must define a vendor-specific service
+ * data type with the following fields:
+ *
+ *     uint16 index                # Entry index, see TransferLatencyStats::getByIndex()
+ *     uint8 latency_kind          # See TransferLatencyKind
+ *     ---
+ *     uint16 data_type_id
+ *     uint8 data_type_kind        # Same values as uavcan.protocol.DataTypeKind
+ *     uint64 num_samples
+ *     uint64 sum_usec
+ *     uint32 max_usec
+ *     uint32[<=16] buckets        # See LatencyHistogram; empty if there's no such entry
+ *
+ * The caller is expected to request the entries starting from zero until an empty response is received.
+ * All responses are empty if the collection of the statistics is not enabled.
+ *
+ * @tparam DataType_    Service data type with the fields listed above.
+ */
+template <typename DataType_>
+class UAVCAN_EXPORT TransferLatencyStatsProvider : Noncopyable
+{
+    typedef MethodBinder<const TransferLatencyStatsProvider*,
+                         void (TransferLatencyStatsProvider::*)(const typename DataType_::Request&,
+                                                                typename DataType_::Response&) const>
+            GetStatsCallback;
+
+    ServiceServer<DataType_, GetStatsCallback> srv_;
+
+    void handleGetStats(const typename DataType_::Request& req, typename DataType_::Response& resp) const
+    {
+        const TransferLatencyStats* const stats =
+            srv_.getNode().getDispatcher().getTransferPerfCounter().getLatencyStats();
+        if ((stats == NULL) || (req.latency_kind >= NumTransferLatencyKinds))
+        {
+            return;
+        }
+        const TransferLatencyStats::Entry* const entry = stats->getByIndex(req.index);
+        if (entry == NULL)
+        {
+            return;
+        }
+        const LatencyHistogram& hist = entry->histograms[req.latency_kind];
+
+        resp.data_type_id = entry->data_type_id.get();
+        resp.data_type_kind = uint8_t(entry->data_type_kind);
+        resp.num_samples = hist.getNumSamples();
+        resp.sum_usec = hist.getSumUSec();
+        resp.max_usec = hist.getMaxUSec();
+        for (uint8_t i = 0; i < LatencyHistogram::NumBuckets; i++)
+        {
+            resp.buckets.push_back(hist.getBucket(i));
+        }
+    }
+
+public:
+    explicit TransferLatencyStatsProvider(INode& node)
+        : srv_(node)
+    { }
+
+    /**
+     * Once started, this class requires no further attention.
+     * Returns negative error code.
+     */
+    int start()
+    {
+        return srv_.start(GetStatsCallback(this, &TransferLatencyStatsProvider::handleGetStats));
+    }
+};
+
+}
+
+#endif // UAVCAN_PROTOCOL_TRANSFER_LATENCY_STATS_PROVIDER_HPP_INCLUDED
@@ -34,6 +34,12 @@ namespace uavcan
  * @ref MaxCanAcceptanceFilters. The algorithm doesn't allow to have higher number of HW filters configurations than
  * defined by MaxCanAcceptanceFilters. You can change this value according to the number specified in your CAN driver
  * datasheet.
+ *
+ * By default, configurations are merged so that the resulting masks are as specific as possible. This ignores how
+ * much irrelevant traffic every merged filter will let through. If the traffic on the bus is known, either from the
+ * application design or sampled with @ref CanTrafficSampler, it can be supplied via addTrafficSample(); then the
+ * strategy @ref MinimizeFalseAccepts picks the merges that let through the least amount of unwanted frames.
+ * The predicted rate of accepted frames can be compared against the measured one, see getPredictedAcceptedTraffic().
  */
 class CanAcceptanceFilterConfigurator
 {
@@ -47,6 +53,15 @@ public:
         IgnoreAnonymousMessages
     };
 
+    /**
+     * Defines how configurations are merged if there are more of them than hardware filters.
+     */
+    enum MergeStrategy
+    {
+        MaximizeMaskBits,       ///< Default; merges the pair of configurations that yields the most specific mask
+        MinimizeFalseAccepts    ///< Merges the pair that lets through the least unwanted traffic, then as above
+    };
+
 private:
     /**
      * Below constants based on UAVCAN transport layer specification. Masks and ID's depends on message
@@ -71,10 +86,45 @@ private:
 
     typedef uavcan::Multiset<CanFilterConfig> MultisetConfigContainer;
 
-    static CanFilterConfig mergeFilters(CanFilterConfig& a_, CanFilterConfig& b_);
+    /**
+     * Traffic of one CAN ID. The flag is used by the merging algorithm.
+     */
+    struct TrafficEntry
+    {
+        uint32_t can_id;
+        uint32_t rate;
+        bool accepted;
+
+        TrafficEntry(uint32_t arg_can_id, uint32_t arg_rate)
+            : can_id(arg_can_id)
+            , rate(arg_rate)
+            , accepted(false)
+        { }
+
+        bool operator==(const TrafficEntry& rhs) const { return can_id == rhs.can_id; }
+    };
+
+    typedef uavcan::Multiset<TrafficEntry> MultisetTrafficContainer;
+
+    struct TrafficEntryCanIDPredicate;
+    struct AcceptedTrafficCounter;
+    struct UnacceptedTrafficCounter;
+    struct TrafficAcceptanceResetter;
+    struct TrafficAcceptanceUpdater;
+
+    static CanFilterConfig mergeFilters(const CanFilterConfig& a_, const CanFilterConfig& b_);
     static uint8_t countBits(uint32_t n_);
+    static bool isAccepted(const CanFilterConfig& config, uint32_t can_id)
+    {
+        return ((can_id ^ config.id) & config.mask) == 0;
+    }
     uint16_t getNumFilters() const;
 
+    /**
+     * Rate of the traffic that is accepted by the merged configuration and was not accepted before the merge.
+     */
+    uint64_t computeMergeCost(const CanFilterConfig& merged) const;
+
     /**
      * Fills the multiset_configs_ to proceed it with mergeConfigurations()
      */
@@ -88,7 +138,10 @@ private:
 
     INode& node_;               //< Node reference is needed for access to ICanDriver and Dispatcher
     MultisetConfigContainer multiset_configs_;
+    MultisetTrafficContainer traffic_;
+    uint64_t required_traffic_;
     uint16_t filters_number_;
+    MergeStrategy merge_strategy_;
 
 public:
     /**
@@ -101,7 +154,10 @@ public:
     explicit CanAcceptanceFilterConfigurator(INode& node, uint16_t filters_number = 0)
         : node_(node)
         , multiset_configs_(node.getAllocator())
+        , traffic_(node.getAllocator())
+        , required_traffic_(0)
         , filters_number_(filters_number)
+        , merge_strategy_(MaximizeMaskBits)
     { }
 
     /**
@@ -139,8 +195,177 @@ public:
     {
         return multiset_configs_;
     }
+
+    /**
+     * Merge strategy, see @ref MergeStrategy. Must be set before @ref computeConfiguration().
+     */
+    MergeStrategy getMergeStrategy() const { return merge_strategy_; }
+    void setMergeStrategy(MergeStrategy strategy) { merge_strategy_ = strategy; }
+
+    /**
+     * Adds the observed or expected rate of frames with the specified CAN ID, including the flags (@ref CanFrame).
+     * The rate can be expressed in any units, e.g. frames per second or the number of frames received within the
+     * sampling period, as long as all samples use the same units. Adding the same CAN ID again accumulates the rate.
+     * Frames with CAN IDs that were not added are assumed to be absent on the bus.
+     * @return 0 = success, negative for error.
+     */
+    int addTrafficSample(uint32_t can_id, uint32_t rate);
+
+    void clearTrafficSamples() { traffic_.clear(); }
+
+    unsigned getNumTrafficSamples() const { return traffic_.getSize(); }
+
+    /**
+     * Rate of the frames that will pass the current configuration, according to the traffic samples.
+     * Once the configuration is applied, this can be compared with the rate of the frames that are actually
+     * received, e.g. using @ref CanTrafficSampler.
+     */
+    uint64_t getPredictedAcceptedTraffic() const;
+
+    /**
+     * Rate of the frames that passed the configuration before it was merged, according to the traffic samples,
+     * i.e. the frames that the node actually needs. The difference between the predicted accepted traffic
+     * and this value is the expected rate of false accepts.
+     */
+    uint64_t getRequiredTraffic() const { return required_traffic_; }
 };
 
+#if !UAVCAN_TINY
+/**
+ * This class counts the received CAN frames per CAN ID; it can be used to supply the traffic samples to
+ * @ref CanAcceptanceFilterConfigurator, and to measure the rate of accepted frames once the filters are applied.
+ * Note that the sampler can only see the frames that pass the hardware acceptance filters; therefore, in order
+ * to sample all traffic on the bus, the sampling must be done before the filters are configured.
+ *
+ * The sampler is installed as the RX frame listener of the node (see @ref Dispatcher::installRxFrameListener()),
+ * replacing the previous one, if any. Loopback frames are ignored.
+ *
+ * @tparam Capacity     Maximum number of distinct CAN IDs. Frames of CAN IDs that don't fit are counted as
+ *                      untracked.
+ */
+template <unsigned Capacity = 64>
+class UAVCAN_EXPORT CanTrafficSampler : public IRxFrameListener
+                                      , Noncopyable
+{
+    struct Entry
+    {
+        uint32_t can_id;
+        uint32_t num_frames;
+    };
+
+    INode& node_;
+    MonotonicTime started_at_;
+    Entry entries_[Capacity];
+    unsigned num_entries_;
+    uint32_t num_frames_;
+    uint32_t num_untracked_frames_;
+
+    virtual void handleRxFrame(const CanRxFrame& frame, CanIOFlags flags)
+    {
+        if ((flags & CanIOFlagLoopback) != 0)
+        {
+            return;
+        }
+        num_frames_++;
+
+        for (unsigned i = 0; i < num_entries_; i++)
+        {
+            if (entries_[i].can_id == frame.id)
+            {
+                entries_[i].num_frames++;
+                return;
+            }
+        }
+
+        if (num_entries_ < Capacity)
+        {
+            entries_[num_entries_].can_id = frame.id;
+            entries_[num_entries_].num_frames = 1;
+            num_entries_++;
+        }
+        else
+        {
+            num_untracked_frames_++;
+        }
+    }
+
+public:
+    explicit CanTrafficSampler(INode& node)
+        : node_(node)
+        , num_entries_(0)
+        , num_frames_(0)
+        , num_untracked_frames_(0)
+    { }
+
+    virtual ~CanTrafficSampler() { stop(); }
+
+    /**
+     * Resets the counters and starts sampling.
+     */
+    void start()
+    {
+        reset();
+        node_.getDispatcher().installRxFrameListener(this);
+    }
+
+    void stop()
+    {
+        if (isRunning())
+        {
+            node_.getDispatcher().removeRxFrameListener();
+        }
+    }
+
+    bool isRunning() const { return node_.getDispatcher().getRxFrameListener() == this; }
+
+    void reset()
+    {
+        started_at_ = node_.getMonotonicTime();
+        num_entries_ = 0;
+        num_frames_ = 0;
+        num_untracked_frames_ = 0;
+    }
+
+    /**
+     * Supplies the number of frames per CAN ID to the configurator.
+     * @return 0 = success, negative for error.
+     */
+    int exportTrafficSamples(CanAcceptanceFilterConfigurator& configurator) const
+    {
+        for (unsigned i = 0; i < num_entries_; i++)
+        {
+            const int res = configurator.addTrafficSample(entries_[i].can_id, entries_[i].num_frames);
+            if (res < 0)
+            {
+                return res;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Number of frames with the specified CAN ID.
+     */
+    uint32_t getNumFrames(uint32_t can_id) const
+    {
+        for (unsigned i = 0; i < num_entries_; i++)
+        {
+            if (entries_[i].can_id == can_id)
+            {
+                return entries_[i].num_frames;
+            }
+        }
+        return 0;
+    }
+
+    uint32_t getNumFrames() const { return num_frames_; }
+    uint32_t getNumUntrackedFrames() const { return num_untracked_frames_; }
+    unsigned getNumCanIDs() const { return num_entries_; }
+
+    MonotonicDuration getSamplingDuration() const { return node_.getMonotonicTime() - started_at_; }
+};
+#endif
+
 /**
  * This function is a shortcut for @ref CanAcceptanceFilterConfigurator.
  * It allows to compute filter configuration and then apply it in just one step.
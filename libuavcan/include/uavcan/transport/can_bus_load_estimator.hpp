@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#ifndef UAVCAN_TRANSPORT_CAN_BUS_LOAD_ESTIMATOR_HPP_INCLUDED
+#define UAVCAN_TRANSPORT_CAN_BUS_LOAD_ESTIMATOR_HPP_INCLUDED
+
+#include <uavcan/std.hpp>
+#include <uavcan/build_config.hpp>
+#include <uavcan/driver/can.hpp>
+#include <uavcan/time.hpp>
+
+namespace uavcan
+{
+/**
+ * Estimates the utilization of a CAN bus from the frames that were transmitted or received via one interface.
+ * Every frame is accounted for with its exact length on the wire: the bit stuffing is computed for the actual
+ * identifier, payload and CRC, and the fixed-form fields (CRC delimiter, ACK, EOF) and the interframe space
+ * are added. The worst case length, which does not depend on the frame contents, is also available for analysis.
+ *
+ * The bits are accumulated in a ring of time slots, which allows to compute the utilization over any sliding
+ * window that fits the ring; see @ref getUtilization().
+ *
+ * Note that the frames filtered out by the hardware acceptance filters can't be observed, so the estimate should
+ * be considered a lower bound if the filters are configured.
+ */
+class UAVCAN_EXPORT CanBusLoadEstimator
+{
+public:
+    enum { NumSlots = 16 };
+    enum { DefaultBitRate = 1000000 };
+    enum { DefaultSlotDurationMSec = 100 };
+    enum { MaxUtilization = 1000 };             ///< Utilization is expressed in per mille
+
+    /**
+     * CRC delimiter, ACK slot, ACK delimiter, end of frame, interframe space. These fields are not stuffed.
+     */
+    enum { FrameTrailerBitLength = 13 };
+
+private:
+    struct Slot
+    {
+        uint32_t index;         ///< Number of slot durations since the epoch of the monotonic clock
+        uint32_t num_bits;
+
+        Slot()
+            : index(0)
+            , num_bits(0)
+        { }
+    };
+
+    Slot slots_[NumSlots];
+    uint32_t bit_rate_;
+    MonotonicDuration slot_duration_;
+    uint64_t num_bits_;
+    uint32_t num_frames_;
+
+    uint32_t getSlotIndex(MonotonicTime ts) const
+    {
+        return static_cast<uint32_t>(ts.toUSec() / static_cast<uint64_t>(slot_duration_.toUSec()));
+    }
+
+public:
+    CanBusLoadEstimator()
+        : bit_rate_(DefaultBitRate)
+        , slot_duration_(MonotonicDuration::fromMSec(DefaultSlotDurationMSec))
+        , num_bits_(0)
+        , num_frames_(0)
+    { }
+
+    /**
+     * Exact number of bits the frame occupies on the bus, including the stuff bits and the interframe space.
+     * Error frames are not accounted for, zero will be returned.
+     */
+    static unsigned computeFrameBitLength(const CanFrame& frame);
+
+    /**
+     * Maximum number of bits a data frame with the specified payload length can occupy on the bus, including
+     * the interframe space, assuming the worst case bit stuffing:
+     *      length = g + 8 * dlc + 13 + floor((g + 8 * dlc - 1) / 4)
+     * Where g is 34 for the standard frame format and 54 for the extended frame format.
+     */
+    static unsigned computeWorstCaseFrameBitLength(uint8_t dlc, bool extended);
+
+    /**
+     * Accounts for the frame that was transmitted or received at the specified time.
+     */
+    void addFrame(const CanFrame& frame, MonotonicTime ts);
+
+    /**
+     * Utilization over the sliding window that ends at the specified time, in per mille (see @ref MaxUtilization).
+     * The window is rounded up to an integer number of slots, plus the elapsed part of the current slot.
+     * Windows that don't fit the ring will be truncated, see @ref getMaxWindow().
+     */
+    uint16_t getUtilization(MonotonicTime now, MonotonicDuration window) const;
+
+    /**
+     * Longest window that can be passed to @ref getUtilization().
+     */
+    MonotonicDuration getMaxWindow() const { return slot_duration_ * (NumSlots - 1); }
+
+    /**
+     * Nominal bit rate of the bus; the default is 1 Mbit/s.
+     */
+    uint32_t getBitRate() const { return bit_rate_; }
+    void setBitRate(uint32_t bit_rate);
+
+    /**
+     * Resolution of the sliding window. Changing the slot duration resets the accumulated data.
+     */
+    MonotonicDuration getSlotDuration() const { return slot_duration_; }
+    void setSlotDuration(MonotonicDuration duration);
+
+    void reset();
+
+    /**
+     * Totals since the last reset.
+     */
+    uint64_t getNumBits() const { return num_bits_; }
+    uint32_t getNumFrames() const { return num_frames_; }
+};
+
+}
+
+#endif // UAVCAN_TRANSPORT_CAN_BUS_LOAD_ESTIMATOR_HPP_INCLUDED
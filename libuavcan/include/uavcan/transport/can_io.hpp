@@ -17,6 +17,9 @@
 #include <uavcan/driver/can.hpp>
 #include <uavcan/driver/system_clock.hpp>
 #include <uavcan/time.hpp>
+#include <uavcan/transport/transfer.hpp>
+#include <uavcan/transport/can_bus_load_estimator.hpp>
+#include <uavcan/transport/transfer_latency_stats.hpp>
 
 namespace uavcan
 {
@@ -48,12 +51,15 @@ public:
         CanFrame frame;
         uint8_t qos;
         CanIOFlags flags;
+        uint32_t enqueued_at_usec;      ///< Lower 32 bits only, this way the entry doesn't grow; see getTimeInQueue()
 
-        Entry(const CanFrame& arg_frame, MonotonicTime arg_deadline, Qos arg_qos, CanIOFlags arg_flags)
+        Entry(const CanFrame& arg_frame, MonotonicTime arg_deadline, Qos arg_qos, CanIOFlags arg_flags,
+              MonotonicTime arg_enqueued_at = MonotonicTime())
             : deadline(arg_deadline)
             , frame(arg_frame)
             , qos(uint8_t(arg_qos))
             , flags(arg_flags)
+            , enqueued_at_usec(uint32_t(arg_enqueued_at.toUSec()))
         {
             UAVCAN_ASSERT((qos == Volatile) || (qos == Persistent));
             IsDynamicallyAllocatable<Entry>::check();
@@ -63,6 +69,14 @@ public:
 
         bool isExpired(MonotonicTime timestamp) const { return timestamp > deadline; }
 
+        /**
+         * Valid as long as the frame has been waiting for less than 2^32 microseconds (71 minutes).
+         */
+        MonotonicDuration getTimeInQueue(MonotonicTime timestamp) const
+        {
+            return MonotonicDuration::fromUSec(int64_t(uint32_t(uint32_t(timestamp.toUSec()) - enqueued_at_usec)));
+        }
+
         bool qosHigherThan(const CanFrame& rhs_frame, Qos rhs_qos) const;
         bool qosLowerThan(const CanFrame& rhs_frame, Qos rhs_qos) const;
         bool qosHigherThan(const Entry& rhs) const { return qosHigherThan(rhs.frame, Qos(rhs.qos)); }
@@ -87,6 +101,7 @@ private:
     };
 
     LinkedListRoot<Entry> queue_;
+    TaggedPoolAllocator tagged_allocator_;
     LimitedPoolAllocator allocator_;
     ISystemClock& sysclock_;
     uint32_t rejected_frames_cnt_;
@@ -94,8 +109,10 @@ private:
     void registerRejectedFrame();
 
 public:
-    CanTxQueue(IPoolAllocator& allocator, ISystemClock& sysclock, std::size_t allocator_quota)
-        : allocator_(allocator, allocator_quota)
+    CanTxQueue(IPoolAllocator& allocator, ISystemClock& sysclock, std::size_t allocator_quota,
+               uint8_t iface_index = 0)
+        : tagged_allocator_(allocator, PoolAllocationOwner(PoolAllocationOwner::KindCanTxQueue, iface_index))
+        , allocator_(tagged_allocator_, allocator_quota)
         , sysclock_(sysclock)
         , rejected_frames_cnt_(0)
     { }
@@ -106,6 +123,7 @@ public:
 
     Entry* peek();               // Modifier
     void remove(Entry*& entry);
+    const Entry* getTopPriorityPendingEntry() const { return queue_.get(); }
     const CanFrame* getTopPriorityPendingFrame() const;
 
     /// The 'or equal' condition is necessary to avoid frame reordering.
@@ -122,11 +140,47 @@ struct UAVCAN_EXPORT CanIfacePerfCounters
     uint64_t frames_tx;
     uint64_t frames_rx;
     uint64_t errors;
+    uint64_t frames_deferred;       ///< See @ref CanTxAdmissionPolicy
+    uint64_t frames_dropped;        ///< Ditto
 
     CanIfacePerfCounters()
         : frames_tx(0)
         , frames_rx(0)
         , errors(0)
+        , frames_deferred(0)
+        , frames_dropped(0)
+    { }
+};
+
+/**
+ * Admission control protects the bus from being saturated by low-priority traffic.
+ * When the utilization of an interface, as estimated by @ref CanBusLoadEstimator, reaches the threshold,
+ * volatile extended frames whose transfer priority is equal to or lower than the configured one (i.e. numerically
+ * greater or equal) will be either deferred, or dropped, depending on the action. Persistent frames and
+ * higher-priority frames are never restricted.
+ *
+ * Deferred frames stay in the TX queue until the utilization falls below the threshold or they expire.
+ * Since the TX queue is ordered by CAN priority, the frames queued behind a deferred frame will wait as well.
+ */
+struct UAVCAN_EXPORT CanTxAdmissionPolicy
+{
+    enum Action
+    {
+        Disabled,
+        Defer,
+        Drop
+    };
+
+    Action action;
+    TransferPriority min_restricted_priority;
+    uint16_t max_utilization;                       ///< Per mille, see CanBusLoadEstimator::MaxUtilization
+    MonotonicDuration utilization_window;
+
+    CanTxAdmissionPolicy()
+        : action(Disabled)
+        , min_restricted_priority(TransferPriority::MiddleLower)
+        , max_utilization(700)
+        , utilization_window(MonotonicDuration::fromMSec(500))
     { }
 };
 
@@ -137,10 +191,14 @@ class UAVCAN_EXPORT CanIOManager : Noncopyable
     {
         uint64_t frames_tx;
         uint64_t frames_rx;
+        uint64_t frames_deferred;
+        uint64_t frames_dropped;
 
         IfaceFrameCounters()
             : frames_tx(0)
             , frames_rx(0)
+            , frames_deferred(0)
+            , frames_dropped(0)
         { }
     };
 
@@ -149,9 +207,22 @@ class UAVCAN_EXPORT CanIOManager : Noncopyable
 
     LazyConstructor<CanTxQueue> tx_queues_[MaxCanIfaces];
     IfaceFrameCounters counters_[MaxCanIfaces];
+#if !UAVCAN_TINY
+    CanBusLoadEstimator load_estimators_[MaxCanIfaces];
+    CanTxAdmissionPolicy tx_admission_policy_;
+    TransferLatencyStats* latency_stats_;
+    bool bus_load_estimation_requested_;
+#endif
 
     const uint8_t num_ifaces_;
 
+    /**
+     * Zero timestamp means that the current time should be used.
+     */
+    void updateBusLoadEstimator(uint8_t iface_index, const CanFrame& frame, MonotonicTime ts);
+
+    bool isTxAdmissible(uint8_t iface_index, const CanFrame& frame, CanTxQueue::Qos qos) const;
+
     int sendToIface(uint8_t iface_index, const CanFrame& frame, MonotonicTime tx_deadline, CanIOFlags flags);
     int sendFromTxQueue(uint8_t iface_index);
     int callSelect(CanSelectMasks& inout_masks, const CanFrame* (& pending_tx)[MaxCanIfaces],
@@ -165,6 +236,42 @@ public:
 
     CanIfacePerfCounters getIfacePerfCounters(uint8_t iface_index) const;
 
+#if !UAVCAN_TINY
+    /**
+     * Bus load estimator of the specified interface. It accounts for all transmitted frames and all received
+     * frames except loopback. The bit rate defaults to 1 Mbit/s; it should be configured by the application
+     * if the bus runs at a different rate, otherwise the utilization estimates will be wrong.
+     * The estimators are not updated unless the estimation is enabled, see @ref setBusLoadEstimationEnabled().
+     * Returns NULL if there's no such interface.
+     */
+    CanBusLoadEstimator* getBusLoadEstimator(uint8_t iface_index);
+    const CanBusLoadEstimator* getBusLoadEstimator(uint8_t iface_index) const;
+
+    /**
+     * Admission control is disabled by default.
+     * The policy applies to all interfaces; the utilization is evaluated per interface.
+     */
+    const CanTxAdmissionPolicy& getTxAdmissionPolicy() const { return tx_admission_policy_; }
+    void setTxAdmissionPolicy(const CanTxAdmissionPolicy& policy) { tx_admission_policy_ = policy; }
+
+    /**
+     * The bus load estimation computes the exact bit length of every transmitted and received frame, which is
+     * not free, so it is disabled by default. It is enabled either explicitly, or implicitly while the
+     * admission control is enabled, since the latter relies on the estimates.
+     */
+    void setBusLoadEstimationEnabled(bool enabled) { bus_load_estimation_requested_ = enabled; }
+    bool isBusLoadEstimationEnabled() const
+    {
+        return bus_load_estimation_requested_ || (tx_admission_policy_.action != CanTxAdmissionPolicy::Disabled);
+    }
+
+    /**
+     * TX latency of every frame accepted by the driver will be reported to the installed object.
+     * Normally it's installed via @ref Dispatcher::setTransferLatencyStats(). Pass NULL to uninstall.
+     */
+    void setTransferLatencyStats(TransferLatencyStats* stats) { latency_stats_ = stats; }
+#endif
+
     const ICanDriver& getCanDriver() const { return driver_; }
     ICanDriver& getCanDriver()             { return driver_; }
 
@@ -213,6 +213,17 @@ public:
         UAVCAN_ASSERT(listener != NULL);
         rx_listener_ = listener;
     }
+
+    /**
+     * Enables collection of the latency statistics into the specified object; refer to @ref TransferLatencyStats.
+     * Pass NULL to disable.
+     */
+    void setTransferLatencyStats(TransferLatencyStats* stats)
+    {
+        perf_.setLatencyStats(stats);
+        canio_.setTransferLatencyStats(stats);
+    }
+    TransferLatencyStats* getTransferLatencyStats() const { return perf_.getLatencyStats(); }
 #endif
 
     /**
@@ -109,13 +109,15 @@ class UAVCAN_EXPORT OutgoingTransferRegistry : Noncopyable
         }
     };
 
+    TaggedPoolAllocator allocator_;
     Map<OutgoingTransferRegistryKey, Value> map_;
 
 public:
     static const MonotonicDuration MinEntryLifetime;
 
     explicit OutgoingTransferRegistry(IPoolAllocator& allocator)
-        : map_(allocator)
+        : allocator_(allocator, PoolAllocationOwner(PoolAllocationOwner::KindOutgoingTransferRegistry))
+        , map_(allocator_)
     { }
 
     TransferID* accessOrCreate(const OutgoingTransferRegistryKey& key, MonotonicTime new_deadline);
@@ -7,6 +7,7 @@
 
 #include <uavcan/std.hpp>
 #include <uavcan/build_config.hpp>
+#include <uavcan/transport/transfer_latency_stats.hpp>
 
 namespace uavcan
 {
@@ -23,6 +24,8 @@ public:
     uint64_t getTxTransferCount() const { return 0; }
     uint64_t getRxTransferCount() const { return 0; }
     uint64_t getErrorCount() const { return 0; }
+    void setLatencyStats(TransferLatencyStats*) { }
+    TransferLatencyStats* getLatencyStats() const { return NULL; }
 };
 
 #else
@@ -32,12 +35,14 @@ class UAVCAN_EXPORT TransferPerfCounter
     uint64_t transfers_tx_;
     uint64_t transfers_rx_;
     uint64_t errors_;
+    TransferLatencyStats* latency_stats_;
 
 public:
     TransferPerfCounter()
         : transfers_tx_(0)
         , transfers_rx_(0)
         , errors_(0)
+        , latency_stats_(NULL)
     { }
 
     void addTxTransfer() { transfers_tx_++; }
@@ -53,6 +58,13 @@ public:
     uint64_t getTxTransferCount() const { return transfers_tx_; }
     uint64_t getRxTransferCount() const { return transfers_rx_; }
     uint64_t getErrorCount() const { return errors_; }
+
+    /**
+     * Latency statistics are not collected unless installed; use @ref Dispatcher::setTransferLatencyStats().
+     * Returns NULL if not installed.
+     */
+    void setLatencyStats(TransferLatencyStats* stats) { latency_stats_ = stats; }
+    TransferLatencyStats* getLatencyStats() const { return latency_stats_; }
 };
 
 #endif
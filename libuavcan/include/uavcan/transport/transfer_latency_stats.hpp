@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#ifndef UAVCAN_TRANSPORT_TRANSFER_LATENCY_STATS_HPP_INCLUDED
+#define UAVCAN_TRANSPORT_TRANSFER_LATENCY_STATS_HPP_INCLUDED
+
+#include <uavcan/std.hpp>
+#include <uavcan/build_config.hpp>
+#include <uavcan/data_type.hpp>
+#include <uavcan/time.hpp>
+#include <uavcan/driver/can.hpp>
+#include <uavcan/driver/system_clock.hpp>
+#include <uavcan/util/templates.hpp>
+
+namespace uavcan
+{
+/**
+ * Fixed-bucket latency histogram with logarithmic bucket widths.
+ * Bucket 0 holds latencies shorter than BaseUSec; bucket N (0 < N < NumBuckets - 1) holds latencies in the range
+ * [BaseUSec * 2^(N - 1), BaseUSec * 2^N); the last bucket holds everything longer than that (524 ms and above).
+ * Bucket counters saturate instead of wrapping around.
+ */
+class UAVCAN_EXPORT LatencyHistogram
+{
+public:
+    enum { NumBuckets = 16 };
+    enum { BaseUSec = 32 };
+
+private:
+    uint32_t buckets_[NumBuckets];
+    uint64_t num_samples_;
+    uint64_t sum_usec_;
+    uint32_t max_usec_;
+
+public:
+    LatencyHistogram() { reset(); }
+
+    void reset();
+
+    /**
+     * Negative latencies, which may appear if the driver timestamps are not perfectly in sync with the system
+     * clock, are accounted as zero.
+     */
+    void addSample(MonotonicDuration latency);
+
+    static uint8_t getBucketIndex(uint64_t latency_usec);
+
+    /**
+     * Lower inclusive bound of the bucket.
+     */
+    static uint64_t getBucketLowerBoundUSec(uint8_t index);
+
+    uint32_t getBucket(uint8_t index) const { return (index < NumBuckets) ? buckets_[index] : 0; }
+
+    uint64_t getNumSamples() const { return num_samples_; }
+    uint64_t getSumUSec() const { return sum_usec_; }
+    uint32_t getMaxUSec() const { return max_usec_; }
+
+    /**
+     * Returns zero if there are no samples.
+     */
+    MonotonicDuration getMean() const;
+
+    /**
+     * Upper estimate of the given percentile, i.e. the upper bound of the bucket the percentile falls into,
+     * but no more than the maximum observed latency. Returns zero if there are no samples.
+     */
+    MonotonicDuration estimatePercentile(uint8_t percent) const;
+};
+
+/**
+ * Points in the transfer processing where the latency is sampled.
+ */
+enum TransferLatencyKind
+{
+    TransferLatencyKindRxReassembly,      ///< First to last frame timestamp of an incoming multi-frame transfer
+    TransferLatencyKindRxCallback,        ///< Last frame timestamp to return from the transfer handler
+    TransferLatencyKindTxQueue,           ///< Submission of an outgoing frame to its acceptance by the driver
+    TransferLatencyKindServiceRoundTrip,  ///< Service call to the reception of the response, client side only
+    NumTransferLatencyKinds
+};
+
+/**
+ * Per data type latency histograms; refer to @ref TransferLatencyKind for the list of sampled latencies.
+ *
+ * The collection is disabled by default. In order to enable it, the application needs to allocate an instance
+ * of @ref StaticTransferLatencyStats and install it via @ref Dispatcher::setTransferLatencyStats(). The object
+ * must outlive the node, or it should be uninstalled before destruction.
+ *
+ * A data type is assigned a table entry the first time it produces a sample; the entry is never released.
+ * If the table is full, samples of the data types that don't fit are counted as dropped. The table is searched
+ * linearly, so it should be sized for the actual number of data types used by the node.
+ *
+ * TX latency is sampled per frame, for every frame accepted by the driver; frames that expired in the TX queue
+ * are not sampled. Anonymous frames are not sampled either, because the data type ID cannot be recovered from
+ * their CAN ID. All other latencies are sampled per transfer.
+ */
+class UAVCAN_EXPORT TransferLatencyStats : Noncopyable
+{
+public:
+    struct Entry
+    {
+        DataTypeID data_type_id;
+        DataTypeKind data_type_kind;
+        LatencyHistogram histograms[NumTransferLatencyKinds];
+
+        Entry() : data_type_kind(DataTypeKindMessage) { }
+    };
+
+private:
+    const ISystemClock& sysclock_;
+    Entry* const entries_;
+    const uint16_t capacity_;
+    uint16_t size_;
+    uint64_t num_dropped_samples_;
+
+    Entry* findOrCreate(DataTypeKind data_type_kind, DataTypeID data_type_id);
+
+protected:
+    /**
+     * The entries will not be accessed from the constructor, so the storage can be a member of a derived class.
+     */
+    TransferLatencyStats(const ISystemClock& sysclock, Entry* entries, uint16_t capacity)
+        : sysclock_(sysclock)
+        , entries_(entries)
+        , capacity_(capacity)
+        , size_(0)
+        , num_dropped_samples_(0)
+    { }
+
+public:
+    void addSample(TransferLatencyKind latency_kind, DataTypeKind data_type_kind, DataTypeID data_type_id,
+                   MonotonicDuration latency);
+
+    /**
+     * Extracts the data type from the CAN ID; frames that are not UAVCAN frames or are anonymous are ignored.
+     */
+    void addTxFrameSample(const CanFrame& frame, MonotonicDuration latency);
+
+    /**
+     * Returns false if the data type cannot be determined from the CAN ID.
+     */
+    static bool extractDataType(const CanFrame& frame, DataTypeKind& out_data_type_kind,
+                                DataTypeID& out_data_type_id);
+
+    /**
+     * Returns NULL if the data type hasn't produced any samples yet.
+     */
+    const Entry* find(DataTypeKind data_type_kind, DataTypeID data_type_id) const;
+
+    /**
+     * Entries are ordered by the time of the first sample. Returns NULL if the index is out of range.
+     */
+    const Entry* getByIndex(unsigned index) const { return (index < size_) ? &entries_[index] : NULL; }
+
+    unsigned getSize() const { return size_; }
+    unsigned getCapacity() const { return capacity_; }
+
+    uint64_t getNumDroppedSamples() const { return num_dropped_samples_; }
+
+    /**
+     * Removes all entries.
+     */
+    void reset();
+
+    MonotonicTime getMonotonicTime() const { return sysclock_.getMonotonic(); }
+};
+
+/**
+ * Latency statistics with the storage for the specified number of data types.
+ * Memory footprint is about 360 bytes per data type.
+ */
+template <unsigned MaxDataTypes>
+class UAVCAN_EXPORT StaticTransferLatencyStats : public TransferLatencyStats
+{
+    Entry storage_[MaxDataTypes];
+
+public:
+    explicit StaticTransferLatencyStats(const ISystemClock& sysclock)
+        : TransferLatencyStats(sysclock, storage_, uint16_t(MaxDataTypes))
+    {
+        StaticAssert<(MaxDataTypes > 0)>::check();
+        StaticAssert<(MaxDataTypes <= 0xFFFFU)>::check();
+    }
+};
+
+}
+
+#endif // UAVCAN_TRANSPORT_TRANSFER_LATENCY_STATS_HPP_INCLUDED
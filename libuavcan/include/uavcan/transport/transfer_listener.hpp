@@ -99,6 +99,8 @@ public:
 class UAVCAN_EXPORT TransferListener : public LinkedListNode<TransferListener>, Noncopyable
 {
     const DataTypeDescriptor& data_type_;
+    TaggedPoolAllocator bufmgr_allocator_;
+    TaggedPoolAllocator receivers_allocator_;
     TransferBufferManager bufmgr_;
     Map<TransferBufferManagerKey, TransferReceiver> receivers_;
     TransferPerfCounter& perf_;
@@ -121,6 +123,10 @@ class UAVCAN_EXPORT TransferListener : public LinkedListNode<TransferListener>,
 
     bool checkPayloadCrc(const uint16_t compare_with, const ITransferBuffer& tbb) const;
 
+    static PoolAllocationOwner makeAllocationOwner(const DataTypeDescriptor& data_type, bool buffers);
+
+    void invokeTransferHandler(IncomingTransfer& transfer, const RxFrame& last_frame);
+
 protected:
     void handleReception(TransferReceiver& receiver, const RxFrame& frame, TransferBufferAccessor& tba);
     void handleAnonymousTransferReception(const RxFrame& frame);
@@ -131,8 +137,10 @@ public:
     TransferListener(TransferPerfCounter& perf, const DataTypeDescriptor& data_type,
                      uint16_t max_buffer_size, IPoolAllocator& allocator)
         : data_type_(data_type)
-        , bufmgr_(max_buffer_size, allocator)
-        , receivers_(allocator)
+        , bufmgr_allocator_(allocator, makeAllocationOwner(data_type, true))
+        , receivers_allocator_(allocator, makeAllocationOwner(data_type, false))
+        , bufmgr_(max_buffer_size, bufmgr_allocator_)
+        , receivers_(receivers_allocator_)
         , perf_(perf)
         , crc_base_(data_type.getSignature().toTransferCRC())
         , allow_anonymous_transfers_(false)
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <uavcan/node/deferred_subscriber.hpp>
+#include <uavcan/debug.hpp>
+
+namespace uavcan
+{
+
+void DeferredTransferQueue::destroy(Entry* entry)
+{
+    UAVCAN_ASSERT(entry != NULL);
+    TransferBufferManagerEntry::destroy(entry->payload, allocator_);
+    entry->~Entry();
+    allocator_.deallocate(entry);
+}
+
+int DeferredTransferQueue::push(const IncomingTransfer& transfer)
+{
+    if (depth_ >= max_depth_)
+    {
+        num_dropped_++;
+        return -ErrMemory;
+    }
+
+    void* const praw = allocator_.allocate(sizeof(Entry));
+    if (praw == NULL)
+    {
+        num_dropped_++;
+        return -ErrMemory;
+    }
+    Entry* const entry = new (praw) Entry();
+
+    entry->payload = TransferBufferManagerEntry::instantiate(allocator_, max_payload_len_);
+    if (entry->payload == NULL)
+    {
+        destroy(entry);
+        num_dropped_++;
+        return -ErrMemory;
+    }
+
+    /*
+     * Copying the payload
+     */
+    uint8_t chunk[16];
+    unsigned offset = 0;
+    while (true)
+    {
+        const int read_res = transfer.read(offset, chunk, sizeof(chunk));
+        if (read_res < 0)
+        {
+            destroy(entry);
+            num_dropped_++;
+            return read_res;
+        }
+        if (read_res == 0)
+        {
+            break;
+        }
+        const int write_res = entry->payload->write(offset, chunk, unsigned(read_res));
+        if (write_res != read_res)
+        {
+            UAVCAN_TRACE("DeferredTransferQueue", "Payload copy failed at offset %u", offset);
+            destroy(entry);
+            num_dropped_++;
+            return -ErrMemory;
+        }
+        offset += unsigned(read_res);
+    }
+
+    /*
+     * Metadata
+     */
+    entry->ts_mono = transfer.getMonotonicTimestamp();
+    entry->ts_utc = transfer.getUtcTimestamp();
+    entry->priority = transfer.getPriority();
+    entry->transfer_type = uint8_t(transfer.getTransferType());
+    entry->transfer_id = transfer.getTransferID();
+    entry->src_node_id = transfer.getSrcNodeID();
+    entry->iface_index = transfer.getIfaceIndex();
+    entry->anonymous = transfer.isAnonymousTransfer();
+
+    /*
+     * Appending to the tail
+     */
+    if (tail_ == NULL)
+    {
+        UAVCAN_ASSERT(head_ == NULL);
+        head_ = entry;
+    }
+    else
+    {
+        tail_->setNextListNode(entry);
+    }
+    tail_ = entry;
+
+    depth_++;
+    peak_depth_ = max(peak_depth_, depth_);
+    return 0;
+}
+
+bool DeferredTransferQueue::pop(IDeferredTransferHandler& handler)
+{
+    Entry* const entry = head_;
+    if (entry == NULL)
+    {
+        return false;
+    }
+
+    // Unlinking first, so that the handler is free to modify the queue
+    head_ = entry->getNextListNode();
+    if (head_ == NULL)
+    {
+        tail_ = NULL;
+    }
+    entry->setNextListNode(NULL);
+    UAVCAN_ASSERT(depth_ > 0);
+    depth_--;
+
+    DeferredIncomingTransfer transfer(entry->ts_mono, entry->ts_utc, entry->priority,
+                                      TransferType(entry->transfer_type), entry->transfer_id, entry->src_node_id,
+                                      entry->iface_index, entry->anonymous, *entry->payload);
+    handler.handleDeferredTransfer(transfer);
+
+    destroy(entry);
+    return true;
+}
+
+void DeferredTransferQueue::clear()
+{
+    while (head_ != NULL)
+    {
+        Entry* const next = head_->getNextListNode();
+        destroy(head_);
+        head_ = next;
+    }
+    tail_ = NULL;
+    depth_ = 0;
+}
+
+}
@@ -34,6 +34,24 @@ bool DeadlineHandler::isRunning() const
     return scheduler_.getDeadlineScheduler().doesExist(this);
 }
 
+/*
+ * SpinHandler
+ */
+void SpinHandler::start()
+{
+    scheduler_.addSpinHandler(this);
+}
+
+void SpinHandler::stop()
+{
+    scheduler_.removeSpinHandler(this);
+}
+
+bool SpinHandler::isRunning() const
+{
+    return scheduler_.hasSpinHandler(this);
+}
+
 /*
  * MonotonicDeadlineScheduler
  */
@@ -152,6 +170,44 @@ void Scheduler::pollCleanup(MonotonicTime mono_ts, uint32_t num_frames_processed
     }
 }
 
+void Scheduler::pollSpinHandlers(MonotonicTime mono_ts)
+{
+    SpinHandler* p = spin_handlers_.get();
+    while (p)
+    {
+        SpinHandler* const next = p->getNextListNode();   // The handler is allowed to remove itself
+        p->handleSpin(mono_ts);
+        p = next;
+    }
+}
+
+void Scheduler::addSpinHandler(SpinHandler* sh)
+{
+    UAVCAN_ASSERT(sh);
+    spin_handlers_.insert(sh);
+}
+
+void Scheduler::removeSpinHandler(SpinHandler* sh)
+{
+    UAVCAN_ASSERT(sh);
+    spin_handlers_.remove(sh);
+}
+
+bool Scheduler::hasSpinHandler(const SpinHandler* sh) const
+{
+    UAVCAN_ASSERT(sh);
+    const SpinHandler* p = spin_handlers_.get();
+    while (p)
+    {
+        if (p == sh)
+        {
+            return true;
+        }
+        p = p->getNextListNode();
+    }
+    return false;
+}
+
 int Scheduler::spin(MonotonicTime deadline)
 {
     if (inside_spin_)  // Preventing recursive calls
@@ -173,6 +229,7 @@ int Scheduler::spin(MonotonicTime deadline)
         }
 
         const MonotonicTime ts = deadline_scheduler_.pollAndGetMonotonicTime(getSystemClock());
+        pollSpinHandlers(ts);
         pollCleanup(ts, unsigned(retval));
         if (ts >= deadline)
         {
@@ -200,6 +257,7 @@ int Scheduler::spinOnce()
     }
 
     const MonotonicTime ts = deadline_scheduler_.pollAndGetMonotonicTime(getSystemClock());
+    pollSpinHandlers(ts);
     pollCleanup(ts, unsigned(retval));
 
     return retval;
@@ -25,6 +25,218 @@ void ServiceClientBase::CallState::handleDeadline(MonotonicTime)
     UAVCAN_TRACE("ServiceClient::CallState", "Relaying execution to the owner's handler via timer callback");
 }
 
+/*
+ * ServiceClientBase::CallRegistry
+ */
+ServiceClientBase::CallState** ServiceClientBase::CallRegistry::findSlot(NodeID server_node_id) const
+{
+    UAVCAN_ASSERT(server_node_id.isUnicast());
+    IndexBlock* const block = blocks_[server_node_id.get() / NumSlotsPerBlock];
+    return (block == NULL) ? NULL : &block->slots[server_node_id.get() % NumSlotsPerBlock];
+}
+
+ServiceClientBase::CallState** ServiceClientBase::CallRegistry::findOrCreateSlot(NodeID server_node_id)
+{
+    UAVCAN_ASSERT(server_node_id.isUnicast());
+    IndexBlock*& block = blocks_[server_node_id.get() / NumSlotsPerBlock];
+    if (block == NULL)
+    {
+        void* const praw = allocator_.allocate(sizeof(IndexBlock));
+        if (praw == NULL)
+        {
+            return NULL;
+        }
+        block = new (praw) IndexBlock();    // Value-initialized, i.e. all slots are NULL
+    }
+    return &block->slots[server_node_id.get() % NumSlotsPerBlock];
+}
+
+void ServiceClientBase::CallRegistry::releaseBlockIfEmpty(NodeID server_node_id)
+{
+    IndexBlock*& block = blocks_[server_node_id.get() / NumSlotsPerBlock];
+    if (block == NULL)
+    {
+        return;
+    }
+    for (unsigned i = 0; i < NumSlotsPerBlock; i++)
+    {
+        if (block->slots[i] != NULL)
+        {
+            return;
+        }
+    }
+    block->~IndexBlock();
+    allocator_.deallocate(block);
+    block = NULL;
+}
+
+void ServiceClientBase::CallRegistry::unlinkAndDestroy(CallState** slot, CallState* prev, CallState* state)
+{
+    UAVCAN_ASSERT((slot != NULL) && (state != NULL));
+    if (prev == NULL)
+    {
+        UAVCAN_ASSERT(*slot == state);
+        *slot = state->next_;
+    }
+    else
+    {
+        UAVCAN_ASSERT(prev->next_ == state);
+        prev->next_ = state->next_;
+    }
+
+    const NodeID server_node_id = state->getCallID().server_node_id;
+    state->~CallState();
+    allocator_.deallocate(state);
+
+    UAVCAN_ASSERT(size_ > 0);
+    size_--;
+
+    if (*slot == NULL)
+    {
+        releaseBlockIfEmpty(server_node_id);
+    }
+}
+
+ServiceClientBase::CallState* ServiceClientBase::CallRegistry::add(INode& node, ServiceClientBase& owner,
+                                                                   ServiceCallID call_id)
+{
+    CallState** const slot = findOrCreateSlot(call_id.server_node_id);
+    if (slot == NULL)
+    {
+        return NULL;
+    }
+
+    void* const praw = allocator_.allocate(sizeof(CallState));
+    if (praw == NULL)
+    {
+        if (*slot == NULL)
+        {
+            releaseBlockIfEmpty(call_id.server_node_id);
+        }
+        return NULL;
+    }
+    CallState* const state = new (praw) CallState(node, owner, call_id);
+
+    // Appending to the end of the chain, so the oldest call will be matched first
+    CallState** pp = slot;
+    while (*pp != NULL)
+    {
+        pp = &(*pp)->next_;
+    }
+    *pp = state;
+
+    size_++;
+    return state;
+}
+
+const ServiceClientBase::CallState* ServiceClientBase::CallRegistry::find(ServiceCallID call_id) const
+{
+    CallState* const* const slot = findSlot(call_id.server_node_id);
+    for (const CallState* p = (slot == NULL) ? NULL : *slot; p != NULL; p = p->next_)
+    {
+        if ((p->getCallID() == call_id) && !p->hasTimedOut())
+        {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+bool ServiceClientBase::CallRegistry::remove(ServiceCallID call_id)
+{
+    if (!call_id.isValid())
+    {
+        return false;
+    }
+    CallState** const slot = findSlot(call_id.server_node_id);
+    if (slot == NULL)
+    {
+        return false;
+    }
+
+    CallState* prev = NULL;
+    for (CallState* p = *slot; p != NULL; prev = p, p = p->next_)
+    {
+        if ((p->getCallID() == call_id) && !p->hasTimedOut())
+        {
+            unlinkAndDestroy(slot, prev, p);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ServiceClientBase::CallRegistry::removeTimedOut(NodeID server_node_id, ServiceCallID& out_call_id)
+{
+    CallState** const slot = findSlot(server_node_id);
+    if (slot == NULL)
+    {
+        return false;
+    }
+
+    CallState* prev = NULL;
+    for (CallState* p = *slot; p != NULL; prev = p, p = p->next_)
+    {
+        if (p->hasTimedOut())
+        {
+            out_call_id = p->getCallID();
+            unlinkAndDestroy(slot, prev, p);
+            return true;
+        }
+    }
+    return false;
+}
+
+const ServiceClientBase::CallState* ServiceClientBase::CallRegistry::getByIndex(unsigned index) const
+{
+    for (unsigned block_index = 0; block_index < NumBlocks; block_index++)
+    {
+        const IndexBlock* const block = blocks_[block_index];
+        if (block == NULL)
+        {
+            continue;
+        }
+        for (unsigned i = 0; i < NumSlotsPerBlock; i++)
+        {
+            for (const CallState* p = block->slots[i]; p != NULL; p = p->next_)
+            {
+                if (index == 0)
+                {
+                    return p;
+                }
+                index--;
+            }
+        }
+    }
+    return NULL;
+}
+
+void ServiceClientBase::CallRegistry::clear()
+{
+    for (unsigned block_index = 0; block_index < NumBlocks; block_index++)
+    {
+        IndexBlock* const block = blocks_[block_index];
+        if (block == NULL)
+        {
+            continue;
+        }
+        for (unsigned i = 0; i < NumSlotsPerBlock; i++)
+        {
+            while (block->slots[i] != NULL)
+            {
+                CallState* const state = block->slots[i];
+                block->slots[i] = state->next_;
+                state->~CallState();
+                allocator_.deallocate(state);
+            }
+        }
+        block->~IndexBlock();
+        allocator_.deallocate(block);
+        blocks_[block_index] = NULL;
+    }
+    size_ = 0;
+}
+
 /*
  * ServiceClientBase
  */
@@ -56,6 +268,10 @@ int ServiceClientBase::prepareToCall(INode& node,
             return -ErrUnknownDataType;
         }
         UAVCAN_TRACE("ServiceClient", "Data type descriptor inited: %s", data_type_descriptor_->toString().c_str());
+
+        // This is the first call, so there can be no blocks allocated by the call registry yet
+        call_registry_allocator_.setOwner(PoolAllocationOwner(PoolAllocationOwner::KindServiceCalls,
+                                                              data_type_descriptor_->getID().get()));
     }
     UAVCAN_ASSERT(data_type_descriptor_ != NULL);
 
@@ -78,4 +294,16 @@ int ServiceClientBase::prepareToCall(INode& node,
     return 0;
 }
 
+void ServiceClientBase::sampleRoundTripLatency(const CallState* call_state)
+{
+    TransferLatencyStats* const latency_stats =
+        DeadlineHandler::getScheduler().getDispatcher().getTransferPerfCounter().getLatencyStats();
+    if ((latency_stats == NULL) || (call_state == NULL) || (data_type_descriptor_ == NULL))
+    {
+        return;
+    }
+    latency_stats->addSample(TransferLatencyKindServiceRoundTrip, DataTypeKindService, data_type_descriptor_->getID(),
+                             latency_stats->getMonotonicTime() - call_state->getStartTime());
+}
+
 }
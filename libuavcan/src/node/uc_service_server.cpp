@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <uavcan/node/service_server.hpp>
+#include <uavcan/util/placement_new.hpp>
+#include <uavcan/debug.hpp>
+
+namespace uavcan
+{
+
+void DeferredResponseRegistry::destroy(Entry* entry)
+{
+    UAVCAN_ASSERT(entry != NULL);
+    list_.remove(entry);
+    entry->~Entry();
+    allocator_.deallocate(entry);
+}
+
+void DeferredResponseRegistry::restartTimer()
+{
+    const Entry* p = list_.get();
+    if (p == NULL)
+    {
+        DeadlineHandler::stop();
+        return;
+    }
+    MonotonicTime earliest = p->token.getDeadline();
+    for (; p != NULL; p = p->getNextListNode())
+    {
+        earliest = min(earliest, p->token.getDeadline());
+    }
+    DeadlineHandler::startWithDeadline(earliest);
+}
+
+void DeferredResponseRegistry::handleDeadline(MonotonicTime current)
+{
+    Entry* p = list_.get();
+    while (p != NULL)
+    {
+        Entry* const next = p->getNextListNode();
+        if (p->token.getDeadline() <= current)
+        {
+            UAVCAN_TRACE("DeferredResponseRegistry", "Response timed out; client=%i tid=%i",
+                         int(p->token.getClientNodeID().get()), int(p->token.getTransferID().get()));
+            destroy(p);
+            num_timed_out_++;
+        }
+        p = next;
+    }
+    restartTimer();
+}
+
+void DeferredResponseRegistry::setDataTypeID(DataTypeID dtid)
+{
+    clear();            // Pending entries must be freed with the same owner they were allocated with
+    allocator_.setOwner(PoolAllocationOwner(PoolAllocationOwner::KindDeferredResponses, dtid.get()));
+}
+
+ServiceResponseToken DeferredResponseRegistry::add(NodeID client_node_id, TransferID transfer_id,
+                                                   TransferPriority priority, MonotonicTime request_timestamp)
+{
+    void* const praw = allocator_.allocate(sizeof(Entry));
+    if (praw == NULL)
+    {
+        return ServiceResponseToken();
+    }
+    const ServiceResponseToken token(client_node_id, transfer_id, priority, request_timestamp + timeout_);
+    list_.insert(new (praw) Entry(token));
+
+    if (!DeadlineHandler::isRunning() || (token.getDeadline() < DeadlineHandler::getDeadline()))
+    {
+        DeadlineHandler::startWithDeadline(token.getDeadline());
+    }
+    return token;
+}
+
+bool DeferredResponseRegistry::remove(const ServiceResponseToken& token)
+{
+    if (!token.isValid())
+    {
+        return false;
+    }
+    for (Entry* p = list_.get(); p != NULL; p = p->getNextListNode())
+    {
+        if (p->token == token)
+        {
+            // The timer may not have fired yet
+            const bool expired = token.getDeadline() <= scheduler_.getMonotonicTime();
+            if (expired)
+            {
+                num_timed_out_++;
+            }
+            destroy(p);
+            restartTimer();
+            return !expired;
+        }
+    }
+    return false;
+}
+
+void DeferredResponseRegistry::clear()
+{
+    while (list_.get() != NULL)
+    {
+        destroy(list_.get());
+    }
+    DeadlineHandler::stop();
+}
+
+}
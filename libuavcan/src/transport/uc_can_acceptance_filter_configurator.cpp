@@ -14,6 +14,87 @@ const unsigned CanAcceptanceFilterConfigurator::DefaultFilterServiceMask;
 const unsigned CanAcceptanceFilterConfigurator::DefaultAnonMsgMask;
 const unsigned CanAcceptanceFilterConfigurator::DefaultAnonMsgID;
 
+struct CanAcceptanceFilterConfigurator::TrafficEntryCanIDPredicate
+{
+    const uint32_t can_id;
+
+    explicit TrafficEntryCanIDPredicate(uint32_t arg_can_id) : can_id(arg_can_id) { }
+
+    bool operator()(const TrafficEntry& entry) const { return entry.can_id == can_id; }
+};
+
+/**
+ * Sums the rate of the traffic accepted by any of the configurations.
+ */
+struct CanAcceptanceFilterConfigurator::AcceptedTrafficCounter
+{
+    const MultisetConfigContainer& configs;
+    uint64_t rate;
+
+    explicit AcceptedTrafficCounter(const MultisetConfigContainer& arg_configs)
+        : configs(arg_configs)
+        , rate(0)
+    { }
+
+    void operator()(const TrafficEntry& entry)
+    {
+        const unsigned num_configs = configs.getSize();
+        for (unsigned i = 0; i < num_configs; i++)
+        {
+            if (isAccepted(*configs.getByIndex(i), entry.can_id))
+            {
+                rate += entry.rate;
+                break;
+            }
+        }
+    }
+};
+
+/**
+ * Sums the rate of the traffic accepted by the configuration that is not accepted by the current configurations.
+ */
+struct CanAcceptanceFilterConfigurator::UnacceptedTrafficCounter
+{
+    const CanFilterConfig& config;
+    uint64_t rate;
+
+    explicit UnacceptedTrafficCounter(const CanFilterConfig& arg_config)
+        : config(arg_config)
+        , rate(0)
+    { }
+
+    void operator()(const TrafficEntry& entry)
+    {
+        if (!entry.accepted && isAccepted(config, entry.can_id))
+        {
+            rate += entry.rate;
+        }
+    }
+};
+
+/**
+ * Clears the flags left by the previous computation.
+ */
+struct CanAcceptanceFilterConfigurator::TrafficAcceptanceResetter
+{
+    void operator()(TrafficEntry& entry) { entry.accepted = false; }
+};
+
+/**
+ * Marks the traffic accepted by the configuration.
+ */
+struct CanAcceptanceFilterConfigurator::TrafficAcceptanceUpdater
+{
+    const CanFilterConfig& config;
+
+    explicit TrafficAcceptanceUpdater(const CanFilterConfig& arg_config) : config(arg_config) { }
+
+    void operator()(TrafficEntry& entry)
+    {
+        entry.accepted = entry.accepted || isAccepted(config, entry.can_id);
+    }
+};
+
 int16_t CanAcceptanceFilterConfigurator::loadInputConfiguration(AnonymousMessages load_mode)
 {
     multiset_configs_.clear();
@@ -69,22 +150,54 @@ int16_t CanAcceptanceFilterConfigurator::mergeConfigurations()
     }
     UAVCAN_ASSERT(multiset_configs_.getSize() != 0);
 
+    /*
+     * Traffic that is accepted by the configurations before merging is required by the node, so merging it
+     * is free. Traffic of all other CAN IDs is unwanted; the cost of a merge is the rate of unwanted traffic
+     * that would be let through by the merged configuration.
+     */
+    const bool minimize_false_accepts = (merge_strategy_ == MinimizeFalseAccepts) && !traffic_.isEmpty();
+    required_traffic_ = getPredictedAcceptedTraffic();
+    traffic_.forEach(TrafficAcceptanceResetter());     // The configurations may have changed since the last call
+    if (minimize_false_accepts)
+    {
+        const uint16_t num_configs = static_cast<uint16_t>(multiset_configs_.getSize());
+        for (uint16_t i = 0; i < num_configs; i++)
+        {
+            traffic_.forEach(TrafficAcceptanceUpdater(*multiset_configs_.getByIndex(i)));
+        }
+    }
+
     while (acceptance_filters_number < multiset_configs_.getSize())
     {
-        uint16_t i_rank = 0, j_rank = 0;
+        uint16_t i_rank = 0, j_rank = 1;
         uint8_t best_rank = 0;
+        uint64_t best_cost = 0;
+        bool found = false;
 
         const uint16_t multiset_array_size = static_cast<uint16_t>(multiset_configs_.getSize());
 
         for (uint16_t i_ind = 0; i_ind < multiset_array_size - 1; i_ind++)
         {
-            for (uint16_t j_ind = static_cast<uint8_t>(i_ind + 1); j_ind < multiset_array_size; j_ind++)
+            const CanFilterConfig& i_config = *multiset_configs_.getByIndex(i_ind);
+
+            for (uint16_t j_ind = static_cast<uint16_t>(i_ind + 1); j_ind < multiset_array_size; j_ind++)
             {
-                CanFilterConfig temp_config = mergeFilters(*multiset_configs_.getByIndex(i_ind),
-                                                           *multiset_configs_.getByIndex(j_ind));
-                uint8_t rank = countBits(temp_config.mask);
-                if (rank > best_rank)
+                const CanFilterConfig& j_config = *multiset_configs_.getByIndex(j_ind);
+
+                // The merged mask can't have more bits than the masks have in common
+                if (found && !minimize_false_accepts && (countBits(i_config.mask & j_config.mask) <= best_rank))
+                {
+                    continue;
+                }
+
+                const CanFilterConfig temp_config = mergeFilters(i_config, j_config);
+                const uint8_t rank = countBits(temp_config.mask);
+                const uint64_t cost = minimize_false_accepts ? computeMergeCost(temp_config) : 0;
+
+                if (!found || (cost < best_cost) || ((cost == best_cost) && (rank > best_rank)))
                 {
+                    found = true;
+                    best_cost = cost;
                     best_rank = rank;
                     i_rank = i_ind;
                     j_rank = j_ind;
@@ -92,11 +205,21 @@ int16_t CanAcceptanceFilterConfigurator::mergeConfigurations()
             }
         }
 
-        *multiset_configs_.getByIndex(j_rank) = mergeFilters(*multiset_configs_.getByIndex(i_rank),
-                                                             *multiset_configs_.getByIndex(j_rank));
+        const CanFilterConfig merged_config = mergeFilters(*multiset_configs_.getByIndex(i_rank),
+                                                           *multiset_configs_.getByIndex(j_rank));
+        *multiset_configs_.getByIndex(j_rank) = merged_config;
         multiset_configs_.removeFirst(*multiset_configs_.getByIndex(i_rank));
+
+        if (minimize_false_accepts)
+        {
+            traffic_.forEach(TrafficAcceptanceUpdater(merged_config));
+        }
     }
 
+    UAVCAN_TRACE("CanAcceptanceFilter", "Traffic: required %llu, predicted %llu",
+                 static_cast<unsigned long long>(required_traffic_),
+                 static_cast<unsigned long long>(getPredictedAcceptedTraffic()));
+
     UAVCAN_ASSERT(acceptance_filters_number >= multiset_configs_.getSize());
 
     return 0;
@@ -234,7 +357,38 @@ int CanAcceptanceFilterConfigurator::addFilterConfig(const CanFilterConfig& conf
     return 0;
 }
 
-CanFilterConfig CanAcceptanceFilterConfigurator::mergeFilters(CanFilterConfig& a_, CanFilterConfig& b_)
+int CanAcceptanceFilterConfigurator::addTrafficSample(uint32_t can_id, uint32_t rate)
+{
+    TrafficEntry* const entry = traffic_.find(TrafficEntryCanIDPredicate(can_id));
+    if (entry != NULL)
+    {
+        entry->rate += rate;
+        return 0;
+    }
+
+    if (traffic_.emplace(can_id, rate) == NULL)
+    {
+        return -ErrMemory;
+    }
+
+    return 0;
+}
+
+uint64_t CanAcceptanceFilterConfigurator::getPredictedAcceptedTraffic() const
+{
+    AcceptedTrafficCounter counter(multiset_configs_);
+    traffic_.forEach<AcceptedTrafficCounter&>(counter);
+    return counter.rate;
+}
+
+uint64_t CanAcceptanceFilterConfigurator::computeMergeCost(const CanFilterConfig& merged) const
+{
+    UnacceptedTrafficCounter counter(merged);
+    traffic_.forEach<UnacceptedTrafficCounter&>(counter);
+    return counter.rate;
+}
+
+CanFilterConfig CanAcceptanceFilterConfigurator::mergeFilters(const CanFilterConfig& a_, const CanFilterConfig& b_)
 {
     CanFilterConfig temp_arr;
     temp_arr.mask = a_.mask & b_.mask & ~(a_.id ^ b_.id);
@@ -245,12 +399,13 @@ CanFilterConfig CanAcceptanceFilterConfigurator::mergeFilters(CanFilterConfig& a
 
 uint8_t CanAcceptanceFilterConfigurator::countBits(uint32_t n_)
 {
-    uint8_t c_; // c accumulates the total bits set in v
-    for (c_ = 0; n_; c_++)
-    {
-        n_ &= n_ - 1; // clear the least significant bit set
-    }
-
-    return c_;
+#if defined(__GNUC__)
+    return static_cast<uint8_t>(__builtin_popcountl(n_));     // Compiles into a single instruction where available
+#else
+    // Parallel bit count, see "Bit Twiddling Hacks"
+    n_ = n_ - ((n_ >> 1) & 0x55555555U);
+    n_ = (n_ & 0x33333333U) + ((n_ >> 2) & 0x33333333U);
+    return static_cast<uint8_t>((((n_ + (n_ >> 4)) & 0x0F0F0F0FU) * 0x01010101U) >> 24);
+#endif
 }
 }
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <uavcan/transport/can_bus_load_estimator.hpp>
+#include <uavcan/util/templates.hpp>
+#include <uavcan/debug.hpp>
+
+namespace uavcan
+{
+namespace
+{
+/**
+ * Feeds the bits of a frame from SOF to the end of the CRC sequence, computing the CRC and counting the stuff bits.
+ */
+class FrameBitStuffer
+{
+    enum { CrcPolynomial = 0x4599 };
+    enum { CrcBitLength = 15 };
+    enum { MaxRunLength = 5 };
+
+    unsigned num_bits_;
+    unsigned run_length_;
+    uint16_t crc_;
+    bool last_bit_;
+
+    void addStuffedBit(bool bit)
+    {
+        num_bits_++;
+        if ((run_length_ > 0) && (bit == last_bit_))
+        {
+            run_length_++;
+        }
+        else
+        {
+            run_length_ = 1;
+            last_bit_ = bit;
+        }
+
+        if (run_length_ == MaxRunLength)
+        {
+            // The stuff bit has the opposite polarity and begins a new run
+            num_bits_++;
+            last_bit_ = !bit;
+            run_length_ = 1;
+        }
+    }
+
+public:
+    FrameBitStuffer()
+        : num_bits_(0)
+        , run_length_(0)
+        , crc_(0)
+        , last_bit_(false)
+    { }
+
+    void addBits(uint32_t value, unsigned width)
+    {
+        while (width > 0)
+        {
+            width--;
+            const bool bit = ((value >> width) & 1U) != 0;
+
+            const bool crc_msb = ((crc_ >> (CrcBitLength - 1)) & 1U) != 0;
+            crc_ = static_cast<uint16_t>((unsigned(crc_) << 1) & ((1U << CrcBitLength) - 1U));
+            if (bit != crc_msb)
+            {
+                crc_ = static_cast<uint16_t>(crc_ ^ CrcPolynomial);
+            }
+
+            addStuffedBit(bit);
+        }
+    }
+
+    /**
+     * Appends the CRC sequence; no more bits can be added afterwards.
+     */
+    unsigned finalize()
+    {
+        const uint16_t crc = crc_;
+        for (int i = CrcBitLength - 1; i >= 0; i--)
+        {
+            addStuffedBit(((crc >> i) & 1U) != 0);
+        }
+        return num_bits_;
+    }
+};
+
+}
+
+unsigned CanBusLoadEstimator::computeFrameBitLength(const CanFrame& frame)
+{
+    if (frame.isErrorFrame() || (frame.dlc > CanFrame::MaxDataLen))
+    {
+        return 0;
+    }
+
+    FrameBitStuffer stuffer;
+    stuffer.addBits(0, 1);                                                      // SOF
+
+    const uint32_t rtr = frame.isRemoteTransmissionRequest() ? 1U : 0U;
+    if (frame.isExtended())
+    {
+        const uint32_t id = frame.id & CanFrame::MaskExtID;
+        stuffer.addBits(id >> 18, 11);                                          // Base ID
+        stuffer.addBits(1, 1);                                                  // SRR
+        stuffer.addBits(1, 1);                                                  // IDE
+        stuffer.addBits(id & 0x3FFFFU, 18);                                     // Extended ID
+        stuffer.addBits(rtr, 1);                                                // RTR
+        stuffer.addBits(0, 2);                                                  // r1, r0
+    }
+    else
+    {
+        stuffer.addBits(frame.id & CanFrame::MaskStdID, 11);                    // ID
+        stuffer.addBits(rtr, 1);                                                // RTR
+        stuffer.addBits(0, 2);                                                  // IDE, r0
+    }
+    stuffer.addBits(frame.dlc, 4);                                              // DLC
+
+    if (rtr == 0)
+    {
+        for (unsigned i = 0; i < frame.dlc; i++)
+        {
+            stuffer.addBits(frame.data[i], 8);
+        }
+    }
+
+    return stuffer.finalize() + FrameTrailerBitLength;
+}
+
+unsigned CanBusLoadEstimator::computeWorstCaseFrameBitLength(uint8_t dlc, bool extended)
+{
+    if (dlc > CanFrame::MaxDataLen)
+    {
+        dlc = CanFrame::MaxDataLen;
+    }
+    const unsigned stuffable_bits = (extended ? 54U : 34U) + 8U * dlc;
+    return stuffable_bits + FrameTrailerBitLength + (stuffable_bits - 1U) / 4U;
+}
+
+void CanBusLoadEstimator::addFrame(const CanFrame& frame, MonotonicTime ts)
+{
+    const unsigned num_bits = computeFrameBitLength(frame);
+    if (num_bits == 0)
+    {
+        return;
+    }
+
+    const uint32_t index = getSlotIndex(ts);
+    Slot& slot = slots_[index % NumSlots];
+    if (slot.index != index)
+    {
+        slot.index = index;
+        slot.num_bits = 0;
+    }
+    slot.num_bits += num_bits;
+
+    num_bits_ += num_bits;
+    num_frames_++;
+}
+
+uint16_t CanBusLoadEstimator::getUtilization(MonotonicTime now, MonotonicDuration window) const
+{
+    const uint64_t slot_usec = static_cast<uint64_t>(slot_duration_.toUSec());
+    const uint32_t current_index = getSlotIndex(now);
+
+    uint32_t num_full_slots = 0;
+    if (window.isPositive())
+    {
+        num_full_slots = static_cast<uint32_t>((static_cast<uint64_t>(window.toUSec()) + slot_usec - 1U) / slot_usec);
+    }
+    num_full_slots = min(num_full_slots, uint32_t(NumSlots - 1));
+    num_full_slots = min(num_full_slots, current_index);        // Can't look beyond the epoch
+
+    uint64_t num_bits = 0;
+    for (uint32_t i = 0; i <= num_full_slots; i++)
+    {
+        const uint32_t index = current_index - i;
+        const Slot& slot = slots_[index % NumSlots];
+        if (slot.index == index)
+        {
+            num_bits += slot.num_bits;
+        }
+    }
+
+    const uint64_t elapsed_usec = num_full_slots * slot_usec + (static_cast<uint64_t>(now.toUSec()) % slot_usec);
+    if (elapsed_usec == 0)
+    {
+        return 0;
+    }
+
+    // Bus capacity within the interval, in bits, is bit_rate * elapsed_usec / 1e6
+    const uint64_t utilization = (num_bits * MaxUtilization * 1000000U) / (uint64_t(bit_rate_) * elapsed_usec);
+    return static_cast<uint16_t>(min(utilization, uint64_t(MaxUtilization)));
+}
+
+void CanBusLoadEstimator::setBitRate(uint32_t bit_rate)
+{
+    if (bit_rate > 0)
+    {
+        bit_rate_ = bit_rate;
+    }
+    else
+    {
+        UAVCAN_ASSERT(0);
+    }
+}
+
+void CanBusLoadEstimator::setSlotDuration(MonotonicDuration duration)
+{
+    if (duration.isPositive())
+    {
+        slot_duration_ = duration;
+        reset();
+    }
+    else
+    {
+        UAVCAN_ASSERT(0);
+    }
+}
+
+void CanBusLoadEstimator::reset()
+{
+    for (unsigned i = 0; i < NumSlots; i++)
+    {
+        slots_[i] = Slot();
+    }
+    num_bits_ = 0;
+    num_frames_ = 0;
+}
+
+}
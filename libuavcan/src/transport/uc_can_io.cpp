@@ -172,7 +172,7 @@ void CanTxQueue::push(const CanFrame& frame, MonotonicTime tx_deadline, Qos qos,
     {
         return;                                            // Seems that there is no memory at all.
     }
-    Entry* entry = new (praw) Entry(frame, tx_deadline, qos, flags);
+    Entry* entry = new (praw) Entry(frame, tx_deadline, qos, flags, timestamp);
     UAVCAN_ASSERT(entry);
     queue_.insertBefore(entry, PriorityInsertionComparator(frame));
 }
@@ -228,6 +228,45 @@ bool CanTxQueue::topPriorityHigherOrEqual(const CanFrame& rhs_frame) const
 /*
  * CanIOManager
  */
+void CanIOManager::updateBusLoadEstimator(uint8_t iface_index, const CanFrame& frame, MonotonicTime ts)
+{
+#if UAVCAN_TINY
+    (void)iface_index;
+    (void)frame;
+    (void)ts;
+#else
+    UAVCAN_ASSERT(iface_index < MaxCanIfaces);
+    if (isBusLoadEstimationEnabled())
+    {
+        load_estimators_[iface_index].addFrame(frame, ts.isZero() ? sysclock_.getMonotonic() : ts);
+    }
+#endif
+}
+
+bool CanIOManager::isTxAdmissible(uint8_t iface_index, const CanFrame& frame, CanTxQueue::Qos qos) const
+{
+#if UAVCAN_TINY
+    (void)iface_index;
+    (void)frame;
+    (void)qos;
+    return true;
+#else
+    const CanTxAdmissionPolicy& policy = tx_admission_policy_;
+    if ((policy.action == CanTxAdmissionPolicy::Disabled) || (qos != CanTxQueue::Volatile) || !frame.isExtended())
+    {
+        return true;
+    }
+    const uint8_t priority = uint8_t(((frame.id & CanFrame::MaskExtID) >> 24) & TransferPriority::NumericallyMax);
+    if (priority < policy.min_restricted_priority.get())
+    {
+        return true;
+    }
+    UAVCAN_ASSERT(iface_index < MaxCanIfaces);
+    return load_estimators_[iface_index].getUtilization(sysclock_.getMonotonic(), policy.utilization_window) <
+           policy.max_utilization;
+#endif
+}
+
 int CanIOManager::sendToIface(uint8_t iface_index, const CanFrame& frame, MonotonicTime tx_deadline, CanIOFlags flags)
 {
     UAVCAN_ASSERT(iface_index < MaxCanIfaces);
@@ -246,6 +285,7 @@ int CanIOManager::sendToIface(uint8_t iface_index, const CanFrame& frame, Monoto
     if (res > 0)
     {
         counters_[iface_index].frames_tx += unsigned(res);
+        updateBusLoadEstimator(iface_index, frame, MonotonicTime());
     }
     return res;
 }
@@ -254,13 +294,19 @@ int CanIOManager::sendFromTxQueue(uint8_t iface_index)
 {
     UAVCAN_ASSERT(iface_index < MaxCanIfaces);
     CanTxQueue::Entry* entry = tx_queues_[iface_index]->peek();
-    if (entry == NULL)
+    if ((entry == NULL) || !isTxAdmissible(iface_index, entry->frame, CanTxQueue::Qos(entry->qos)))
     {
         return 0;
     }
     const int res = sendToIface(iface_index, entry->frame, entry->deadline, entry->flags);
     if (res > 0)
     {
+#if !UAVCAN_TINY
+        if (latency_stats_ != NULL)
+        {
+            latency_stats_->addTxFrameSample(entry->frame, entry->getTimeInQueue(sysclock_.getMonotonic()));
+        }
+#endif
         tx_queues_[iface_index]->remove(entry);
     }
     return res;
@@ -286,6 +332,10 @@ CanIOManager::CanIOManager(ICanDriver& driver, IPoolAllocator& allocator, ISyste
                            std::size_t mem_blocks_per_iface)
     : driver_(driver)
     , sysclock_(sysclock)
+#if !UAVCAN_TINY
+    , latency_stats_(NULL)
+    , bus_load_estimation_requested_(false)
+#endif
     , num_ifaces_(driver.getNumIfaces())
 {
     if (num_ifaces_ < 1 || num_ifaces_ > MaxCanIfaces)
@@ -300,10 +350,10 @@ CanIOManager::CanIOManager(ICanDriver& driver, IPoolAllocator& allocator, ISyste
     UAVCAN_TRACE("CanIOManager", "Memory blocks per iface: %u, total: %u",
                  unsigned(mem_blocks_per_iface), unsigned(allocator.getBlockCapacity()));
 
-    for (int i = 0; i < num_ifaces_; i++)
+    for (uint8_t i = 0; i < num_ifaces_; i++)
     {
-        tx_queues_[i].construct<IPoolAllocator&, ISystemClock&, std::size_t>
-        (allocator, sysclock, mem_blocks_per_iface);
+        tx_queues_[i].construct<IPoolAllocator&, ISystemClock&, std::size_t, uint8_t>
+        (allocator, sysclock, mem_blocks_per_iface, i);
     }
 }
 
@@ -312,7 +362,12 @@ uint8_t CanIOManager::makePendingTxMask() const
     uint8_t write_mask = 0;
     for (uint8_t i = 0; i < getNumIfaces(); i++)
     {
-        if (!tx_queues_[i]->isEmpty())
+        // Deferred frames must not keep the interface writeable, otherwise select() would never block.
+        // Expired frames are let through, so that they could be removed from the queue.
+        const CanTxQueue::Entry* const entry = tx_queues_[i]->getTopPriorityPendingEntry();
+        if ((entry != NULL) &&
+            (isTxAdmissible(i, entry->frame, CanTxQueue::Qos(entry->qos)) ||
+             entry->isExpired(sysclock_.getMonotonic())))
         {
             write_mask |= uint8_t(1 << i);
         }
@@ -320,6 +375,18 @@ uint8_t CanIOManager::makePendingTxMask() const
     return write_mask;
 }
 
+#if !UAVCAN_TINY
+CanBusLoadEstimator* CanIOManager::getBusLoadEstimator(uint8_t iface_index)
+{
+    return (iface_index < num_ifaces_) ? &load_estimators_[iface_index] : NULL;
+}
+
+const CanBusLoadEstimator* CanIOManager::getBusLoadEstimator(uint8_t iface_index) const
+{
+    return (iface_index < num_ifaces_) ? &load_estimators_[iface_index] : NULL;
+}
+#endif
+
 CanIfacePerfCounters CanIOManager::getIfacePerfCounters(uint8_t iface_index) const
 {
     ICanIface* const iface = driver_.getIface(iface_index);
@@ -332,6 +399,8 @@ CanIfacePerfCounters CanIOManager::getIfacePerfCounters(uint8_t iface_index) con
     cnt.errors = iface->getErrorCount() + tx_queues_[iface_index]->getRejectedFrameCount();
     cnt.frames_rx = counters_[iface_index].frames_rx;
     cnt.frames_tx = counters_[iface_index].frames_tx;
+    cnt.frames_deferred = counters_[iface_index].frames_deferred;
+    cnt.frames_dropped = counters_[iface_index].frames_dropped;
     return cnt;
 }
 
@@ -347,6 +416,33 @@ int CanIOManager::send(const CanFrame& frame, MonotonicTime tx_deadline, Monoton
         blocking_deadline = tx_deadline;
     }
 
+#if !UAVCAN_TINY
+    // Frames that are accepted by the driver directly are sampled as well; their latency is the time spent in select()
+    const MonotonicTime submitted_at = (latency_stats_ != NULL) ? sysclock_.getMonotonic() : MonotonicTime();
+#endif
+
+#if !UAVCAN_TINY
+    // Admission control - restricted frames are removed from the mask before any IO takes place
+    for (uint8_t i = 0; i < num_ifaces; i++)
+    {
+        if ((iface_mask & (1 << i)) && !isTxAdmissible(i, frame, qos))
+        {
+            iface_mask &= uint8_t(~(1 << i));
+            if (tx_admission_policy_.action == CanTxAdmissionPolicy::Defer)
+            {
+                tx_queues_[i]->push(frame, tx_deadline, qos, flags);
+                counters_[i].frames_deferred++;
+            }
+            else
+            {
+                counters_[i].frames_dropped++;
+            }
+            UAVCAN_TRACE("CanIOManager", "Send: Restricted by admission control, iface %i, frame %s",
+                         int(i), frame.toString().c_str());
+        }
+    }
+#endif
+
     int retval = 0;
 
     while (true)        // Somebody please refactor this.
@@ -401,6 +497,12 @@ int CanIOManager::send(const CanFrame& frame, MonotonicTime tx_deadline, Monoton
                         if (res > 0)
                         {
                             iface_mask &= uint8_t(~(1 << i));     // Mark transmitted
+#if !UAVCAN_TINY
+                            if (latency_stats_ != NULL)
+                            {
+                                latency_stats_->addTxFrameSample(frame, sysclock_.getMonotonic() - submitted_at);
+                            }
+#endif
                         }
                     }
                 }
@@ -492,6 +594,7 @@ int CanIOManager::receive(CanRxFrame& out_frame, MonotonicTime blocking_deadline
                 if ((res > 0) && !(out_flags & CanIOFlagLoopback))
                 {
                     counters_[i].frames_rx += 1;
+                    updateBusLoadEstimator(i, out_frame, out_frame.ts_mono);
                 }
                 return (res < 0) ? -ErrDriver : res;
             }
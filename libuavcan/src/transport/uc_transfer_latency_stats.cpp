@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <uavcan/transport/transfer_latency_stats.hpp>
+#include <uavcan/debug.hpp>
+
+namespace uavcan
+{
+/*
+ * LatencyHistogram
+ */
+void LatencyHistogram::reset()
+{
+    fill_n(buckets_, unsigned(NumBuckets), uint32_t(0));
+    num_samples_ = 0;
+    sum_usec_ = 0;
+    max_usec_ = 0;
+}
+
+void LatencyHistogram::addSample(MonotonicDuration latency)
+{
+    const uint64_t usec = latency.isNegative() ? 0U : uint64_t(latency.toUSec());
+
+    uint32_t& bucket = buckets_[getBucketIndex(usec)];
+    if (bucket < NumericTraits<uint32_t>::max())
+    {
+        bucket++;
+    }
+    num_samples_++;
+    sum_usec_ += usec;
+
+    const uint32_t usec32 = (usec < NumericTraits<uint32_t>::max()) ? uint32_t(usec) : NumericTraits<uint32_t>::max();
+    if (usec32 > max_usec_)
+    {
+        max_usec_ = usec32;
+    }
+}
+
+uint8_t LatencyHistogram::getBucketIndex(uint64_t latency_usec)
+{
+    uint8_t index = 0;
+    uint64_t threshold = BaseUSec;
+    while ((index < (NumBuckets - 1)) && (latency_usec >= threshold))
+    {
+        index++;
+        threshold <<= 1;
+    }
+    return index;
+}
+
+uint64_t LatencyHistogram::getBucketLowerBoundUSec(uint8_t index)
+{
+    if (index == 0)
+    {
+        return 0;
+    }
+    index = min(index, uint8_t(NumBuckets - 1));
+    return uint64_t(BaseUSec) << (index - 1U);
+}
+
+MonotonicDuration LatencyHistogram::getMean() const
+{
+    return (num_samples_ > 0) ? MonotonicDuration::fromUSec(int64_t(sum_usec_ / num_samples_)) : MonotonicDuration();
+}
+
+MonotonicDuration LatencyHistogram::estimatePercentile(uint8_t percent) const
+{
+    if (num_samples_ == 0)
+    {
+        return MonotonicDuration();
+    }
+    percent = min(percent, uint8_t(100));
+
+    uint64_t target = (num_samples_ * percent + 99U) / 100U;
+    target = max(target, uint64_t(1));
+
+    uint64_t accumulated = 0;
+    for (uint8_t i = 0; i < (NumBuckets - 1); i++)
+    {
+        accumulated += buckets_[i];
+        if (accumulated >= target)
+        {
+            const uint64_t upper_bound = getBucketLowerBoundUSec(uint8_t(i + 1U));
+            return MonotonicDuration::fromUSec(int64_t(min(upper_bound, uint64_t(max_usec_))));
+        }
+    }
+    return MonotonicDuration::fromUSec(int64_t(max_usec_));   // Last bucket, or the counters have saturated
+}
+
+/*
+ * TransferLatencyStats
+ */
+TransferLatencyStats::Entry* TransferLatencyStats::findOrCreate(DataTypeKind data_type_kind,
+                                                                DataTypeID data_type_id)
+{
+    for (uint16_t i = 0; i < size_; i++)
+    {
+        if ((entries_[i].data_type_id == data_type_id) && (entries_[i].data_type_kind == data_type_kind))
+        {
+            return &entries_[i];
+        }
+    }
+    if (size_ >= capacity_)
+    {
+        return NULL;
+    }
+    Entry& entry = entries_[size_++];
+    entry = Entry();
+    entry.data_type_id = data_type_id;
+    entry.data_type_kind = data_type_kind;
+    return &entry;
+}
+
+void TransferLatencyStats::addSample(TransferLatencyKind latency_kind, DataTypeKind data_type_kind,
+                                     DataTypeID data_type_id, MonotonicDuration latency)
+{
+    UAVCAN_ASSERT(latency_kind < NumTransferLatencyKinds);
+    Entry* const entry = findOrCreate(data_type_kind, data_type_id);
+    if ((entry == NULL) || (latency_kind >= NumTransferLatencyKinds))
+    {
+        num_dropped_samples_++;
+        return;
+    }
+    entry->histograms[latency_kind].addSample(latency);
+}
+
+void TransferLatencyStats::addTxFrameSample(const CanFrame& frame, MonotonicDuration latency)
+{
+    DataTypeKind data_type_kind = DataTypeKindMessage;
+    DataTypeID data_type_id;
+    if (extractDataType(frame, data_type_kind, data_type_id))
+    {
+        addSample(TransferLatencyKindTxQueue, data_type_kind, data_type_id, latency);
+    }
+}
+
+bool TransferLatencyStats::extractDataType(const CanFrame& frame, DataTypeKind& out_data_type_kind,
+                                           DataTypeID& out_data_type_id)
+{
+    if (frame.isErrorFrame() || frame.isRemoteTransmissionRequest() || !frame.isExtended())
+    {
+        return false;
+    }
+    // Refer to Frame::parse() for the CAN ID layout
+    const uint32_t id = frame.id & CanFrame::MaskExtID;
+    const bool service_not_message = ((id >> 7) & 1U) != 0U;
+    if (service_not_message)
+    {
+        out_data_type_kind = DataTypeKindService;
+        out_data_type_id = uint16_t((id >> 16) & 0xFFU);
+        return true;
+    }
+    const bool anonymous = (id & 0x7FU) == 0U;
+    if (anonymous)
+    {
+        return false;
+    }
+    out_data_type_kind = DataTypeKindMessage;
+    out_data_type_id = uint16_t((id >> 8) & 0xFFFFU);
+    return true;
+}
+
+const TransferLatencyStats::Entry* TransferLatencyStats::find(DataTypeKind data_type_kind,
+                                                              DataTypeID data_type_id) const
+{
+    for (uint16_t i = 0; i < size_; i++)
+    {
+        if ((entries_[i].data_type_id == data_type_id) && (entries_[i].data_type_kind == data_type_kind))
+        {
+            return &entries_[i];
+        }
+    }
+    return NULL;
+}
+
+void TransferLatencyStats::reset()
+{
+    size_ = 0;
+    num_dropped_samples_ = 0;
+}
+
+}
@@ -103,6 +103,17 @@ bool TransferListener::TimedOutReceiverPredicate::operator()(const TransferBuffe
 /*
  * TransferListener
  */
+PoolAllocationOwner TransferListener::makeAllocationOwner(const DataTypeDescriptor& data_type, bool buffers)
+{
+    const bool service = data_type.getKind() == DataTypeKindService;
+    const PoolAllocationOwner::Kind kind =
+        buffers ? (service ? PoolAllocationOwner::KindServiceTransferBuffers :
+                             PoolAllocationOwner::KindMessageTransferBuffers) :
+                  (service ? PoolAllocationOwner::KindServiceTransferReceivers :
+                             PoolAllocationOwner::KindMessageTransferReceivers);
+    return PoolAllocationOwner(kind, data_type.getID().get());
+}
+
 bool TransferListener::checkPayloadCrc(const uint16_t compare_with, const ITransferBuffer& tbb) const
 {
     TransferCRC crc = crc_base_;
@@ -132,6 +143,17 @@ bool TransferListener::checkPayloadCrc(const uint16_t compare_with, const ITrans
     return true;
 }
 
+void TransferListener::invokeTransferHandler(IncomingTransfer& transfer, const RxFrame& last_frame)
+{
+    TransferLatencyStats* const latency_stats = perf_.getLatencyStats();
+    handleIncomingTransfer(transfer);
+    if (latency_stats != NULL)
+    {
+        latency_stats->addSample(TransferLatencyKindRxCallback, data_type_.getKind(), data_type_.getID(),
+                                 latency_stats->getMonotonicTime() - last_frame.getMonotonicTimestamp());
+    }
+}
+
 void TransferListener::handleReception(TransferReceiver& receiver, const RxFrame& frame,
                                            TransferBufferAccessor& tba)
 {
@@ -146,7 +168,7 @@ void TransferListener::handleReception(TransferReceiver& receiver, const RxFrame
     {
         perf_.addRxTransfer();
         SingleFrameIncomingTransfer it(frame);
-        handleIncomingTransfer(it);
+        invokeTransferHandler(it, frame);
         break;
     }
     case TransferReceiver::ResultComplete:
@@ -163,9 +185,15 @@ void TransferListener::handleReception(TransferReceiver& receiver, const RxFrame
             UAVCAN_TRACE("TransferListener", "CRC error, last frame: %s", frame.toString().c_str());
             break;
         }
+        TransferLatencyStats* const latency_stats = perf_.getLatencyStats();
+        if (latency_stats != NULL)
+        {
+            latency_stats->addSample(TransferLatencyKindRxReassembly, data_type_.getKind(), data_type_.getID(),
+                                     frame.getMonotonicTimestamp() - receiver.getLastTransferTimestampMonotonic());
+        }
         MultiFrameIncomingTransfer it(receiver.getLastTransferTimestampMonotonic(),
                                       receiver.getLastTransferTimestampUtc(), frame, tba);
-        handleIncomingTransfer(it);
+        invokeTransferHandler(it, frame);
         it.release();
         break;
     }
@@ -183,7 +211,7 @@ void TransferListener::handleAnonymousTransferReception(const RxFrame& frame)
     {
         perf_.addRxTransfer();
         SingleFrameIncomingTransfer it(frame);
-        handleIncomingTransfer(it);
+        invokeTransferHandler(it, frame);
     }
 }
 
@@ -6,15 +6,84 @@
 
 namespace uavcan
 {
+/*
+ * PoolAllocationOwner
+ */
+const char* PoolAllocationOwner::getKindName(Kind kind)
+{
+    switch (kind)
+    {
+    case KindUnspecified:               return "Unspecified";
+    case KindCanTxQueue:                return "CanTxQueue";
+    case KindOutgoingTransferRegistry:  return "OutgoingTransferRegistry";
+    case KindMessageTransferBuffers:    return "MessageTransferBuffers";
+    case KindServiceTransferBuffers:    return "ServiceTransferBuffers";
+    case KindMessageTransferReceivers:  return "MessageTransferReceivers";
+    case KindServiceTransferReceivers:  return "ServiceTransferReceivers";
+    case KindServiceCalls:              return "ServiceCalls";
+    case KindDeferredTransfers:         return "DeferredTransfers";
+    case KindDeferredResponses:         return "DeferredResponses";
+    case NumKinds:
+    default:
+    {
+        UAVCAN_ASSERT(0);
+        return "???";
+    }
+    }
+}
+
+#if UAVCAN_TOSTRING
+std::string PoolAllocationOwner::toString() const
+{
+    char buf[48];
+    (void)snprintf(buf, sizeof(buf), "%s[%u]", getKindName(Kind(kind)), unsigned(index));
+    return std::string(buf);
+}
+#endif
+
+#if UAVCAN_POOL_ALLOCATION_ACCOUNTING
+/*
+ * TaggedPoolAllocator
+ */
+void* TaggedPoolAllocator::allocate(std::size_t size)
+{
+    return allocator_.allocateForOwner(size, owner_);
+}
+
+void TaggedPoolAllocator::deallocate(const void* ptr)
+{
+    allocator_.deallocateForOwner(ptr, owner_);
+}
+
+uint16_t TaggedPoolAllocator::getBlockCapacity() const
+{
+    return allocator_.getBlockCapacity();
+}
+#endif
+
 /*
  * LimitedPoolAllocator
  */
 void* LimitedPoolAllocator::allocate(std::size_t size)
+{
+    return allocateForOwner(size, PoolAllocationOwner());
+}
+
+void LimitedPoolAllocator::deallocate(const void* ptr)
+{
+    deallocateForOwner(ptr, PoolAllocationOwner());
+}
+
+void* LimitedPoolAllocator::allocateForOwner(std::size_t size, PoolAllocationOwner owner)
 {
     if (used_blocks_ < max_blocks_)
     {
-        used_blocks_++;
-        return allocator_.allocate(size);
+        void* const ptr = allocator_.allocateForOwner(size, owner);
+        if (ptr != NULL)
+        {
+            used_blocks_++;
+        }
+        return ptr;
     }
     else
     {
@@ -22,9 +91,14 @@ void* LimitedPoolAllocator::allocate(std::size_t size)
     }
 }
 
-void LimitedPoolAllocator::deallocate(const void* ptr)
+void LimitedPoolAllocator::deallocateForOwner(const void* ptr, PoolAllocationOwner owner)
 {
-    allocator_.deallocate(ptr);
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    allocator_.deallocateForOwner(ptr, owner);
 
     UAVCAN_ASSERT(used_blocks_ > 0);
     if (used_blocks_ > 0)
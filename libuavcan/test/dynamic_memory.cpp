@@ -72,3 +72,82 @@ TEST(DynamicMemory, LimitedPoolAllocator)
 
     EXPECT_EQ(2, pool32.getPeakNumUsedBlocks());
 }
+
+TEST(DynamicMemory, SlabPoolAllocator)
+{
+    typedef uavcan::SlabPoolAllocator<1024, 128> Pool;
+    Pool pool;
+
+    EXPECT_EQ(8, Pool::NumSlabs);
+    EXPECT_EQ(8, pool.getNumFreeSlabs());
+    EXPECT_EQ(1024 / uavcan::MemPoolBlockSize, pool.getBlockCapacity());
+    EXPECT_EQ(0, pool.getNumUsedBlocks());
+    EXPECT_EQ(0, pool.getNumUsedBytes());
+
+    EXPECT_EQ(uavcan::MemPoolAlignment, Pool::getBlockSizeForAllocationSize(1));
+    EXPECT_EQ(uavcan::MemPoolAlignment, Pool::getBlockSizeForAllocationSize(uavcan::MemPoolAlignment));
+    EXPECT_EQ(uavcan::MemPoolAlignment * 2, Pool::getBlockSizeForAllocationSize(uavcan::MemPoolAlignment + 1));
+    EXPECT_EQ(128, Pool::getBlockSizeForAllocationSize(128));
+    EXPECT_EQ(0, Pool::getBlockSizeForAllocationSize(129));
+
+    // Too large
+    EXPECT_FALSE(pool.allocate(129));
+    EXPECT_EQ(8, pool.getNumFreeSlabs());
+
+    // Small blocks are carved from the same slab
+    void* const small1 = pool.allocate(1);
+    void* const small2 = pool.allocate(uavcan::MemPoolAlignment);
+    ASSERT_TRUE(small1);
+    ASSERT_TRUE(small2);
+    EXPECT_EQ(7, pool.getNumFreeSlabs());
+    EXPECT_EQ(uavcan::MemPoolAlignment,
+              unsigned(static_cast<uint8_t*>(small2) - static_cast<uint8_t*>(small1)));
+    EXPECT_EQ(2, pool.getNumUsedBlocks());
+    EXPECT_EQ(uavcan::MemPoolAlignment * 2, pool.getNumUsedBytes());
+
+    // Different size class takes a new slab
+    void* const large = pool.allocate(100);
+    ASSERT_TRUE(large);
+    EXPECT_EQ(6, pool.getNumFreeSlabs());
+    EXPECT_EQ(0, reinterpret_cast<std::size_t>(large) % uavcan::MemPoolAlignment);
+    EXPECT_EQ(3, pool.getNumUsedBlocks());
+
+    // Deallocated blocks are reused within the same size class
+    pool.deallocate(small1);
+    EXPECT_EQ(small1, pool.allocate(3));
+    pool.deallocate(large);
+    EXPECT_EQ(large, pool.allocate(Pool::getBlockSizeForAllocationSize(100)));
+    EXPECT_EQ(6, pool.getNumFreeSlabs());
+
+    pool.deallocate(small1);
+    pool.deallocate(small2);
+    pool.deallocate(large);
+    pool.deallocate(NULL);
+    EXPECT_EQ(0, pool.getNumUsedBlocks());
+    EXPECT_EQ(0, pool.getNumUsedBytes());
+    EXPECT_EQ(3, pool.getPeakNumUsedBlocks());
+    EXPECT_EQ(uavcan::MemPoolAlignment * 2 + Pool::getBlockSizeForAllocationSize(100), pool.getPeakNumUsedBytes());
+}
+
+TEST(DynamicMemory, SlabPoolAllocatorOutOfMemory)
+{
+    uavcan::SlabPoolAllocator<256, 128> pool;
+
+    // Two slabs only; the third size class cannot be served
+    void* const a = pool.allocate(128);
+    void* const b = pool.allocate(64);
+    ASSERT_TRUE(a);
+    ASSERT_TRUE(b);
+    EXPECT_EQ(0, pool.getNumFreeSlabs());
+    EXPECT_FALSE(pool.allocate(1));
+
+    // The slab of 64-byte blocks still has one free block
+    void* const c = pool.allocate(64);
+    ASSERT_TRUE(c);
+    EXPECT_FALSE(pool.allocate(64));
+    EXPECT_FALSE(pool.allocate(128));
+
+    pool.deallocate(a);
+    EXPECT_EQ(a, pool.allocate(128));
+    EXPECT_EQ(3, pool.getNumUsedBlocks());
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <gtest/gtest.h>
+#include <uavcan/helpers/instrumented_pool_allocator.hpp>
+#include <uavcan/transport/can_io.hpp>
+#include <uavcan/transport/outgoing_transfer_registry.hpp>
+#include "../clock.hpp"
+#include "../transport/can/can.hpp"
+
+
+namespace
+{
+
+struct ExhaustionListener : public uavcan::IPoolExhaustionListener
+{
+    uavcan::PoolAllocationOwner last_owner;
+    std::size_t last_size;
+    unsigned count;
+
+    ExhaustionListener()
+        : last_size(0)
+        , count(0)
+    { }
+
+    virtual void handlePoolExhaustion(uavcan::PoolAllocationOwner owner, std::size_t requested_size)
+    {
+        last_owner = owner;
+        last_size = requested_size;
+        count++;
+    }
+};
+
+}
+
+TEST(InstrumentedPoolAllocator, Basic)
+{
+    using uavcan::PoolAllocationOwner;
+
+    uavcan::PoolAllocator<uavcan::MemPoolBlockSize * 4, uavcan::MemPoolBlockSize> pool;
+    uavcan::InstrumentedPoolAllocator<3> instr(pool);
+    ExhaustionListener listener;
+    instr.setExhaustionListener(&listener);
+
+    EXPECT_EQ(4, instr.getBlockCapacity());
+    EXPECT_EQ(1, instr.getNumOwners());
+    EXPECT_EQ(PoolAllocationOwner(), instr.getOwnerStatsByIndex(0).owner);
+
+    const PoolAllocationOwner txq(PoolAllocationOwner::KindCanTxQueue, 1);
+    const PoolAllocationOwner bufs(PoolAllocationOwner::KindMessageTransferBuffers, 341);
+    const PoolAllocationOwner calls(PoolAllocationOwner::KindServiceCalls, 1);
+
+    uavcan::TaggedPoolAllocator txq_al(instr, txq);
+    uavcan::TaggedPoolAllocator bufs_al(instr, bufs);
+    uavcan::TaggedPoolAllocator calls_al(instr, calls);     // Will not fit the owner table
+
+    void* a = txq_al.allocate(1);
+    void* b = txq_al.allocate(1);
+    void* c = bufs_al.allocate(1);
+    void* d = calls_al.allocate(1);
+    ASSERT_TRUE(a);
+    ASSERT_TRUE(b);
+    ASSERT_TRUE(c);
+    ASSERT_TRUE(d);
+
+    EXPECT_EQ(3, instr.getNumOwners());
+    EXPECT_EQ(2, instr.getOwnerStats(txq).num_used_blocks);
+    EXPECT_EQ(1, instr.getOwnerStats(bufs).num_used_blocks);
+    EXPECT_EQ(0, instr.getOwnerStats(calls).num_used_blocks);               // Not tracked individually
+    EXPECT_EQ(1, instr.getOwnerStats(PoolAllocationOwner()).num_used_blocks);   // Accounted here instead
+    EXPECT_EQ(4, instr.getNumUsedBlocks());
+    EXPECT_EQ(4, pool.getNumUsedBlocks());
+
+    // Exhaustion
+    EXPECT_FALSE(bufs_al.allocate(1));
+    EXPECT_EQ(1, listener.count);
+    EXPECT_EQ(bufs, listener.last_owner);
+    EXPECT_EQ(1, listener.last_size);
+    EXPECT_EQ(1, instr.getOwnerStats(bufs).num_failed_allocations);
+    EXPECT_EQ(1, instr.getNumFailedAllocations());
+
+    txq_al.deallocate(a);
+    txq_al.deallocate(b);
+    bufs_al.deallocate(c);
+    calls_al.deallocate(d);
+
+    EXPECT_EQ(0, instr.getNumUsedBlocks());
+    EXPECT_EQ(4, instr.getPeakNumUsedBlocks());
+    EXPECT_EQ(0, instr.getOwnerStats(txq).num_used_blocks);
+    EXPECT_EQ(2, instr.getOwnerStats(txq).peak_num_used_blocks);
+    EXPECT_EQ(0, instr.getOwnerStats(PoolAllocationOwner()).num_used_blocks);
+    EXPECT_EQ(0, pool.getNumUsedBlocks());
+
+    // Out of range
+    EXPECT_EQ(0, instr.getOwnerStatsByIndex(3).peak_num_used_blocks);
+
+    instr.setExhaustionListener(NULL);
+    EXPECT_FALSE(instr.getExhaustionListener());
+}
+
+TEST(InstrumentedPoolAllocator, UnknownOwnerIsNotAddedOnDeallocation)
+{
+    using uavcan::PoolAllocationOwner;
+
+    uavcan::PoolAllocator<uavcan::MemPoolBlockSize * 4, uavcan::MemPoolBlockSize> pool;
+    uavcan::InstrumentedPoolAllocator<> instr(pool);
+
+    void* a = instr.allocate(1);                        // Accounted under Unspecified
+    ASSERT_TRUE(a);
+    EXPECT_EQ(1, instr.getOwnerStats(PoolAllocationOwner()).num_used_blocks);
+
+    instr.deallocateForOwner(a, PoolAllocationOwner(PoolAllocationOwner::KindServiceCalls, 7));
+    EXPECT_EQ(1, instr.getNumOwners());
+    EXPECT_EQ(0, instr.getOwnerStats(PoolAllocationOwner()).num_used_blocks);
+    EXPECT_EQ(0, instr.getNumUsedBlocks());
+    EXPECT_EQ(0, pool.getNumUsedBlocks());
+}
+
+TEST(InstrumentedPoolAllocator, LimitedPoolAllocatorPreservesOwner)
+{
+    using uavcan::PoolAllocationOwner;
+
+    uavcan::PoolAllocator<uavcan::MemPoolBlockSize * 4, uavcan::MemPoolBlockSize> pool;
+    uavcan::InstrumentedPoolAllocator<> instr(pool);
+
+    const PoolAllocationOwner owner(PoolAllocationOwner::KindOutgoingTransferRegistry);
+    uavcan::LimitedPoolAllocator lim(instr, 1);
+    uavcan::TaggedPoolAllocator tagged(lim, owner);
+
+    void* a = tagged.allocate(1);
+    ASSERT_TRUE(a);
+    EXPECT_FALSE(tagged.allocate(1));                   // Limit reached, not an exhaustion
+    EXPECT_EQ(1, instr.getOwnerStats(owner).num_used_blocks);
+    EXPECT_EQ(0, instr.getNumFailedAllocations());
+
+    tagged.deallocate(a);
+    EXPECT_EQ(0, instr.getOwnerStats(owner).num_used_blocks);
+    EXPECT_EQ(0, instr.getNumUsedBlocks());
+}
+
+TEST(InstrumentedPoolAllocator, LibraryComponents)
+{
+    using uavcan::PoolAllocationOwner;
+
+    uavcan::PoolAllocator<uavcan::MemPoolBlockSize * 8, uavcan::MemPoolBlockSize> pool;
+    uavcan::InstrumentedPoolAllocator<> instr(pool);
+    SystemClockMock clockmock;
+
+    // TX queue is tagged with the interface index
+    uavcan::CanTxQueue queue(instr, clockmock, 99999, 2);
+    queue.push(makeCanFrame(123, "", EXT), tsMono(1000), uavcan::CanTxQueue::Persistent, 0);
+    queue.push(makeCanFrame(456, "", EXT), tsMono(1000), uavcan::CanTxQueue::Persistent, 0);
+    EXPECT_EQ(2, instr.getOwnerStats(PoolAllocationOwner(PoolAllocationOwner::KindCanTxQueue, 2)).num_used_blocks);
+
+    // Outgoing transfer registry
+    uavcan::OutgoingTransferRegistry otr(instr);
+    ASSERT_TRUE(otr.accessOrCreate(uavcan::OutgoingTransferRegistryKey(123, uavcan::TransferTypeServiceRequest, 42),
+                                   tsMono(1000000)));
+    EXPECT_EQ(1, instr.getOwnerStats(PoolAllocationOwner(PoolAllocationOwner::KindOutgoingTransferRegistry))
+                 .num_used_blocks);
+
+    EXPECT_EQ(3, instr.getNumUsedBlocks());
+    EXPECT_EQ(0, instr.getOwnerStats(PoolAllocationOwner()).num_used_blocks);
+
+    for (unsigned i = 0; i < instr.getNumOwners(); i++)
+    {
+        const uavcan::PoolAllocationOwnerStats stats = instr.getOwnerStatsByIndex(i);
+        std::cout << stats.owner.toString() << ": used " << stats.num_used_blocks
+                  << ", peak " << stats.peak_num_used_blocks << std::endl;
+    }
+    EXPECT_EQ("CanTxQueue[2]", PoolAllocationOwner(PoolAllocationOwner::KindCanTxQueue, 2).toString());
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <gtest/gtest.h>
+#include <uavcan/helpers/virtual_system_clock.hpp>
+
+
+TEST(VirtualSystemClock, VirtualTime)
+{
+    uavcan::VirtualTime time(1500);
+    EXPECT_EQ(1500, time.getNSec());
+    EXPECT_EQ(1, time.getMonotonic().toUSec());            // Rounded down
+
+    time.advanceTo(1000);                                   // Backwards - ignored
+    EXPECT_EQ(1500, time.getNSec());
+
+    time.advanceTo(999999);
+    EXPECT_EQ(999, time.getMonotonic().toUSec());
+
+    time.advance(uavcan::MonotonicDuration::fromMSec(10));
+    EXPECT_EQ(10999999, time.getNSec());
+
+    time.advance(uavcan::MonotonicDuration::fromMSec(-10)); // Ignored
+    EXPECT_EQ(10999999, time.getNSec());
+}
+
+
+TEST(VirtualSystemClock, Basic)
+{
+    uavcan::VirtualTime time;
+
+    uavcan::VirtualSystemClock plain(time);
+    uavcan::VirtualSystemClock offset(time, 1000000, 2000000);
+
+    EXPECT_EQ(0, plain.getMonotonic().toUSec());
+    EXPECT_EQ(0, plain.getUtc().toUSec());
+    EXPECT_EQ(1000000, offset.getMonotonic().toUSec());
+    EXPECT_EQ(2000000, offset.getUtc().toUSec());
+
+    time.advanceTo(5000000000ULL);                          // 5 s
+
+    EXPECT_EQ(5000000, plain.getMonotonic().toUSec());
+    EXPECT_EQ(5000000, plain.getUtc().toUSec());
+    EXPECT_EQ(6000000, offset.getMonotonic().toUSec());
+    EXPECT_EQ(7000000, offset.getUtc().toUSec());
+
+    /*
+     * Conversion to the virtual time
+     */
+    EXPECT_EQ(5000000000ULL, plain.toVirtualNSec(uavcan::MonotonicTime::fromUSec(5000000)));
+    EXPECT_EQ(5000000000ULL, offset.toVirtualNSec(uavcan::MonotonicTime::fromUSec(6000000)));
+    EXPECT_EQ(0, offset.toVirtualNSec(uavcan::MonotonicTime::fromUSec(500000)));
+    EXPECT_EQ(uavcan::NumericTraits<uint64_t>::max(), offset.toVirtualNSec(uavcan::MonotonicTime::getMax()));
+
+    /*
+     * UTC adjustment affects only the UTC time
+     */
+    offset.adjustUtc(uavcan::UtcDuration::fromMSec(-1500));
+    EXPECT_EQ(6000000, offset.getMonotonic().toUSec());
+    EXPECT_EQ(5500000, offset.getUtc().toUSec());
+    EXPECT_EQ(-1500000, offset.getLastUtcAdjustment().toUSec());
+    EXPECT_EQ(1, offset.getNumUtcAdjustments());
+
+    offset.adjustUtc(uavcan::UtcDuration::fromMSec(-10000));
+    EXPECT_EQ(0, offset.getUtc().toUSec());                 // Saturated
+}
+
+
+TEST(VirtualSystemClock, Drift)
+{
+    uavcan::VirtualTime time;
+    uavcan::VirtualSystemClock fast(time, 0, 0, 100);
+    uavcan::VirtualSystemClock slow(time, 0, 0, -100);
+
+    time.advance(uavcan::MonotonicDuration::fromMSec(3600 * 1000));    // One hour
+
+    EXPECT_EQ(3600000000ULL, fast.getMonotonic().toUSec());            // Monotonic time does not drift
+    EXPECT_EQ(3600000000ULL + 360000, fast.getUtc().toUSec());
+    EXPECT_EQ(3600000000ULL - 360000, slow.getUtc().toUSec());
+
+    /*
+     * Changing the drift rate doesn't make the UTC time jump
+     */
+    fast.setUtcDrift(-100);
+    EXPECT_EQ(-100, fast.getUtcDrift());
+    EXPECT_EQ(3600000000ULL + 360000, fast.getUtc().toUSec());
+
+    time.advance(uavcan::MonotonicDuration::fromMSec(3600 * 1000));
+    EXPECT_EQ(7200000000ULL, fast.getUtc().toUSec());
+}
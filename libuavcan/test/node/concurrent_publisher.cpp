@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include <uavcan/node/concurrent_publisher.hpp>
+#include <root_ns_a/MavlinkMessage.hpp>
+#include "../clock.hpp"
+#include "../transport/can/can.hpp"
+#include "test_node.hpp"
+
+
+TEST(ConcurrentPublisher, Basic)
+{
+    SystemClockMock clock_mock(100);
+    CanDriverMock can_driver(2, clock_mock);
+    TestNode node(can_driver, clock_mock, 1);
+
+    // Manual type registration - we can't rely on the GDTR state
+    uavcan::GlobalDataTypeRegistry::instance().reset();
+    uavcan::DefaultDataTypeRegistrator<root_ns_a::MavlinkMessage> _registrator;
+
+    uavcan::ConcurrentPublisher<root_ns_a::MavlinkMessage, 2> publisher(node);
+
+    std::cout <<
+        "sizeof(uavcan::ConcurrentPublisher<root_ns_a::MavlinkMessage, 2>): " <<
+        sizeof(uavcan::ConcurrentPublisher<root_ns_a::MavlinkMessage, 2>) << std::endl;
+
+    ASSERT_EQ(1, node.getScheduler().getNumSpinHandlers());
+    ASSERT_FALSE(publisher.getTransferSender().isInitialized());
+
+    root_ns_a::MavlinkMessage msg;
+    msg.seq = 0x42;
+    msg.sysid = 0x72;
+    msg.compid = 0x08;
+    msg.msgid = 0xa5;
+    msg.payload = "Msg";
+
+    const uint8_t expected_transfer_payload[] = {0x42, 0x72, 0x08, 0xa5, 'M', 's', 'g'};
+    const uint64_t tx_timeout_usec = uint64_t(publisher.getDefaultTxTimeout().toUSec());
+
+    /*
+     * Enqueueing; nothing is transmitted until the node is spinning
+     */
+    ASSERT_EQ(0, publisher.broadcast(msg));
+    ASSERT_EQ(0, publisher.broadcast(msg));
+    ASSERT_EQ(-uavcan::ErrMemory, publisher.broadcast(msg));        // Queue is full
+    ASSERT_EQ(1, publisher.getNumDroppedMessages());
+    ASSERT_TRUE(can_driver.ifaces[0].tx.empty());
+
+    /*
+     * Spinning - both transfers must be sent, with incrementing transfer ID
+     */
+    ASSERT_LE(0, node.spinOnce());
+
+    for (uint8_t tid = 0; tid < 2; tid++)
+    {
+        uavcan::Frame expected_frame(root_ns_a::MavlinkMessage::DefaultDataTypeID,
+                                     uavcan::TransferTypeMessageBroadcast,
+                                     node.getNodeID(), uavcan::NodeID::Broadcast, tid);
+        expected_frame.setPayload(expected_transfer_payload, 7);
+        expected_frame.setStartOfTransfer(true);
+        expected_frame.setEndOfTransfer(true);
+
+        uavcan::CanFrame expected_can_frame;
+        ASSERT_TRUE(expected_frame.compile(expected_can_frame));
+
+        ASSERT_TRUE(can_driver.ifaces[0].matchAndPopTx(expected_can_frame, tx_timeout_usec + 100));
+        ASSERT_TRUE(can_driver.ifaces[1].matchAndPopTx(expected_can_frame, tx_timeout_usec + 100));
+    }
+    ASSERT_TRUE(can_driver.ifaces[0].tx.empty());
+    ASSERT_TRUE(can_driver.ifaces[1].tx.empty());
+    ASSERT_TRUE(publisher.getTransferSender().isInitialized());
+    ASSERT_EQ(0, publisher.getNumFailedMessages());
+
+    /*
+     * The queue is empty again
+     */
+    ASSERT_EQ(0, publisher.broadcast(msg));
+    ASSERT_LE(0, node.spinOnce());
+    ASSERT_FALSE(can_driver.ifaces[0].tx.empty());
+    ASSERT_EQ(1, publisher.getNumDroppedMessages());
+}
+
+TEST(ConcurrentPublisher, MultipleThreads)
+{
+    SystemClockMock clock_mock(100);
+    CanDriverMock can_driver(1, clock_mock);
+    TestNode node(can_driver, clock_mock, 1);
+
+    uavcan::GlobalDataTypeRegistry::instance().reset();
+    uavcan::DefaultDataTypeRegistrator<root_ns_a::MavlinkMessage> _registrator;
+
+    static const unsigned NumThreads = 4;
+    static const unsigned NumMessagesPerThread = 16;
+
+    // Large enough to accommodate all messages at once
+    uavcan::ConcurrentPublisher<root_ns_a::MavlinkMessage, 64> publisher(node);
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < NumThreads; i++)
+    {
+        threads.push_back(std::thread([&publisher, i]()
+            {
+                root_ns_a::MavlinkMessage msg;
+                msg.sysid = uint8_t(i);
+                for (unsigned k = 0; k < NumMessagesPerThread; k++)
+                {
+                    msg.seq = uint8_t(k);
+                    ASSERT_EQ(0, publisher.broadcast(msg));
+                }
+            }));
+    }
+    for (unsigned i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+
+    ASSERT_LE(0, node.spinOnce());
+
+    // Every transfer must get its own transfer ID, and the order of each thread must be preserved
+    unsigned next_seq[NumThreads] = { };
+    for (unsigned tid = 0; tid < NumThreads * NumMessagesPerThread; tid++)
+    {
+        ASSERT_FALSE(can_driver.ifaces[0].tx.empty());
+        const uavcan::CanFrame can_frame = can_driver.ifaces[0].tx.front().frame;
+        can_driver.ifaces[0].tx.pop();
+
+        uavcan::Frame frame;
+        ASSERT_TRUE(frame.parse(can_frame));
+        ASSERT_EQ(tid % (uavcan::TransferID::Max + 1), frame.getTransferID().get());
+
+        const uint8_t seq = frame.getPayloadPtr()[0];
+        const uint8_t sysid = frame.getPayloadPtr()[1];
+        ASSERT_GT(NumThreads, sysid);
+        ASSERT_EQ(next_seq[sysid], seq);
+        next_seq[sysid]++;
+    }
+    ASSERT_TRUE(can_driver.ifaces[0].tx.empty());
+    ASSERT_EQ(0, publisher.getNumDroppedMessages());
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <uavcan/node/deferred_subscriber.hpp>
+#include <uavcan/helpers/instrumented_pool_allocator.hpp>
+#include <uavcan/util/method_binder.hpp>
+#include <root_ns_a/MavlinkMessage.hpp>
+#include "../clock.hpp"
+#include "../transport/can/can.hpp"
+#include "../transport/transfer_test_helpers.hpp"
+#include "test_node.hpp"
+
+
+namespace
+{
+
+struct DeferredListener
+{
+    typedef uavcan::ReceivedDataStructure<root_ns_a::MavlinkMessage> ReceivedDataStructure;
+
+    std::vector<root_ns_a::MavlinkMessage> messages;
+    std::vector<uavcan::NodeID> src_node_ids;
+
+    void receive(const ReceivedDataStructure& msg)
+    {
+        messages.push_back(msg);
+        src_node_ids.push_back(msg.getSrcNodeID());
+    }
+
+    typedef uavcan::MethodBinder<DeferredListener*, void (DeferredListener::*)(const ReceivedDataStructure&)> Binder;
+
+    Binder bind() { return Binder(this, &DeferredListener::receive); }
+};
+
+void pushMavlinkTransfer(CanDriverMock& can_driver, SystemClockMock& clock, uint8_t src_node_id, uint8_t tid,
+                         const std::string& text)
+{
+    // seq, sysid, compid, msgid, payload
+    std::string payload;
+    payload.push_back(char(tid));
+    payload.push_back(char(0x72));
+    payload.push_back(char(0x08));
+    payload.push_back(char(0xa5));
+    payload += text;
+
+    const uavcan::DataTypeDescriptor* const desc =
+        uavcan::GlobalDataTypeRegistry::instance().find(root_ns_a::MavlinkMessage::getDataTypeFullName());
+    ASSERT_TRUE(desc);
+
+    const Transfer transfer(clock.getMonotonic(), clock.getUtc(), uavcan::TransferPriority::Default,
+                            uavcan::TransferTypeMessageBroadcast, tid, src_node_id, uavcan::NodeID::Broadcast,
+                            payload, *desc);
+    const std::vector<uavcan::RxFrame> frames = serializeTransfer(transfer);
+    for (unsigned i = 0; i < frames.size(); i++)
+    {
+        can_driver.ifaces[0].pushRx(frames[i]);
+    }
+}
+
+}
+
+
+TEST(DeferredSubscriber, Basic)
+{
+    // Manual type registration - we can't rely on the GDTR state
+    uavcan::GlobalDataTypeRegistry::instance().reset();
+    uavcan::DefaultDataTypeRegistrator<root_ns_a::MavlinkMessage> _registrator;
+
+    SystemClockMock clock_mock(100);
+    clock_mock.monotonic_auto_advance = 1000;
+    CanDriverMock can_driver(1, clock_mock);
+    TestNode node(can_driver, clock_mock, 1);
+
+    DeferredListener listener;
+
+    uavcan::DeferredSubscriber<root_ns_a::MavlinkMessage, DeferredListener::Binder> sub(node, 3);
+
+    std::cout <<
+        "sizeof(uavcan::DeferredSubscriber<root_ns_a::MavlinkMessage, DeferredListener::Binder>): " <<
+        sizeof(uavcan::DeferredSubscriber<root_ns_a::MavlinkMessage, DeferredListener::Binder>) << std::endl;
+
+    // Null binder - will fail
+    ASSERT_EQ(-uavcan::ErrInvalidParam, sub.start(DeferredListener::Binder(NULL, NULL)));
+    ASSERT_EQ(0, node.getScheduler().getNumSpinHandlers());
+
+    ASSERT_EQ(0, sub.start(listener.bind()));
+    ASSERT_EQ(1, node.getDispatcher().getNumMessageListeners());
+    ASSERT_EQ(1, node.getScheduler().getNumSpinHandlers());
+    ASSERT_EQ(3, sub.getMaxQueueDepth());
+
+    /*
+     * One callback per spin; the rest of the transfers stay in the queue
+     */
+    sub.setMaxCallbacksPerSpin(1);
+
+    pushMavlinkTransfer(can_driver, clock_mock, 100, 0, "Msg");
+    pushMavlinkTransfer(can_driver, clock_mock, 101, 1, "Long enough to be a multi-frame transfer");
+    pushMavlinkTransfer(can_driver, clock_mock, 102, 2, "");
+    pushMavlinkTransfer(can_driver, clock_mock, 103, 3, "Dropped");      // Doesn't fit the queue
+
+    while (!can_driver.ifaces[0].rx.empty())
+    {
+        ASSERT_LE(0, node.getDispatcher().spinOnce());  // Bypassing the spin handlers
+    }
+
+    ASSERT_TRUE(listener.messages.empty());
+    ASSERT_EQ(3, sub.getQueueDepth());
+    ASSERT_EQ(3, sub.getPeakQueueDepth());
+    ASSERT_EQ(1, sub.getNumDroppedMessages());
+
+    ASSERT_LE(0, node.spinOnce());
+    ASSERT_EQ(1, listener.messages.size());
+    ASSERT_EQ(2, sub.getQueueDepth());
+
+    sub.setMaxCallbacksPerSpin(0);
+    ASSERT_LE(0, node.spinOnce());
+    ASSERT_EQ(0, sub.getQueueDepth());
+    ASSERT_EQ(3, sub.getPeakQueueDepth());
+
+    /*
+     * Validation - FIFO order, payload intact
+     */
+    ASSERT_EQ(3, listener.messages.size());
+    ASSERT_EQ(100, listener.src_node_ids.at(0).get());
+    ASSERT_EQ(101, listener.src_node_ids.at(1).get());
+    ASSERT_EQ(102, listener.src_node_ids.at(2).get());
+
+    ASSERT_EQ(0, listener.messages.at(0).seq);
+    ASSERT_EQ("Msg", listener.messages.at(0).payload);
+    ASSERT_EQ(1, listener.messages.at(1).seq);
+    ASSERT_EQ(0x72, listener.messages.at(1).sysid);
+    ASSERT_EQ("Long enough to be a multi-frame transfer", listener.messages.at(1).payload);
+    ASSERT_EQ(2, listener.messages.at(2).seq);
+    ASSERT_TRUE(listener.messages.at(2).payload.empty());
+
+    ASSERT_EQ(3, sub.getNumExecutedCallbacks());
+    ASSERT_EQ(0, sub.getFailureCount());
+
+    // The clock advances on every access, so the latency can't be zero
+    ASSERT_LT(0, sub.getMaxCallbackLatency().toUSec());
+    ASSERT_LT(0, sub.getAverageCallbackLatency().toUSec());
+    ASSERT_LE(sub.getAverageCallbackLatency(), sub.getMaxCallbackLatency());
+
+    /*
+     * Stopping discards the pending transfers and releases the memory
+     */
+    pushMavlinkTransfer(can_driver, clock_mock, 100, 4, "Discarded");
+    ASSERT_LE(0, node.getDispatcher().spinOnce());
+    ASSERT_EQ(1, sub.getQueueDepth());
+    ASSERT_LT(0, node.pool.getNumAllocatedBlocks());
+
+    sub.stop();
+    ASSERT_EQ(0, sub.getQueueDepth());
+    ASSERT_EQ(0, node.getDispatcher().getNumMessageListeners());
+    ASSERT_EQ(0, node.getScheduler().getNumSpinHandlers());
+
+    ASSERT_LE(0, node.spinOnce());
+    ASSERT_EQ(3, listener.messages.size());
+}
+
+
+TEST(DeferredSubscriber, MemoryAccounting)
+{
+    using uavcan::PoolAllocationOwner;
+
+    uavcan::GlobalDataTypeRegistry::instance().reset();
+    uavcan::DefaultDataTypeRegistrator<root_ns_a::MavlinkMessage> _registrator;
+
+    SystemClockMock clock_mock(100);
+    CanDriverMock can_driver(1, clock_mock);
+    uavcan::PoolAllocator<uavcan::MemPoolBlockSize * 64, uavcan::MemPoolBlockSize> pool;
+    uavcan::InstrumentedPoolAllocator<> instr(pool);
+    uavcan::Scheduler scheduler(can_driver, instr, clock_mock);
+
+    struct Node : public uavcan::INode
+    {
+        uavcan::IPoolAllocator& allocator;
+        uavcan::Scheduler& scheduler;
+
+        Node(uavcan::IPoolAllocator& a, uavcan::Scheduler& s) : allocator(a), scheduler(s) { setNodeID(1); }
+
+        virtual void registerInternalFailure(const char*) { }
+        virtual uavcan::IPoolAllocator& getAllocator() { return allocator; }
+        virtual uavcan::Scheduler& getScheduler() { return scheduler; }
+        virtual const uavcan::Scheduler& getScheduler() const { return scheduler; }
+    } node(instr, scheduler);
+
+    DeferredListener listener;
+    uavcan::DeferredSubscriber<root_ns_a::MavlinkMessage, DeferredListener::Binder> sub(node);
+    ASSERT_EQ(0, sub.start(listener.bind()));
+
+    pushMavlinkTransfer(can_driver, clock_mock, 100, 0, "Long enough to be a multi-frame transfer");
+    while (!can_driver.ifaces[0].rx.empty())
+    {
+        ASSERT_LE(0, node.getDispatcher().spinOnce());
+    }
+    ASSERT_EQ(1, sub.getQueueDepth());
+
+    const PoolAllocationOwner owner(PoolAllocationOwner::KindDeferredTransfers,
+                                    root_ns_a::MavlinkMessage::DefaultDataTypeID);
+    ASSERT_LT(1, instr.getOwnerStats(owner).num_used_blocks);     // Entry plus payload
+
+    ASSERT_LE(0, node.spinOnce());
+    ASSERT_EQ(1, listener.messages.size());
+    ASSERT_EQ(0, instr.getOwnerStats(owner).num_used_blocks);
+    ASSERT_LT(1, instr.getOwnerStats(owner).peak_num_used_blocks);
+}
@@ -90,6 +90,65 @@ TEST(Scheduler, Timers)
     ASSERT_EQ(0, node.spin(durMono(1000)));                                    // Spin some more without timers
 }
 
+struct SpinHandlerCounter : public uavcan::SpinHandler
+{
+    unsigned count;
+    unsigned remove_after;
+
+    SpinHandlerCounter(uavcan::Scheduler& scheduler, unsigned arg_remove_after)
+        : uavcan::SpinHandler(scheduler)
+        , count(0)
+        , remove_after(arg_remove_after)
+    { }
+
+    virtual void handleSpin(uavcan::MonotonicTime)
+    {
+        count++;
+        if (count >= remove_after)
+        {
+            stop();
+        }
+    }
+};
+
+TEST(Scheduler, SpinHandlers)
+{
+    SystemClockMock clock_mock(100);
+    CanDriverMock can_driver(2, clock_mock);
+    TestNode node(can_driver, clock_mock, 1);
+
+    {
+        SpinHandlerCounter a(node.getScheduler(), 1000);
+        SpinHandlerCounter b(node.getScheduler(), 2);       // Will remove itself on the second call
+
+        ASSERT_EQ(0, node.getScheduler().getNumSpinHandlers());
+        a.start();
+        b.start();
+        b.start();                                          // Repeated registration is ignored
+        ASSERT_EQ(2, node.getScheduler().getNumSpinHandlers());
+        ASSERT_TRUE(a.isRunning());
+        ASSERT_TRUE(b.isRunning());
+
+        ASSERT_LE(0, node.spinOnce());
+        ASSERT_EQ(1, a.count);
+        ASSERT_EQ(1, b.count);
+
+        ASSERT_LE(0, node.spinOnce());
+        ASSERT_LE(0, node.spinOnce());
+        ASSERT_EQ(3, a.count);
+        ASSERT_EQ(2, b.count);
+        ASSERT_TRUE(a.isRunning());
+        ASSERT_FALSE(b.isRunning());
+        ASSERT_EQ(1, node.getScheduler().getNumSpinHandlers());
+
+        clock_mock.monotonic_auto_advance = 1000;
+        ASSERT_LE(0, node.spin(durMono(10000)));            // Invoked once per spin iteration
+        ASSERT_LT(3, a.count);
+    }
+
+    ASSERT_EQ(0, node.getScheduler().getNumSpinHandlers()); // Destroyed handlers are removed automatically
+}
+
 #if UAVCAN_CPP_VERSION >= UAVCAN_CPP11
 
 TEST(Scheduler, TimerCpp11)
@@ -439,6 +439,102 @@ TEST(ServiceClient, Priority)
 }
 
 
+TEST(ServiceClient, ManyServers)
+{
+    InterlinkedTestNodesWithSysClock nodes;
+
+    // Type registration
+    uavcan::GlobalDataTypeRegistry::instance().reset();
+    uavcan::DefaultDataTypeRegistrator<root_ns_a::StringService> _registrator;
+
+    // Server - the only one that is actually present
+    uavcan::ServiceServer<root_ns_a::StringService> server(nodes.a);
+    ASSERT_EQ(0, server.start(stringServiceServerCallback));
+
+    // Caller
+    typedef uavcan::ServiceCallResult<root_ns_a::StringService> ResultType;
+    typedef uavcan::ServiceClient<root_ns_a::StringService,
+                                  typename ServiceCallResultHandler<root_ns_a::StringService>::Binder > ClientType;
+    ServiceCallResultHandler<root_ns_a::StringService> handler;
+
+    ClientType client(nodes.b);
+    client.setCallback(handler.bind());
+    client.setRequestTimeout(uavcan::MonotonicDuration::fromMSec(100));
+
+    // The outgoing transfer registry keeps growing during the first round, so memory is checked on the second one
+    unsigned num_blocks_after_first_round = 0;
+    for (unsigned round = 0; round < 2; round++)
+    {
+        /*
+         * Fanning out to every possible server, except self
+         */
+        root_ns_a::StringService::Request request;
+        request.string_request = "Fan out";
+        for (uint8_t nid = 1; nid <= uavcan::NodeID::Max; nid++)
+        {
+            if (nid != nodes.b.getNodeID().get())
+            {
+                ASSERT_LT(0, client.call(nid, request));
+            }
+        }
+        ASSERT_EQ(uavcan::NodeID::Max - 1U, client.getNumPendingCalls());
+
+        for (uint8_t nid = 1; nid <= uavcan::NodeID::Max; nid++)
+        {
+            ASSERT_EQ(nid != nodes.b.getNodeID().get(), client.hasPendingCallToServer(nid));
+        }
+
+        // Calls are traversed in the order of server node ID
+        ASSERT_EQ(uavcan::NodeID(1), client.getCallIDByIndex(0).server_node_id);
+        ASSERT_EQ(uavcan::NodeID(3), client.getCallIDByIndex(1).server_node_id);
+        ASSERT_EQ(uavcan::NodeID::Max, client.getCallIDByIndex(uavcan::NodeID::Max - 2U).server_node_id.get());
+        ASSERT_FALSE(client.getCallIDByIndex(uavcan::NodeID::Max - 1U).isValid());
+
+        // Cancelling a few; non-existent calls are ignored
+        client.cancelCall(client.getCallIDByIndex(1));
+        client.cancelCall(uavcan::ServiceCallID(uavcan::NodeID(100), uavcan::TransferID(7)));
+        client.cancelCall(uavcan::ServiceCallID());
+        ASSERT_FALSE(client.hasPendingCallToServer(3));
+        ASSERT_EQ(uavcan::NodeID::Max - 2U, client.getNumPendingCalls());
+
+        /*
+         * Only one server responds
+         */
+        nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(20));
+        ASSERT_FALSE(client.hasPendingCallToServer(1));
+        ASSERT_EQ(uavcan::NodeID::Max - 3U, client.getNumPendingCalls());
+        ASSERT_EQ(1, handler.responses.size());
+        ASSERT_TRUE(handler.match(ResultType::Success, 1, handler.responses.front()));
+        ASSERT_STREQ("Request string: Fan out", handler.responses.front().string_response.c_str());
+        handler.responses.pop();
+
+        /*
+         * The rest time out
+         */
+        nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(200));
+        ASSERT_FALSE(client.hasPendingCalls());
+        ASSERT_EQ(0, client.getNumPendingCalls());
+        ASSERT_EQ(uavcan::NodeID::Max - 3U, handler.responses.size());
+        ASSERT_EQ(ResultType::ErrorTimeout, handler.last_status);
+        ASSERT_EQ(0, nodes.b.getDispatcher().getNumServiceResponseListeners());
+        while (!handler.responses.empty())
+        {
+            handler.responses.pop();
+        }
+
+        // All index blocks and call states have been released
+        if (round == 0)
+        {
+            num_blocks_after_first_round = nodes.b.pool.getNumAllocatedBlocks();
+        }
+        else
+        {
+            ASSERT_EQ(num_blocks_after_first_round, nodes.b.pool.getNumAllocatedBlocks());
+        }
+    }
+}
+
+
 TEST(ServiceClient, Sizes)
 {
     using namespace uavcan;
@@ -3,6 +3,7 @@
  */
 
 #include <gtest/gtest.h>
+#include <vector>
 #include <uavcan/node/service_server.hpp>
 #include <uavcan/util/method_binder.hpp>
 #include <root_ns_a/StringService.hpp>
@@ -52,6 +53,45 @@ struct EmptyServerImpl
 };
 
 
+struct DeferringServerImpl
+{
+    typedef uavcan::ServiceServer<root_ns_a::StringService,
+                                  uavcan::MethodBinder<DeferringServerImpl*,
+                                      void (DeferringServerImpl::*)(
+                                          const uavcan::ReceivedDataStructure<root_ns_a::StringService::Request>&,
+                                          root_ns_a::StringService::Response&)>,
+                                  true> Server;
+
+    Server* server;
+    std::vector<uavcan::ServiceResponseToken> tokens;
+
+    DeferringServerImpl() : server(NULL) { }
+
+    void handleRequest(const uavcan::ReceivedDataStructure<root_ns_a::StringService::Request>&,
+                       root_ns_a::StringService::Response& response)
+    {
+        response.string_response = "immediate";       // Will be sent only if the response could not be deferred
+        tokens.push_back(server->deferResponse());
+    }
+
+    Server::Callback bind() { return Server::Callback(this, &DeferringServerImpl::handleRequest); }
+};
+
+
+static void pushStringRequest(CanDriverMock& can_driver, const uavcan::ISystemClock& clock, uint8_t src_node_id,
+                              uint8_t tid)
+{
+    uavcan::Frame frame(root_ns_a::StringService::DefaultDataTypeID, uavcan::TransferTypeServiceRequest,
+                        uavcan::NodeID(src_node_id), 1, tid);
+    const uint8_t req[] = {'r', 'e', 'q'};
+    frame.setPayload(req, sizeof(req));
+    frame.setStartOfTransfer(true);
+    frame.setEndOfTransfer(true);
+    frame.setPriority(tid);
+    can_driver.ifaces[0].pushRx(uavcan::RxFrame(frame, clock.getMonotonic(), clock.getUtc(), 0));
+}
+
+
 TEST(ServiceServer, Basic)
 {
     // Manual type registration - we can't rely on the GDTR state
@@ -154,3 +194,128 @@ TEST(ServiceServer, Empty)
     ASSERT_GE(0, server.start(impl.bind()));
     ASSERT_EQ(1, node.getDispatcher().getNumServiceRequestListeners());
 }
+
+
+TEST(ServiceServer, DeferredResponsesAreOptIn)
+{
+    typedef uavcan::ServiceServer<root_ns_a::StringService, StringServerImpl::Binder> SyncServer;
+    typedef uavcan::ServiceServer<root_ns_a::StringService, StringServerImpl::Binder, true> DeferringServer;
+
+    std::cout << "sizeof(SyncServer): " << sizeof(SyncServer) << std::endl;
+    std::cout << "sizeof(DeferringServer): " << sizeof(DeferringServer) << std::endl;
+
+    // Synchronous servers don't carry the deferred response registry
+    ASSERT_LT(sizeof(SyncServer) + sizeof(uavcan::DeferredResponseRegistry) / 2, sizeof(DeferringServer));
+}
+
+
+TEST(ServiceServer, DeferredResponse)
+{
+    uavcan::GlobalDataTypeRegistry::instance().reset();
+    uavcan::DefaultDataTypeRegistrator<root_ns_a::StringService> _registrator;
+
+    SystemClockMock clock_mock(100);
+    CanDriverMock can_driver(1, clock_mock);
+    TestNode node(can_driver, clock_mock, 1);
+
+    DeferringServerImpl impl;
+    DeferringServerImpl::Server server(node);
+    impl.server = &server;
+
+    ASSERT_EQ(0, server.start(impl.bind()));
+    server.setDeferredResponseTimeout(uavcan::MonotonicDuration::fromMSec(100));
+
+    /*
+     * Two requests, neither is responded immediately
+     */
+    pushStringRequest(can_driver, clock_mock, 0x10, 0);
+    pushStringRequest(can_driver, clock_mock, 0x11, 1);
+    ASSERT_LE(0, node.spinOnce());
+
+    ASSERT_TRUE(can_driver.ifaces[0].tx.empty());
+    ASSERT_EQ(2, impl.tokens.size());
+    ASSERT_TRUE(impl.tokens.at(0).isValid());
+    ASSERT_TRUE(impl.tokens.at(1).isValid());
+    ASSERT_EQ(2, server.getNumPendingResponses());
+    ASSERT_EQ(0x11, impl.tokens.at(1).getClientNodeID().get());
+    ASSERT_EQ(1, impl.tokens.at(1).getTransferID().get());
+
+    /*
+     * Responding out of order
+     */
+    root_ns_a::StringService::Response response;
+    response.string_response = "ok";
+    ASSERT_LE(0, server.respond(impl.tokens.at(1), response));
+    ASSERT_EQ(1, server.getNumPendingResponses());
+
+    ASSERT_EQ(1, can_driver.ifaces[0].tx.size());
+    uavcan::Frame fr;
+    ASSERT_TRUE(fr.parse(can_driver.ifaces[0].popTxFrame()));
+    ASSERT_EQ(uavcan::TransferTypeServiceResponse, fr.getTransferType());
+    ASSERT_EQ(0x11, fr.getDstNodeID().get());
+    ASSERT_EQ(1, fr.getTransferID().get());
+    ASSERT_EQ(1, fr.getPriority().get());
+    ASSERT_EQ(0, std::strncmp("ok", reinterpret_cast<const char*>(fr.getPayloadPtr()), 2));
+
+    // Tokens can't be reused
+    ASSERT_EQ(-uavcan::ErrInvalidParam, server.respond(impl.tokens.at(1), response));
+    ASSERT_EQ(-uavcan::ErrInvalidParam, server.respond(uavcan::ServiceResponseToken(), response));
+
+    /*
+     * The other one times out
+     */
+    clock_mock.advance(200000);
+    ASSERT_LE(0, node.spinOnce());
+    ASSERT_EQ(0, server.getNumPendingResponses());
+    ASSERT_EQ(1, server.getNumTimedOutResponses());
+    ASSERT_EQ(-uavcan::ErrInvalidParam, server.respond(impl.tokens.at(0), response));
+    ASSERT_TRUE(can_driver.ifaces[0].tx.empty());
+
+    /*
+     * Expired tokens are rejected even if the timer didn't fire yet; stopping the server discards the rest
+     */
+    pushStringRequest(can_driver, clock_mock, 0x12, 2);
+    pushStringRequest(can_driver, clock_mock, 0x13, 3);
+    ASSERT_LE(0, node.getDispatcher().spinOnce());
+    ASSERT_EQ(2, server.getNumPendingResponses());
+    ASSERT_TRUE(server.cancelResponse(impl.tokens.at(3)));
+    ASSERT_FALSE(server.cancelResponse(impl.tokens.at(3)));
+
+    clock_mock.advance(200000);
+    ASSERT_EQ(-uavcan::ErrInvalidParam, server.respond(impl.tokens.at(2), response));
+    ASSERT_EQ(2, server.getNumTimedOutResponses());
+    ASSERT_EQ(0, server.getNumPendingResponses());
+
+    pushStringRequest(can_driver, clock_mock, 0x14, 4);
+    ASSERT_LE(0, node.spinOnce());
+    ASSERT_EQ(1, server.getNumPendingResponses());
+    server.stop();
+    ASSERT_EQ(0, server.getNumPendingResponses());
+    ASSERT_EQ(-uavcan::ErrInvalidParam, server.respond(impl.tokens.at(4), response));
+
+    /*
+     * Restarting the server while some responses are pending discards them as well
+     */
+    ASSERT_EQ(0, server.start(impl.bind()));
+    pushStringRequest(can_driver, clock_mock, 0x15, 5);
+    pushStringRequest(can_driver, clock_mock, 0x16, 6);
+    ASSERT_LE(0, node.spinOnce());
+    ASSERT_EQ(2, server.getNumPendingResponses());
+
+    ASSERT_EQ(0, server.start(impl.bind()));
+    ASSERT_EQ(0, server.getNumPendingResponses());
+    ASSERT_EQ(-uavcan::ErrInvalidParam, server.respond(impl.tokens.at(5), response));
+    ASSERT_EQ(-uavcan::ErrInvalidParam, server.respond(impl.tokens.at(6), response));
+
+    pushStringRequest(can_driver, clock_mock, 0x17, 7);
+    ASSERT_LE(0, node.spinOnce());
+    ASSERT_EQ(1, server.getNumPendingResponses());
+    ASSERT_LE(0, server.respond(impl.tokens.at(7), response));
+    ASSERT_EQ(0, server.getNumPendingResponses());
+    ASSERT_EQ(1, can_driver.ifaces[0].tx.size());
+    ASSERT_TRUE(fr.parse(can_driver.ifaces[0].popTxFrame()));
+    ASSERT_EQ(0x17, fr.getDstNodeID().get());
+
+    ASSERT_TRUE(can_driver.ifaces[0].tx.empty());
+    ASSERT_EQ(0, server.getResponseFailureCount());
+}
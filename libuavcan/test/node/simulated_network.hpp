@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#pragma once
+
+#include <cassert>
+#include <vector>
+#include <algorithm>
+#include <uavcan/node/abstract_node.hpp>
+#include <uavcan/helpers/virtual_system_clock.hpp>
+#include "../transport/can/simulated_can_bus.hpp"
+
+/**
+ * Discrete-event driver of a network of nodes attached to one @ref SimulatedCanBus.
+ *
+ * Instead of spinning every node in real time, the driver spins only the nodes that have something to do -
+ * received frames, a released TX mailbox or an expired deadline - and then advances the virtual time straight
+ * to the next event, which is either the end of the current bus transmission or the earliest deadline among
+ * all nodes. Therefore the cost of a simulation depends on the number of events rather than on the simulated
+ * time, which makes it possible to simulate hours of network operation in seconds.
+ *
+ * Nodes are spun with spinOnce(), hence spin handlers are invoked only when the node is spun for one of the
+ * reasons listed above. Every node should use the clock of its driver (see @ref SimulatedCanDriver::getClock()).
+ *
+ * The nodes must not be spun by other means while the simulation is running.
+ */
+class SimulatedNetwork : uavcan::Noncopyable
+{
+public:
+    struct Statistics
+    {
+        uint64_t spins;                 ///< Number of spinOnce() calls, all nodes together
+        uint64_t bus_events;            ///< Completed transmissions, including the corrupted ones
+        uint64_t time_jumps;            ///< Advancements of the virtual time to a node deadline
+
+        Statistics()
+            : spins(0)
+            , bus_events(0)
+            , time_jumps(0)
+        { }
+    };
+
+private:
+    struct Entry
+    {
+        uavcan::INode* node;
+        SimulatedCanDriver* driver;
+    };
+
+    SimulatedCanBus& bus_;
+    std::vector<Entry> nodes_;
+    Statistics stats_;
+
+    static uint64_t getNextDeadlineNSec(const Entry& e)
+    {
+        const uavcan::MonotonicTime dl = e.node->getScheduler().getDeadlineScheduler().getEarliestDeadline();
+        return e.driver->getClock().toVirtualNSec(dl);
+    }
+
+    /**
+     * Spins the nodes that have pending work until there's none left.
+     * Returns the earliest deadline among all nodes, in the virtual time, or a negative error code.
+     */
+    int spinPendingNodes(uint64_t& out_next_deadline_ns)
+    {
+        bool spun = true;
+        while (spun)
+        {
+            spun = false;
+            out_next_deadline_ns = uavcan::NumericTraits<uint64_t>::max();
+
+            for (std::vector<Entry>::iterator it = nodes_.begin(); it != nodes_.end(); ++it)
+            {
+                uint64_t deadline_ns = getNextDeadlineNSec(*it);
+                const bool mailbox_released = it->driver->pollTxMailboxReleased();
+
+                if (mailbox_released ||
+                    (it->driver->getNumPendingRxFrames() > 0) ||
+                    (deadline_ns <= bus_.getVirtualTime().getNSec()))
+                {
+                    const int res = it->node->spinOnce();
+                    if (res < 0)
+                    {
+                        return res;
+                    }
+                    stats_.spins++;
+                    spun = true;
+                    deadline_ns = getNextDeadlineNSec(*it);
+                }
+
+                out_next_deadline_ns = std::min(out_next_deadline_ns, deadline_ns);
+            }
+        }
+        return 0;
+    }
+
+public:
+    explicit SimulatedNetwork(SimulatedCanBus& bus)
+        : bus_(bus)
+    { }
+
+    /**
+     * The driver must be attached to the bus of this network, and the node must use that driver.
+     */
+    void addNode(uavcan::INode& node, SimulatedCanDriver& driver)
+    {
+        assert(&driver.getBus() == &bus_);
+        Entry e;
+        e.node = &node;
+        e.driver = &driver;
+        nodes_.push_back(e);
+    }
+
+    unsigned getNumNodes() const { return unsigned(nodes_.size()); }
+
+    SimulatedCanBus& getBus() { return bus_; }
+
+    uavcan::VirtualTime& getVirtualTime() { return bus_.getVirtualTime(); }
+
+    const Statistics& getStatistics() const { return stats_; }
+
+    /**
+     * Runs the simulation until the specified virtual time, in nanoseconds.
+     * Returns the first negative error code reported by a node, or zero.
+     */
+    int runUntil(uint64_t deadline_ns)
+    {
+        while (true)
+        {
+            uint64_t next_deadline_ns = 0;
+            const int res = spinPendingNodes(next_deadline_ns);
+            if (res < 0)
+            {
+                return res;
+            }
+
+            const uint64_t limit_ns = std::min(next_deadline_ns, deadline_ns);
+            if (bus_.step(limit_ns))
+            {
+                stats_.bus_events++;
+                continue;
+            }
+
+            if (bus_.getVirtualTime().getNSec() >= deadline_ns)
+            {
+                break;
+            }
+            bus_.getVirtualTime().advanceTo(limit_ns);
+            stats_.time_jumps++;
+        }
+        return 0;
+    }
+
+    int run(uavcan::MonotonicDuration duration)
+    {
+        return runUntil(bus_.getVirtualTime().getNSec() + uint64_t(duration.toUSec()) * 1000U);
+    }
+};
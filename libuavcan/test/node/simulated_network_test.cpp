@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <uavcan/node/publisher.hpp>
+#include <uavcan/node/subscriber.hpp>
+#include <uavcan/node/timer.hpp>
+#include <root_ns_a/MavlinkMessage.hpp>
+#include "simulated_network.hpp"
+#include "test_node.hpp"
+
+
+namespace
+{
+/**
+ * Publishes a message on every timer event.
+ */
+struct PeriodicPublisher : public uavcan::TimerBase
+{
+    uavcan::Publisher<root_ns_a::MavlinkMessage> publisher;
+    unsigned num_timer_events;
+
+    explicit PeriodicPublisher(uavcan::INode& node)
+        : uavcan::TimerBase(node)
+        , publisher(node)
+        , num_timer_events(0)
+    { }
+
+    virtual void handleTimerEvent(const uavcan::TimerEvent& event)
+    {
+        num_timer_events++;
+        EXPECT_EQ(event.scheduled_time, event.real_time);   // No jitter in the virtual time
+        root_ns_a::MavlinkMessage msg;
+        msg.seq = uint8_t(num_timer_events);
+        ASSERT_LE(0, publisher.broadcast(msg));
+    }
+};
+
+struct SimulatedNode
+{
+    uavcan::VirtualSystemClock clock;
+    SimulatedCanDriver can;
+    TestNode node;
+    PeriodicPublisher timer;
+
+    SimulatedNode(SimulatedCanBus& bus, uavcan::NodeID node_id, uint64_t monotonic_offset_usec)
+        : clock(bus.getVirtualTime(), monotonic_offset_usec)
+        , can(bus, clock)
+        , node(can, clock, node_id)
+        , timer(node)
+    { }
+};
+
+struct SimulatedNodes
+{
+    std::vector<SimulatedNode*> items;
+
+    ~SimulatedNodes()
+    {
+        for (std::vector<SimulatedNode*>::iterator it = items.begin(); it != items.end(); ++it)
+        {
+            delete *it;
+        }
+    }
+};
+
+struct MessageCounter
+{
+    unsigned* counter;
+
+    MessageCounter(unsigned* c = NULL) : counter(c) { }
+
+    void operator()(const root_ns_a::MavlinkMessage&) { (*counter)++; }
+};
+
+}
+
+
+TEST(SimulatedNetwork, TimeJumps)
+{
+    uavcan::GlobalDataTypeRegistry::instance().reset();
+    uavcan::DefaultDataTypeRegistrator<root_ns_a::MavlinkMessage> _registrator;
+
+    uavcan::VirtualTime time;
+    SimulatedCanBus bus(time);
+    SimulatedNetwork network(bus);
+
+    SimulatedNode a(bus, 1, 0);
+    network.addNode(a.node, a.can);
+    ASSERT_EQ(1, network.getNumNodes());
+
+    /*
+     * The virtual time jumps from one event to the next one, so a simulated hour takes only a few thousands
+     * of iterations
+     */
+    a.timer.startPeriodic(uavcan::MonotonicDuration::fromMSec(1000));
+    ASSERT_EQ(0, network.run(uavcan::MonotonicDuration::fromMSec(3600 * 1000 + 500)));
+
+    EXPECT_EQ(3600500000000ULL, time.getNSec());
+    EXPECT_EQ(3600, a.timer.num_timer_events);
+    EXPECT_EQ(3600, bus.getStatistics().frames);
+    EXPECT_EQ(3600, network.getStatistics().bus_events);
+    EXPECT_GE(3600 + 1, network.getStatistics().time_jumps);
+    EXPECT_GE(2 * 3600, network.getStatistics().spins);     // Timer event, then the released TX mailbox
+
+    /*
+     * Nothing to do - a single jump to the deadline
+     */
+    a.timer.stop();
+    const SimulatedNetwork::Statistics stats = network.getStatistics();
+    ASSERT_EQ(0, network.run(uavcan::MonotonicDuration::fromMSec(3600 * 1000)));
+    EXPECT_EQ(7200500000000ULL, time.getNSec());
+    EXPECT_EQ(stats.time_jumps + 1, network.getStatistics().time_jumps);
+    EXPECT_EQ(stats.spins, network.getStatistics().spins);
+}
+
+
+TEST(SimulatedNetwork, MaxNodes)
+{
+    uavcan::GlobalDataTypeRegistry::instance().reset();
+    uavcan::DefaultDataTypeRegistrator<root_ns_a::MavlinkMessage> _registrator;
+
+    uavcan::VirtualTime time;
+    SimulatedCanBus bus(time);
+    SimulatedNetwork network(bus);
+
+    /*
+     * Every node publishes once per second; their clocks are not aligned
+     */
+    SimulatedNodes nodes;
+    for (uint8_t i = 1; i <= uavcan::NodeID::Max; i++)
+    {
+        SimulatedNode* const n = new SimulatedNode(bus, i, uint64_t(i) * 12345U);
+        nodes.items.push_back(n);
+        network.addNode(n->node, n->can);
+        n->timer.startPeriodic(uavcan::MonotonicDuration::fromMSec(1000));
+    }
+    ASSERT_EQ(127, network.getNumNodes());
+
+    unsigned num_received = 0;
+    uavcan::Subscriber<root_ns_a::MavlinkMessage, MessageCounter> subscriber(nodes.items.back()->node);
+    ASSERT_LE(0, subscriber.start(MessageCounter(&num_received)));
+
+    ASSERT_EQ(0, network.run(uavcan::MonotonicDuration::fromMSec(10 * 1000 + 500)));
+
+    /*
+     * All messages are delivered, the bus is lightly loaded
+     */
+    for (std::vector<SimulatedNode*>::const_iterator it = nodes.items.begin(); it != nodes.items.end(); ++it)
+    {
+        EXPECT_EQ(10, (*it)->timer.num_timer_events);
+        EXPECT_EQ(10, (*it)->can.getStatistics().frames_tx);
+        EXPECT_EQ(0, (*it)->node.internal_failure_count);
+    }
+    EXPECT_EQ(126 * 10, num_received);
+    EXPECT_EQ(127 * 10, bus.getStatistics().frames);
+    EXPECT_GT(0.02, bus.getUtilization());
+}
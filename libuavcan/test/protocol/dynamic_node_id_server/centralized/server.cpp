@@ -69,6 +69,113 @@ TEST(dynamic_node_id_server_centralized_Server, Basic)
 }
 
 
+namespace
+{
+
+struct NodeEnvironment
+{
+    PairableCanDriver can_driver;
+    TestNode node;
+
+    NodeEnvironment(SystemClockMock& clock, uavcan::NodeID node_id)
+        : can_driver(clock)
+        , node(can_driver, clock, node_id)
+    { }
+};
+
+}
+
+TEST(dynamic_node_id_server_centralized_Server, AllocationStorm)
+{
+    using namespace uavcan::dynamic_node_id_server;
+    using namespace uavcan::protocol::dynamic_node_id;
+
+    uavcan::GlobalDataTypeRegistry::instance().reset();
+    uavcan::DefaultDataTypeRegistrator<Allocation> _reg1;
+    uavcan::DefaultDataTypeRegistrator<uavcan::protocol::GetNodeInfo> _reg2;
+    uavcan::DefaultDataTypeRegistrator<uavcan::protocol::NodeStatus> _reg3;
+
+    static const unsigned NumClients = 120;      // Whole vehicle powering on at once
+
+    /*
+     * All nodes share the same simulated clock, otherwise the storm would take minutes of real time
+     */
+    SystemClockMock clock(1000000);
+    EventTracer tracer;
+    MemoryStorageBackend storage;
+
+    NodeEnvironment server_env(clock, uavcan::NodeID(127));
+    std::auto_ptr<NodeEnvironment> client_envs[NumClients];
+    std::auto_ptr<uavcan::DynamicNodeIDClient> clients[NumClients];
+
+    for (unsigned i = 0; i < NumClients; i++)
+    {
+        client_envs[i].reset(new NodeEnvironment(clock, uavcan::NodeID::Broadcast));
+        server_env.can_driver.linkTogether(&client_envs[i]->can_driver);
+        for (unsigned k = 0; k < i; k++)
+        {
+            client_envs[i]->can_driver.linkTogether(&client_envs[k]->can_driver);
+        }
+    }
+
+    UniqueID own_unique_id;
+    own_unique_id[0] = 0xFF;
+
+    uavcan::dynamic_node_id_server::CentralizedServer server(server_env.node, storage, tracer);
+    ASSERT_LE(0, server.init(own_unique_id));
+
+    for (unsigned i = 0; i < NumClients; i++)
+    {
+        clients[i].reset(new uavcan::DynamicNodeIDClient(client_envs[i]->node));
+        uavcan::protocol::HardwareVersion::FieldTypes::unique_id unique_id;
+        unique_id[0] = uint8_t(i + 1);          // The first part of the unique ID must be unique
+        unique_id[15] = 0xAA;
+        ASSERT_LE(0, clients[i]->start(unique_id));
+    }
+
+    /*
+     * Fire
+     */
+    const unsigned num_get_calls_before = storage.getNumGetCalls();
+    const uavcan::MonotonicTime started_at = clock.getMonotonic();
+    unsigned num_allocated = 0;
+
+    while (num_allocated < NumClients)
+    {
+        ASSERT_LE(0, server_env.node.spinOnce());
+        num_allocated = 0;
+        for (unsigned i = 0; i < NumClients; i++)
+        {
+            ASSERT_LE(0, client_envs[i]->node.spinOnce());
+            num_allocated += clients[i]->isAllocationComplete() ? 1U : 0U;
+        }
+        clock.advance(5000);
+        ASSERT_GT(600000, (clock.getMonotonic() - started_at).toMSec());
+    }
+
+    const uavcan::MonotonicDuration time_to_allocate_all = clock.getMonotonic() - started_at;
+    const unsigned num_get_calls = storage.getNumGetCalls() - num_get_calls_before;
+    std::cout << "Time to allocate " << NumClients << " nodes: " << time_to_allocate_all.toMSec() << " ms, "
+              << num_get_calls << " storage reads" << std::endl;
+
+    /*
+     * Every allocation reads back what it has written, and nothing else is read from the storage
+     */
+    ASSERT_EQ(NumClients + 1, server.getNumAllocations());
+    ASSERT_GE(NumClients * 3, num_get_calls);
+
+    uavcan::BitSet<uavcan::NodeID::Max + 1> allocated_node_ids;
+    allocated_node_ids[127] = true;
+    for (unsigned i = 0; i < NumClients; i++)
+    {
+        const uavcan::NodeID nid = clients[i]->getAllocatedNodeID();
+        ASSERT_TRUE(nid.isUnicast());
+        ASSERT_FALSE(allocated_node_ids[nid.get()]);
+        allocated_node_ids[nid.get()] = true;
+    }
+}
+
+
 TEST(dynamic_node_id_server_centralized, ObjectSizes)
 {
     using namespace uavcan::dynamic_node_id_server;
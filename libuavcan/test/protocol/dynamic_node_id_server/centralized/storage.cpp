@@ -91,21 +91,24 @@ TEST(dynamic_node_id_server_centralized_Storage, Basic)
 
     ASSERT_EQ("02000000000000000000000000000000", storage.get("occupation_mask"));
     ASSERT_EQ("1",                                storage.get("01000000000000000000000000000000"));
+    ASSERT_EQ("01000000000000000000000000000000", storage.get("node1_unique_id"));
 
-    ASSERT_EQ(2, storage.getNumKeys());
+    ASSERT_EQ(3, storage.getNumKeys());
     ASSERT_EQ(1, stor.getSize());
+    ASSERT_EQ(1, stor.getNumIndexedAllocations());
 
     /*
      * Adding another entry while storage is failing
      */
     storage.failOnSetCalls(true);
 
-    ASSERT_EQ(2, storage.getNumKeys());
+    ASSERT_EQ(3, storage.getNumKeys());
 
     unique_id[0] = 2;
     ASSERT_GT(0, stor.add(2, unique_id));
 
-    ASSERT_EQ(2, storage.getNumKeys());  // No new entries, we failed
+    ASSERT_EQ(3, storage.getNumKeys());  // No new entries, we failed
+    ASSERT_FALSE(stor.getNodeIDForUniqueID(unique_id).isValid());
 
     ASSERT_EQ(1, stor.getSize());
 
@@ -128,3 +131,84 @@ TEST(dynamic_node_id_server_centralized_Storage, Basic)
 
     storage.print();
 }
+
+
+TEST(dynamic_node_id_server_centralized_Storage, Index)
+{
+    using namespace uavcan::dynamic_node_id_server::centralized;
+    using namespace uavcan::dynamic_node_id_server;
+
+    MemoryStorageBackend storage;
+
+    /*
+     * Filling the storage
+     */
+    {
+        Storage stor(storage);
+        ASSERT_LE(0, stor.init());
+
+        for (uint8_t i = 1; i <= 127; i++)
+        {
+            UniqueID unique_id;
+            unique_id[0] = i;
+            unique_id[15] = uint8_t(i * 3U);
+            ASSERT_LE(0, stor.add(i, unique_id));
+        }
+        ASSERT_EQ(127, stor.getSize());
+        ASSERT_EQ(127, stor.getNumIndexedAllocations());
+    }
+
+    /*
+     * Restoring the index - lookups must not access the storage
+     */
+    Storage stor(storage);
+    ASSERT_LE(0, stor.init());
+    ASSERT_EQ(127, stor.getSize());
+    ASSERT_EQ(127, stor.getNumIndexedAllocations());
+
+    const unsigned num_get_calls = storage.getNumGetCalls();
+
+    for (uint8_t i = 1; i <= 127; i++)
+    {
+        UniqueID unique_id;
+        unique_id[0] = i;
+        unique_id[15] = uint8_t(i * 3U);
+        ASSERT_EQ(i, stor.getNodeIDForUniqueID(unique_id).get());
+    }
+
+    UniqueID unknown_unique_id;
+    unknown_unique_id[0] = 200;
+    ASSERT_FALSE(stor.getNodeIDForUniqueID(unknown_unique_id).isValid());
+
+    ASSERT_EQ(num_get_calls, storage.getNumGetCalls());
+
+    /*
+     * Reassigning a node ID to a different unique ID
+     */
+    UniqueID new_unique_id;
+    new_unique_id[0] = 42;
+    new_unique_id[1] = 42;
+    ASSERT_LE(0, stor.add(42, new_unique_id));
+    ASSERT_EQ(42, stor.getNodeIDForUniqueID(new_unique_id).get());
+    ASSERT_EQ(127, stor.getNumIndexedAllocations());
+
+    UniqueID old_unique_id;
+    old_unique_id[0] = 42;
+    old_unique_id[15] = uint8_t(42 * 3U);
+    ASSERT_FALSE(stor.getNodeIDForUniqueID(old_unique_id).isValid());
+
+    /*
+     * Allocations without the reverse mapping are looked up in the storage
+     */
+    storage.set("node10_unique_id", "");
+    Storage legacy_stor(storage);
+    ASSERT_LE(0, legacy_stor.init());
+    ASSERT_EQ(127, legacy_stor.getSize());
+    ASSERT_EQ(126, legacy_stor.getNumIndexedAllocations());
+
+    UniqueID unique_id_10;
+    unique_id_10[0] = 10;
+    unique_id_10[15] = 30;
+    ASSERT_EQ(10, legacy_stor.getNodeIDForUniqueID(unique_id_10).get());
+    ASSERT_FALSE(legacy_stor.getNodeIDForUniqueID(unknown_unique_id).isValid());
+}
@@ -165,10 +165,46 @@ TEST(dynamic_node_id_server_Log, Append)
     ASSERT_EQ(1, log.getLastIndex());
 
     /*
-     * Making sure append() fails when the log is full
+     * Adding several entries at once - either all or none are appended
      */
+    uavcan::protocol::dynamic_node_id::server::Entry entries[3];
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        entries[i].term = 2;
+        entries[i].node_id = uint8_t(i + 2U);
+        entries[i].unique_id[0] = uint8_t(i + 2U);
+    }
+
+    ASSERT_GT(0, log.append(entries, 3));
+    ASSERT_EQ(7, storage.getNumKeys());
+    ASSERT_EQ(1, log.getLastIndex());
+
     storage.failOnSetCalls(false);
 
+    ASSERT_GT(0, log.append(entries, 0));
+    ASSERT_LE(0, log.append(entries, 3));
+
+    ASSERT_EQ("4",                                storage.get("log_last_index"));
+    ASSERT_EQ("3",                                storage.get("log3_node_id"));
+    ASSERT_EQ("04000000000000000000000000000000", storage.get("log4_unique_id"));
+
+    ASSERT_EQ(4, log.getLastIndex());
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        ASSERT_TRUE(entries[i] == *log.getEntryAtIndex(uint8_t(i + 2U)));
+    }
+
+    Log::Index index = 0;
+    ASSERT_TRUE(log.findLastIndexByNodeID(4, index));
+    ASSERT_EQ(4, index);
+
+    entry = entries[2];
+    entry.term = 3;
+
+    /*
+     * Making sure append() fails when the log is full
+     */
+
     while (log.getLastIndex() < (log.Capacity - 1))
     {
         ASSERT_LE(0, log.append(entry));
@@ -241,3 +277,222 @@ TEST(dynamic_node_id_server_Log, Remove)
 
     storage.print();
 }
+
+
+TEST(dynamic_node_id_server_Log, Search)
+{
+    using namespace uavcan::dynamic_node_id_server::distributed;
+
+    EventTracer tracer;
+    MemoryStorageBackend storage;
+    Log log(storage, tracer);
+    ASSERT_LE(0, log.init());
+
+    /*
+     * Entry 0 is always there
+     */
+    Log::Index index = 0xFF;
+    ASSERT_TRUE(log.findLastIndexByNodeID(uavcan::NodeID(0), index));
+    ASSERT_EQ(0, index);
+    ASSERT_TRUE(log.findLastIndexByUniqueID(uavcan::dynamic_node_id_server::UniqueID(), index));
+    ASSERT_EQ(0, index);
+    ASSERT_FALSE(log.findLastIndexByNodeID(uavcan::NodeID(1), index));
+    ASSERT_FALSE(log.findLastIndexByNodeID(uavcan::NodeID(), index));
+
+    /*
+     * Filling the log with duplicated values; the last matching entry must be found
+     */
+    uavcan::protocol::dynamic_node_id::server::Entry entry;
+    entry.term = 1;
+    for (unsigned i = 1; i < log.Capacity; i++)
+    {
+        entry.node_id = uint8_t(1 + (i % 40));
+        entry.unique_id[0] = uint8_t(i % 50);
+        entry.unique_id[15] = uint8_t(i % 7);
+        ASSERT_LE(0, log.append(entry));
+    }
+
+    const auto check_against_linear_search = [](const Log& log)
+    {
+        for (unsigned nid = 0; nid <= uavcan::NodeID::Max; nid++)
+        {
+            int expected = -1;
+            for (int i = log.getLastIndex(); i >= 0; i--)
+            {
+                if (log.getEntryAtIndex(Log::Index(i))->node_id == nid)
+                {
+                    expected = i;
+                    break;
+                }
+            }
+            Log::Index found = 0;
+            const bool res = log.findLastIndexByNodeID(uavcan::NodeID(uint8_t(nid)), found);
+            ASSERT_EQ(expected >= 0, res);
+            if (res)
+            {
+                ASSERT_EQ(expected, found);
+            }
+        }
+        for (int i = log.getLastIndex(); i >= 0; i--)
+        {
+            const auto& uid = log.getEntryAtIndex(Log::Index(i))->unique_id;
+            int expected = -1;
+            for (int k = log.getLastIndex(); k >= 0; k--)
+            {
+                if (log.getEntryAtIndex(Log::Index(k))->unique_id == uid)
+                {
+                    expected = k;
+                    break;
+                }
+            }
+            Log::Index found = 0;
+            ASSERT_TRUE(log.findLastIndexByUniqueID(uid, found));
+            ASSERT_EQ(expected, found);
+        }
+    };
+
+    check_against_linear_search(log);
+
+    /*
+     * Removal must expose the older entries
+     */
+    ASSERT_LE(0, log.removeEntriesWhereIndexGreater(60));
+    check_against_linear_search(log);
+    ASSERT_FALSE(log.findLastIndexByUniqueID(entry.unique_id, index) && (index > 60));
+
+    ASSERT_LE(0, log.removeEntriesWhereIndexGreaterOrEqual(3));
+    check_against_linear_search(log);
+    ASSERT_FALSE(log.findLastIndexByNodeID(uavcan::NodeID(10), index));
+
+    /*
+     * Indexes must be restored on initialization
+     */
+    entry.node_id = 10;
+    ASSERT_LE(0, log.append(entry));
+
+    Log log2(storage, tracer);
+    ASSERT_LE(0, log2.init());
+    ASSERT_TRUE(log2.findLastIndexByNodeID(uavcan::NodeID(10), index));
+    ASSERT_EQ(3, index);
+    ASSERT_TRUE(log2.findLastIndexByUniqueID(entry.unique_id, index));
+    ASSERT_EQ(3, index);
+    check_against_linear_search(log2);
+
+    /*
+     * Full log restored from the storage; the entries past the last index that were left in the storage by the
+     * removal must not appear in the index
+     */
+    for (unsigned i = 4; i < log.Capacity; i++)
+    {
+        entry.node_id = uint8_t(1 + (i % 30));
+        entry.unique_id[0] = uint8_t(i % 20);
+        entry.unique_id[1] = uint8_t(i % 3);
+        ASSERT_LE(0, log2.append(entry));
+    }
+    ASSERT_LE(0, log2.removeEntriesWhereIndexGreater(100));
+
+    Log log3(storage, tracer);
+    ASSERT_LE(0, log3.init());
+    ASSERT_EQ(100, log3.getLastIndex());
+    check_against_linear_search(log3);
+    ASSERT_FALSE(log3.findLastIndexByNodeID(uavcan::NodeID(10), index) && (index > 100));
+}
+
+
+/**
+ * Same hash as used by the log; it is replicated here in order to find unique IDs that share the same bucket.
+ */
+static uint8_t computeUniqueIDBucket(const uavcan::dynamic_node_id_server::UniqueID& unique_id)
+{
+    uint32_t hash = 2166136261U;
+    for (uint8_t i = 0; i < unique_id.size(); i++)
+    {
+        hash = (hash ^ unique_id[i]) * 16777619U;
+    }
+    return static_cast<uint8_t>(hash & (uavcan::dynamic_node_id_server::distributed::Log::Capacity - 1U));
+}
+
+TEST(dynamic_node_id_server_Log, SearchBucketCollisions)
+{
+    using namespace uavcan::dynamic_node_id_server::distributed;
+    using uavcan::dynamic_node_id_server::UniqueID;
+
+    /*
+     * Four different unique IDs that fall into the same bucket
+     */
+    std::vector<UniqueID> uids;
+    UniqueID uid;
+    uid[15] = 0xAA;
+    const uint8_t bucket = computeUniqueIDBucket(uid);
+    for (unsigned i = 0; (i < 0x10000) && (uids.size() < 4); i++)
+    {
+        uid[0] = uint8_t(i);
+        uid[1] = uint8_t(i >> 8);
+        if (computeUniqueIDBucket(uid) == bucket)
+        {
+            uids.push_back(uid);
+        }
+    }
+    ASSERT_EQ(4, uids.size());
+
+    EventTracer tracer;
+    MemoryStorageBackend storage;
+    Log log(storage, tracer);
+    ASSERT_LE(0, log.init());
+
+    uavcan::protocol::dynamic_node_id::server::Entry entry;
+    entry.term = 1;
+    for (unsigned i = 0; i < 3; i++)            // Entries 1, 2, 3; the last unique ID is never added
+    {
+        entry.unique_id = uids.at(i);
+        entry.node_id = uint8_t(10 + i);
+        ASSERT_LE(0, log.append(entry));
+    }
+    entry.unique_id = uids.at(0);               // Entry 4 duplicates the first unique ID
+    entry.node_id = 13;
+    ASSERT_LE(0, log.append(entry));
+
+    Log::Index index = 0;
+    ASSERT_TRUE(log.findLastIndexByUniqueID(uids.at(0), index));
+    ASSERT_EQ(4, index);
+    ASSERT_TRUE(log.findLastIndexByUniqueID(uids.at(1), index));
+    ASSERT_EQ(2, index);
+    ASSERT_TRUE(log.findLastIndexByUniqueID(uids.at(2), index));
+    ASSERT_EQ(3, index);
+    ASSERT_FALSE(log.findLastIndexByUniqueID(uids.at(3), index));
+
+    /*
+     * Removal in the middle of the chain
+     */
+    ASSERT_LE(0, log.removeEntriesWhereIndexGreaterOrEqual(3));
+    ASSERT_TRUE(log.findLastIndexByUniqueID(uids.at(0), index));
+    ASSERT_EQ(1, index);
+    ASSERT_TRUE(log.findLastIndexByUniqueID(uids.at(1), index));
+    ASSERT_EQ(2, index);
+    ASSERT_FALSE(log.findLastIndexByUniqueID(uids.at(2), index));
+    ASSERT_FALSE(log.findLastIndexByNodeID(uavcan::NodeID(12), index));
+    ASSERT_FALSE(log.findLastIndexByNodeID(uavcan::NodeID(13), index));
+
+    entry.unique_id = uids.at(3);
+    entry.node_id = 12;
+    ASSERT_LE(0, log.append(entry));
+    ASSERT_TRUE(log.findLastIndexByUniqueID(uids.at(3), index));
+    ASSERT_EQ(3, index);
+    ASSERT_TRUE(log.findLastIndexByNodeID(uavcan::NodeID(12), index));
+    ASSERT_EQ(3, index);
+
+    /*
+     * The chain is rebuilt from the storage; the removed entry 4 is still there but must be ignored
+     */
+    Log log2(storage, tracer);
+    ASSERT_LE(0, log2.init());
+    ASSERT_EQ(3, log2.getLastIndex());
+    ASSERT_TRUE(log2.findLastIndexByUniqueID(uids.at(0), index));
+    ASSERT_EQ(1, index);
+    ASSERT_TRUE(log2.findLastIndexByUniqueID(uids.at(1), index));
+    ASSERT_EQ(2, index);
+    ASSERT_FALSE(log2.findLastIndexByUniqueID(uids.at(2), index));
+    ASSERT_TRUE(log2.findLastIndexByUniqueID(uids.at(3), index));
+    ASSERT_EQ(3, index);
+    ASSERT_FALSE(log2.findLastIndexByNodeID(uavcan::NodeID(13), index));
+}
@@ -115,6 +115,96 @@ TEST(dynamic_node_id_server_RaftCore, Basic)
 }
 
 
+TEST(dynamic_node_id_server_RaftCore, Replication)
+{
+    using namespace uavcan::dynamic_node_id_server::distributed;
+    using namespace uavcan::protocol::dynamic_node_id::server;
+
+    uavcan::GlobalDataTypeRegistry::instance().reset();
+    uavcan::DefaultDataTypeRegistrator<Discovery> _reg1;
+    uavcan::DefaultDataTypeRegistrator<AppendEntries> _reg2;
+    uavcan::DefaultDataTypeRegistrator<RequestVote> _reg3;
+
+    static const unsigned NumServers = 3;
+    static const unsigned NumAllocations = 60;    // Whole vehicle powering on at once
+
+    TestNetwork<NumServers> nodes;
+
+    std::auto_ptr<EventTracer> tracers[NumServers];
+    std::auto_ptr<MemoryStorageBackend> storages[NumServers];
+    std::auto_ptr<CommitHandler> commit_handlers[NumServers];
+    std::auto_ptr<RaftCore> rafts[NumServers];
+
+    for (unsigned i = 0; i < NumServers; i++)
+    {
+        const std::string id(1, char('a' + i));
+        tracers[i].reset(new EventTracer(id));
+        storages[i].reset(new MemoryStorageBackend);
+        commit_handlers[i].reset(new CommitHandler(id));
+        rafts[i].reset(new RaftCore(nodes[i], *storages[i], *tracers[i], *commit_handlers[i]));
+        ASSERT_LE(0, rafts[i]->init(NumServers, uavcan::TransferPriority::OneHigherThanLowest));
+    }
+
+    /*
+     * Electing the leader
+     */
+    RaftCore* leader = NULL;
+    for (unsigned attempt = 0; (attempt < 100) && (leader == NULL); attempt++)
+    {
+        ASSERT_LE(0, nodes.spinAll(uavcan::MonotonicDuration::fromMSec(100)));
+        for (unsigned i = 0; i < NumServers; i++)
+        {
+            if (rafts[i]->isLeader() && rafts[i]->getClusterManager().isClusterDiscovered())
+            {
+                leader = rafts[i].get();
+            }
+        }
+    }
+    ASSERT_TRUE(leader != NULL);
+
+    /*
+     * All nodes are requesting allocation at the same time.
+     * Without pipelining, the leader would commit at most one entry per update interval.
+     */
+    const uavcan::MonotonicTime started_at = nodes[0].getMonotonicTime();
+
+    for (unsigned i = 0; i < NumAllocations; i++)
+    {
+        Entry::FieldTypes::unique_id unique_id;
+        uavcan::fill_n(unique_id.begin(), 16, uint8_t(i));
+        leader->appendLog(unique_id, uavcan::NodeID(uint8_t(i + 1)));
+    }
+
+    while (leader->getCommitIndex() < NumAllocations)
+    {
+        ASSERT_TRUE(leader->isLeader());
+        ASSERT_LE(0, nodes.spinAll(uavcan::MonotonicDuration::fromMSec(3)));
+        ASSERT_GT(20000, (nodes[0].getMonotonicTime() - started_at).toMSec());
+    }
+
+    const uavcan::MonotonicDuration time_to_allocate_all = nodes[0].getMonotonicTime() - started_at;
+    std::cout << "Time to allocate " << NumAllocations << " nodes: " << time_to_allocate_all.toMSec() << " ms, "
+              << "update interval " << leader->getUpdateInterval().toMSec() << " ms" << std::endl;
+
+    ASSERT_GT(leader->getUpdateInterval().toMSec() * NumAllocations / 4, time_to_allocate_all.toMSec());
+
+    /*
+     * Followers will learn the commit index from the next heartbeat
+     */
+    ASSERT_LE(0, nodes.spinAll(uavcan::MonotonicDuration::fromMSec(3000)));
+
+    for (unsigned i = 0; i < NumServers; i++)
+    {
+        ASSERT_EQ(NumAllocations, rafts[i]->getCommitIndex());
+        ASSERT_EQ(NumAllocations, rafts[i]->getPersistentState().getLog().getLastIndex());
+        for (unsigned index = 1; index <= NumAllocations; index++)
+        {
+            ASSERT_TRUE(*rafts[i]->getPersistentState().getLog().getEntryAtIndex(uint8_t(index)) ==
+                        *leader->getPersistentState().getLog().getEntryAtIndex(uint8_t(index)));
+        }
+    }
+}
+
 TEST(dynamic_node_id_server_Server, Basic)
 {
     using namespace uavcan::dynamic_node_id_server;
@@ -13,14 +13,17 @@ class MemoryStorageBackend : public uavcan::dynamic_node_id_server::IStorageBack
     Container container_;
 
     bool fail_;
+    mutable unsigned num_get_calls_;
 
 public:
     MemoryStorageBackend()
         : fail_(false)
+        , num_get_calls_(0)
     { }
 
     virtual String get(const String& key) const
     {
+        num_get_calls_++;
         const Container::const_iterator it = container_.find(key);
         if (it == container_.end())
         {
@@ -43,6 +46,8 @@ public:
 
     unsigned getNumKeys() const { return unsigned(container_.size()); }
 
+    unsigned getNumGetCalls() const { return num_get_calls_; }
+
     void print() const
     {
         for (Container::const_iterator it = container_.begin(); it != container_.end(); ++it)
@@ -3,6 +3,7 @@
  */
 
 #include <gtest/gtest.h>
+#include <vector>
 #include <uavcan/protocol/file_server.hpp>
 #include "helpers.hpp"
 
@@ -53,6 +54,68 @@ public:
 const std::string TestFileServerBackend::file_name = "test";
 const std::string TestFileServerBackend::file_data = "123456789";
 
+
+/**
+ * Reads are completed manually by the test
+ */
+class AsyncTestFileServerBackend : public TestFileServerBackend
+{
+public:
+    struct PendingRead
+    {
+        std::string path;
+        uint64_t offset;
+        uavcan::ServiceResponseToken token;
+        uavcan::IFileReadCompletionHandler* handler;
+    };
+
+    std::vector<PendingRead> pending_reads;
+    bool accept_reads;
+    unsigned num_cancel_calls;
+
+    AsyncTestFileServerBackend()
+        : accept_reads(true)
+        , num_cancel_calls(0)
+    { }
+
+    virtual bool isAsyncReadSupported() const { return true; }
+
+    virtual bool startRead(const Path& path, const uint64_t offset, const uavcan::ServiceResponseToken& token,
+                           uavcan::IFileReadCompletionHandler& handler)
+    {
+        if (!accept_reads)
+        {
+            return false;
+        }
+        PendingRead pr;
+        pr.path = path.c_str();
+        pr.offset = offset;
+        pr.token = token;
+        pr.handler = &handler;
+        pending_reads.push_back(pr);
+        return true;
+    }
+
+    virtual void cancelReads(uavcan::IFileReadCompletionHandler&)
+    {
+        num_cancel_calls++;
+        pending_reads.clear();
+    }
+
+    void completeAll()
+    {
+        std::vector<PendingRead> reads;
+        reads.swap(pending_reads);
+        for (unsigned i = 0; i < reads.size(); i++)
+        {
+            uint8_t buffer[ReadSize];
+            uint16_t size = ReadSize;
+            const int16_t error = read(reads[i].path.c_str(), reads[i].offset, buffer, size);
+            reads[i].handler->handleReadCompletion(reads[i].token, error, buffer, size);
+        }
+    }
+};
+
 TEST(BasicFileServer, Basic)
 {
     using namespace uavcan::protocol::file;
@@ -112,6 +175,83 @@ TEST(BasicFileServer, Basic)
 }
 
 
+TEST(BasicFileServer, AsyncRead)
+{
+    using namespace uavcan::protocol::file;
+
+    uavcan::GlobalDataTypeRegistry::instance().reset();
+    uavcan::DefaultDataTypeRegistrator<GetInfo> _reg1;
+    uavcan::DefaultDataTypeRegistrator<Read> _reg2;
+
+    InterlinkedTestNodesWithSysClock nodes;
+
+    AsyncTestFileServerBackend backend;
+
+    {
+        uavcan::BasicFileServer serv(nodes.a, backend);
+        ASSERT_LE(0, serv.start());
+
+        ServiceClientWithCollector<Read> read(nodes.b);
+
+        Read::Request read_req;
+        read_req.path.path = "test";
+        read_req.offset = 3;
+
+        /*
+         * The response is sent once the backend reports completion
+         */
+        ASSERT_LE(0, read.call(1, read_req));
+        nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(10));
+
+        ASSERT_FALSE(read.collector.result.get());
+        ASSERT_EQ(1, backend.pending_reads.size());
+        ASSERT_EQ(3, backend.pending_reads.at(0).offset);
+        ASSERT_EQ("test", backend.pending_reads.at(0).path);
+
+        backend.completeAll();
+        nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(10));
+
+        ASSERT_TRUE(read.collector.result.get());
+        ASSERT_TRUE(read.collector.result->isSuccessful());
+        ASSERT_EQ("456789", read.collector.result->getResponse().data);
+        ASSERT_EQ(0, read.collector.result->getResponse().error.value);
+
+        /*
+         * Errors are reported as usual
+         */
+        read.collector.result.reset();
+        read_req.path.path = "nonexistent";
+        ASSERT_LE(0, read.call(1, read_req));
+        nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(10));
+        backend.completeAll();
+        nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(10));
+
+        ASSERT_TRUE(read.collector.result.get());
+        ASSERT_TRUE(read.collector.result->isSuccessful());
+        ASSERT_TRUE(read.collector.result->getResponse().data.empty());
+        ASSERT_EQ(Error::NOT_FOUND, read.collector.result->getResponse().error.value);
+
+        /*
+         * Fallback to the synchronous read if the backend can't accept the request
+         */
+        read.collector.result.reset();
+        backend.accept_reads = false;
+        read_req.path.path = "test";
+        read_req.offset = 0;
+        ASSERT_LE(0, read.call(1, read_req));
+        nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(10));
+
+        ASSERT_TRUE(backend.pending_reads.empty());
+        ASSERT_TRUE(read.collector.result.get());
+        ASSERT_TRUE(read.collector.result->isSuccessful());
+        ASSERT_EQ("123456789", read.collector.result->getResponse().data);
+
+        ASSERT_EQ(0, backend.num_cancel_calls);
+    }
+    ASSERT_EQ(1, backend.num_cancel_calls);
+}
+
+
 TEST(FileServer, Basic)
 {
     using namespace uavcan::protocol::file;
@@ -8,6 +8,7 @@
 #endif
 
 #include <memory>
+#include <map>
 #include <gtest/gtest.h>
 #include <uavcan/protocol/node_info_retriever.hpp>
 #include <uavcan/protocol/node_status_provider.hpp>
@@ -290,3 +291,254 @@ TEST(NodeInfoRetriever, MaxConcurrentRequests)
     ASSERT_EQ(0, retr.getNumPendingRequests());
     ASSERT_FALSE(retr.isRetrievingInProgress());
 }
+
+
+struct MemoryNodeInfoCache : public uavcan::INodeInfoCache
+{
+    std::map<uavcan::uint8_t, uavcan::protocol::GetNodeInfo::Response> entries;
+    std::map<uavcan::uint8_t, uavcan::UtcTime> cache_times;
+    unsigned num_gets;
+    unsigned num_puts;
+
+    MemoryNodeInfoCache()
+        : num_gets(0)
+        , num_puts(0)
+    { }
+
+    virtual int get(uavcan::NodeID node_id, uavcan::protocol::GetNodeInfo::Response& out_node_info,
+                    uavcan::UtcTime& out_cached_at)
+    {
+        num_gets++;
+        if (entries.find(node_id.get()) == entries.end())
+        {
+            return -uavcan::ErrFailure;
+        }
+        out_node_info = entries[node_id.get()];
+        out_cached_at = cache_times[node_id.get()];
+        return 0;
+    }
+
+    virtual int put(uavcan::NodeID node_id, const uavcan::protocol::GetNodeInfo::Response& node_info,
+                    uavcan::UtcTime cached_at)
+    {
+        num_puts++;
+        entries[node_id.get()] = node_info;
+        cache_times[node_id.get()] = cached_at;
+        return 0;
+    }
+
+    void add(uavcan::uint8_t node_id, const uavcan::protocol::GetNodeInfo::Response& node_info,
+             uavcan::uint32_t uptime_sec, uavcan::UtcTime cached_at)
+    {
+        entries[node_id] = node_info;
+        entries[node_id].status.uptime_sec = uptime_sec;
+        cache_times[node_id] = cached_at;
+    }
+};
+
+
+TEST(NodeInfoRetriever, Cache)
+{
+    uavcan::GlobalDataTypeRegistry::instance().reset();
+    uavcan::DefaultDataTypeRegistrator<uavcan::protocol::NodeStatus> _reg1;
+    uavcan::DefaultDataTypeRegistrator<uavcan::protocol::GetNodeInfo> _reg2;
+
+    InterlinkedTestNodesWithSysClock nodes;
+
+    MemoryNodeInfoCache cache;
+
+    /*
+     * Empty cache - the response is retrieved from the node and cached
+     */
+    uavcan::NodeStatusProvider provider(nodes.b);
+    provider.setName("Ivan");
+
+    {
+        uavcan::NodeInfoRetriever retr(nodes.a);
+        ASSERT_TRUE(retr.getCache() == NULL);
+        retr.setCache(&cache);
+        ASSERT_EQ(&cache, retr.getCache());
+        ASSERT_LE(0, retr.start());
+
+        ASSERT_LE(0, provider.startAndPublish());
+        nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(100));
+
+        ASSERT_FALSE(retr.isRetrievingInProgress());
+        ASSERT_EQ(1, retr.getNumResponses());
+        ASSERT_EQ(0, retr.getNumCacheHits());
+        ASSERT_EQ(1, cache.num_gets);
+        ASSERT_EQ(1, cache.num_puts);
+        ASSERT_EQ("Ivan", cache.entries[2].name);
+        ASSERT_FALSE(cache.cache_times[2].isZero());
+    }
+
+    /*
+     * Restart - the response is taken from the cache, no requests are made
+     */
+    {
+        uavcan::NodeInfoRetriever retr(nodes.a);
+        retr.setCache(&cache);
+        ASSERT_LE(0, retr.start());
+
+        NodeInfoListener listener;
+        retr.addListener(&listener);
+
+        ASSERT_LE(0, provider.forcePublish());
+        nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(100));
+
+        ASSERT_FALSE(retr.isRetrievingInProgress());
+        ASSERT_EQ(0, retr.getNumPendingRequests());
+        ASSERT_EQ(0, retr.getNumResponses());
+        ASSERT_EQ(1, retr.getNumCacheHits());
+        ASSERT_EQ(1, cache.num_puts);
+
+        ASSERT_EQ(1, listener.status_message_cnt);
+        ASSERT_TRUE(listener.last_node_info.get());
+        ASSERT_EQ(uavcan::NodeID(2), listener.last_node_id);
+        ASSERT_EQ("Ivan", listener.last_node_info->name);
+
+        /*
+         * The nodes that restarted after their info was cached must be queried:
+         *  - Node 10 restarted, its uptime is lower than cached.
+         *  - Node 11 has not restarted, its uptime has grown by the time elapsed since caching.
+         *  - Node 12 restarted, its uptime is higher than cached but it has grown by less than the elapsed time.
+         *  - Node 13 has unknown cache time, so its restart cannot be ruled out.
+         */
+        const uavcan::UtcTime now = nodes.a.getUtcTime();
+        const uavcan::protocol::GetNodeInfo::Response info = cache.entries[2];
+        cache.add(10, info, 100, now - uavcan::UtcDuration::fromMSec(5000));
+        cache.add(11, info, 100, now - uavcan::UtcDuration::fromMSec(5000));
+        cache.add(12, info, 100, now - uavcan::UtcDuration::fromMSec(60000));
+        cache.add(13, info, 100, uavcan::UtcTime());
+
+        publishNodeStatus(nodes.can_a, uavcan::NodeID(10), 5, uavcan::TransferID());
+        publishNodeStatus(nodes.can_a, uavcan::NodeID(11), 105, uavcan::TransferID());
+        nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(100));
+
+        ASSERT_TRUE(retr.isRetrievingInProgress());
+        ASSERT_EQ(1, retr.getNumPendingRequests());
+        ASSERT_EQ(2, retr.getNumCacheHits());
+        ASSERT_EQ(1, retr.getNumCacheMisses());
+        ASSERT_EQ(105, listener.last_node_info->status.uptime_sec);    // The status is not taken from the cache
+        ASSERT_EQ(uavcan::NodeID(11), listener.last_node_id);
+
+        publishNodeStatus(nodes.can_a, uavcan::NodeID(12), 105, uavcan::TransferID());
+        publishNodeStatus(nodes.can_a, uavcan::NodeID(13), 105, uavcan::TransferID());
+        nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(100));
+
+        ASSERT_EQ(2, retr.getNumCacheHits());
+        ASSERT_EQ(3, retr.getNumCacheMisses());
+        ASSERT_EQ(uavcan::NodeID(11), listener.last_node_id);          // Stale info was not reported
+
+        /*
+         * Invalidation must bypass the cache
+         */
+        retr.invalidateAll();
+        ASSERT_LE(0, provider.forcePublish());
+        nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(100));
+
+        ASSERT_EQ(2, retr.getNumCacheHits());
+        ASSERT_EQ(1, retr.getNumResponses());
+        ASSERT_EQ(2, cache.num_puts);
+    }
+}
+
+
+/**
+ * Returns the time to full discovery of all nodes in the network, measured by the retriever.
+ */
+static uavcan::MonotonicDuration measureDiscoveryTime(uavcan::uint8_t max_concurrent_requests,
+                                                      uavcan::MonotonicDuration target_response_latency,
+                                                      uavcan::uint8_t& out_final_window)
+{
+    static const unsigned NumNodes = 9;
+    TestNetwork<NumNodes> nodes;
+
+    uavcan::NodeInfoRetriever retr(nodes[0]);
+    retr.setMaxConcurrentRequests(max_concurrent_requests);
+    retr.setTargetResponseLatency(target_response_latency);
+    EXPECT_LE(0, retr.start());
+
+    NodeInfoListener listener;
+    retr.addListener(&listener);
+
+    std::auto_ptr<uavcan::NodeStatusProvider> providers[NumNodes - 1];
+    for (unsigned i = 0; i < (NumNodes - 1); i++)
+    {
+        providers[i].reset(new uavcan::NodeStatusProvider(nodes[i + 1]));
+        providers[i]->setName("Node");
+        EXPECT_LE(0, providers[i]->startAndPublish());
+    }
+
+    for (unsigned i = 0; (i < 100) && (retr.getLastDiscoveryDuration().isZero() || retr.isRetrievingInProgress()); i++)
+    {
+        EXPECT_GE(std::max<unsigned>(max_concurrent_requests, 1U), unsigned(retr.getNumPendingRequests()));
+        EXPECT_LE(0, nodes.spinAll(uavcan::MonotonicDuration::fromMSec(10)));
+    }
+
+    EXPECT_FALSE(retr.isRetrievingInProgress());
+    EXPECT_EQ(NumNodes - 1, retr.getNumResponses());
+    EXPECT_EQ(0, retr.getNumFailedRequests());
+    EXPECT_EQ(0, listener.info_unavailable_cnt);
+    EXPECT_TRUE(retr.getSmoothedResponseLatency().isPositive());
+
+    std::cout << "Max concurrent requests " << int(max_concurrent_requests)
+              << ": discovery time " << retr.getLastDiscoveryDuration().toString()
+              << ", smoothed latency " << retr.getSmoothedResponseLatency().toString()
+              << ", final window " << int(retr.getRequestWindow()) << std::endl;
+
+    out_final_window = retr.getRequestWindow();
+    return retr.getLastDiscoveryDuration();
+}
+
+
+TEST(NodeInfoRetriever, ConcurrencyWindow)
+{
+    uavcan::GlobalDataTypeRegistry::instance().reset();
+    uavcan::DefaultDataTypeRegistrator<uavcan::protocol::NodeStatus> _reg1;
+    uavcan::DefaultDataTypeRegistrator<uavcan::protocol::GetNodeInfo> _reg2;
+
+    /*
+     * Configuration
+     */
+    {
+        InterlinkedTestNodesWithSysClock nodes;
+        uavcan::NodeInfoRetriever retr(nodes.a);
+
+        ASSERT_EQ(0, retr.getMaxConcurrentRequests());     // Disabled by default
+        ASSERT_EQ(0, retr.getRequestWindow());
+        ASSERT_TRUE(retr.getLastDiscoveryDuration().isZero());
+
+        retr.setMaxConcurrentRequests(200);
+        ASSERT_EQ(uavcan::NodeInfoRetriever::MaxConcurrentRequestsLimit, retr.getMaxConcurrentRequests());
+        ASSERT_EQ(uavcan::NodeInfoRetriever::MaxConcurrentRequestsLimit, retr.getRequestWindow());
+
+        retr.setMaxConcurrentRequests(4);
+        ASSERT_EQ(4, retr.getMaxConcurrentRequests());
+        ASSERT_EQ(4, retr.getRequestWindow());
+
+        retr.setTargetResponseLatency(uavcan::MonotonicDuration::fromMSec(20));
+        ASSERT_EQ(20, retr.getTargetResponseLatency().toMSec());
+    }
+
+    /*
+     * One request per interval vs. the window; the latter must not wait for the timer
+     */
+    uavcan::uint8_t final_window = 0;
+
+    const uavcan::MonotonicDuration legacy =
+        measureDiscoveryTime(0, uavcan::MonotonicDuration::fromMSec(100), final_window);
+    ASSERT_EQ(0, final_window);
+    ASSERT_LE(7 * 40, legacy.toMSec());                 // 8 nodes, one request per 40 ms
+
+    const uavcan::MonotonicDuration windowed =
+        measureDiscoveryTime(8, uavcan::MonotonicDuration::fromMSec(100), final_window);
+    ASSERT_EQ(8, final_window);                         // All responses were fast
+    ASSERT_GT(legacy.toMSec() / 3, windowed.toMSec());
+
+    /*
+     * Slow responses make the window shrink, discovery still completes
+     */
+    measureDiscoveryTime(8, uavcan::MonotonicDuration::fromUSec(1), final_window);
+    ASSERT_EQ(1, final_window);
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <gtest/gtest.h>
+#include <uavcan/protocol/transfer_latency_stats_provider.hpp>
+#include <root_ns_a/GetTransferLatencyStats.hpp>
+#include "helpers.hpp"
+
+
+static root_ns_a::GetTransferLatencyStats::Request makeRequest(uint16_t index, uavcan::TransferLatencyKind kind)
+{
+    root_ns_a::GetTransferLatencyStats::Request req;
+    req.index = index;
+    req.latency_kind = uint8_t(kind);
+    return req;
+}
+
+TEST(TransferLatencyStatsProvider, Basic)
+{
+    InterlinkedTestNodesWithSysClock nodes;
+
+    uavcan::StaticTransferLatencyStats<4> stats_a(nodes.clock_a);
+    uavcan::StaticTransferLatencyStats<4> stats_b(nodes.clock_b);
+    nodes.a.getDispatcher().setTransferLatencyStats(&stats_a);
+    nodes.b.getDispatcher().setTransferLatencyStats(&stats_b);
+    ASSERT_EQ(&stats_a, nodes.a.getDispatcher().getTransferLatencyStats());
+
+    uavcan::GlobalDataTypeRegistry::instance().reset();
+    uavcan::DefaultDataTypeRegistrator<root_ns_a::GetTransferLatencyStats> _reg1;
+
+    uavcan::TransferLatencyStatsProvider<root_ns_a::GetTransferLatencyStats> provider(nodes.a);
+    ASSERT_LE(0, provider.start());
+
+    ServiceClientWithCollector<root_ns_a::GetTransferLatencyStats> cln(nodes.b);
+
+    /*
+     * Nothing has been sampled on the server side yet - the request being served is sampled after the handler
+     */
+    ASSERT_LE(0, cln.call(1, makeRequest(0, uavcan::TransferLatencyKindRxCallback)));
+    ASSERT_LE(0, nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(10)));
+
+    ASSERT_TRUE(cln.collector.result.get());
+    ASSERT_TRUE(cln.collector.result->isSuccessful());
+    EXPECT_EQ(0, cln.collector.result->getResponse().num_samples);
+    EXPECT_EQ(0, cln.collector.result->getResponse().buckets.size());
+
+    /*
+     * The first request is accounted now
+     */
+    ASSERT_LE(0, cln.call(1, makeRequest(0, uavcan::TransferLatencyKindRxCallback)));
+    ASSERT_LE(0, nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(10)));
+
+    ASSERT_TRUE(cln.collector.result.get());
+    ASSERT_TRUE(cln.collector.result->isSuccessful());
+    EXPECT_EQ(root_ns_a::GetTransferLatencyStats::DefaultDataTypeID, cln.collector.result->getResponse().data_type_id);
+    EXPECT_EQ(uavcan::DataTypeKindService, cln.collector.result->getResponse().data_type_kind);
+    EXPECT_EQ(1, cln.collector.result->getResponse().num_samples);
+    ASSERT_EQ(uavcan::LatencyHistogram::NumBuckets, cln.collector.result->getResponse().buckets.size());
+    uint64_t bucket_sum = 0;
+    for (uint8_t i = 0; i < uavcan::LatencyHistogram::NumBuckets; i++)
+    {
+        bucket_sum += cln.collector.result->getResponse().buckets[i];
+    }
+    EXPECT_EQ(1, bucket_sum);
+
+    /*
+     * Both responses were multi-frame
+     */
+    ASSERT_LE(0, cln.call(1, makeRequest(0, uavcan::TransferLatencyKindTxQueue)));
+    ASSERT_LE(0, nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(10)));
+
+    ASSERT_TRUE(cln.collector.result.get());
+    ASSERT_TRUE(cln.collector.result->isSuccessful());
+    EXPECT_LT(2, cln.collector.result->getResponse().num_samples);
+
+    /*
+     * Invalid requests
+     */
+    ASSERT_LE(0, cln.call(1, makeRequest(1, uavcan::TransferLatencyKindTxQueue)));
+    ASSERT_LE(0, nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(10)));
+    ASSERT_TRUE(cln.collector.result.get());
+    EXPECT_EQ(0, cln.collector.result->getResponse().buckets.size());
+
+    ASSERT_LE(0, cln.call(1, makeRequest(0, uavcan::NumTransferLatencyKinds)));
+    ASSERT_LE(0, nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(10)));
+    ASSERT_TRUE(cln.collector.result.get());
+    EXPECT_EQ(0, cln.collector.result->getResponse().buckets.size());
+
+    /*
+     * Client side: single-frame requests, multi-frame responses
+     */
+    const uavcan::TransferLatencyStats::Entry* const entry =
+        stats_b.find(uavcan::DataTypeKindService, root_ns_a::GetTransferLatencyStats::DefaultDataTypeID);
+    ASSERT_TRUE(entry);
+    EXPECT_EQ(1, stats_b.getSize());
+    EXPECT_EQ(5, entry->histograms[uavcan::TransferLatencyKindTxQueue].getNumSamples());
+    EXPECT_EQ(5, entry->histograms[uavcan::TransferLatencyKindRxReassembly].getNumSamples());
+    EXPECT_EQ(5, entry->histograms[uavcan::TransferLatencyKindRxCallback].getNumSamples());
+    EXPECT_EQ(5, entry->histograms[uavcan::TransferLatencyKindServiceRoundTrip].getNumSamples());
+    EXPECT_GT(100000, entry->histograms[uavcan::TransferLatencyKindServiceRoundTrip].getMaxUSec());
+
+    // The server never calls services
+    EXPECT_EQ(0, stats_a.getByIndex(0)->histograms[uavcan::TransferLatencyKindServiceRoundTrip].getNumSamples());
+    EXPECT_EQ(5, stats_a.getByIndex(0)->histograms[uavcan::TransferLatencyKindRxCallback].getNumSamples());
+    EXPECT_EQ(0, stats_a.getNumDroppedSamples());
+
+    /*
+     * Disabled
+     */
+    nodes.a.getDispatcher().setTransferLatencyStats(NULL);
+    ASSERT_LE(0, cln.call(1, makeRequest(0, uavcan::TransferLatencyKindRxCallback)));
+    ASSERT_LE(0, nodes.spinBoth(uavcan::MonotonicDuration::fromMSec(10)));
+    ASSERT_TRUE(cln.collector.result.get());
+    ASSERT_TRUE(cln.collector.result->isSuccessful());
+    EXPECT_EQ(0, cln.collector.result->getResponse().buckets.size());
+    EXPECT_EQ(5, stats_a.getByIndex(0)->histograms[uavcan::TransferLatencyKindRxCallback].getNumSamples());
+
+    nodes.b.getDispatcher().setTransferLatencyStats(NULL);
+}
@@ -380,6 +380,159 @@ TEST(CanIOManager, Loopback)
     EXPECT_EQ(0, iomgr.getIfacePerfCounters(1).frames_tx);
 }
 
+TEST(CanIOManager, TxAdmissionControl)
+{
+    using uavcan::CanIOManager;
+    using uavcan::CanTxQueue;
+    using uavcan::CanFrame;
+    using uavcan::MonotonicDuration;
+
+    // Memory
+    uavcan::PoolAllocator<sizeof(CanTxQueue::Entry) * 4, sizeof(CanTxQueue::Entry)> pool;
+
+    // Platform interface
+    SystemClockMock clockmock(1000000);
+    CanDriverMock driver(1, clockmock);
+
+    // IO Manager
+    CanIOManager iomgr(driver, pool, clockmock);
+    ASSERT_EQ(1, iomgr.getNumIfaces());
+    ASSERT_EQ(uavcan::CanTxAdmissionPolicy::Disabled, iomgr.getTxAdmissionPolicy().action);
+    ASSERT_TRUE(iomgr.getBusLoadEstimator(0));
+    ASSERT_FALSE(iomgr.getBusLoadEstimator(1));
+    ASSERT_FALSE(iomgr.isBusLoadEstimationEnabled());
+
+    uavcan::CanTxAdmissionPolicy policy;
+    policy.action = uavcan::CanTxAdmissionPolicy::Defer;
+    policy.min_restricted_priority = 24;
+    policy.max_utilization = 100;
+    policy.utilization_window = MonotonicDuration::fromMSec(100);
+    iomgr.setTxAdmissionPolicy(policy);
+    ASSERT_TRUE(iomgr.isBusLoadEstimationEnabled());              // Implied by the admission control
+
+    const CanFrame low = makeCanFrame((30U << 24) | 123U, "low", EXT);
+    const CanFrame high = makeCanFrame((1U << 24) | 123U, "high", EXT);
+    const CanFrame standard = makeCanFrame(123, "std", STD);
+
+    uavcan::CanIOFlags flags = uavcan::CanIOFlags();
+
+    /*
+     * Bus is idle - no restrictions
+     */
+    EXPECT_EQ(1, iomgr.send(low, tsMono(2000000), tsMono(0), 1, CanTxQueue::Volatile, flags));
+    EXPECT_TRUE(driver.ifaces.at(0).matchAndPopTx(low, 2000000));
+    EXPECT_LT(0, iomgr.getBusLoadEstimator(0)->getNumBits());
+
+    /*
+     * Saturating the bus with foreign traffic: 30 kbit within the last 150 ms, which is 20%
+     */
+    clockmock.advance(50000);
+    const uavcan::uint8_t zeros[8] = {};
+    const CanFrame foreign(CanFrame::FlagEFF, zeros, 8);                           // 150 bits
+    for (int i = 0; i < 200; i++)
+    {
+        iomgr.getBusLoadEstimator(0)->addFrame(foreign, tsMono(1000000));
+    }
+    EXPECT_LE(200, iomgr.getBusLoadEstimator(0)->getUtilization(tsMono(clockmock.monotonic),
+                                                                  MonotonicDuration::fromMSec(100)));
+
+    // Low priority volatile frame is deferred
+    EXPECT_EQ(0, iomgr.send(low, tsMono(2000000), tsMono(0), 1, CanTxQueue::Volatile, flags));
+    EXPECT_TRUE(driver.ifaces.at(0).tx.empty());
+    EXPECT_EQ(1, iomgr.getIfacePerfCounters(0).frames_deferred);
+    EXPECT_EQ(0, iomgr.makePendingTxMask());        // Deferred frame must not make the interface writeable
+
+    // Persistent, high priority, and standard frames are not affected
+    EXPECT_EQ(1, iomgr.send(low, tsMono(2000000), tsMono(0), 1, CanTxQueue::Persistent, flags));
+    EXPECT_TRUE(driver.ifaces.at(0).matchAndPopTx(low, 2000000));
+    EXPECT_EQ(1, iomgr.send(high, tsMono(2000000), tsMono(0), 1, CanTxQueue::Volatile, flags));
+    EXPECT_TRUE(driver.ifaces.at(0).matchAndPopTx(high, 2000000));
+    EXPECT_EQ(1, iomgr.send(standard, tsMono(2000000), tsMono(0), 1, CanTxQueue::Volatile, flags));
+    EXPECT_TRUE(driver.ifaces.at(0).matchAndPopTx(standard, 2000000));
+
+    // Deferred frame is still there
+    uavcan::CanRxFrame rx_frame;
+    EXPECT_EQ(0, iomgr.receive(rx_frame, tsMono(clockmock.monotonic + 1000), flags));
+    EXPECT_TRUE(driver.ifaces.at(0).tx.empty());
+
+    /*
+     * Load goes away, the deferred frame gets transmitted on the next IO
+     */
+    clockmock.advance(300000);
+    EXPECT_EQ(1, iomgr.makePendingTxMask());
+    EXPECT_EQ(0, iomgr.receive(rx_frame, tsMono(clockmock.monotonic + 1000), flags));
+    EXPECT_TRUE(driver.ifaces.at(0).matchAndPopTx(low, 2000000));
+    EXPECT_TRUE(driver.ifaces.at(0).tx.empty());
+
+    /*
+     * Drop mode
+     */
+    policy.action = uavcan::CanTxAdmissionPolicy::Drop;
+    iomgr.setTxAdmissionPolicy(policy);
+    for (int i = 0; i < 200; i++)
+    {
+        iomgr.getBusLoadEstimator(0)->addFrame(foreign, tsMono(clockmock.monotonic));
+    }
+    EXPECT_EQ(0, iomgr.send(low, tsMono(2000000), tsMono(0), 1, CanTxQueue::Volatile, flags));
+    EXPECT_TRUE(driver.ifaces.at(0).tx.empty());
+    EXPECT_EQ(0, iomgr.makePendingTxMask());
+    EXPECT_EQ(1, iomgr.getIfacePerfCounters(0).frames_deferred);
+    EXPECT_EQ(1, iomgr.getIfacePerfCounters(0).frames_dropped);
+    EXPECT_EQ(0, iomgr.getIfacePerfCounters(0).errors);
+
+    /*
+     * Disabled again
+     */
+    policy.action = uavcan::CanTxAdmissionPolicy::Disabled;
+    iomgr.setTxAdmissionPolicy(policy);
+    EXPECT_FALSE(iomgr.isBusLoadEstimationEnabled());
+    const uavcan::uint64_t num_bits = iomgr.getBusLoadEstimator(0)->getNumBits();
+    EXPECT_EQ(1, iomgr.send(low, tsMono(2000000), tsMono(0), 1, CanTxQueue::Volatile, flags));
+    EXPECT_TRUE(driver.ifaces.at(0).matchAndPopTx(low, 2000000));
+    EXPECT_EQ(6, iomgr.getIfacePerfCounters(0).frames_tx);
+    EXPECT_EQ(num_bits, iomgr.getBusLoadEstimator(0)->getNumBits());    // Estimation is off
+}
+
+TEST(CanIOManager, BusLoadEstimationOptIn)
+{
+    using uavcan::CanTxQueue;
+
+    uavcan::PoolAllocator<sizeof(CanTxQueue::Entry) * 4, sizeof(CanTxQueue::Entry)> pool;
+    SystemClockMock clockmock(1000000);
+    CanDriverMock driver(1, clockmock);
+    uavcan::CanIOManager iomgr(driver, pool, clockmock);
+
+    const uavcan::CanFrame frame = makeCanFrame(123, "frame", EXT);
+    uavcan::CanIOFlags flags = uavcan::CanIOFlags();
+    uavcan::CanRxFrame rx_frame;
+
+    /*
+     * Disabled by default - neither TX nor RX frames are accounted
+     */
+    EXPECT_EQ(1, iomgr.send(frame, tsMono(2000000), tsMono(0), 1, CanTxQueue::Volatile, flags));
+    EXPECT_TRUE(driver.ifaces.at(0).matchAndPopTx(frame, 2000000));
+    driver.ifaces.at(0).pushRx(frame);
+    EXPECT_EQ(1, iomgr.receive(rx_frame, tsMono(0), flags));
+    EXPECT_EQ(0, iomgr.getBusLoadEstimator(0)->getNumFrames());
+
+    /*
+     * Enabled explicitly
+     */
+    iomgr.setBusLoadEstimationEnabled(true);
+    EXPECT_TRUE(iomgr.isBusLoadEstimationEnabled());
+    EXPECT_EQ(1, iomgr.send(frame, tsMono(2000000), tsMono(0), 1, CanTxQueue::Volatile, flags));
+    EXPECT_TRUE(driver.ifaces.at(0).matchAndPopTx(frame, 2000000));
+    driver.ifaces.at(0).pushRx(frame);
+    EXPECT_EQ(1, iomgr.receive(rx_frame, tsMono(0), flags));
+    EXPECT_EQ(2, iomgr.getBusLoadEstimator(0)->getNumFrames());
+    EXPECT_EQ(2 * uavcan::CanBusLoadEstimator::computeFrameBitLength(frame),
+              iomgr.getBusLoadEstimator(0)->getNumBits());
+
+    iomgr.setBusLoadEstimationEnabled(false);
+    EXPECT_EQ(1, iomgr.send(frame, tsMono(2000000), tsMono(0), 1, CanTxQueue::Volatile, flags));
+    EXPECT_EQ(2, iomgr.getBusLoadEstimator(0)->getNumFrames());
+}
+
 TEST(CanIOManager, Size)
 {
     std::cout << sizeof(uavcan::CanIOManager) << std::endl;
@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <uavcan/node/publisher.hpp>
+#include <uavcan/node/subscriber.hpp>
+#include <root_ns_a/MavlinkMessage.hpp>
+#include "simulated_can_bus.hpp"
+#include "can.hpp"
+#include "../../node/test_node.hpp"
+
+
+struct SimulatedCanBusEventCollector : public ISimulatedCanBusListener
+{
+    std::vector<FrameEvent> events;
+
+    virtual void handleSimulatedCanFrame(const FrameEvent& event)
+    {
+        events.push_back(event);
+    }
+};
+
+
+static bool receiveFrom(SimulatedCanDriver& driver, uavcan::CanFrame& out_frame, uint64_t& out_ts_usec,
+                        uavcan::CanIOFlags& out_flags)
+{
+    uavcan::MonotonicTime ts_mono;
+    uavcan::UtcTime ts_utc;
+    const bool res = driver.receive(out_frame, ts_mono, ts_utc, out_flags) > 0;
+    out_ts_usec = uint64_t(ts_mono.toUSec());
+    return res;
+}
+
+
+TEST(SimulatedCanBus, Arbitration)
+{
+    uavcan::VirtualTime time(1000000);
+    SimulatedCanBus bus(time);
+    SimulatedCanBusEventCollector collector;
+    bus.setListener(&collector);
+
+    SimulatedCanDriver a(bus);
+    SimulatedCanDriver b(bus);
+    SimulatedCanDriver c(bus);
+
+    // Zero payload extended frame with zero ID is 80 bits long, see the bus load estimator test
+    const uavcan::CanFrame low  = makeCanFrame(300, "", EXT);
+    const uavcan::CanFrame mid  = makeCanFrame(200, "", EXT);
+    const uavcan::CanFrame high = makeCanFrame(100, "", EXT);
+    const unsigned low_len  = uavcan::CanBusLoadEstimator::computeFrameBitLength(low);
+    const unsigned mid_len  = uavcan::CanBusLoadEstimator::computeFrameBitLength(mid);
+    const unsigned high_len = uavcan::CanBusLoadEstimator::computeFrameBitLength(high);
+
+    /*
+     * All frames are enqueued at the same instant, the order of enqueueing doesn't matter
+     */
+    ASSERT_EQ(1, a.send(low, tsMono(100000), 0));
+    ASSERT_EQ(1, b.send(mid, tsMono(100000), 0));
+    ASSERT_EQ(1, c.send(high, tsMono(100000), 0));
+    ASSERT_TRUE(bus.isIdle());
+
+    bus.run(uavcan::MonotonicDuration::fromMSec(10));
+    EXPECT_EQ(11000, time.getMonotonic().toUSec());
+
+    ASSERT_EQ(3, collector.events.size());
+    EXPECT_TRUE(collector.events[0].frame == high);
+    EXPECT_TRUE(collector.events[1].frame == mid);
+    EXPECT_TRUE(collector.events[2].frame == low);
+    EXPECT_EQ(&c, collector.events[0].sender);
+    EXPECT_EQ(&b, collector.events[1].sender);
+    EXPECT_EQ(&a, collector.events[2].sender);
+
+    // At 1 Mbit/s one bit takes one microsecond; frames follow each other back to back
+    EXPECT_EQ(1000, collector.events[0].started_at.toUSec());
+    EXPECT_EQ(1000 + high_len, collector.events[0].finished_at.toUSec());
+    EXPECT_EQ(1000 + high_len, collector.events[1].started_at.toUSec());
+    EXPECT_EQ(1000 + high_len + mid_len, collector.events[2].started_at.toUSec());
+    EXPECT_EQ(1000 + high_len + mid_len + low_len, collector.events[2].finished_at.toUSec());
+    EXPECT_EQ(1000, collector.events[2].enqueued_at.toUSec());
+
+    /*
+     * Every node receives the frames of the other nodes, timestamped at the end of transmission
+     */
+    uavcan::CanFrame frame;
+    uint64_t ts = 0;
+    uavcan::CanIOFlags flags = 0;
+    ASSERT_EQ(2, a.getNumPendingRxFrames());
+    ASSERT_TRUE(receiveFrom(a, frame, ts, flags));
+    EXPECT_TRUE(frame == high);
+    EXPECT_EQ(1000 + high_len, ts);
+    EXPECT_EQ(0, flags);
+    ASSERT_TRUE(receiveFrom(a, frame, ts, flags));
+    EXPECT_TRUE(frame == mid);
+    EXPECT_EQ(1000 + high_len + mid_len, ts);
+    EXPECT_FALSE(receiveFrom(a, frame, ts, flags));
+
+    ASSERT_EQ(2, c.getNumPendingRxFrames());
+    ASSERT_TRUE(receiveFrom(c, frame, ts, flags));
+    EXPECT_TRUE(frame == mid);
+
+    EXPECT_EQ(3, bus.getStatistics().frames);
+    EXPECT_EQ(high_len + mid_len + low_len, bus.getStatistics().bits);
+    EXPECT_EQ(1, a.getStatistics().frames_tx);
+    EXPECT_EQ(2, a.getStatistics().frames_rx);
+
+    /*
+     * Lower bit rate
+     */
+    uavcan::VirtualTime slow_time;
+    SimulatedCanBus slow_bus(slow_time, 125000);
+    SimulatedCanDriver d(slow_bus);
+    ASSERT_EQ(1, d.send(high, tsMono(100000), 0));
+    slow_bus.run(uavcan::MonotonicDuration::fromMSec(10));
+    EXPECT_EQ(high_len * 8, slow_bus.getStatistics().busy_time_ns / 1000);
+}
+
+
+TEST(SimulatedCanBus, MailboxesAndSelect)
+{
+    uavcan::VirtualTime time;
+    SimulatedCanBus bus(time);
+
+    SimulatedCanDriver a(bus, 2);
+    SimulatedCanDriver b(bus);
+
+    const uavcan::CanFrame frame = makeCanFrame(123, "12345678", EXT);
+    const unsigned frame_len = uavcan::CanBusLoadEstimator::computeFrameBitLength(frame);
+
+    ASSERT_EQ(1, a.send(frame, tsMono(100000), 0));
+    ASSERT_EQ(1, a.send(frame, tsMono(100000), 0));
+    ASSERT_EQ(0, a.send(frame, tsMono(100000), 0));         // Mailboxes are full
+
+    /*
+     * Select blocks until a mailbox is released; the virtual time jumps to the end of the frame
+     */
+    const uavcan::CanFrame* pending_tx[uavcan::MaxCanIfaces] = {};
+    uavcan::CanSelectMasks masks;
+    masks.write = 1;
+    ASSERT_EQ(1, a.select(masks, pending_tx, tsMono(100000)));
+    EXPECT_EQ(1, masks.write);
+    EXPECT_EQ(frame_len, time.getMonotonic().toUSec());
+
+    /*
+     * Select on read
+     */
+    masks = uavcan::CanSelectMasks();
+    masks.read = 1;
+    ASSERT_EQ(1, b.select(masks, pending_tx, tsMono(100000)));
+    EXPECT_EQ(1, masks.read);
+    EXPECT_EQ(frame_len, time.getMonotonic().toUSec());       // Already received
+
+    /*
+     * Select times out when there's nothing to do
+     */
+    a.setOnline(false);
+    masks = uavcan::CanSelectMasks();
+    masks.read = 1;
+    ASSERT_EQ(0, a.select(masks, pending_tx, tsMono(50000)));
+    EXPECT_EQ(0, masks.read);
+    EXPECT_EQ(50000, time.getMonotonic().toUSec());
+    EXPECT_EQ(1, a.getNumPendingTxFrames());                // Retained while offline
+
+    a.setOnline(true);
+    bus.run(uavcan::MonotonicDuration::fromMSec(1));
+    EXPECT_EQ(0, a.getNumPendingTxFrames());
+    EXPECT_EQ(2, b.getNumPendingRxFrames());
+}
+
+
+TEST(SimulatedCanBus, LoopbackFiltersAndTimeouts)
+{
+    uavcan::VirtualTime time;
+    SimulatedCanBus bus(time);
+
+    SimulatedCanDriver a(bus);
+    SimulatedCanDriver b(bus, 3, 2);
+
+    /*
+     * Loopback
+     */
+    const uavcan::CanFrame frame = makeCanFrame(123, "abc", EXT);
+    ASSERT_EQ(1, a.send(frame, tsMono(100000), uavcan::CanIOFlagLoopback));
+    bus.run(uavcan::MonotonicDuration::fromMSec(1));
+
+    uavcan::CanFrame rx;
+    uint64_t ts = 0;
+    uavcan::CanIOFlags flags = 0;
+    ASSERT_TRUE(receiveFrom(a, rx, ts, flags));
+    EXPECT_TRUE(rx == frame);
+    EXPECT_EQ(uavcan::CanIOFlagLoopback, flags);
+    ASSERT_TRUE(receiveFrom(b, rx, ts, flags));
+    EXPECT_EQ(0, flags);
+
+    /*
+     * Acceptance filters
+     */
+    uavcan::CanFilterConfig filter;
+    filter.id = 123 | uavcan::CanFrame::FlagEFF;
+    filter.mask = uavcan::CanFrame::MaskExtID | uavcan::CanFrame::FlagEFF;
+    ASSERT_EQ(0, b.configureFilters(&filter, 1));
+    ASSERT_GT(0, b.configureFilters(&filter, SimulatedCanDriver::NumFilters + 1));
+
+    ASSERT_EQ(1, a.send(makeCanFrame(124, "abc", EXT), tsMono(100000), 0));
+    ASSERT_EQ(1, a.send(makeCanFrame(123, "abc", STD), tsMono(100000), 0));
+    ASSERT_EQ(1, a.send(frame, tsMono(100000), 0));
+    bus.run(uavcan::MonotonicDuration::fromMSec(1));
+    ASSERT_EQ(1, b.getNumPendingRxFrames());
+    EXPECT_EQ(2, b.getStatistics().rx_filtered_out);
+    ASSERT_TRUE(receiveFrom(b, rx, ts, flags));
+    EXPECT_TRUE(rx == frame);
+
+    /*
+     * RX overrun
+     */
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_EQ(1, a.send(frame, tsMono(100000), 0));
+        bus.run(uavcan::MonotonicDuration::fromMSec(1));
+    }
+    EXPECT_EQ(2, b.getNumPendingRxFrames());
+    EXPECT_EQ(1, b.getStatistics().rx_overruns);
+    EXPECT_EQ(1, b.getErrorCount());
+
+    /*
+     * TX timeout - the frame expires while the bus is busy with a higher priority frame
+     */
+    const uint64_t now = time.getMonotonic().toUSec();
+    ASSERT_EQ(1, a.send(makeCanFrame(1, "12345678", EXT), tsMono(now + 1000), 0));
+    ASSERT_EQ(1, b.send(makeCanFrame(1000, "", EXT), tsMono(now + 10), 0));
+    bus.run(uavcan::MonotonicDuration::fromMSec(1));
+    EXPECT_EQ(1, b.getStatistics().tx_timeouts);
+    EXPECT_EQ(0, b.getNumPendingTxFrames());
+    EXPECT_EQ(0, b.getStatistics().frames_tx);
+}
+
+
+TEST(SimulatedCanBus, ErrorInjection)
+{
+    uavcan::VirtualTime time;
+    SimulatedCanBus bus(time);
+    SimulatedCanBusEventCollector collector;
+    bus.setListener(&collector);
+
+    SimulatedCanDriver a(bus);
+    SimulatedCanDriver b(bus);
+
+    const uavcan::CanFrame frame = makeCanFrame(123, "abc", EXT);
+    const unsigned frame_len = uavcan::CanBusLoadEstimator::computeFrameBitLength(frame);
+
+    /*
+     * Corrupted frame is retransmitted automatically
+     */
+    bus.injectErrors(2);
+    ASSERT_EQ(1, a.send(frame, tsMono(100000), 0));
+    bus.run(uavcan::MonotonicDuration::fromMSec(1));
+
+    ASSERT_EQ(3, collector.events.size());
+    EXPECT_TRUE(collector.events[0].corrupted);
+    EXPECT_TRUE(collector.events[1].corrupted);
+    EXPECT_FALSE(collector.events[2].corrupted);
+    EXPECT_EQ(3 * frame_len + 2 * SimulatedCanBus::ErrorFrameBitLength, collector.events[2].finished_at.toUSec());
+    EXPECT_EQ(1, b.getNumPendingRxFrames());
+    EXPECT_EQ(2, a.getStatistics().tx_errors);
+    EXPECT_EQ(2, a.getErrorCount());
+    EXPECT_EQ(2, bus.getStatistics().errors);
+
+    /*
+     * Abort on error
+     */
+    bus.injectErrors(1);
+    ASSERT_EQ(1, a.send(frame, tsMono(100000), uavcan::CanIOFlagAbortOnError));
+    bus.run(uavcan::MonotonicDuration::fromMSec(1));
+    EXPECT_EQ(4, collector.events.size());
+    EXPECT_EQ(1, b.getNumPendingRxFrames());
+    EXPECT_EQ(0, a.getNumPendingTxFrames());
+
+    /*
+     * Random errors are reproducible
+     */
+    bus.setErrorProbability(100000, 42);            // 10%
+    for (int i = 0; i < 1000; i++)
+    {
+        ASSERT_EQ(1, a.send(frame, tsMono(time.getMonotonic().toUSec() + 100000), 0));
+        bus.run(uavcan::MonotonicDuration::fromMSec(1));
+    }
+    const uint64_t num_errors = a.getStatistics().tx_errors;
+    EXPECT_LT(3 + 50, num_errors);
+    EXPECT_GT(3 + 200, num_errors);
+    EXPECT_EQ(1001, b.getNumPendingRxFrames() + b.getStatistics().rx_overruns);
+}
+
+
+struct MavlinkMessageCollector
+{
+    std::vector<root_ns_a::MavlinkMessage>* received;
+
+    MavlinkMessageCollector(std::vector<root_ns_a::MavlinkMessage>* r = NULL) : received(r) { }
+
+    void operator()(const root_ns_a::MavlinkMessage& msg) { received->push_back(msg); }
+};
+
+TEST(SimulatedCanBus, Nodes)
+{
+    uavcan::GlobalDataTypeRegistry::instance().reset();
+    uavcan::DefaultDataTypeRegistrator<root_ns_a::MavlinkMessage> _registrator;
+
+    uavcan::VirtualTime time(1000000000);
+    SimulatedCanBus bus(time);
+    SimulatedCanBusEventCollector collector;
+    bus.setListener(&collector);
+
+    // The nodes were started at different moments
+    uavcan::VirtualSystemClock clock_a(time);
+    uavcan::VirtualSystemClock clock_b(time, 5000000);
+    SimulatedCanDriver can_a(bus, clock_a);
+    SimulatedCanDriver can_b(bus, clock_b);
+    TestNode node_a(can_a, clock_a, 1);
+    TestNode node_b(can_b, clock_b, 2);
+
+    uavcan::Publisher<root_ns_a::MavlinkMessage> publisher(node_a);
+    ASSERT_LE(0, publisher.init());
+
+    std::vector<root_ns_a::MavlinkMessage> received;
+    uavcan::Subscriber<root_ns_a::MavlinkMessage, MavlinkMessageCollector> subscriber(node_b);
+    ASSERT_LE(0, subscriber.start(MavlinkMessageCollector(&received)));
+
+    /*
+     * Multi-frame transfer, 100 bytes of payload
+     */
+    root_ns_a::MavlinkMessage msg;
+    msg.seq = 42;
+    for (int i = 0; i < 100; i++)
+    {
+        msg.payload.push_back(uint8_t(i));
+    }
+    ASSERT_LE(0, publisher.broadcast(msg));
+
+    for (int i = 0; i < 10; i++)
+    {
+        ASSERT_LE(0, node_a.spin(uavcan::MonotonicDuration::fromMSec(1)));
+        ASSERT_LE(0, node_b.spin(uavcan::MonotonicDuration::fromMSec(1)));
+    }
+
+    ASSERT_EQ(1, received.size());
+    EXPECT_EQ(42, received[0].seq);
+    EXPECT_TRUE(received[0].payload == msg.payload);
+    EXPECT_EQ(1020000, time.getMonotonic().toUSec());
+    EXPECT_EQ(6020000, clock_b.getMonotonic().toUSec());
+
+    // The frames never overlap; there may be gaps while the sender isn't spinning and its mailboxes are empty
+    ASSERT_LT(15, collector.events.size());
+    for (unsigned i = 1; i < collector.events.size(); i++)
+    {
+        EXPECT_LE(collector.events[i - 1].finished_at, collector.events[i].started_at);
+    }
+    EXPECT_EQ(collector.events.size(), bus.getStatistics().frames);
+}
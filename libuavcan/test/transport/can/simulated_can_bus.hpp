@@ -0,0 +1,636 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <stdexcept>
+#include <uavcan/driver/can.hpp>
+#include <uavcan/transport/can_bus_load_estimator.hpp>
+#include <uavcan/helpers/virtual_system_clock.hpp>
+
+class SimulatedCanDriver;
+
+/**
+ * Receives a notification for every frame that has occupied the simulated bus, including the corrupted ones.
+ * All timestamps are in the virtual time of the bus.
+ */
+class ISimulatedCanBusListener
+{
+public:
+    struct FrameEvent
+    {
+        uavcan::CanFrame frame;
+        const SimulatedCanDriver* sender;
+        uavcan::MonotonicTime enqueued_at;      ///< When the frame was accepted by the sender's TX mailbox
+        uavcan::MonotonicTime started_at;       ///< When the frame won arbitration
+        uavcan::MonotonicTime finished_at;      ///< End of the interframe space (or of the error frame)
+        bool corrupted;
+
+        FrameEvent()
+            : sender(NULL)
+            , corrupted(false)
+        { }
+    };
+
+    virtual ~ISimulatedCanBusListener() { }
+
+    virtual void handleSimulatedCanFrame(const FrameEvent& event) = 0;
+};
+
+/**
+ * In-process model of a single CAN bus with any number of attached nodes (see @ref SimulatedCanDriver).
+ *
+ * The bus is driven by the virtual time (@ref uavcan::VirtualTime) that jumps from one bus event to another,
+ * so the simulation runs faster than real time. Frames occupy the bus for their exact length on the wire, which
+ * depends on the bit rate and the bit stuffing. Whenever the bus becomes idle, the frames pending in the TX
+ * mailboxes of all nodes compete in the arbitration, and the frame with the highest priority wins. Arbitration
+ * is resolved lazily, at the moment the virtual time is advanced, so that all frames enqueued at the same instant
+ * compete fairly regardless of the order in which the nodes were spinning. See also @ref SimulatedNetwork.
+ *
+ * Errors can be injected either deterministically or randomly. A corrupted frame occupies the bus for its
+ * full length plus the error frame; then it is retransmitted, unless it was sent with CanIOFlagAbortOnError.
+ *
+ * The model is single threaded.
+ */
+class SimulatedCanBus : uavcan::Noncopyable
+{
+    friend class SimulatedCanDriver;
+
+public:
+    enum { DefaultBitRate = 1000000 };
+
+    /**
+     * Error flag (6), error delimiter (8), intermission (3).
+     */
+    enum { ErrorFrameBitLength = 17 };
+
+    struct Statistics
+    {
+        uint64_t frames;                        ///< Successfully transmitted
+        uint64_t errors;                        ///< Corrupted transmissions
+        uint64_t bits;                          ///< Including the corrupted transmissions and the error frames
+        uint64_t busy_time_ns;
+
+        Statistics()
+            : frames(0)
+            , errors(0)
+            , bits(0)
+            , busy_time_ns(0)
+        { }
+    };
+
+private:
+    struct Transmission
+    {
+        SimulatedCanDriver* sender;
+        unsigned mailbox_index;
+        uint64_t started_at_ns;
+        uint64_t finished_at_ns;
+        bool corrupted;
+
+        Transmission()
+            : sender(NULL)
+            , mailbox_index(0)
+            , started_at_ns(0)
+            , finished_at_ns(0)
+            , corrupted(false)
+        { }
+    };
+
+    uavcan::VirtualTime& time_;
+    const uavcan::VirtualSystemClock default_clock_;
+    uint32_t bit_rate_;
+    std::vector<SimulatedCanDriver*> nodes_;
+    ISimulatedCanBusListener* listener_;
+    Transmission current_;
+    unsigned num_errors_to_inject_;
+    uint32_t error_probability_ppm_;
+    uint32_t prng_state_;
+    Statistics stats_;
+
+    uint64_t bitsToNSec(uint64_t bits) const
+    {
+        return (bits * 1000000000U + bit_rate_ - 1U) / bit_rate_;
+    }
+
+    bool nextErrorInjected()
+    {
+        if (num_errors_to_inject_ > 0)
+        {
+            num_errors_to_inject_--;
+            return true;
+        }
+        if (error_probability_ppm_ > 0)
+        {
+            prng_state_ ^= prng_state_ << 13;       // Xorshift32, reproducible across platforms
+            prng_state_ ^= prng_state_ >> 17;
+            prng_state_ ^= prng_state_ << 5;
+            return (prng_state_ % 1000000U) < error_probability_ppm_;
+        }
+        return false;
+    }
+
+    inline bool startArbitration();
+    inline void finishTransmission();
+
+    void detach(SimulatedCanDriver* node)
+    {
+        assert(current_.sender != node);
+        nodes_.erase(std::remove(nodes_.begin(), nodes_.end(), node), nodes_.end());
+    }
+
+public:
+    SimulatedCanBus(uavcan::VirtualTime& time, uint32_t bit_rate = DefaultBitRate)
+        : time_(time)
+        , default_clock_(time)
+        , bit_rate_(bit_rate)
+        , listener_(NULL)
+        , num_errors_to_inject_(0)
+        , error_probability_ppm_(0)
+        , prng_state_(0x12345678U)
+    {
+        if (bit_rate_ == 0)
+        {
+            throw std::invalid_argument("Bit rate");
+        }
+    }
+
+    uavcan::VirtualTime& getVirtualTime() { return time_; }
+
+    /**
+     * Clock of the nodes that were attached without a clock of their own.
+     * Its monotonic time equals the virtual time.
+     */
+    const uavcan::VirtualSystemClock& getDefaultClock() const { return default_clock_; }
+
+    uint32_t getBitRate() const { return bit_rate_; }
+
+    void setListener(ISimulatedCanBusListener* listener) { listener_ = listener; }
+
+    /**
+     * The next N transmissions will be corrupted.
+     */
+    void injectErrors(unsigned num_frames) { num_errors_to_inject_ += num_frames; }
+
+    /**
+     * Every transmission will be corrupted with the specified probability, in parts per million.
+     * The pseudo-random sequence is determined by the seed.
+     */
+    void setErrorProbability(uint32_t ppm, uint32_t seed = 0x12345678U)
+    {
+        error_probability_ppm_ = ppm;
+        prng_state_ = (seed == 0) ? 1U : seed;
+    }
+
+    bool isIdle() const { return current_.sender == NULL; }
+
+    /**
+     * Processes one bus event - either the end of the current transmission, or the start of a new one followed
+     * by its end - unless it happens after the deadline. Returns true if an event has been processed.
+     * The deadline is in the virtual time, nanoseconds.
+     */
+    bool step(uint64_t deadline_ns)
+    {
+        if (isIdle() && !startArbitration())
+        {
+            return false;
+        }
+        if (current_.finished_at_ns > deadline_ns)
+        {
+            return false;
+        }
+        time_.advanceTo(current_.finished_at_ns);
+        finishTransmission();
+        return true;
+    }
+
+    /**
+     * Processes all bus events until the deadline, then advances the virtual time to the deadline.
+     */
+    void runUntil(uint64_t deadline_ns)
+    {
+        while (step(deadline_ns)) { }
+        time_.advanceTo(deadline_ns);
+    }
+
+    void run(uavcan::MonotonicDuration duration)
+    {
+        runUntil(time_.getNSec() + uint64_t(duration.toUSec()) * 1000U);
+    }
+
+    const Statistics& getStatistics() const { return stats_; }
+
+    /**
+     * Bus utilization since the start of the simulation, 1.0 means 100%.
+     */
+    double getUtilization() const
+    {
+        return (time_.getNSec() > 0) ? (double(stats_.busy_time_ns) / double(time_.getNSec())) : 0.0;
+    }
+};
+
+/**
+ * Single-interface driver of a node attached to @ref SimulatedCanBus.
+ * The TX mailboxes are arbitrated by priority, like in most CAN controllers; the number of mailboxes and the
+ * depth of the RX FIFO are configurable. Hardware acceptance filters are supported.
+ *
+ * When nothing is ready, select() advances the virtual time of the bus until an event relevant to this node
+ * occurs or the deadline is reached.
+ *
+ * Every node may have its own clock (e.g. with a monotonic offset or a drifting UTC); the driver timestamps
+ * the received frames and interprets the TX deadlines using that clock.
+ */
+class SimulatedCanDriver : public uavcan::ICanDriver, public uavcan::ICanIface, uavcan::Noncopyable
+{
+    friend class SimulatedCanBus;
+
+public:
+    enum { DefaultNumTxMailboxes = 3 };
+    enum { DefaultRxQueueCapacity = 64 };
+    enum { NumFilters = 14 };
+
+    struct Statistics
+    {
+        uint64_t frames_tx;
+        uint64_t frames_rx;
+        uint64_t tx_errors;
+        uint64_t tx_timeouts;           ///< Frames that expired in the TX mailbox before winning the arbitration
+        uint64_t rx_overruns;
+        uint64_t rx_filtered_out;
+
+        Statistics()
+            : frames_tx(0)
+            , frames_rx(0)
+            , tx_errors(0)
+            , tx_timeouts(0)
+            , rx_overruns(0)
+            , rx_filtered_out(0)
+        { }
+    };
+
+private:
+    struct Mailbox
+    {
+        uavcan::CanFrame frame;
+        uint64_t deadline_ns;                   ///< Virtual time
+        uavcan::MonotonicTime enqueued_at;      ///< Virtual time
+        uavcan::CanIOFlags flags;
+        bool in_flight;
+
+        Mailbox()
+            : deadline_ns(0)
+            , flags(0)
+            , in_flight(false)
+        { }
+    };
+
+    struct RxItem
+    {
+        uavcan::CanFrame frame;
+        uavcan::MonotonicTime ts_mono;
+        uavcan::UtcTime ts_utc;
+        uavcan::CanIOFlags flags;
+
+        RxItem()
+            : flags(0)
+        { }
+    };
+
+    SimulatedCanBus& bus_;
+    const uavcan::VirtualSystemClock& clock_;
+    const unsigned num_tx_mailboxes_;
+    const unsigned rx_queue_capacity_;
+    std::vector<Mailbox> mailboxes_;
+    std::deque<RxItem> rx_queue_;
+    std::vector<uavcan::CanFilterConfig> filters_;
+    Statistics stats_;
+    bool online_;
+    bool tx_mailbox_released_;
+
+    void init()
+    {
+        if (num_tx_mailboxes_ < 1 || rx_queue_capacity_ < 1)
+        {
+            throw std::invalid_argument("Mailboxes");
+        }
+        bus_.nodes_.push_back(this);
+    }
+
+    void releaseMailbox(unsigned index)
+    {
+        mailboxes_.erase(mailboxes_.begin() + std::ptrdiff_t(index));
+        tx_mailbox_released_ = true;
+    }
+
+    bool isWriteable() const { return mailboxes_.size() < num_tx_mailboxes_; }
+    bool isReadable() const { return !rx_queue_.empty(); }
+
+    bool isAcceptedByFilters(const uavcan::CanFrame& frame) const
+    {
+        if (filters_.empty())
+        {
+            return true;
+        }
+        for (std::vector<uavcan::CanFilterConfig>::const_iterator it = filters_.begin(); it != filters_.end(); ++it)
+        {
+            if (((frame.id ^ it->id) & it->mask) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void deliver(const uavcan::CanFrame& frame, uavcan::CanIOFlags flags)
+    {
+        if (!(flags & uavcan::CanIOFlagLoopback) && !isAcceptedByFilters(frame))
+        {
+            stats_.rx_filtered_out++;
+            return;
+        }
+        if (rx_queue_.size() >= rx_queue_capacity_)
+        {
+            stats_.rx_overruns++;
+            return;
+        }
+        RxItem item;
+        item.frame = frame;
+        item.ts_mono = clock_.getMonotonic();
+        item.ts_utc = clock_.getUtc();
+        item.flags = flags;
+        rx_queue_.push_back(item);
+    }
+
+public:
+    /**
+     * The node uses the default clock of the bus.
+     */
+    SimulatedCanDriver(SimulatedCanBus& bus,
+                       unsigned num_tx_mailboxes = DefaultNumTxMailboxes,
+                       unsigned rx_queue_capacity = DefaultRxQueueCapacity)
+        : bus_(bus)
+        , clock_(bus.getDefaultClock())
+        , num_tx_mailboxes_(num_tx_mailboxes)
+        , rx_queue_capacity_(rx_queue_capacity)
+        , online_(true)
+        , tx_mailbox_released_(false)
+    {
+        init();
+    }
+
+    /**
+     * The clock must be driven by the same virtual time as the bus.
+     */
+    SimulatedCanDriver(SimulatedCanBus& bus,
+                       const uavcan::VirtualSystemClock& clock,
+                       unsigned num_tx_mailboxes = DefaultNumTxMailboxes,
+                       unsigned rx_queue_capacity = DefaultRxQueueCapacity)
+        : bus_(bus)
+        , clock_(clock)
+        , num_tx_mailboxes_(num_tx_mailboxes)
+        , rx_queue_capacity_(rx_queue_capacity)
+        , online_(true)
+        , tx_mailbox_released_(false)
+    {
+        assert(&clock.getVirtualTime() == &bus.getVirtualTime());
+        init();
+    }
+
+    virtual ~SimulatedCanDriver()
+    {
+        if (bus_.current_.sender == this)
+        {
+            bus_.current_ = SimulatedCanBus::Transmission();
+        }
+        bus_.detach(this);
+    }
+
+    SimulatedCanBus& getBus() { return bus_; }
+
+    const uavcan::VirtualSystemClock& getClock() const { return clock_; }
+
+    const Statistics& getStatistics() const { return stats_; }
+
+    /**
+     * An offline node neither transmits nor receives; its mailboxes are retained.
+     */
+    void setOnline(bool online) { online_ = online; }
+    bool isOnline() const { return online_; }
+
+    unsigned getNumPendingTxFrames() const { return unsigned(mailboxes_.size()); }
+    unsigned getNumPendingRxFrames() const { return unsigned(rx_queue_.size()); }
+
+    /**
+     * Returns true if a TX mailbox has been released since the last call, which means that the node may want to
+     * refill it from its TX queue. Clears the flag.
+     */
+    bool pollTxMailboxReleased()
+    {
+        const bool res = tx_mailbox_released_;
+        tx_mailbox_released_ = false;
+        return res;
+    }
+
+    /*
+     * ICanDriver
+     */
+    virtual uavcan::ICanIface* getIface(uavcan::uint8_t iface_index) { return (iface_index == 0) ? this : NULL; }
+
+    virtual uavcan::uint8_t getNumIfaces() const { return 1; }
+
+    virtual uavcan::int16_t select(uavcan::CanSelectMasks& inout_masks,
+                                   const uavcan::CanFrame* (&)[uavcan::MaxCanIfaces],
+                                   uavcan::MonotonicTime blocking_deadline)
+    {
+        const uavcan::CanSelectMasks in_masks = inout_masks;
+        while (true)
+        {
+            inout_masks.read = uavcan::uint8_t(in_masks.read & (isReadable() ? 1U : 0U));
+            inout_masks.write = uavcan::uint8_t(in_masks.write & (isWriteable() ? 1U : 0U));
+            if ((inout_masks.read | inout_masks.write) != 0)
+            {
+                return 1;
+            }
+            const uint64_t deadline_ns = clock_.toVirtualNSec(blocking_deadline);
+            if (bus_.time_.getNSec() >= deadline_ns)
+            {
+                return 0;
+            }
+            if (!bus_.step(deadline_ns))
+            {
+                bus_.runUntil(deadline_ns);
+            }
+        }
+    }
+
+    /*
+     * ICanIface
+     */
+    virtual uavcan::int16_t send(const uavcan::CanFrame& frame, uavcan::MonotonicTime tx_deadline,
+                                 uavcan::CanIOFlags flags)
+    {
+        if (!isWriteable())
+        {
+            return 0;
+        }
+        Mailbox mb;
+        mb.frame = frame;
+        mb.deadline_ns = clock_.toVirtualNSec(tx_deadline);
+        mb.enqueued_at = bus_.time_.getMonotonic();
+        mb.flags = flags;
+        mailboxes_.push_back(mb);
+        return 1;
+    }
+
+    virtual uavcan::int16_t receive(uavcan::CanFrame& out_frame, uavcan::MonotonicTime& out_ts_monotonic,
+                                    uavcan::UtcTime& out_ts_utc, uavcan::CanIOFlags& out_flags)
+    {
+        if (rx_queue_.empty())
+        {
+            return 0;
+        }
+        const RxItem& item = rx_queue_.front();
+        out_frame = item.frame;
+        out_ts_monotonic = item.ts_mono;
+        out_ts_utc = item.ts_utc;
+        out_flags = item.flags;
+        rx_queue_.pop_front();
+        stats_.frames_rx++;
+        return 1;
+    }
+
+    virtual uavcan::int16_t configureFilters(const uavcan::CanFilterConfig* filter_configs,
+                                             uavcan::uint16_t num_configs)
+    {
+        if (num_configs > NumFilters || (filter_configs == NULL && num_configs > 0))
+        {
+            return -1;
+        }
+        filters_.assign(filter_configs, filter_configs + num_configs);
+        return 0;
+    }
+
+    virtual uavcan::uint16_t getNumFilters() const { return NumFilters; }
+
+    virtual uavcan::uint64_t getErrorCount() const { return stats_.tx_errors + stats_.rx_overruns; }
+};
+
+
+bool SimulatedCanBus::startArbitration()
+{
+    assert(isIdle());
+    const uint64_t now_ns = time_.getNSec();
+
+    SimulatedCanDriver* winner = NULL;
+    unsigned winner_index = 0;
+
+    for (std::vector<SimulatedCanDriver*>::iterator it = nodes_.begin(); it != nodes_.end(); ++it)
+    {
+        SimulatedCanDriver& node = **it;
+        if (!node.online_)
+        {
+            continue;
+        }
+        unsigned i = 0;
+        while (i < node.mailboxes_.size())
+        {
+            const SimulatedCanDriver::Mailbox& mb = node.mailboxes_[i];
+            if (mb.deadline_ns < now_ns)
+            {
+                node.stats_.tx_timeouts++;
+                node.releaseMailbox(i);
+                continue;
+            }
+            if ((winner == NULL) || mb.frame.priorityHigherThan(winner->mailboxes_[winner_index].frame))
+            {
+                winner = &node;
+                winner_index = i;
+            }
+            i++;
+        }
+    }
+
+    if (winner == NULL)
+    {
+        return false;
+    }
+
+    SimulatedCanDriver::Mailbox& mb = winner->mailboxes_[winner_index];
+    mb.in_flight = true;
+
+    current_.sender = winner;
+    current_.mailbox_index = winner_index;
+    current_.started_at_ns = now_ns;
+    current_.corrupted = nextErrorInjected();
+
+    uint64_t bits = uavcan::CanBusLoadEstimator::computeFrameBitLength(mb.frame);
+    if (current_.corrupted)
+    {
+        bits += ErrorFrameBitLength;
+    }
+    current_.finished_at_ns = now_ns + bitsToNSec(bits);
+
+    stats_.bits += bits;
+    stats_.busy_time_ns += current_.finished_at_ns - current_.started_at_ns;
+    return true;
+}
+
+void SimulatedCanBus::finishTransmission()
+{
+    assert(!isIdle());
+    SimulatedCanDriver& sender = *current_.sender;
+    SimulatedCanDriver::Mailbox mb = sender.mailboxes_.at(current_.mailbox_index);
+    assert(mb.in_flight);
+
+    ISimulatedCanBusListener::FrameEvent event;
+    event.frame = mb.frame;
+    event.sender = &sender;
+    event.enqueued_at = mb.enqueued_at;
+    event.started_at = uavcan::MonotonicTime::fromUSec(current_.started_at_ns / 1000U);
+    event.finished_at = time_.getMonotonic();
+    event.corrupted = current_.corrupted;
+
+    const bool retransmit = current_.corrupted && !(mb.flags & uavcan::CanIOFlagAbortOnError);
+    if (retransmit)
+    {
+        sender.mailboxes_[current_.mailbox_index].in_flight = false;
+    }
+    else
+    {
+        sender.releaseMailbox(current_.mailbox_index);
+    }
+    current_ = Transmission();
+
+    if (event.corrupted)
+    {
+        stats_.errors++;
+        sender.stats_.tx_errors++;
+    }
+    else
+    {
+        stats_.frames++;
+        sender.stats_.frames_tx++;
+        for (std::vector<SimulatedCanDriver*>::iterator it = nodes_.begin(); it != nodes_.end(); ++it)
+        {
+            if ((*it != &sender) && (*it)->online_)
+            {
+                (*it)->deliver(mb.frame, 0);
+            }
+        }
+        if (mb.flags & uavcan::CanIOFlagLoopback)
+        {
+            sender.deliver(mb.frame, uavcan::CanIOFlagLoopback);
+        }
+    }
+
+    if (listener_ != NULL)
+    {
+        listener_->handleSimulatedCanFrame(event);
+    }
+}
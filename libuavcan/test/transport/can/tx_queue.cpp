@@ -60,6 +60,46 @@ TEST(CanTxQueue, Qos)
     EXPECT_TRUE(e2.qosLowerThan(e1));
 }
 
+TEST(CanTxQueue, SlabPoolAllocatorMemorySavings)
+{
+    using uavcan::CanTxQueue;
+
+    static const std::size_t PoolSize = 2048;
+    uavcan::PoolAllocator<PoolSize, uavcan::MemPoolBlockSize> fixed_pool;
+    uavcan::SlabPoolAllocator<PoolSize> slab_pool;
+
+    SystemClockMock clockmock;
+    CanTxQueue fixed_queue(fixed_pool, clockmock, 99999);
+    CanTxQueue slab_queue(slab_pool, clockmock, 99999);
+
+    // Filling both queues with unique persistent frames until the pools are exhausted
+    const uavcan::CanIOFlags flags = 0;
+    for (uint32_t i = 0; i < PoolSize; i++)
+    {
+        fixed_queue.push(makeCanFrame(i, "", EXT), tsMono(1000), CanTxQueue::Persistent, flags);
+        slab_queue.push(makeCanFrame(i, "", EXT), tsMono(1000), CanTxQueue::Persistent, flags);
+    }
+
+    const int fixed_len = getQueueLength(fixed_queue);
+    const int slab_len = getQueueLength(slab_queue);
+
+    std::cout << "sizeof(CanTxQueue::Entry): " << sizeof(CanTxQueue::Entry)
+              << ", frames per " << PoolSize << " bytes: "
+              << "PoolAllocator " << fixed_len << ", SlabPoolAllocator " << slab_len << std::endl;
+
+    EXPECT_EQ(fixed_pool.getNumUsedBlocks(), fixed_len);
+    EXPECT_EQ(slab_pool.getNumUsedBlocks(), slab_len);
+    EXPECT_EQ(0, slab_pool.getNumFreeSlabs());
+
+    // Slab allocator is never worse; it is strictly better if the entry is smaller than the pool block
+    EXPECT_LE(fixed_len, slab_len);
+    if (uavcan::SlabPoolAllocator<PoolSize>::getBlockSizeForAllocationSize(sizeof(CanTxQueue::Entry)) <
+        uavcan::MemPoolBlockSize)
+    {
+        EXPECT_LT(fixed_len, slab_len);
+    }
+}
+
 TEST(CanTxQueue, TxQueue)
 {
     using uavcan::CanTxQueue;
@@ -8,6 +8,7 @@
 
 #include <uavcan/transport/can_acceptance_filter_configurator.hpp>
 #include "../node/test_node.hpp"
+#include "transfer_test_helpers.hpp"
 #include "uavcan/node/subscriber.hpp"
 #include <uavcan/equipment/camera_gimbal/AngularCommand.hpp>
 #include <uavcan/equipment/air_data/Sideslip.hpp>
@@ -216,4 +217,196 @@ TEST(CanAcceptanceFilter, Basic_test)
     ASSERT_EQ(configure_array_2.getByIndex(3)->id, 2147745792);
     ASSERT_EQ(configure_array_2.getByIndex(3)->mask, 3774868352);
 }
+
+static uavcan::CanFrame makeMessageFrame(uavcan::uint16_t data_type_id, uavcan::uint8_t src_node_id)
+{
+    const uavcan::uint32_t id = (uint32_t(data_type_id) << 8) | src_node_id | uavcan::CanFrame::FlagEFF;
+    const uavcan::uint8_t payload[1] = { 0xC0 };    // Single frame transfer
+    return uavcan::CanFrame(id, payload, 1);
+}
+
+static uavcan::CanFilterConfig makeMessageConfig(uavcan::uint16_t data_type_id)
+{
+    uavcan::CanFilterConfig cfg;
+    cfg.id = (uint32_t(data_type_id) << 8) | uavcan::CanFrame::FlagEFF;
+    cfg.mask = 0xFFFF80U | uavcan::CanFrame::FlagEFF | uavcan::CanFrame::FlagRTR | uavcan::CanFrame::FlagERR;
+    return cfg;
+}
+
+TEST(CanAcceptanceFilter, TrafficAwareMerging)
+{
+    SystemClockDriver clock_driver;
+    CanDriverMock can_driver(1, clock_driver);
+    TestNode node(can_driver, clock_driver, 24);
+
+    /*
+     * Traffic on the bus: messages the node needs and one busy message that it doesn't need.
+     * 0x100 and 0x103 differ in two bits, so merging them also accepts 0x101 and 0x102; 0xF000 and 0xF007
+     * differ in three bits, but there is no traffic in between.
+     */
+    struct TrafficSpec
+    {
+        uavcan::uint16_t data_type_id;
+        unsigned num_frames;
+    };
+    const TrafficSpec traffic[] =
+    {
+        { 0x100, 10 },
+        { 0x103, 10 },
+        { 0xF000, 5 },
+        { 0xF007, 5 },
+        { 0x101, 200 },     // Unwanted
+        { 0x555, 3 }        // Unwanted
+    };
+
+    uavcan::CanTrafficSampler<> sampler(node);
+    ASSERT_FALSE(sampler.isRunning());
+    sampler.start();
+    ASSERT_TRUE(sampler.isRunning());
+
+    unsigned total_frames = 0;
+    for (unsigned i = 0; i < sizeof(traffic) / sizeof(traffic[0]); i++)
+    {
+        for (unsigned k = 0; k < traffic[i].num_frames; k++)
+        {
+            can_driver.ifaces.at(0).pushRx(makeMessageFrame(traffic[i].data_type_id, 10));
+            total_frames++;
+        }
+    }
+    while (node.spinOnce() > 0 || !can_driver.ifaces.at(0).rx.empty()) { }
+
+    ASSERT_EQ(total_frames, sampler.getNumFrames());
+    ASSERT_EQ(6, sampler.getNumCanIDs());
+    ASSERT_EQ(0, sampler.getNumUntrackedFrames());
+    ASSERT_EQ(200, sampler.getNumFrames(makeMessageFrame(0x101, 10).id));
+
+    sampler.stop();
+    ASSERT_FALSE(sampler.isRunning());
+    ASSERT_TRUE(node.getDispatcher().getRxFrameListener() == NULL);
+
+    /*
+     * Computing the configuration with both strategies; 5 configurations into 4 filters
+     */
+    const uavcan::uint16_t needed_types[] = { 0x100, 0x103, 0xF000, 0xF007 };
+
+    uavcan::uint64_t predicted_by_strategy[2] = { 0, 0 };
+
+    for (int strategy = 0; strategy < 2; strategy++)
+    {
+        uavcan::CanAcceptanceFilterConfigurator cfger(node, 4);
+        cfger.setMergeStrategy(uavcan::CanAcceptanceFilterConfigurator::MergeStrategy(strategy));
+        ASSERT_EQ(0, sampler.exportTrafficSamples(cfger));
+        ASSERT_EQ(6, cfger.getNumTrafficSamples());
+
+        ASSERT_EQ(0, cfger.computeConfiguration(uavcan::CanAcceptanceFilterConfigurator::IgnoreAnonymousMessages));
+        for (unsigned i = 0; i < sizeof(needed_types) / sizeof(needed_types[0]); i++)
+        {
+            ASSERT_EQ(0, cfger.addFilterConfig(makeMessageConfig(needed_types[i])));
+        }
+        ASSERT_EQ(0, cfger.applyConfiguration());
+        ASSERT_EQ(4, cfger.getConfiguration().getSize());
+
+        ASSERT_EQ(30, cfger.getRequiredTraffic());
+        predicted_by_strategy[strategy] = cfger.getPredictedAcceptedTraffic();
+
+        /*
+         * Measuring the accepted traffic by emulating the hardware filters
+         */
+        uavcan::CanTrafficSampler<> measurement(node);
+        measurement.start();
+        for (unsigned i = 0; i < sizeof(traffic) / sizeof(traffic[0]); i++)
+        {
+            const uavcan::CanFrame frame = makeMessageFrame(traffic[i].data_type_id, 10);
+            bool accepted = false;
+            for (unsigned k = 0; k < cfger.getConfiguration().getSize(); k++)
+            {
+                const uavcan::CanFilterConfig& cfg = *cfger.getConfiguration().getByIndex(k);
+                accepted = accepted || (((frame.id ^ cfg.id) & cfg.mask) == 0);
+            }
+            for (unsigned k = 0; accepted && (k < traffic[i].num_frames); k++)
+            {
+                can_driver.ifaces.at(0).pushRx(frame);
+            }
+        }
+        while (node.spinOnce() > 0 || !can_driver.ifaces.at(0).rx.empty()) { }
+
+        std::cout << "Strategy " << strategy << ": required " << cfger.getRequiredTraffic()
+                  << ", predicted " << predicted_by_strategy[strategy]
+                  << ", measured " << measurement.getNumFrames() << std::endl;
+        ASSERT_EQ(predicted_by_strategy[strategy], measurement.getNumFrames());
+    }
+
+    ASSERT_EQ(230, predicted_by_strategy[uavcan::CanAcceptanceFilterConfigurator::MaximizeMaskBits]);
+    ASSERT_EQ(30, predicted_by_strategy[uavcan::CanAcceptanceFilterConfigurator::MinimizeFalseAccepts]);
+}
+
+TEST(CanAcceptanceFilter, TrafficAwareMergingRecompute)
+{
+    SystemClockDriver clock_driver;
+    CanDriverMock can_driver(1, clock_driver);
+    TestNode node(can_driver, clock_driver, 24);
+
+    uavcan::CanAcceptanceFilterConfigurator cfger(node, 4);
+    cfger.setMergeStrategy(uavcan::CanAcceptanceFilterConfigurator::MinimizeFalseAccepts);
+
+    const uavcan::uint16_t traffic[][2] =
+    {
+        { 0x100, 10 },
+        { 0x103, 10 },
+        { 0x400, 10 },
+        { 0x403, 10 },
+        { 0x101, 200 },
+        { 0x402, 20 },
+        { 0x000, 50 },
+        { 0x503, 50 }
+    };
+    for (unsigned i = 0; i < sizeof(traffic) / sizeof(traffic[0]); i++)
+    {
+        ASSERT_EQ(0, cfger.addTrafficSample(makeMessageFrame(traffic[i][0], 10).id, traffic[i][1]));
+    }
+
+    const uavcan::DataTypeDescriptor types[] =
+    {
+        makeDataType(uavcan::DataTypeKindMessage, 0x101),
+        makeDataType(uavcan::DataTypeKindMessage, 0x100),
+        makeDataType(uavcan::DataTypeKindMessage, 0x103),
+        makeDataType(uavcan::DataTypeKindMessage, 0x400),
+        makeDataType(uavcan::DataTypeKindMessage, 0x403)
+    };
+    std::auto_ptr<TestListener> listeners[sizeof(types) / sizeof(types[0])];
+    for (unsigned i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+    {
+        listeners[i].reset(new TestListener(node.getDispatcher().getTransferPerfCounter(), types[i], 8,
+                                            node.getAllocator()));
+    }
+
+    /*
+     * First computation - 0x101 is subscribed to, no merging is needed
+     */
+    ASSERT_TRUE(node.getDispatcher().registerMessageListener(listeners[0].get()));
+    ASSERT_EQ(0, cfger.computeConfiguration(uavcan::CanAcceptanceFilterConfigurator::IgnoreAnonymousMessages));
+    ASSERT_EQ(2, cfger.getConfiguration().getSize());
+    ASSERT_EQ(200, cfger.getRequiredTraffic());
+    ASSERT_EQ(200, cfger.getPredictedAcceptedTraffic());
+
+    /*
+     * Second computation - 0x101 is not needed anymore, one merge is needed.
+     * Merging 0x400 with 0x403 lets through 0x402, which is the least of the unwanted traffic; merging 0x100 with
+     * 0x103 would let through 0x101, which must not be treated as wanted because it was subscribed to before.
+     */
+    node.getDispatcher().unregisterMessageListener(listeners[0].get());
+    for (unsigned i = 1; i < sizeof(types) / sizeof(types[0]); i++)
+    {
+        ASSERT_TRUE(node.getDispatcher().registerMessageListener(listeners[i].get()));
+    }
+    ASSERT_EQ(0, cfger.computeConfiguration(uavcan::CanAcceptanceFilterConfigurator::IgnoreAnonymousMessages));
+    ASSERT_EQ(4, cfger.getConfiguration().getSize());
+    ASSERT_EQ(40, cfger.getRequiredTraffic());
+    ASSERT_EQ(60, cfger.getPredictedAcceptedTraffic());
+
+    for (unsigned i = 1; i < sizeof(types) / sizeof(types[0]); i++)
+    {
+        node.getDispatcher().unregisterMessageListener(listeners[i].get());
+    }
+}
 #endif
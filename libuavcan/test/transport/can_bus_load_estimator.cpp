@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <uavcan/transport/can_bus_load_estimator.hpp>
+#include "can/can.hpp"
+
+
+static uavcan::CanFrame makeFrame(uint32_t id, const uint8_t* data, uint8_t dlc, bool extended)
+{
+    return uavcan::CanFrame(id | (extended ? uavcan::CanFrame::FlagEFF : 0U), data, dlc);
+}
+
+TEST(CanBusLoadEstimator, FrameBitLength)
+{
+    using uavcan::CanBusLoadEstimator;
+
+    static const uint8_t Zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    static const uint8_t Ones[8] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    static const uint8_t Counter[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    static const uint8_t Alternating[2] = { 0x55, 0xAA };
+
+    /*
+     * Worst case - the well known figures for 8 byte frames
+     */
+    EXPECT_EQ(135, CanBusLoadEstimator::computeWorstCaseFrameBitLength(8, false));
+    EXPECT_EQ(160, CanBusLoadEstimator::computeWorstCaseFrameBitLength(8, true));
+    EXPECT_EQ(55,  CanBusLoadEstimator::computeWorstCaseFrameBitLength(0, false));
+    EXPECT_EQ(80,  CanBusLoadEstimator::computeWorstCaseFrameBitLength(0, true));
+    EXPECT_EQ(160, CanBusLoadEstimator::computeWorstCaseFrameBitLength(100, true));    // Clamped
+
+    /*
+     * Exact lengths, including the stuff bits in the CRC sequence
+     */
+    EXPECT_EQ(53,  CanBusLoadEstimator::computeFrameBitLength(makeFrame(0, Zeros, 0, false)));
+    EXPECT_EQ(127, CanBusLoadEstimator::computeFrameBitLength(makeFrame(0, Zeros, 8, false)));
+    EXPECT_EQ(126, CanBusLoadEstimator::computeFrameBitLength(makeFrame(0x7FF, Ones, 8, false)));
+    EXPECT_EQ(149, CanBusLoadEstimator::computeFrameBitLength(makeFrame(0x1FFFFFFF, Ones, 8, true)));
+    EXPECT_EQ(150, CanBusLoadEstimator::computeFrameBitLength(makeFrame(0, Zeros, 8, true)));
+    EXPECT_EQ(141, CanBusLoadEstimator::computeFrameBitLength(makeFrame(0x10012345, Counter, 8, true)));
+    EXPECT_EQ(88,  CanBusLoadEstimator::computeFrameBitLength(makeFrame(123, Alternating, 2, true)));
+
+    /*
+     * Error frames are ignored
+     */
+    uavcan::CanFrame error_frame = makeFrame(123, Counter, 8, true);
+    error_frame.id |= uavcan::CanFrame::FlagERR;
+    EXPECT_EQ(0, CanBusLoadEstimator::computeFrameBitLength(error_frame));
+
+    /*
+     * The exact length always lies between the unstuffed length and the worst case
+     */
+    for (int i = 0; i < 10000; i++)
+    {
+        uint8_t data[8];
+        for (int k = 0; k < 8; k++)
+        {
+            data[k] = uint8_t(std::rand());
+        }
+        const bool extended = (std::rand() & 1) != 0;
+        const uint8_t dlc = uint8_t(std::rand() % 9);
+        const uint32_t id = uint32_t(std::rand()) & (extended ? uavcan::CanFrame::MaskExtID :
+                                                                uavcan::CanFrame::MaskStdID);
+
+        const unsigned length = CanBusLoadEstimator::computeFrameBitLength(makeFrame(id, data, dlc, extended));
+        const unsigned unstuffed_length = (extended ? 67U : 47U) + dlc * 8U;
+
+        ASSERT_LE(unstuffed_length, length);
+        ASSERT_GE(CanBusLoadEstimator::computeWorstCaseFrameBitLength(dlc, extended), length);
+    }
+}
+
+
+TEST(CanBusLoadEstimator, Utilization)
+{
+    using uavcan::CanBusLoadEstimator;
+    using uavcan::MonotonicDuration;
+
+    static const uint8_t Zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    const uavcan::CanFrame frame = makeFrame(0, Zeros, 8, true);            // 150 bits
+
+    CanBusLoadEstimator estimator;
+    ASSERT_EQ(1000000, estimator.getBitRate());
+    ASSERT_EQ(MonotonicDuration::fromMSec(100), estimator.getSlotDuration());
+    ASSERT_EQ(MonotonicDuration::fromMSec(1500), estimator.getMaxWindow());
+
+    /*
+     * Empty
+     */
+    EXPECT_EQ(0, estimator.getUtilization(tsMono(0), MonotonicDuration::fromMSec(100)));
+    EXPECT_EQ(0, estimator.getUtilization(tsMono(10000000), MonotonicDuration::fromMSec(100)));
+
+    /*
+     * 100 frames within 100 ms starting at 10 s --> 15 kbit per 100 ms, 15% of 1 Mbit/s
+     */
+    for (int i = 0; i < 100; i++)
+    {
+        estimator.addFrame(frame, tsMono(10000000 + uint64_t(i) * 1000));
+    }
+    EXPECT_EQ(100, estimator.getNumFrames());
+    EXPECT_EQ(15000, estimator.getNumBits());
+
+    // Only the elapsed part of the current slot is considered
+    EXPECT_EQ(300,  estimator.getUtilization(tsMono(10050000), MonotonicDuration()));
+    EXPECT_EQ(150,  estimator.getUtilization(tsMono(10100000), MonotonicDuration::fromMSec(100)));
+    EXPECT_EQ(75,   estimator.getUtilization(tsMono(10100000), MonotonicDuration::fromMSec(200)));
+    EXPECT_EQ(100,  estimator.getUtilization(tsMono(10150000), MonotonicDuration::fromMSec(100)));
+    EXPECT_EQ(0,    estimator.getUtilization(tsMono(10250000), MonotonicDuration::fromMSec(100)));
+    EXPECT_EQ(10,   estimator.getUtilization(tsMono(11500000), MonotonicDuration::fromMSec(1500)));
+    EXPECT_EQ(10,   estimator.getUtilization(tsMono(11500000), MonotonicDuration::fromMSec(100500)));   // Truncated
+
+    // The slot is outside of the ring now
+    EXPECT_EQ(0,    estimator.getUtilization(tsMono(11600000), MonotonicDuration::fromMSec(1500)));
+
+    /*
+     * Different bit rate
+     */
+    estimator.setBitRate(250000);
+    EXPECT_EQ(600, estimator.getUtilization(tsMono(10100000), MonotonicDuration::fromMSec(100)));
+
+    /*
+     * Ring wrap-around - old slots must be discarded
+     */
+    estimator.addFrame(frame, tsMono(11650000));            // Slot 116 takes the place of 100
+    EXPECT_EQ(0, estimator.getUtilization(tsMono(10100000), MonotonicDuration::fromMSec(100)));
+    EXPECT_EQ(6, estimator.getUtilization(tsMono(11700000), MonotonicDuration::fromMSec(100)));
+
+    /*
+     * Reset
+     */
+    estimator.setSlotDuration(MonotonicDuration::fromMSec(10));
+    EXPECT_EQ(0, estimator.getNumFrames());
+    EXPECT_EQ(0, estimator.getNumBits());
+    EXPECT_EQ(0, estimator.getUtilization(tsMono(11700000), MonotonicDuration::fromMSec(100)));
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <gtest/gtest.h>
+#include <uavcan/transport/transfer_latency_stats.hpp>
+#include <uavcan/transport/can_io.hpp>
+#include <uavcan/transport/frame.hpp>
+#include "can/can.hpp"
+
+
+static uavcan::CanFrame makeUavcanFrame(uavcan::DataTypeID dtid, uavcan::TransferType transfer_type,
+                                        uavcan::NodeID src_node_id, uavcan::NodeID dst_node_id)
+{
+    uavcan::Frame frame(dtid, transfer_type, src_node_id, dst_node_id, uavcan::TransferID(0));
+    const uint8_t payload[1] = { 42 };
+    frame.setPayload(payload, sizeof(payload));
+    frame.setStartOfTransfer(true);
+    frame.setEndOfTransfer(true);
+    uavcan::CanFrame can_frame;
+    EXPECT_TRUE(frame.compile(can_frame));
+    return can_frame;
+}
+
+TEST(TransferLatencyStats, Histogram)
+{
+    using uavcan::LatencyHistogram;
+    using uavcan::MonotonicDuration;
+
+    /*
+     * Bucket boundaries
+     */
+    EXPECT_EQ(0, LatencyHistogram::getBucketIndex(0));
+    EXPECT_EQ(0, LatencyHistogram::getBucketIndex(31));
+    EXPECT_EQ(1, LatencyHistogram::getBucketIndex(32));
+    EXPECT_EQ(1, LatencyHistogram::getBucketIndex(63));
+    EXPECT_EQ(2, LatencyHistogram::getBucketIndex(64));
+    EXPECT_EQ(14, LatencyHistogram::getBucketIndex(524287));
+    EXPECT_EQ(15, LatencyHistogram::getBucketIndex(524288));
+    EXPECT_EQ(15, LatencyHistogram::getBucketIndex(0xFFFFFFFFFFFFULL));
+
+    EXPECT_EQ(0, LatencyHistogram::getBucketLowerBoundUSec(0));
+    EXPECT_EQ(32, LatencyHistogram::getBucketLowerBoundUSec(1));
+    EXPECT_EQ(64, LatencyHistogram::getBucketLowerBoundUSec(2));
+    EXPECT_EQ(524288, LatencyHistogram::getBucketLowerBoundUSec(15));
+
+    for (uint8_t i = 0; i < LatencyHistogram::NumBuckets; i++)
+    {
+        EXPECT_EQ(i, LatencyHistogram::getBucketIndex(LatencyHistogram::getBucketLowerBoundUSec(i)));
+    }
+
+    /*
+     * Samples
+     */
+    LatencyHistogram hist;
+    EXPECT_EQ(0, hist.getNumSamples());
+    EXPECT_EQ(0, hist.getMean().toUSec());
+    EXPECT_EQ(0, hist.estimatePercentile(50).toUSec());
+
+    hist.addSample(MonotonicDuration::fromUSec(-5));        // Accounted as zero
+    hist.addSample(MonotonicDuration::fromUSec(100));
+    hist.addSample(MonotonicDuration::fromUSec(1000));
+
+    EXPECT_EQ(3, hist.getNumSamples());
+    EXPECT_EQ(1100, hist.getSumUSec());
+    EXPECT_EQ(1000, hist.getMaxUSec());
+    EXPECT_EQ(366, hist.getMean().toUSec());
+
+    EXPECT_EQ(1, hist.getBucket(0));
+    EXPECT_EQ(1, hist.getBucket(2));
+    EXPECT_EQ(1, hist.getBucket(5));
+    EXPECT_EQ(0, hist.getBucket(1));
+    EXPECT_EQ(0, hist.getBucket(LatencyHistogram::NumBuckets));      // Out of range
+
+    EXPECT_EQ(32, hist.estimatePercentile(0).toUSec());
+    EXPECT_EQ(128, hist.estimatePercentile(50).toUSec());
+    EXPECT_EQ(1000, hist.estimatePercentile(100).toUSec());          // Limited by the max
+    EXPECT_EQ(1000, hist.estimatePercentile(200).toUSec());
+
+    hist.addSample(MonotonicDuration::fromMSec(2000));                // Last bucket
+    EXPECT_EQ(1, hist.getBucket(LatencyHistogram::NumBuckets - 1));
+    EXPECT_EQ(2000000, hist.getMaxUSec());
+    EXPECT_EQ(2000000, hist.estimatePercentile(99).toUSec());
+
+    hist.reset();
+    EXPECT_EQ(0, hist.getNumSamples());
+    EXPECT_EQ(0, hist.getMaxUSec());
+    EXPECT_EQ(0, hist.getBucket(0));
+}
+
+TEST(TransferLatencyStats, Table)
+{
+    SystemClockMock clock(1000);
+    uavcan::StaticTransferLatencyStats<2> stats(clock);
+
+    EXPECT_EQ(0, stats.getSize());
+    EXPECT_EQ(2, stats.getCapacity());
+    EXPECT_FALSE(stats.getByIndex(0));
+    EXPECT_FALSE(stats.find(uavcan::DataTypeKindMessage, 20000));
+    EXPECT_EQ(1000, stats.getMonotonicTime().toUSec());
+
+    const uavcan::MonotonicDuration latency = uavcan::MonotonicDuration::fromUSec(100);
+
+    stats.addSample(uavcan::TransferLatencyKindRxCallback, uavcan::DataTypeKindMessage, 20000, latency);
+    stats.addSample(uavcan::TransferLatencyKindRxCallback, uavcan::DataTypeKindMessage, 20000, latency);
+    stats.addSample(uavcan::TransferLatencyKindServiceRoundTrip, uavcan::DataTypeKindService, 20, latency);
+    stats.addSample(uavcan::TransferLatencyKindRxReassembly, uavcan::DataTypeKindMessage, 20, latency);  // Dropped
+    EXPECT_EQ(2, stats.getSize());
+    EXPECT_EQ(1, stats.getNumDroppedSamples());
+
+    // Entries are ordered by the time of creation
+    ASSERT_TRUE(stats.getByIndex(0));
+    EXPECT_EQ(20000, stats.getByIndex(0)->data_type_id.get());
+    EXPECT_EQ(uavcan::DataTypeKindMessage, stats.getByIndex(0)->data_type_kind);
+    ASSERT_TRUE(stats.getByIndex(1));
+    EXPECT_EQ(20, stats.getByIndex(1)->data_type_id.get());
+    EXPECT_EQ(uavcan::DataTypeKindService, stats.getByIndex(1)->data_type_kind);
+    EXPECT_FALSE(stats.getByIndex(2));
+
+    const uavcan::TransferLatencyStats::Entry* const msg = stats.find(uavcan::DataTypeKindMessage, 20000);
+    ASSERT_TRUE(msg);
+    EXPECT_EQ(2, msg->histograms[uavcan::TransferLatencyKindRxCallback].getNumSamples());
+    EXPECT_EQ(0, msg->histograms[uavcan::TransferLatencyKindRxReassembly].getNumSamples());
+    EXPECT_EQ(0, msg->histograms[uavcan::TransferLatencyKindServiceRoundTrip].getNumSamples());
+
+    const uavcan::TransferLatencyStats::Entry* const srv = stats.find(uavcan::DataTypeKindService, 20);
+    ASSERT_TRUE(srv);
+    EXPECT_EQ(1, srv->histograms[uavcan::TransferLatencyKindServiceRoundTrip].getNumSamples());
+    EXPECT_FALSE(stats.find(uavcan::DataTypeKindMessage, 20));
+
+    stats.reset();
+    EXPECT_EQ(0, stats.getSize());
+    EXPECT_EQ(0, stats.getNumDroppedSamples());
+    EXPECT_FALSE(stats.find(uavcan::DataTypeKindMessage, 20000));
+
+    // Reused entries start from scratch
+    stats.addSample(uavcan::TransferLatencyKindRxReassembly, uavcan::DataTypeKindMessage, 20, latency);
+    ASSERT_TRUE(stats.getByIndex(0));
+    EXPECT_EQ(1, stats.getByIndex(0)->histograms[uavcan::TransferLatencyKindRxReassembly].getNumSamples());
+    EXPECT_EQ(0, stats.getByIndex(0)->histograms[uavcan::TransferLatencyKindRxCallback].getNumSamples());
+}
+
+TEST(TransferLatencyStats, DataTypeExtraction)
+{
+    uavcan::DataTypeKind kind = uavcan::DataTypeKindMessage;
+    uavcan::DataTypeID dtid;
+
+    EXPECT_TRUE(uavcan::TransferLatencyStats::extractDataType(
+        makeUavcanFrame(20000, uavcan::TransferTypeMessageBroadcast, 42, uavcan::NodeID::Broadcast), kind, dtid));
+    EXPECT_EQ(uavcan::DataTypeKindMessage, kind);
+    EXPECT_EQ(20000, dtid.get());
+
+    EXPECT_TRUE(uavcan::TransferLatencyStats::extractDataType(
+        makeUavcanFrame(130, uavcan::TransferTypeServiceRequest, 42, 1), kind, dtid));
+    EXPECT_EQ(uavcan::DataTypeKindService, kind);
+    EXPECT_EQ(130, dtid.get());
+
+    EXPECT_TRUE(uavcan::TransferLatencyStats::extractDataType(
+        makeUavcanFrame(255, uavcan::TransferTypeServiceResponse, 1, 42), kind, dtid));
+    EXPECT_EQ(uavcan::DataTypeKindService, kind);
+    EXPECT_EQ(255, dtid.get());
+
+    // Anonymous
+    EXPECT_FALSE(uavcan::TransferLatencyStats::extractDataType(
+        makeUavcanFrame(3, uavcan::TransferTypeMessageBroadcast, uavcan::NodeID::Broadcast,
+                        uavcan::NodeID::Broadcast), kind, dtid));
+
+    // Not UAVCAN
+    EXPECT_FALSE(uavcan::TransferLatencyStats::extractDataType(makeCanFrame(123, "", STD), kind, dtid));
+}
+
+TEST(TransferLatencyStats, TxQueueEntryTimeInQueue)
+{
+    const uavcan::CanFrame frame = makeCanFrame(123, "", EXT);
+
+    const uavcan::CanTxQueue::Entry entry(frame, tsMono(100000000), uavcan::CanTxQueue::Volatile, 0, tsMono(1000));
+    EXPECT_EQ(0, entry.getTimeInQueue(tsMono(1000)).toUSec());
+    EXPECT_EQ(2500, entry.getTimeInQueue(tsMono(3500)).toUSec());
+
+    // Only the lower 32 bits of the timestamp are stored
+    const uavcan::CanTxQueue::Entry wrapped(frame, tsMono(0xFFFFFFFFFULL), uavcan::CanTxQueue::Volatile, 0,
+                                            tsMono(0xFFFFFFFFULL - 100));
+    EXPECT_EQ(300, wrapped.getTimeInQueue(tsMono(0x100000000ULL + 199)).toUSec());
+}
+
+TEST(TransferLatencyStats, CanIOManager)
+{
+    uavcan::PoolAllocator<sizeof(uavcan::CanTxQueue::Entry) * 4, sizeof(uavcan::CanTxQueue::Entry)> pool;
+    SystemClockMock clockmock(1000);
+    CanDriverMock driver(1, clockmock);
+    uavcan::CanIOManager iomgr(driver, pool, clockmock);
+
+    uavcan::StaticTransferLatencyStats<4> stats(clockmock);
+    iomgr.setTransferLatencyStats(&stats);
+
+    const uavcan::CanFrame msg_frame =
+        makeUavcanFrame(20000, uavcan::TransferTypeMessageBroadcast, 42, uavcan::NodeID::Broadcast);
+    const uavcan::CanFrame srv_frame = makeUavcanFrame(130, uavcan::TransferTypeServiceRequest, 42, 1);
+
+    /*
+     * Accepted by the driver immediately
+     */
+    EXPECT_EQ(1, iomgr.send(msg_frame, tsMono(100000), tsMono(0), 1, uavcan::CanTxQueue::Volatile, 0));
+
+    const uavcan::TransferLatencyStats::Entry* const msg = stats.find(uavcan::DataTypeKindMessage, 20000);
+    ASSERT_TRUE(msg);
+    EXPECT_EQ(1, msg->histograms[uavcan::TransferLatencyKindTxQueue].getNumSamples());
+    EXPECT_EQ(0, msg->histograms[uavcan::TransferLatencyKindTxQueue].getMaxUSec());
+
+    /*
+     * Waiting in the queue for 1.5 ms
+     */
+    driver.ifaces.at(0).writeable = false;
+    EXPECT_EQ(0, iomgr.send(srv_frame, tsMono(100000), tsMono(0), 1, uavcan::CanTxQueue::Volatile, 0));
+    EXPECT_FALSE(stats.find(uavcan::DataTypeKindService, 130));
+
+    clockmock.advance(1500);
+    driver.ifaces.at(0).writeable = true;
+    uavcan::CanRxFrame rx_frame;
+    uavcan::CanIOFlags flags = 0;
+    EXPECT_EQ(0, iomgr.receive(rx_frame, clockmock.getMonotonic(), flags));
+
+    const uavcan::TransferLatencyStats::Entry* const srv = stats.find(uavcan::DataTypeKindService, 130);
+    ASSERT_TRUE(srv);
+    EXPECT_EQ(1, srv->histograms[uavcan::TransferLatencyKindTxQueue].getNumSamples());
+    EXPECT_EQ(1500, srv->histograms[uavcan::TransferLatencyKindTxQueue].getMaxUSec());
+    EXPECT_EQ(1, srv->histograms[uavcan::TransferLatencyKindTxQueue].getBucket(6));
+
+    EXPECT_TRUE(driver.ifaces.at(0).matchAndPopTx(msg_frame, 100000));
+    EXPECT_TRUE(driver.ifaces.at(0).matchAndPopTx(srv_frame, 100000));
+
+    /*
+     * Disabled
+     */
+    iomgr.setTransferLatencyStats(NULL);
+    EXPECT_EQ(1, iomgr.send(msg_frame, tsMono(100000), tsMono(0), 1, uavcan::CanTxQueue::Volatile, 0));
+    EXPECT_EQ(1, msg->histograms[uavcan::TransferLatencyKindTxQueue].getNumSamples());
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ *
+ * Storage throughput of the dynamic node ID allocation server when many nodes boot at once.
+ * Every allocation is stored exactly as the servers do it: the distributed server appends an entry to the Raft log,
+ * the centralized server adds an entry to its storage. The CAN bus is not involved, so the results reflect
+ * the cost of the storage backend only. Backends that defer writes are flushed after every allocation, i.e. at
+ * the point where the server would send the response.
+ * The restart time is the time needed to restore the persistent state of the distributed server, i.e. how long
+ * the server takes to become available after reboot.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <uavcan/protocol/dynamic_node_id_server/distributed/persistent_state.hpp>
+#include <uavcan/protocol/dynamic_node_id_server/centralized/storage.hpp>
+#include <uavcan_posix/dynamic_node_id_server/file_storage_backend.hpp>
+#include <uavcan_posix/dynamic_node_id_server/journaled_file_storage_backend.hpp>
+#include <uavcan_posix/dynamic_node_id_server/snapshot_file_storage_backend.hpp>
+#include "debug.hpp"
+
+namespace
+{
+
+constexpr unsigned NumNodes = 100;
+const std::string BasePath = "/tmp/uavcan_linux_test_allocation_storage_load";
+
+using namespace uavcan::dynamic_node_id_server;
+
+class NullEventTracer : public IEventTracer
+{
+    void onEvent(TraceCode, uavcan::int64_t) override { }
+};
+
+struct Backend
+{
+    const char* name;
+    std::function<std::unique_ptr<IStorageBackend>(const std::string&)> make;
+    /// Called once per allocation, where the server would send the response; may be empty
+    std::function<int(IStorageBackend&)> flush;
+};
+
+std::unique_ptr<IStorageBackend> makeFileStorageBackend(const std::string& path)
+{
+    auto backend = new uavcan_posix::dynamic_node_id_server::FileStorageBackend;
+    std::unique_ptr<IStorageBackend> ptr(backend);
+    ENFORCE(0 <= backend->init(path.c_str()));
+    return ptr;
+}
+
+std::unique_ptr<IStorageBackend> makeSnapshotFileStorageBackend(const std::string& path)
+{
+    auto backend = new uavcan_posix::dynamic_node_id_server::SnapshotFileStorageBackend;
+    std::unique_ptr<IStorageBackend> ptr(backend);
+    ENFORCE(0 <= backend->init(path.c_str()));
+    ENFORCE(backend->isSnapshotEnabled());
+    return ptr;
+}
+
+int flushSnapshotFileStorageBackend(IStorageBackend& backend)
+{
+    return static_cast<uavcan_posix::dynamic_node_id_server::SnapshotFileStorageBackend&>(backend).flush();
+}
+
+int flushJournaledStorageBackend(IStorageBackend& backend)
+{
+    return static_cast<uavcan_posix::dynamic_node_id_server::JournaledFileStorageBackend&>(backend).flush();
+}
+
+std::unique_ptr<IStorageBackend> makeJournaledStorageBackend(const std::string& path, unsigned commit_interval_msec)
+{
+    auto backend = new uavcan_posix::dynamic_node_id_server::JournaledFileStorageBackend(
+        uavcan::MonotonicDuration::fromMSec(commit_interval_msec));
+    std::unique_ptr<IStorageBackend> ptr(backend);
+    ENFORCE(0 <= backend->init(path.c_str()));
+    return ptr;
+}
+
+UniqueID makeUniqueID(unsigned node_index)
+{
+    UniqueID uid;
+    for (unsigned i = 0; i < uid.size(); i++)
+    {
+        uid[i] = std::uint8_t(node_index * 31U + i);
+    }
+    return uid;
+}
+
+template <typename Fun>
+double measureSeconds(Fun fun)
+{
+    const auto started_at = std::chrono::steady_clock::now();
+    fun();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - started_at).count();
+}
+
+struct Result
+{
+    double distributed_allocs_per_sec = 0;
+    double centralized_allocs_per_sec = 0;
+    double restart_msec = 0;
+};
+
+Result runTest(const Backend& backend)
+{
+    const std::string path = BasePath + "/" + backend.name;
+    ENFORCE(0 == std::system(("rm -rf '" + path + "'").c_str()));
+    ENFORCE(0 == std::system(("mkdir -p '" + path + "'").c_str()));
+
+    NullEventTracer tracer;
+    Result result;
+
+    /*
+     * Distributed server - every allocation is a new Raft log entry
+     */
+    {
+        auto storage = backend.make(path + "/distributed");
+        distributed::PersistentState state(*storage, tracer);
+        ENFORCE(0 <= state.init());
+        ENFORCE(0 <= state.setCurrentTerm(1));
+
+        const double seconds = measureSeconds([&]()
+            {
+                for (unsigned i = 0; i < NumNodes; i++)
+                {
+                    distributed::Entry entry;
+                    entry.term = 1;
+                    entry.unique_id = makeUniqueID(i);
+                    entry.node_id = std::uint8_t(i + 1);
+                    ENFORCE(0 <= state.getLog().append(entry));
+                    if (backend.flush)
+                    {
+                        ENFORCE(0 <= backend.flush(*storage));
+                    }
+                }
+            });
+        result.distributed_allocs_per_sec = NumNodes / seconds;
+    }
+
+    /*
+     * Restart - the log must be restored completely
+     */
+    {
+        std::unique_ptr<IStorageBackend> storage;
+        std::unique_ptr<distributed::PersistentState> state;
+        result.restart_msec = 1000.0 * measureSeconds([&]()
+            {
+                storage = backend.make(path + "/distributed");
+                state.reset(new distributed::PersistentState(*storage, tracer));
+                ENFORCE(0 <= state->init());
+            });
+        ENFORCE(state->getLog().getLastIndex() == NumNodes);
+        for (unsigned i = 0; i < NumNodes; i++)
+        {
+            const distributed::Entry* const entry = state->getLog().getEntryAtIndex(std::uint8_t(i + 1));
+            ENFORCE(entry != nullptr);
+            ENFORCE(entry->node_id == i + 1);
+            ENFORCE(entry->unique_id == makeUniqueID(i));
+        }
+    }
+
+    /*
+     * Centralized server
+     */
+    {
+        auto storage = backend.make(path + "/centralized");
+        centralized::Storage centralized_storage(*storage);
+        ENFORCE(0 <= centralized_storage.init());
+
+        const double seconds = measureSeconds([&]()
+            {
+                for (unsigned i = 0; i < NumNodes; i++)
+                {
+                    ENFORCE(0 <= centralized_storage.add(uavcan::NodeID(std::uint8_t(i + 1)), makeUniqueID(i)));
+                    if (backend.flush)
+                    {
+                        ENFORCE(0 <= backend.flush(*storage));
+                    }
+                }
+            });
+        result.centralized_allocs_per_sec = NumNodes / seconds;
+        ENFORCE(centralized_storage.getSize() == NumNodes);
+    }
+
+    return result;
+}
+
+}
+
+int main()
+{
+    try
+    {
+        const Backend backends[] =
+        {
+            { "file",             &makeFileStorageBackend, nullptr },
+            { "file+snapshot",    &makeSnapshotFileStorageBackend, &flushSnapshotFileStorageBackend },
+            { "journal",          [](const std::string& p) { return makeJournaledStorageBackend(p, 0); },
+                                  &flushJournaledStorageBackend },
+            { "journal+commit10", [](const std::string& p) { return makeJournaledStorageBackend(p, 10); },
+                                  &flushJournaledStorageBackend }
+        };
+
+        std::cout << NumNodes << " allocations, storage path " << BasePath << "\n"
+                  << "         Backend | Distributed allocs/s | Centralized allocs/s | Restart ms" << std::endl;
+
+        for (const Backend& backend : backends)
+        {
+            const Result r = runTest(backend);
+            std::cout << std::setw(16) << backend.name << " | "
+                      << std::setw(20) << std::fixed << std::setprecision(1) << r.distributed_allocs_per_sec << " | "
+                      << std::setw(20) << r.centralized_allocs_per_sec << " | "
+                      << std::setw(10) << r.restart_msec << std::endl;
+        }
+
+        ENFORCE(0 == std::system(("rm -rf '" + BasePath + "'").c_str()));
+        return 0;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ *
+ * Many nodes reading the same file from one file server at once, e.g. during a firmware update of the whole bus.
+ * The readers are sub-nodes connected to the bus via the virtual CAN bridge; the main node periodically
+ * calls GetNodeInfo on the file server node to measure how responsive it remains under load.
+ * Every configuration is tested with the synchronous and the asynchronous backends, with and without the block cache.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <uavcan_linux/uavcan_linux.hpp>
+#include <uavcan/protocol/file_server.hpp>
+#include <uavcan/protocol/GetNodeInfo.hpp>
+#include <uavcan_posix/basic_file_server_backend.hpp>
+#include <uavcan_posix/async_file_server_backend.hpp>
+#include "debug.hpp"
+
+namespace
+{
+
+constexpr std::uint8_t ServerNodeID = 100;
+constexpr std::uint8_t MainNodeID = 127;
+constexpr unsigned FileSize = 16 * 1024;
+constexpr unsigned DiskLatencyMSec = 5;
+constexpr unsigned ProbePeriodMSec = 20;
+constexpr std::size_t BlockCacheSize = 1024 * 1024;
+const char* const FilePath = "/tmp/uavcan_linux_test_file_server_load.bin";
+
+typedef uavcan::protocol::file::Read Read;
+typedef uavcan::protocol::GetNodeInfo GetNodeInfo;
+
+/**
+ * Both backends are slowed down in the same way, emulating a slow storage device.
+ * Blocks served from the block cache are not affected.
+ */
+template <typename Base>
+class SlowFileServerBackend : public Base
+{
+    uavcan::int16_t readBlock(int fd, uavcan::uint64_t offset, uavcan::uint8_t* out_buffer,
+                              uavcan::uint16_t& inout_size) override
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(DiskLatencyMSec));
+        return Base::readBlock(fd, offset, out_buffer, inout_size);
+    }
+
+public:
+    template <typename... Args>
+    explicit SlowFileServerBackend(Args&&... args) : Base(std::forward<Args>(args)...) { }
+};
+
+struct Config
+{
+    const char* name;
+    bool async;
+    std::size_t block_cache_size;
+};
+
+uavcan_linux::NodePtr initNode(const std::vector<std::string>& ifaces, uavcan::NodeID nid, const std::string& name)
+{
+    auto node = uavcan_linux::makeNode(ifaces);
+    node->setNodeID(nid);
+    node->setName(name.c_str());
+    ENFORCE(0 == node->start());
+    node->setModeOperational();
+    return node;
+}
+
+void runServer(const std::vector<std::string>& ifaces, Config config, const std::atomic<bool>& stop,
+               float& out_cache_hit_rate)
+{
+    auto node = initNode(ifaces, ServerNodeID, "org.uavcan.linux_test_file_server_load.server");
+
+    std::unique_ptr<uavcan_posix::BasicFileServerBackend> backend;
+    if (config.async)
+    {
+        auto async_backend =
+            new SlowFileServerBackend<uavcan_posix::AsyncFileServerBackend>(
+                *node,
+                unsigned(uavcan_posix::AsyncFileServerBackend::DefaultNumWorkers),
+                unsigned(uavcan_posix::AsyncFileServerBackend::DefaultMaxPendingReads),
+                config.block_cache_size);
+        backend.reset(async_backend);
+        ENFORCE(0 == async_backend->init());
+    }
+    else
+    {
+        backend.reset(new SlowFileServerBackend<uavcan_posix::BasicFileServerBackend>(*node,
+                                                                                      config.block_cache_size));
+    }
+
+    {
+        uavcan::BasicFileServer server(*node, *backend);
+        ENFORCE(0 == server.start());
+
+        while (!stop)
+        {
+            ENFORCE(node->spin(uavcan::MonotonicDuration::fromMSec(10)) >= 0);
+        }
+    }
+    out_cache_hit_rate = backend->getBlockCache().getHitRate();
+}
+
+/**
+ * Reads the whole file sequentially, verifying the content.
+ */
+void runReader(const uavcan_linux::SubNodePtr& node, std::atomic<unsigned>& num_finished)
+{
+    auto client = node->makeBlockingServiceClient<Read>();
+    client->setRequestTimeout(uavcan::MonotonicDuration::fromMSec(5000));
+
+    Read::Request request;
+    request.path.path = FilePath;
+    while (true)
+    {
+        ENFORCE(0 <= client->blockingCall(ServerNodeID, request));
+        ENFORCE(client->wasSuccessful());
+
+        const auto& response = client->getResponse();
+        ENFORCE(response.error.value == 0);
+        for (unsigned i = 0; i < response.data.size(); i++)
+        {
+            ENFORCE(response.data[i] == std::uint8_t(request.offset + i));
+        }
+        request.offset += response.data.size();
+
+        if (response.data.size() < Read::Response::FieldTypes::data::MaxSize)
+        {
+            break;
+        }
+    }
+    ENFORCE(request.offset == FileSize);
+    num_finished++;
+}
+
+struct Result
+{
+    double seconds = 0;
+    double probe_avg_msec = 0;
+    double probe_max_msec = 0;
+    unsigned num_probe_timeouts = 0;
+    float cache_hit_rate = 0;
+};
+
+Result runTest(const std::vector<std::string>& ifaces, const Config& config, unsigned num_readers)
+{
+    float cache_hit_rate = 0;
+    std::atomic<bool> stop_server(false);
+    std::thread server_thread(runServer, ifaces, config, std::cref(stop_server), std::ref(cache_hit_rate));
+
+    auto main_node = initNode(ifaces, MainNodeID, "org.uavcan.linux_test_file_server_load.main");
+    uavcan_linux::VirtualCanBridge bridge;
+    main_node->installRxFrameListener(&bridge);
+    const unsigned num_ifaces = main_node->getDispatcher().getCanIOManager().getNumIfaces();
+
+    ENFORCE(main_node->spin(uavcan::MonotonicDuration::fromMSec(500)) >= 0);  // Letting the server start
+
+    /*
+     * Probing the server node
+     */
+    unsigned num_probes = 0;
+    Result result;
+    double probe_sum_msec = 0;
+    bool probe_pending = false;
+    auto probe_started_at = std::chrono::steady_clock::now();
+
+    auto probe_client = main_node->makeServiceClient<GetNodeInfo>(
+        [&](const uavcan::ServiceCallResult<GetNodeInfo>& call_result)
+        {
+            probe_pending = false;
+            if (!call_result.isSuccessful())
+            {
+                result.num_probe_timeouts++;
+                return;
+            }
+            const double msec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                                          probe_started_at).count();
+            probe_sum_msec += msec;
+            result.probe_max_msec = std::max(result.probe_max_msec, msec);
+            num_probes++;
+        });
+
+    /*
+     * Starting the readers
+     */
+    std::vector<uavcan_linux::SubNodePtr> readers;
+    for (unsigned i = 0; i < num_readers; i++)
+    {
+        std::shared_ptr<uavcan_linux::VirtualCanDriver> driver(new uavcan_linux::VirtualCanDriver(bridge,
+                                                                                                   num_ifaces));
+        readers.push_back(uavcan_linux::makeSubNode(driver));
+        readers.back()->setNodeID(std::uint8_t(i + 1));
+    }
+
+    const auto started_at = std::chrono::steady_clock::now();
+    std::atomic<unsigned> num_finished(0);
+    std::vector<std::thread> reader_threads;
+    for (auto& r : readers)
+    {
+        reader_threads.emplace_back(runReader, r, std::ref(num_finished));
+    }
+
+    while (num_finished < num_readers)
+    {
+        ENFORCE(main_node->spin(uavcan::MonotonicDuration::fromMSec(1)) >= 0);
+        (void)bridge.injectTxFramesInto(*main_node);
+
+        const auto now = std::chrono::steady_clock::now();
+        if (!probe_pending && (now - probe_started_at) > std::chrono::milliseconds(ProbePeriodMSec))
+        {
+            probe_started_at = now;
+            probe_pending = probe_client->call(ServerNodeID, GetNodeInfo::Request()) >= 0;
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_at).count();
+    result.probe_avg_msec = (num_probes > 0) ? (probe_sum_msec / num_probes) : 0.0;
+
+    for (auto& t : reader_threads)
+    {
+        t.join();
+    }
+    ENFORCE(bridge.getNumInjectionFailures() == 0);
+    main_node->installRxFrameListener(nullptr);
+
+    stop_server = true;
+    server_thread.join();
+    result.cache_hit_rate = cache_hit_rate;
+    return result;
+}
+
+}
+
+int main(int argc, const char** argv)
+{
+    try
+    {
+        if (argc < 2)
+        {
+            std::cerr << "Usage:\n\t" << argv[0] << " <can-iface-name-1> [can-iface-name-N...]" << std::endl;
+            return 1;
+        }
+        const std::vector<std::string> iface_names(argv + 1, argv + argc);
+
+        {
+            std::ofstream file(FilePath, std::ios::binary | std::ios::trunc);
+            for (unsigned i = 0; i < FileSize; i++)
+            {
+                file.put(char(std::uint8_t(i)));
+            }
+            ENFORCE(file.good());
+        }
+
+        const Config configs[] =
+        {
+            { "sync",        false, 0 },
+            { "async",       true,  0 },
+            { "sync+cache",  false, BlockCacheSize },
+            { "async+cache", true,  BlockCacheSize }
+        };
+
+        std::cout << "File size " << FileSize << " bytes, disk latency " << DiskLatencyMSec << " ms per read, "
+                  << "block cache " << (BlockCacheSize / 1024) << " KiB\n"
+                  << "    Backend | Readers |  KiB/s | Probe avg ms | Probe max ms | Probe timeouts | Cache hits %"
+                  << std::endl;
+
+        for (unsigned num_readers : { 1, 5, 10, 20 })
+        {
+            for (const Config& config : configs)
+            {
+                const Result r = runTest(iface_names, config, num_readers);
+                const double kib_per_sec = (double(FileSize) * num_readers / 1024.0) / r.seconds;
+                std::cout << std::setw(11) << config.name << " | "
+                          << std::setw(7) << num_readers << " | "
+                          << std::setw(6) << std::fixed << std::setprecision(1) << kib_per_sec << " | "
+                          << std::setw(12) << r.probe_avg_msec << " | "
+                          << std::setw(12) << r.probe_max_msec << " | "
+                          << std::setw(14) << r.num_probe_timeouts << " | "
+                          << std::setw(12) << (r.cache_hit_rate * 100.0F) << std::endl;
+            }
+        }
+
+        (void)std::remove(FilePath);
+        return 0;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+}
@@ -69,11 +69,12 @@ static void runForever(const uavcan_linux::NodePtr& node)
     ENFORCE(0 == nsm.start());
 
     /*
-     * Adding a stupid timer that does nothing once a minute
+     * Adding a stupid timer that does nothing once a minute, except for printing the memory usage
      */
     auto do_nothing_once_a_minute = [&node](const uavcan::TimerEvent&)
     {
         node->logInfo("timer", "Another minute passed...");
+        node->printMemoryUsage(std::cout);
         // coverity[dont_call]
         node->setVendorSpecificStatusCode(static_cast<std::uint16_t>(std::rand())); // Setting to an arbitrary value
     };
@@ -3,10 +3,21 @@
  */
 
 #include <uavcan_posix/dynamic_node_id_server/file_event_tracer.hpp>
+#include <uavcan_posix/dynamic_node_id_server/buffered_file_event_tracer.hpp>
 #include <uavcan_posix/dynamic_node_id_server/file_storage_backend.hpp>
+#include <uavcan_posix/dynamic_node_id_server/snapshot_file_storage_backend.hpp>
+#include <uavcan_posix/dynamic_node_id_server/journaled_file_storage_backend.hpp>
+#include <uavcan_posix/file_node_info_cache.hpp>
+#include <uavcan_posix/file_block_cache.hpp>
 #include <uavcan_linux/uavcan_linux.hpp>
 #include <iostream>
 #include <iomanip>
+#include <fstream>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include "debug.hpp"
 
 int main(int argc, const char** argv)
@@ -40,6 +51,68 @@ int main(int argc, const char** argv)
             ENFORCE(0 == std::system(("cat " + event_log_file).c_str()));
         }
 
+        /*
+         * Buffered event tracer test
+         */
+        {
+            using namespace uavcan::dynamic_node_id_server;
+            using uavcan_posix::dynamic_node_id_server::EventTraceRecord;
+
+            const std::string event_log_file("/tmp/uavcan_posix/dynamic_node_id_server/event.bin");
+            const unsigned NumEvents = 1000;
+
+            // Non-positive flush interval is rejected, otherwise the writer thread would never sleep
+            {
+                uavcan_posix::dynamic_node_id_server::BufferedFileEventTracer zero(256, uavcan::MonotonicDuration());
+                ENFORCE(-uavcan::ErrInvalidParam == zero.init(event_log_file.c_str()));
+                uavcan_posix::dynamic_node_id_server::BufferedFileEventTracer negative(
+                    256, uavcan::MonotonicDuration::fromMSec(-1));
+                ENFORCE(-uavcan::ErrInvalidParam == negative.init(event_log_file.c_str()));
+            }
+
+            {
+                uavcan_posix::dynamic_node_id_server::BufferedFileEventTracer tracer(256);
+                ENFORCE(0 <= tracer.init(event_log_file.c_str()));
+
+                // Some events may be dropped if the writer thread is not fast enough
+                for (unsigned i = 0; i < NumEvents; i++)
+                {
+                    static_cast<IEventTracer&>(tracer).onEvent(TraceRaftNewLogEntry, i);
+                    if ((i % 100) == 0)
+                    {
+                        tracer.flush();
+                    }
+                }
+                ENFORCE(tracer.getNumFlushes() > 0);
+                std::cout << "Buffered tracer: " << tracer.getNumDroppedEvents() << " events dropped" << std::endl;
+                ENFORCE(tracer.getNumDroppedEvents() < NumEvents);
+            }   // Remaining events are written upon destruction
+
+            std::ifstream in(event_log_file, std::ios::binary);
+            char signature[EventTraceRecord::SignatureLength] = {};
+            ENFORCE(in.read(signature, sizeof(signature)));
+            ENFORCE(0 == std::memcmp(signature, EventTraceRecord::getFileSignature(), sizeof(signature)));
+
+            std::uint8_t buffer[EventTraceRecord::Size];
+            unsigned num_records = 0;
+            std::int64_t prev_argument = -1;
+            while (in.read(reinterpret_cast<char*>(buffer), sizeof(buffer)))
+            {
+                EventTraceRecord record;
+                record.deserialize(buffer);
+                ENFORCE(record.code == TraceRaftNewLogEntry);
+                ENFORCE(record.argument > prev_argument);
+                ENFORCE(record.timestamp_usec > 0);
+                prev_argument = record.argument;
+                num_records++;
+            }
+            ENFORCE(num_records > 0);
+            ENFORCE(num_records <= NumEvents);
+            std::cout << "Buffered tracer: " << num_records << " events written" << std::endl;
+
+            ENFORCE(0 == std::system(("rm -f " + event_log_file).c_str()));
+        }
+
         /*
          * Storage backend test
          */
@@ -63,6 +136,387 @@ int main(int argc, const char** argv)
             print_key("nonexistent");
         }
 
+        /*
+         * Snapshot storage backend test - uses the key files written by the previous test
+         */
+        {
+            using namespace uavcan::dynamic_node_id_server;
+            using uavcan_posix::dynamic_node_id_server::SnapshotFileStorageBackend;
+
+            const char* const storage_path = "/tmp/uavcan_posix/dynamic_node_id_server/storage";
+            const std::string snapshot_file = std::string(storage_path) + "/.snapshot";
+            ENFORCE(0 == std::system(("rm -f " + snapshot_file).c_str()));
+
+            {
+                SnapshotFileStorageBackend backend;
+                ENFORCE(0 <= backend.init(storage_path));
+                ENFORCE(!backend.wasLoadedFromSnapshot());          // Loaded from the key files
+                ENFORCE(backend.isSnapshotEnabled());
+                ENFORCE(static_cast<IStorageBackend&>(backend).get("the_answer") == "42");
+
+                static_cast<IStorageBackend&>(backend).set("the_answer", "43");
+                static_cast<IStorageBackend&>(backend).set("foobar", "");
+                ENFORCE(backend.isFlushPending());
+            }
+
+            // Many updates - one snapshot write per flush
+            {
+                SnapshotFileStorageBackend backend;
+                ENFORCE(0 <= backend.init(storage_path));
+                ENFORCE(backend.wasLoadedFromSnapshot());
+                ENFORCE(!backend.isFlushPending());
+                const unsigned initial_writes = backend.getNumSnapshotWrites();
+
+                static_cast<IStorageBackend&>(backend).set("the_answer", "43");      // Not changed
+                ENFORCE(!backend.isFlushPending());
+
+                static_cast<IStorageBackend&>(backend).set("a", "1");
+                static_cast<IStorageBackend&>(backend).set("b", "2");
+                static_cast<IStorageBackend&>(backend).set("a", "3");
+                ENFORCE(backend.isFlushPending());
+                ENFORCE(initial_writes == backend.getNumSnapshotWrites());
+                ENFORCE(0 != ::access(snapshot_file.c_str(), F_OK));       // Removed until the next flush
+
+                // Crash before the flush - the key files are loaded, nothing is lost
+                {
+                    SnapshotFileStorageBackend crashed;
+                    ENFORCE(0 <= crashed.init(storage_path));
+                    ENFORCE(!crashed.wasLoadedFromSnapshot());
+                    ENFORCE(static_cast<IStorageBackend&>(crashed).get("a") == "3");
+                    ENFORCE(static_cast<IStorageBackend&>(crashed).get("b") == "2");
+                }
+
+                ENFORCE(0 <= backend.flush());
+                ENFORCE(!backend.isFlushPending());
+                ENFORCE((initial_writes + 1) == backend.getNumSnapshotWrites());
+                ENFORCE(0 <= backend.flush());
+                ENFORCE((initial_writes + 1) == backend.getNumSnapshotWrites());
+
+                static_cast<IStorageBackend&>(backend).set("a", "");
+                static_cast<IStorageBackend&>(backend).set("b", "");
+                ENFORCE(0 <= backend.flush());
+                ENFORCE((initial_writes + 2) == backend.getNumSnapshotWrites());
+            }
+
+            {
+                SnapshotFileStorageBackend backend;
+                ENFORCE(0 <= backend.init(storage_path));
+                ENFORCE(backend.wasLoadedFromSnapshot());
+                ENFORCE(static_cast<IStorageBackend&>(backend).get("the_answer") == "43");
+                ENFORCE(static_cast<IStorageBackend&>(backend).get("foobar") == "");
+                std::cout << "Snapshot backend: " << backend.getNumPairs() << " pairs" << std::endl;
+            }
+
+            // Corrupting the snapshot - the key files must be used instead
+            {
+                std::fstream file(snapshot_file, std::ios::in | std::ios::out | std::ios::binary);
+                file.seekp(12);
+                file.put('~');
+            }
+            {
+                SnapshotFileStorageBackend backend;
+                ENFORCE(0 <= backend.init(storage_path));
+                ENFORCE(!backend.wasLoadedFromSnapshot());
+                ENFORCE(static_cast<IStorageBackend&>(backend).get("the_answer") == "43");
+            }
+
+            // Failed key file write - the read-back must return the old value, also after falling back to the key files
+            {
+                SnapshotFileStorageBackend backend;
+                ENFORCE(0 <= backend.init(storage_path));
+                ENFORCE(backend.isSnapshotEnabled());
+
+                rlimit original_limit;
+                ENFORCE(0 == ::getrlimit(RLIMIT_FSIZE, &original_limit));
+                (void)std::signal(SIGXFSZ, SIG_IGN);
+
+                rlimit limit = original_limit;
+                limit.rlim_cur = 0;                                         // Nothing can be written
+                ENFORCE(0 == ::setrlimit(RLIMIT_FSIZE, &limit));
+                static_cast<IStorageBackend&>(backend).set("the_answer", "44");
+                const bool read_back_ok = static_cast<IStorageBackend&>(backend).get("the_answer") == "43";
+                const int flush_res = backend.flush();                      // The snapshot can't be written either
+                const bool fallback_read_back_ok = static_cast<IStorageBackend&>(backend).get("the_answer") == "43";
+                ENFORCE(0 == ::setrlimit(RLIMIT_FSIZE, &original_limit));
+                (void)std::signal(SIGXFSZ, SIG_DFL);
+
+                ENFORCE(read_back_ok);
+                ENFORCE(flush_res < 0);
+                ENFORCE(!backend.isSnapshotEnabled());
+                ENFORCE(fallback_read_back_ok);
+
+                static_cast<IStorageBackend&>(backend).set("the_answer", "44");
+                ENFORCE(static_cast<IStorageBackend&>(backend).get("the_answer") == "44");
+            }
+            {
+                SnapshotFileStorageBackend backend;
+                ENFORCE(0 <= backend.init(storage_path));
+                ENFORCE(!backend.wasLoadedFromSnapshot());
+                ENFORCE(static_cast<IStorageBackend&>(backend).get("the_answer") == "44");
+                ENFORCE(0 != ::access((std::string(storage_path) + "/.key.tmp").c_str(), F_OK));
+            }
+        }
+
+        /*
+         * Journaled storage backend test
+         */
+        {
+            using namespace uavcan::dynamic_node_id_server;
+            using uavcan_posix::dynamic_node_id_server::JournaledFileStorageBackend;
+
+            const char* const storage_path = "/tmp/uavcan_posix/dynamic_node_id_server/journaled_storage";
+            const std::string journal_file = std::string(storage_path) + "/journal";
+            const std::string temp_file = journal_file + ".tmp";
+            ENFORCE(0 == std::system((std::string("rm -rf ") + storage_path).c_str()));
+
+            auto get_file_size = [](const std::string& path) {
+                struct stat sb;
+                ENFORCE(0 == ::stat(path.c_str(), &sb));
+                return sb.st_size;
+            };
+
+            auto enforce_recovered_keys = [](JournaledFileStorageBackend& backend) {
+                ENFORCE(2 == backend.getNumPairs());
+                ENFORCE(static_cast<IStorageBackend&>(backend).get("a") == "3");
+                ENFORCE(static_cast<IStorageBackend&>(backend).get("b") == "2");
+                ENFORCE(static_cast<IStorageBackend&>(backend).get("c") == "");      // Deleted
+                ENFORCE(static_cast<IStorageBackend&>(backend).get("d") == "");      // Never written
+            };
+
+            off_t valid_size = 0;
+            {
+                JournaledFileStorageBackend backend;
+                ENFORCE(0 <= backend.init(storage_path));
+                ENFORCE(0 == backend.getNumRecords());
+                static_cast<IStorageBackend&>(backend).set("a", "1");
+                static_cast<IStorageBackend&>(backend).set("b", "2");
+                static_cast<IStorageBackend&>(backend).set("a", "3");
+                static_cast<IStorageBackend&>(backend).set("c", "4");
+                static_cast<IStorageBackend&>(backend).set("c", "");
+                static_cast<IStorageBackend&>(backend).set("b", "2");                // No change, not recorded
+                ENFORCE(5 == backend.getNumRecords());
+                enforce_recovered_keys(backend);
+                valid_size = backend.getJournalSize();
+                ENFORCE(valid_size == get_file_size(journal_file));
+            }
+
+            // Torn tail: the record header made it to the disk, the rest of the record did not
+            {
+                std::ofstream file(journal_file, std::ios::out | std::ios::app | std::ios::binary);
+                const char torn_record[] = { 0x4A, 1, 1, 'd' };
+                file.write(torn_record, sizeof(torn_record));
+            }
+            ENFORCE((valid_size + 4) == get_file_size(journal_file));
+            {
+                JournaledFileStorageBackend backend;
+                ENFORCE(0 <= backend.init(storage_path));
+                ENFORCE(4 == backend.getNumDiscardedBytes());
+                ENFORCE(5 == backend.getNumRecords());
+                ENFORCE(valid_size == get_file_size(journal_file));        // Truncated
+                enforce_recovered_keys(backend);
+
+                static_cast<IStorageBackend&>(backend).set("d", "5");       // Appended after the valid records
+                ENFORCE(static_cast<IStorageBackend&>(backend).get("d") == "5");
+            }
+
+            // Bad CRC in the last record - it must be discarded as a whole
+            ENFORCE((valid_size + 7) == get_file_size(journal_file));
+            {
+                std::fstream file(journal_file, std::ios::in | std::ios::out | std::ios::binary);
+                file.seekp(valid_size + 6);
+                file.put('~');
+            }
+            {
+                JournaledFileStorageBackend backend;
+                ENFORCE(0 <= backend.init(storage_path));
+                ENFORCE(7 == backend.getNumDiscardedBytes());
+                ENFORCE(5 == backend.getNumRecords());
+                ENFORCE(valid_size == get_file_size(journal_file));
+                enforce_recovered_keys(backend);
+            }
+
+            // Failed write - the partially written record must be rolled back
+            {
+                JournaledFileStorageBackend backend;
+                ENFORCE(0 <= backend.init(storage_path));
+
+                rlimit original_limit;
+                ENFORCE(0 == ::getrlimit(RLIMIT_FSIZE, &original_limit));
+                (void)std::signal(SIGXFSZ, SIG_IGN);
+
+                rlimit limit = original_limit;
+                limit.rlim_cur = static_cast<rlim_t>(valid_size + 3);       // Only the record header will fit
+                ENFORCE(0 == ::setrlimit(RLIMIT_FSIZE, &limit));
+                static_cast<IStorageBackend&>(backend).set("d", "5");
+                ENFORCE(0 == ::setrlimit(RLIMIT_FSIZE, &original_limit));
+                (void)std::signal(SIGXFSZ, SIG_DFL);
+
+                ENFORCE(static_cast<IStorageBackend&>(backend).get("d") == "");
+                ENFORCE(5 == backend.getNumRecords());
+                ENFORCE(valid_size == backend.getJournalSize());
+                ENFORCE(valid_size == get_file_size(journal_file));
+                enforce_recovered_keys(backend);
+
+                // The next record is appended right after the last valid one
+                static_cast<IStorageBackend&>(backend).set("c", "6");
+                ENFORCE(6 == backend.getNumRecords());
+                ENFORCE((valid_size + 7) == get_file_size(journal_file));
+                static_cast<IStorageBackend&>(backend).set("c", "");
+            }
+            {
+                JournaledFileStorageBackend backend;
+                ENFORCE(0 <= backend.init(storage_path));
+                ENFORCE(0 == backend.getNumDiscardedBytes());
+                ENFORCE(7 == backend.getNumRecords());
+                enforce_recovered_keys(backend);
+            }
+
+            // Compaction - live pairs are moved into a temporary file which then replaces the journal
+            {
+                JournaledFileStorageBackend backend;
+                ENFORCE(0 <= backend.init(storage_path));
+
+                ENFORCE(0 <= backend.compact());
+                ENFORCE(1 == backend.getNumCompactions());
+                ENFORCE(2 == backend.getNumRecords());
+                ENFORCE(0 != ::access(temp_file.c_str(), F_OK));
+                ENFORCE(backend.getJournalSize() == get_file_size(journal_file));
+                ENFORCE(backend.getJournalSize() < valid_size);
+                enforce_recovered_keys(backend);
+
+                // Automatic compaction once the journal is mostly made of overwritten records
+                unsigned i = 0;
+                while (backend.getNumCompactions() < 2)
+                {
+                    ENFORCE(i < 10000);
+                    static_cast<IStorageBackend&>(backend).set("x", (i % 2 == 0) ? "foo" : "bar");
+                    i++;
+                }
+                ENFORCE(3 == backend.getNumPairs());
+                ENFORCE(3 == backend.getNumRecords());
+                ENFORCE(backend.getJournalSize() == get_file_size(journal_file));
+                static_cast<IStorageBackend&>(backend).set("x", "");
+            }
+
+            // Leftover temporary file from an interrupted compaction must be ignored
+            ENFORCE(0 == std::system(("echo garbage > " + temp_file).c_str()));
+            {
+                JournaledFileStorageBackend backend;
+                ENFORCE(0 <= backend.init(storage_path));
+                ENFORCE(0 != ::access(temp_file.c_str(), F_OK));
+                ENFORCE(0 == backend.getNumDiscardedBytes());
+                ENFORCE(4 == backend.getNumRecords());
+                enforce_recovered_keys(backend);
+            }
+
+            // Group commit - pending records are committed only by flush(), there is no timer
+            {
+                JournaledFileStorageBackend backend(uavcan::MonotonicDuration::fromMSec(3600000));
+                ENFORCE(0 <= backend.init(storage_path));
+                ENFORCE(0 == backend.getNumCommits());
+
+                static_cast<IStorageBackend&>(backend).set("x", "foo");
+                static_cast<IStorageBackend&>(backend).set("x", "");
+                ENFORCE(0 == backend.getNumCommits());                    // Pending until flushed
+
+                ENFORCE(0 <= backend.flush());
+                ENFORCE(1 == backend.getNumCommits());
+                ENFORCE(0 <= backend.flush());                            // Nothing to commit
+                ENFORCE(1 == backend.getNumCommits());
+            }
+        }
+
+        /*
+         * Node info cache test
+         */
+        {
+            const char* const cache_path = "/tmp/uavcan_posix/node_info_cache";
+            ENFORCE(0 == std::system((std::string("rm -rf ") + cache_path).c_str()));
+
+            uavcan_posix::FileNodeInfoCache cache;
+            ENFORCE(0 <= cache.init(cache_path));
+
+            uavcan::protocol::GetNodeInfo::Response info;
+            info.status.uptime_sec = 1234;
+            info.software_version.major = 3;
+            info.software_version.image_crc = 0x0123456789ABCDEFULL;
+            info.hardware_version.unique_id[3] = 42;
+            info.name = "org.uavcan.test";
+
+            const uavcan::UtcTime cached_at = uavcan::UtcTime::fromUSec(1443000000123456ULL);
+
+            uavcan::protocol::GetNodeInfo::Response read_back;
+            uavcan::UtcTime read_back_cached_at;
+            ENFORCE(0 > cache.get(42, read_back, read_back_cached_at));      // Nothing is cached yet
+            ENFORCE(0 <= cache.put(42, info, cached_at));
+            ENFORCE(0 <= cache.get(42, read_back, read_back_cached_at));
+            ENFORCE(read_back == info);
+            ENFORCE(read_back_cached_at == cached_at);
+            ENFORCE(1 == cache.getNumWrites());
+
+            info.name = "org.uavcan.test2";                     // Overwriting
+            ENFORCE(0 <= cache.put(42, info, uavcan::UtcTime()));
+            ENFORCE(0 <= cache.get(42, read_back, read_back_cached_at));
+            ENFORCE(read_back == info);
+            ENFORCE(read_back_cached_at.isZero());
+
+            // Corrupting the file - the entry must be rejected
+            {
+                std::fstream file(std::string(cache_path) + "/42", std::ios::in | std::ios::out | std::ios::binary);
+                file.seekp(3);
+                file.put('~');
+            }
+            ENFORCE(0 > cache.get(42, read_back, read_back_cached_at));
+
+            cache.remove(42);
+            ENFORCE(0 > cache.get(42, read_back, read_back_cached_at));
+        }
+
+        /*
+         * File block cache test
+         */
+        {
+            using uavcan_posix::FileBlockCache;
+
+            const std::string file_path = "/tmp/uavcan_posix/block_cache_file";
+            ENFORCE(0 == std::system(("echo foo > " + file_path).c_str()));
+
+            auto stat_with_mtime = [&file_path](long nsec) {
+                const struct timespec times[2] = { { 1000000000, nsec }, { 1000000000, nsec } };
+                ENFORCE(0 == ::utimensat(AT_FDCWD, file_path.c_str(), times, 0));
+                struct stat st;
+                ENFORCE(0 == ::stat(file_path.c_str(), &st));
+                return st;
+            };
+
+            FileBlockCache cache(FileBlockCache::BlockSize * 4);
+            ENFORCE(cache.isEnabled());
+
+            const uavcan::uint8_t data[] = { 'f', 'o', 'o', '\n' };
+            uavcan::uint8_t buffer[FileBlockCache::BlockSize] = {};
+            uavcan::uint16_t size = 0;
+
+            const struct stat st = stat_with_mtime(1000);
+            cache.write(FileBlockCache::Key(st, 0), data, sizeof(data));
+            ENFORCE(cache.read(FileBlockCache::Key(st, 0), buffer, size));
+            ENFORCE(size == sizeof(data));
+            ENFORCE(0 == std::memcmp(buffer, data, sizeof(data)));
+            ENFORCE(!cache.read(FileBlockCache::Key(st, FileBlockCache::BlockSize), buffer, size));
+
+            // Same size, same second - only the sub-second part of the modification time differs
+            const struct stat st_modified = stat_with_mtime(2000);
+            ENFORCE(st_modified.st_mtime == st.st_mtime);
+            ENFORCE(!cache.read(FileBlockCache::Key(st_modified, 0), buffer, size));
+
+            // Status change time is a part of the key too
+            struct stat st_changed = st;
+            st_changed.st_ctim.tv_nsec++;
+            ENFORCE(!cache.read(FileBlockCache::Key(st_changed, 0), buffer, size));
+
+            ENFORCE(1 == cache.getNumHits());
+            ENFORCE(3 == cache.getNumMisses());
+        }
+
         return 0;
     }
     catch (const std::exception& ex)
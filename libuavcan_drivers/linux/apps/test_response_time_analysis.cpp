@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ *
+ * The expected response times are computed by hand, following the equations from the header.
+ */
+
+#include <iostream>
+#include <cmath>
+#include <uavcan_linux/response_time_analysis.hpp>
+#include "debug.hpp"
+
+namespace
+{
+
+using Analyzer = uavcan_linux::ResponseTimeAnalyzer;
+
+bool isClose(double a, double b)
+{
+    return std::abs(a - b) < 1e-6;
+}
+
+/**
+ * Message stream from node 10; the priority defines the order of the streams.
+ * Payload of 7 bytes makes one frame of 8 bytes, which is 160 bits long in the worst case.
+ */
+Analyzer::Stream makeStream(const char* name, std::uint8_t priority, double period_usec, unsigned payload_len = 7)
+{
+    Analyzer::Stream s;
+    s.name = name;
+    s.data_type_id = 1000;
+    s.priority = priority;
+    s.src_node_id = 10;
+    s.dst_node_id = uavcan::NodeID::Broadcast;
+    s.max_payload_len = payload_len;
+    s.period_usec = period_usec;
+    return s;
+}
+
+const Analyzer::Result& findResult(const Analyzer::Report& report, const std::string& name)
+{
+    for (const Analyzer::Result& r : report.results)
+    {
+        if (r.stream.name == name)
+        {
+            return r;
+        }
+    }
+    throw std::runtime_error("No such stream: " + name);
+}
+
+void printReport(const Analyzer::Report& report)
+{
+    for (const Analyzer::Result& r : report.results)
+    {
+        std::cout << "    " << r.stream.name << ": frames " << r.num_frames << ", bits " << r.num_bits
+                  << ", C " << r.transmission_time_usec << " us, R " << r.response_time_usec
+                  << " us, instances " << r.num_instances << std::endl;
+    }
+}
+
+void testFrameLengths()
+{
+    Analyzer analyzer;
+    analyzer.addStream(makeStream("empty", 1, 1000, 0));
+    analyzer.addStream(makeStream("single", 2, 1000, 7));
+    analyzer.addStream(makeStream("multi", 3, 1000, 8));
+    const Analyzer::Report report = analyzer.analyze();
+    printReport(report);
+
+    // DLC 1: 54 + 8 + 13 + floor(61 / 4) = 90
+    ENFORCE(findResult(report, "empty").num_frames == 1);
+    ENFORCE(findResult(report, "empty").num_bits == 90);
+
+    // DLC 8: 54 + 64 + 13 + floor(117 / 4) = 160
+    ENFORCE(findResult(report, "single").num_frames == 1);
+    ENFORCE(findResult(report, "single").num_bits == 160);
+
+    // Transfer CRC and 5 bytes, then 3 bytes: DLC 8 and DLC 4; 160 + (54 + 32 + 13 + floor(85 / 4)) = 280
+    ENFORCE(findResult(report, "multi").num_frames == 2);
+    ENFORCE(findResult(report, "multi").num_bits == 280);
+    ENFORCE(isClose(findResult(report, "multi").transmission_time_usec, 280));
+
+    ENFORCE(report.results.at(0).stream.name == "empty");   // Highest priority first
+    ENFORCE(report.results.at(2).stream.name == "multi");
+}
+
+/**
+ * 1 Mbit/s, no jitter, the busy periods are shorter than the periods.
+ */
+void testBlockingAndBusyPeriod()
+{
+    Analyzer analyzer;
+    analyzer.addStream(makeStream("a", 1, 1000));
+    analyzer.addStream(makeStream("b", 2, 2000));
+    analyzer.addStream(makeStream("c", 3, 3000, 0));        // 90 bits
+    const Analyzer::Report report = analyzer.analyze();
+    printReport(report);
+
+    ENFORCE(isClose(report.utilization, 160.0 / 1000 + 160.0 / 2000 + 90.0 / 3000));
+    ENFORCE(report.isSchedulable());
+
+    /*
+     * a: B = 160 (b blocks), t = 160 + 160 = 320, one instance; w = B = 160, R = w + C = 320
+     */
+    ENFORCE(isClose(findResult(report, "a").response_time_usec, 320));
+    ENFORCE(findResult(report, "a").num_instances == 1);
+
+    /*
+     * b: B = 90 (c blocks), t = 90 + 160 + 160 = 410
+     *    w = 90 + ceil((90 + 1) / 1000) * 160 = 250, R = 250 + 160 = 410
+     */
+    ENFORCE(isClose(findResult(report, "b").response_time_usec, 410));
+
+    /*
+     * c: B = 0, t = 160 + 160 + 90 = 410
+     *    w = ceil(1 / 1000) * 160 + ceil(1 / 2000) * 160 = 320, R = 320 + 90 = 410
+     */
+    ENFORCE(isClose(findResult(report, "c").response_time_usec, 410));
+}
+
+/**
+ * The example from Davis et al. 2007, section 3: three messages of 1 ms each, periods 2.5, 3.5, 3.5 ms.
+ * The 160 bit frames take 1 ms at 160 kbit/s. The busy period of the lowest priority message is longer than its
+ * period, and its second instance has the worst response time, which equals the deadline.
+ */
+void testBusyPeriodExceedsPeriod()
+{
+    Analyzer analyzer(160000);
+    analyzer.addStream(makeStream("a", 1, 2500));
+    analyzer.addStream(makeStream("b", 2, 3500));
+    analyzer.addStream(makeStream("c", 3, 3500));
+    const Analyzer::Report report = analyzer.analyze();
+    printReport(report);
+
+    ENFORCE(isClose(analyzer.getBitTimeUSec(), 6.25));
+    ENFORCE(isClose(findResult(report, "c").transmission_time_usec, 1000));
+
+    /*
+     * a: B = 1000, t = 2000, w = 1000, R = 2000
+     */
+    ENFORCE(isClose(findResult(report, "a").response_time_usec, 2000));
+    ENFORCE(findResult(report, "a").num_instances == 1);
+
+    /*
+     * b: B = 1000, t = 1000 + 2 * 1000 + 2 * 1000 = 5000, two instances
+     *    q = 0: w = 1000 + 1000 = 2000, R = 3000
+     *    q = 1: w = 2000 + 2 * 1000 = 4000, R = 4000 - 3500 + 1000 = 1500
+     */
+    ENFORCE(isClose(findResult(report, "b").response_time_usec, 3000));
+    ENFORCE(findResult(report, "b").num_instances == 2);
+
+    /*
+     * c: B = 0, t = 3 * 1000 + 2 * 1000 + 2 * 1000 = 7000, two instances
+     *    q = 0: w = 1000 + 1000 = 2000, R = 3000
+     *    q = 1: w = 1000 + 3 * 1000 + 2 * 1000 = 6000, R = 6000 - 3500 + 1000 = 3500
+     * The analysis that considers only the first instance would yield 3000.
+     */
+    ENFORCE(isClose(findResult(report, "c").response_time_usec, 3500));
+    ENFORCE(findResult(report, "c").num_instances == 2);
+    ENFORCE(findResult(report, "c").isSchedulable());
+    ENFORCE(report.isSchedulable());
+}
+
+/**
+ * 1 Mbit/s, two single frame messages with release jitter.
+ */
+void testJitter()
+{
+    {
+        Analyzer analyzer;
+        Analyzer::Stream high = makeStream("high", 1, 1000);
+        high.jitter_usec = 300;
+        Analyzer::Stream low = makeStream("low", 2, 2000);
+        low.jitter_usec = 100;
+        analyzer.addStream(high);
+        analyzer.addStream(low);
+        const Analyzer::Report report = analyzer.analyze();
+        printReport(report);
+
+        /*
+         * high: B = 160, t = 320, one instance; R = J + B + C = 300 + 160 + 160 = 620
+         * low:  B = 0, t = 320, one instance; w = ceil((300 + 1) / 1000) * 160 = 160, R = 100 + 160 + 160 = 420
+         */
+        ENFORCE(isClose(findResult(report, "high").response_time_usec, 620));
+        ENFORCE(isClose(findResult(report, "low").response_time_usec, 420));
+        ENFORCE(report.isSchedulable());
+    }
+    {
+        Analyzer analyzer;
+        Analyzer::Stream high = makeStream("high", 1, 1000);
+        high.jitter_usec = 900;
+        Analyzer::Stream low = makeStream("low", 2, 2000);
+        low.jitter_usec = 100;
+        analyzer.addStream(high);
+        analyzer.addStream(low);
+        const Analyzer::Report report = analyzer.analyze();
+        printReport(report);
+
+        /*
+         * high: B = 160, t = 160 + ceil((t + 900) / 1000) * 160 = 480, two instances
+         *       q = 0: R = 900 + 160 + 160 = 1220, which is longer than the period - unschedulable
+         * low:  w = ceil((w + 900 + 1) / 1000) * 160 = 320, R = 100 + 320 + 160 = 580
+         */
+        ENFORCE(isClose(findResult(report, "high").response_time_usec, 1220));
+        ENFORCE(findResult(report, "high").num_instances == 2);
+        ENFORCE(!findResult(report, "high").isSchedulable());
+        ENFORCE(isClose(findResult(report, "low").response_time_usec, 580));
+        ENFORCE(findResult(report, "low").isSchedulable());
+        ENFORCE(!report.isSchedulable());
+    }
+}
+
+void testUnschedulable()
+{
+    /*
+     * Explicit deadline shorter than the response time; see testBlockingAndBusyPeriod() for the numbers
+     */
+    Analyzer analyzer;
+    analyzer.addStream(makeStream("a", 1, 1000));
+    Analyzer::Stream b = makeStream("b", 2, 2000);
+    b.deadline_usec = 400;
+    analyzer.addStream(b);
+    analyzer.addStream(makeStream("c", 3, 3000, 0));
+    const Analyzer::Report report = analyzer.analyze();
+    printReport(report);
+
+    ENFORCE(isClose(findResult(report, "b").response_time_usec, 410));
+    ENFORCE(!findResult(report, "b").isSchedulable());
+    ENFORCE(findResult(report, "a").isSchedulable());
+    ENFORCE(findResult(report, "c").isSchedulable());
+    ENFORCE(!report.isSchedulable());
+}
+
+void testDivergent()
+{
+    /*
+     * The two higher priority streams saturate the bus: 160 / 400 + 160 / 250 > 1.
+     * The busy period of the second and third streams is unbounded.
+     * a: B = 160, t = 320, R = 320, which fits into the period of 400
+     */
+    Analyzer analyzer;
+    analyzer.addStream(makeStream("a", 1, 400));
+    analyzer.addStream(makeStream("b", 2, 250));
+    analyzer.addStream(makeStream("c", 3, 100000));
+    const Analyzer::Report report = analyzer.analyze();
+    printReport(report);
+
+    ENFORCE(report.utilization > 1.0);
+    ENFORCE(isClose(findResult(report, "a").response_time_usec, 320));
+    ENFORCE(findResult(report, "a").isSchedulable());
+    ENFORCE(std::isinf(findResult(report, "b").response_time_usec));
+    ENFORCE(!findResult(report, "b").isSchedulable());
+    ENFORCE(std::isinf(findResult(report, "c").response_time_usec));
+    ENFORCE(!report.isSchedulable());
+}
+
+void testInvalidInput()
+{
+    Analyzer analyzer;
+
+    bool thrown = false;
+    try
+    {
+        analyzer.addStream(makeStream("zero period", 1, 0));
+    }
+    catch (const uavcan_linux::Exception&)
+    {
+        thrown = true;
+    }
+    ENFORCE(thrown);
+    ENFORCE(analyzer.getStreams().empty());
+
+    // Same CAN ID
+    analyzer.addStream(makeStream("a", 1, 1000));
+    analyzer.addStream(makeStream("b", 1, 2000));
+    thrown = false;
+    try
+    {
+        (void)analyzer.analyze();
+    }
+    catch (const uavcan_linux::Exception&)
+    {
+        thrown = true;
+    }
+    ENFORCE(thrown);
+}
+
+}
+
+int main()
+{
+    try
+    {
+        testFrameLengths();
+        testBlockingAndBusyPeriod();
+        testBusyPeriodExceedsPeriod();
+        testJitter();
+        testUnschedulable();
+        testDivergent();
+        testInvalidInput();
+        std::cout << "OK" << std::endl;
+        return 0;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Exception: " << ex.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ *
+ * This application must be built in C++20 mode.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <uavcan_linux/uavcan_linux.hpp>
+#include <uavcan_linux/coroutines.hpp>
+#include <uavcan/protocol/GetNodeInfo.hpp>
+#include "debug.hpp"
+
+namespace
+{
+
+constexpr unsigned NumServers = 8;
+constexpr std::uint8_t FirstServerNodeID = 100;
+constexpr std::uint8_t ClientNodeID = 127;
+constexpr std::uint8_t AbsentNodeID = 1;
+constexpr unsigned NumRounds = 10;
+
+typedef uavcan::protocol::GetNodeInfo GetNodeInfo;
+
+uavcan_linux::NodePtr initNode(const std::vector<std::string>& ifaces, uavcan::NodeID nid, const std::string& name)
+{
+    auto node = uavcan_linux::makeNode(ifaces);
+    node->setNodeID(nid);
+    node->setName(name.c_str());
+    ENFORCE(0 == node->start());
+    node->setModeOperational();
+    return node;
+}
+
+/**
+ * Every server node runs in its own thread; GetNodeInfo is served by the node itself.
+ */
+void runServer(const std::vector<std::string>& ifaces, uavcan::NodeID nid, const std::atomic<bool>& stop)
+{
+    auto node = initNode(ifaces, nid, "org.uavcan.linux_test_service_coroutines.server");
+    while (!stop)
+    {
+        ENFORCE(node->spin(uavcan::MonotonicDuration::fromMSec(10)) >= 0);
+    }
+}
+
+/**
+ * Calls every server in turn, blocking on each call.
+ */
+unsigned pollServersBlocking(uavcan_linux::BlockingServiceClient<GetNodeInfo>& client)
+{
+    unsigned num_responses = 0;
+    for (unsigned i = 0; i < NumServers; i++)
+    {
+        ENFORCE(client.blockingCall(uavcan::NodeID(std::uint8_t(FirstServerNodeID + i)), GetNodeInfo::Request()) >= 0);
+        if (client.wasSuccessful())
+        {
+            num_responses++;
+        }
+    }
+    return num_responses;
+}
+
+/**
+ * Same as above, but all calls are in flight at the same time.
+ */
+uavcan_linux::Task<unsigned> pollServersAsync(uavcan_linux::AsyncServiceClient<GetNodeInfo>& client)
+{
+    std::vector<uavcan_linux::AsyncServiceClient<GetNodeInfo>::Call> calls;
+    for (unsigned i = 0; i < NumServers; i++)
+    {
+        calls.push_back(client.call(uavcan::NodeID(std::uint8_t(FirstServerNodeID + i)), GetNodeInfo::Request()));
+    }
+
+    unsigned num_responses = 0;
+    for (auto& call : calls)
+    {
+        const auto result = co_await call;
+        ENFORCE(result.getCallError() >= 0);
+        if (result.isSuccessful())
+        {
+            ENFORCE(result.getResponse().name == "org.uavcan.linux_test_service_coroutines.server");
+            num_responses++;
+        }
+    }
+    co_return num_responses;
+}
+
+uavcan_linux::Task<> checkTimeout(uavcan_linux::AsyncServiceClient<GetNodeInfo>& client)
+{
+    const auto started_at = std::chrono::steady_clock::now();
+    auto call = client.call(AbsentNodeID, GetNodeInfo::Request());
+    auto moved_call = std::move(call);
+    ENFORCE(!call.isDone());                    // Moved-from
+    ENFORCE(!moved_call.isDone());
+    const auto result = co_await moved_call;
+    const auto elapsed = std::chrono::steady_clock::now() - started_at;
+
+    ENFORCE(!result.isSuccessful());
+    ENFORCE(result.getCallError() == 0);
+    ENFORCE(result.getCallID().server_node_id == AbsentNodeID);
+    std::cout << "Timed out after "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms" << std::endl;
+}
+
+template <typename Fun>
+double measureMilliseconds(Fun fun)
+{
+    const auto started_at = std::chrono::steady_clock::now();
+    fun();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started_at).count();
+}
+
+}
+
+int main(int argc, const char** argv)
+{
+    try
+    {
+        if (argc < 2)
+        {
+            std::cerr << "Usage:\n\t" << argv[0] << " <can-iface-name-1> [can-iface-name-N...]" << std::endl;
+            return 1;
+        }
+        const std::vector<std::string> iface_names(argv + 1, argv + argc);
+
+        std::atomic<bool> stop(false);
+        std::vector<std::thread> servers;
+        for (unsigned i = 0; i < NumServers; i++)
+        {
+            servers.emplace_back(runServer, iface_names, uavcan::NodeID(std::uint8_t(FirstServerNodeID + i)),
+                                 std::cref(stop));
+        }
+
+        auto node = initNode(iface_names, ClientNodeID, "org.uavcan.linux_test_service_coroutines.client");
+        ENFORCE(node->spin(uavcan::MonotonicDuration::fromMSec(500)) >= 0);   // Letting the servers start
+
+        /*
+         * Sequential calls
+         */
+        auto blocking_client = node->makeBlockingServiceClient<GetNodeInfo>();
+        unsigned num_blocking_responses = 0;
+        const double blocking_ms = measureMilliseconds([&]()
+            {
+                for (unsigned i = 0; i < NumRounds; i++)
+                {
+                    num_blocking_responses += pollServersBlocking(*blocking_client);
+                }
+            });
+        std::cout << "Blocking:  " << num_blocking_responses << " responses in " << blocking_ms << " ms" << std::endl;
+
+        /*
+         * Pipelined calls
+         */
+        uavcan_linux::AsyncServiceClient<GetNodeInfo> async_client(*node);
+        ENFORCE(0 == async_client.init());
+        unsigned num_async_responses = 0;
+        const double async_ms = measureMilliseconds([&]()
+            {
+                for (unsigned i = 0; i < NumRounds; i++)
+                {
+                    auto task = pollServersAsync(async_client);
+                    num_async_responses += uavcan_linux::spinUntilDone(*node, task);
+                }
+            });
+        std::cout << "Pipelined: " << num_async_responses << " responses in " << async_ms << " ms" << std::endl;
+
+        ENFORCE(num_blocking_responses == NumServers * NumRounds);
+        ENFORCE(num_async_responses == NumServers * NumRounds);
+
+        /*
+         * Timeouts must be reported like in the blocking client
+         */
+        auto timeout_task = checkTimeout(async_client);
+        uavcan_linux::spinUntilDone(*node, timeout_task);
+        ENFORCE(async_client.getNumPendingCalls() == 0);
+
+        stop = true;
+        for (auto& t : servers)
+        {
+            t.join();
+        }
+        std::cout << "Done" << std::endl;
+        return 0;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+}
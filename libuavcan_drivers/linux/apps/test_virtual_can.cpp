@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <uavcan_linux/virtual_can.hpp>
+#include "debug.hpp"
+
+static void testRingBuffers()
+{
+    uavcan_linux::SpscRingBuffer<int, 4> spsc;
+    uavcan_linux::MpscRingBuffer<int, 4> mpsc;
+    int x = 0;
+
+    ENFORCE(spsc.isEmpty() && mpsc.isEmpty());
+    ENFORCE(!spsc.tryPop(x) && !mpsc.tryPop(x));
+    for (int i = 0; i < 4; i++)
+    {
+        ENFORCE(spsc.tryPush(i));
+        ENFORCE(mpsc.tryPush(i));
+    }
+    ENFORCE(spsc.isFull() && mpsc.isFull());
+    ENFORCE(!spsc.tryPush(4) && !mpsc.tryPush(4));
+    for (int i = 0; i < 4; i++)
+    {
+        ENFORCE(spsc.tryPop(x) && x == i);
+        ENFORCE(mpsc.tryPop(x) && x == i);
+        ENFORCE(spsc.tryPush(i + 4));
+        ENFORCE(mpsc.tryPush(i + 4));
+    }
+    ENFORCE(spsc.getSize() == 4 && mpsc.getSize() == 4);
+}
+
+static uavcan::CanFrame makeFrame(unsigned thread_index, std::uint32_t seq)
+{
+    uavcan::CanFrame frame;
+    frame.id = (thread_index & uavcan::CanFrame::MaskExtID) | uavcan::CanFrame::FlagEFF;
+    frame.dlc = 8;
+    std::memcpy(frame.data, &thread_index, 4);
+    std::memcpy(frame.data + 4, &seq, 4);
+    return frame;
+}
+
+/**
+ * Every sub-node thread transmits the given number of frames as fast as possible;
+ * the main thread drains the bridge and verifies that the frames of every thread arrive in order.
+ * @return Frames per second.
+ */
+static double benchmarkTx(unsigned num_threads, unsigned frames_per_thread)
+{
+    uavcan_linux::VirtualCanBridge bridge;
+    std::vector<std::unique_ptr<uavcan_linux::VirtualCanDriver>> drivers;
+    for (unsigned i = 0; i < num_threads; i++)
+    {
+        drivers.emplace_back(new uavcan_linux::VirtualCanDriver(bridge, 1));
+    }
+
+    uavcan_linux::SystemClock clock;
+    const auto started_at = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < num_threads; i++)
+    {
+        uavcan::ICanDriver& driver = *drivers[i];
+        threads.emplace_back([&driver, &clock, i, frames_per_thread]()
+            {
+                uavcan::ICanIface& iface = *driver.getIface(0);
+                const uavcan::MonotonicTime deadline = clock.getMonotonic() + uavcan::MonotonicDuration::fromMSec(10000);
+                std::uint32_t seq = 0;
+                while (seq < frames_per_thread)
+                {
+                    const uavcan::CanFrame frame = makeFrame(i, seq);
+                    if (iface.send(frame, deadline, 0) > 0)
+                    {
+                        seq++;
+                        continue;
+                    }
+                    // TX queue is full - block until the main thread frees some space
+                    uavcan::CanSelectMasks masks;
+                    masks.write = 1;
+                    const uavcan::CanFrame* pending_tx[uavcan::MaxCanIfaces] = { &frame };
+                    ENFORCE(driver.select(masks, pending_tx,
+                                          clock.getMonotonic() + uavcan::MonotonicDuration::fromMSec(100)) >= 0);
+                }
+            });
+    }
+
+    std::vector<std::uint32_t> next_seq(num_threads, 0);
+    const std::uint64_t total = std::uint64_t(num_threads) * frames_per_thread;
+    std::uint64_t received = 0;
+    while (received < total)
+    {
+        ENFORCE(bridge.waitForTxFrames(uavcan::MonotonicDuration::fromMSec(100)) >= 0);
+        received += bridge.drainTxQueue([&next_seq](const uavcan_linux::VirtualCanTxFrame& e)
+            {
+                unsigned thread_index = 0;
+                std::uint32_t seq = 0;
+                std::memcpy(&thread_index, e.frame.data, 4);
+                std::memcpy(&seq, e.frame.data + 4, 4);
+                ENFORCE(thread_index < next_seq.size());
+                ENFORCE(next_seq[thread_index] == seq);
+                next_seq[thread_index]++;
+            });
+    }
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_at).count();
+    return double(total) / elapsed;
+}
+
+/**
+ * The main thread broadcasts frames to all sub-node threads; every sub-node thread must receive all of them in order.
+ */
+static void testRxDelivery(unsigned num_threads)
+{
+    constexpr unsigned NumFrames = uavcan_linux::VirtualCanDriver::RxQueueCapacity;
+
+    uavcan_linux::VirtualCanBridge bridge;
+    std::vector<std::unique_ptr<uavcan_linux::VirtualCanDriver>> drivers;
+    for (unsigned i = 0; i < num_threads; i++)
+    {
+        drivers.emplace_back(new uavcan_linux::VirtualCanDriver(bridge, 1));
+    }
+
+    uavcan_linux::SystemClock clock;
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < num_threads; i++)
+    {
+        uavcan::ICanDriver& driver = *drivers[i];
+        threads.emplace_back([&driver, &clock]()
+            {
+                uavcan::ICanIface& iface = *driver.getIface(0);
+                std::uint32_t next_seq = 0;
+                while (next_seq < NumFrames)
+                {
+                    uavcan::CanSelectMasks masks;
+                    masks.read = 1;
+                    const uavcan::CanFrame* pending_tx[uavcan::MaxCanIfaces] = { };
+                    ENFORCE(driver.select(masks, pending_tx,
+                                          clock.getMonotonic() + uavcan::MonotonicDuration::fromMSec(1000)) >= 0);
+                    uavcan::CanFrame frame;
+                    uavcan::MonotonicTime ts_mono;
+                    uavcan::UtcTime ts_utc;
+                    uavcan::CanIOFlags flags = 0;
+                    while (iface.receive(frame, ts_mono, ts_utc, flags) > 0)
+                    {
+                        std::uint32_t seq = 0;
+                        std::memcpy(&seq, frame.data + 4, 4);
+                        ENFORCE(seq == next_seq);
+                        next_seq++;
+                    }
+                }
+            });
+    }
+
+    for (unsigned i = 0; i < NumFrames; i++)
+    {
+        uavcan::CanRxFrame frame;
+        static_cast<uavcan::CanFrame&>(frame) = makeFrame(0, i);
+        frame.ts_mono = clock.getMonotonic();
+        bridge.handleRxFrame(frame, 0);
+    }
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    for (auto& d : drivers)
+    {
+        ENFORCE(d->getNumRxOverflows() == 0);
+    }
+}
+
+/**
+ * One sub-node thread destroys its driver while the main thread keeps delivering frames to all sub-nodes;
+ * the remaining sub-nodes must keep receiving frames in order.
+ */
+static void testDetachWhileRunning(unsigned num_threads)
+{
+    constexpr unsigned MinNumFrames = uavcan_linux::VirtualCanDriver::RxQueueCapacity * 16;
+    constexpr unsigned VictimIndex = 0;
+
+    uavcan_linux::VirtualCanBridge bridge;
+    std::vector<std::unique_ptr<uavcan_linux::VirtualCanDriver>> drivers;
+    for (unsigned i = 0; i < num_threads; i++)
+    {
+        drivers.emplace_back(new uavcan_linux::VirtualCanDriver(bridge, 1));
+    }
+
+    uavcan_linux::SystemClock clock;
+    std::atomic<bool> victim_gone(false);
+    std::atomic<bool> done(false);
+    std::vector<std::uint64_t> num_received(num_threads, 0);
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < num_threads; i++)
+    {
+        std::unique_ptr<uavcan_linux::VirtualCanDriver>& driver = drivers[i];
+        std::uint64_t& received = num_received[i];
+        threads.emplace_back([&driver, &received, &clock, &victim_gone, &done, i]()
+            {
+                uavcan::ICanDriver& can_driver = *driver;
+                uavcan::ICanIface& iface = *can_driver.getIface(0);
+                std::int64_t last_seq = -1;
+                while (true)
+                {
+                    uavcan::CanSelectMasks masks;
+                    masks.read = 1;
+                    const uavcan::CanFrame* pending_tx[uavcan::MaxCanIfaces] = { };
+                    const bool finishing = done.load();
+                    ENFORCE(can_driver.select(masks, pending_tx,
+                                              clock.getMonotonic() + uavcan::MonotonicDuration::fromMSec(10)) >= 0);
+                    uavcan::CanFrame frame;
+                    uavcan::MonotonicTime ts_mono;
+                    uavcan::UtcTime ts_utc;
+                    uavcan::CanIOFlags flags = 0;
+                    unsigned num_popped = 0;
+                    while (iface.receive(frame, ts_mono, ts_utc, flags) > 0)
+                    {
+                        std::uint32_t seq = 0;
+                        std::memcpy(&seq, frame.data + 4, 4);
+                        ENFORCE(std::int64_t(seq) > last_seq);     // Gaps are possible if the RX queue overflows
+                        last_seq = seq;
+                        received++;
+                        num_popped++;
+                    }
+                    if ((i == VictimIndex) && (received >= MinNumFrames / 4))
+                    {
+                        driver.reset();                             // The main thread is still delivering frames
+                        victim_gone.store(true);
+                        return;
+                    }
+                    if (finishing && (num_popped == 0))
+                    {
+                        return;
+                    }
+                }
+            });
+    }
+
+    std::uint32_t num_sent = 0;
+    while ((num_sent < MinNumFrames) || !victim_gone.load())
+    {
+        uavcan::CanRxFrame frame;
+        static_cast<uavcan::CanFrame&>(frame) = makeFrame(0, num_sent++);
+        frame.ts_mono = clock.getMonotonic();
+        bridge.handleRxFrame(frame, 0);
+        if ((num_sent % 64) == 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+    done.store(true);
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    ENFORCE(bridge.getNumAttachedDrivers() == num_threads - 1);
+    ENFORCE(!drivers[VictimIndex]);
+    for (unsigned i = 0; i < num_threads; i++)
+    {
+        if (i != VictimIndex)
+        {
+            ENFORCE(num_received[i] + drivers[i]->getNumRxOverflows() == num_sent);
+        }
+    }
+
+    drivers.clear();
+    ENFORCE(bridge.getNumAttachedDrivers() == 0);
+}
+
+int main()
+{
+    try
+    {
+        testRingBuffers();
+
+        constexpr unsigned FramesPerThread = 1000000;
+
+        std::cout << "Sub-node threads | TX frames/sec" << std::endl;
+        for (unsigned num_threads = 1; num_threads <= 8; num_threads++)
+        {
+            testRxDelivery(num_threads);
+            testDetachWhileRunning(num_threads + 1);
+            const double tx_rate = benchmarkTx(num_threads, FramesPerThread);
+            std::cout << std::setw(16) << num_threads << " | "
+                      << std::setw(13) << std::fixed << std::setprecision(0) << tx_rate << std::endl;
+        }
+        return 0;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Exception: " << ex.what() << std::endl;
+        return 1;
+    }
+}
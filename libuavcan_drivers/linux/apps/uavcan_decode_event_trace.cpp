@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ *
+ * Converts the binary event trace written by uavcan_posix::dynamic_node_id_server::BufferedFileEventTracer
+ * into the text format of uavcan_posix::dynamic_node_id_server::FileEventTracer.
+ */
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <uavcan_posix/dynamic_node_id_server/buffered_file_event_tracer.hpp>
+#include <uavcan_posix/dynamic_node_id_server/file_event_tracer.hpp>
+#include "debug.hpp"
+
+namespace
+{
+
+using uavcan_posix::dynamic_node_id_server::EventTraceRecord;
+using uavcan_posix::dynamic_node_id_server::FileEventTracer;
+
+/**
+ * Returns the number of decoded records.
+ */
+unsigned decode(std::istream& in, std::ostream& out, bool print_names)
+{
+    char signature[EventTraceRecord::SignatureLength] = {};
+    in.read(signature, sizeof(signature));
+    ENFORCE(in.gcount() == EventTraceRecord::SignatureLength);
+    if (0 != std::memcmp(signature, EventTraceRecord::getFileSignature(), sizeof(signature)))
+    {
+        throw std::runtime_error("Not an event trace file");
+    }
+
+    unsigned num_records = 0;
+    std::uint8_t buffer[EventTraceRecord::Size];
+    while (in.read(reinterpret_cast<char*>(buffer), sizeof(buffer)))
+    {
+        EventTraceRecord record;
+        record.deserialize(buffer);
+
+        const auto code = static_cast<uavcan::dynamic_node_id_server::TraceCode>(record.code);
+        char line[FileEventTracer::MaxLineLength + 1];
+        const int len = FileEventTracer::formatLine(line, record.getTimestamp(), code, record.argument);
+
+        if (print_names)
+        {
+            // Replacing the line feed with the event name
+            const char* const name = (code < uavcan::dynamic_node_id_server::NumTraceCodes) ?
+                uavcan::dynamic_node_id_server::IEventTracer::getEventName(code) : "?";
+            out.write(line, len - 1) << "\t" << name << "\n";
+        }
+        else
+        {
+            out.write(line, len);
+        }
+        num_records++;
+    }
+
+    if (in.gcount() > 0)
+    {
+        std::cerr << "Incomplete record at the end of the trace (" << in.gcount() << " bytes), ignored" << std::endl;
+    }
+    return num_records;
+}
+
+}
+
+int main(int argc, const char** argv)
+{
+    try
+    {
+        bool print_names = false;
+        std::string input_path;
+        std::string output_path;
+
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg(argv[i]);
+            if (arg == "-n")
+            {
+                print_names = true;
+            }
+            else if (input_path.empty())
+            {
+                input_path = arg;
+            }
+            else if (output_path.empty())
+            {
+                output_path = arg;
+            }
+            else
+            {
+                input_path.clear();
+                break;
+            }
+        }
+
+        if (input_path.empty())
+        {
+            std::cerr << "Usage:\n\t" << argv[0] << " [-n] <binary-trace-file> [text-output-file]\n"
+                      << "Options:\n\t-n  Append event names to the lines" << std::endl;
+            return 1;
+        }
+
+        std::ifstream in(input_path, std::ios::binary);
+        ENFORCE(in.is_open());
+
+        unsigned num_records = 0;
+        if (output_path.empty())
+        {
+            num_records = decode(in, std::cout, print_names);
+        }
+        else
+        {
+            std::ofstream out(output_path, std::ios::trunc);
+            ENFORCE(out.is_open());
+            num_records = decode(in, out, print_names);
+            ENFORCE(out.good());
+        }
+
+        std::cerr << num_records << " events decoded" << std::endl;
+        return 0;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+}
@@ -10,6 +10,7 @@
 #include <cstdlib>
 #include <cstdio>
 #include <deque>
+#include <memory>
 #include <unordered_map>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -21,8 +22,9 @@
 // UAVCAN Linux drivers
 #include <uavcan_linux/uavcan_linux.hpp>
 // UAVCAN POSIX drivers
-#include <uavcan_posix/dynamic_node_id_server/file_storage_backend.hpp>
+#include <uavcan_posix/dynamic_node_id_server/snapshot_file_storage_backend.hpp>
 #include <uavcan_posix/dynamic_node_id_server/file_event_tracer.hpp>
+#include <uavcan_posix/dynamic_node_id_server/buffered_file_event_tracer.hpp>
 
 namespace
 {
@@ -57,7 +59,7 @@ uavcan_linux::NodePtr initNode(const std::vector<std::string>& ifaces, uavcan::N
 }
 
 
-class EventTracer : public uavcan_posix::dynamic_node_id_server::FileEventTracer
+class EventTracer : public uavcan::dynamic_node_id_server::IEventTracer
 {
 public:
     struct RecentEvent
@@ -129,6 +131,7 @@ private:
         std::size_t operator()(T t) const { return static_cast<std::size_t>(t); }
     };
 
+    std::unique_ptr<uavcan::dynamic_node_id_server::IEventTracer> file_tracer_;
     uavcan_linux::SystemClock clock_;
     const uavcan::MonotonicTime started_at_ = clock_.getMonotonic();
     const unsigned num_last_events_;
@@ -140,7 +143,10 @@ private:
 
     void onEvent(uavcan::dynamic_node_id_server::TraceCode code, std::int64_t argument) override
     {
-        uavcan_posix::dynamic_node_id_server::FileEventTracer::onEvent(code, argument);
+        if (file_tracer_)
+        {
+            file_tracer_->onEvent(code, argument);
+        }
 
         had_events_ = true;
 
@@ -162,7 +168,24 @@ public:
         : num_last_events_(num_last_events_to_keep)
     { }
 
-    using uavcan_posix::dynamic_node_id_server::FileEventTracer::init;
+    /**
+     * The buffered tracer writes binary records from a background thread, see uavcan_decode_event_trace.
+     */
+    void init(const std::string& path, bool buffered)
+    {
+        if (buffered)
+        {
+            auto tracer = new uavcan_posix::dynamic_node_id_server::BufferedFileEventTracer;
+            file_tracer_.reset(tracer);
+            ENFORCE(0 <= tracer->init(path.c_str()));
+        }
+        else
+        {
+            auto tracer = new uavcan_posix::dynamic_node_id_server::FileEventTracer;
+            file_tracer_.reset(tracer);
+            ENFORCE(0 <= tracer->init(path.c_str()));
+        }
+    }
 
     const RecentEvent& getEventByIndex(unsigned index) const { return last_events_.at(index); }
 
@@ -480,18 +503,19 @@ void redraw(const uavcan_linux::NodePtr& node,
 void runForever(const uavcan_linux::NodePtr& node,
                 const std::uint8_t cluster_size,
                 const std::string& event_log_file,
+                const bool binary_event_log,
                 const std::string& persistent_storage_path)
 {
     /*
      * Event tracer
      */
     EventTracer event_tracer(MaxNumLastEvents);
-    ENFORCE(0 <= event_tracer.init(event_log_file.c_str()));
+    event_tracer.init(event_log_file, binary_event_log);
 
     /*
      * Storage backend
      */
-    uavcan_posix::dynamic_node_id_server::FileStorageBackend storage_backend;
+    uavcan_posix::dynamic_node_id_server::SnapshotFileStorageBackend storage_backend;
     ENFORCE(0 <= storage_backend.init(persistent_storage_path.c_str()));
 
     /*
@@ -523,6 +547,13 @@ void runForever(const uavcan_linux::NodePtr& node,
             std::cerr << "Spin error: " << res << std::endl;
         }
 
+        // All updates made by the server during this spin go into one snapshot write
+        const int flush_res = storage_backend.flush();
+        if (flush_res < 0)
+        {
+            std::cerr << "Storage snapshot flush error: " << flush_res << std::endl;
+        }
+
         const auto ts = node->getMonotonicTime();
 
         if (event_tracer.hadEvents() || (ts - last_redraw_at).toMSec() > 1000)
@@ -539,6 +570,7 @@ struct Options
     std::vector<std::string> ifaces;
     std::uint8_t cluster_size = 0;
     std::string storage_path;
+    bool binary_event_log = false;
 };
 
 Options parseOptions(int argc, const char** argv)
@@ -553,6 +585,8 @@ Options parseOptions(int argc, const char** argv)
                       << "Usage:\n\t"
                       << executable_name
                       << " <node-id> <can-iface-name-1> [can-iface-name-N...] [-c <cluster-size>] -s <storage-path>"
+                         " [-b]\n"
+                      << "Options:\n\t-b  Buffered binary event log (events.bin), see uavcan_decode_event_trace"
                       << std::endl;
             std::exit(1);
         }
@@ -607,6 +641,10 @@ Options parseOptions(int argc, const char** argv)
                 out.storage_path = *argv++;
             }
         }
+        else if (token[1] == 'b')
+        {
+            out.binary_event_log = true;
+        }
         else
         {
             enforce(false, "Unexpected argument");
@@ -653,14 +691,14 @@ int main(int argc, const char** argv)
         int system_res = std::system(("mkdir -p '" + options.storage_path + "' &>/dev/null").c_str());
         (void)system_res;
 
-        const auto event_log_file = options.storage_path + "/events.log";
+        const auto event_log_file = options.storage_path + (options.binary_event_log ? "/events.bin" : "/events.log");
         const auto storage_path   = options.storage_path + "/storage/";
 
         /*
          * Starting the node
          */
         auto node = initNode(options.ifaces, options.node_id, "org.uavcan.linux_app.dynamic_node_id_server");
-        runForever(node, options.cluster_size, event_log_file, storage_path);
+        runForever(node, options.cluster_size, event_log_file, options.binary_event_log, storage_path);
         return 0;
     }
     catch (const std::exception& ex)
@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ *
+ * Worst-case response time analysis of a planned CAN traffic; see uavcan_linux::ResponseTimeAnalyzer.
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <uavcan_linux/response_time_analysis.hpp>
+#include "debug.hpp"
+
+#include <uavcan/protocol/NodeStatus.hpp>
+#include <uavcan/protocol/GlobalTimeSync.hpp>
+#include <uavcan/protocol/debug/LogMessage.hpp>
+#include <uavcan/protocol/dynamic_node_id/Allocation.hpp>
+#include <uavcan/protocol/dynamic_node_id/server/AppendEntries.hpp>
+#include <uavcan/protocol/dynamic_node_id/server/Discovery.hpp>
+#include <uavcan/protocol/dynamic_node_id/server/RequestVote.hpp>
+#include <uavcan/protocol/GetNodeInfo.hpp>
+#include <uavcan/protocol/GetDataTypeInfo.hpp>
+#include <uavcan/protocol/GetTransportStats.hpp>
+#include <uavcan/protocol/RestartNode.hpp>
+#include <uavcan/protocol/param/GetSet.hpp>
+#include <uavcan/protocol/param/ExecuteOpcode.hpp>
+#include <uavcan/protocol/file/BeginFirmwareUpdate.hpp>
+#include <uavcan/protocol/file/GetInfo.hpp>
+#include <uavcan/protocol/file/Read.hpp>
+#include <uavcan/protocol/file/Write.hpp>
+
+namespace
+{
+
+using uavcan_linux::ResponseTimeAnalyzer;
+
+/**
+ * Arguments: source node ID, destination node ID, rate [Hz], request (true) or response (false).
+ */
+typedef std::function<ResponseTimeAnalyzer::Stream (uavcan::NodeID, uavcan::NodeID, double, bool)> StreamFactory;
+
+struct KnownDataType
+{
+    uavcan::DataTypeKind kind;
+    StreamFactory factory;
+};
+
+typedef std::map<std::string, KnownDataType> KnownDataTypes;
+
+template <typename DataType>
+void addMessageType(KnownDataTypes& table)
+{
+    table[DataType::getDataTypeFullName()] = KnownDataType {
+        uavcan::DataTypeKindMessage,
+        [](uavcan::NodeID src, uavcan::NodeID, double rate, bool)
+        {
+            return ResponseTimeAnalyzer::makeMessageStream<DataType>(src, rate);
+        }
+    };
+}
+
+template <typename DataType>
+void addServiceType(KnownDataTypes& table)
+{
+    table[DataType::getDataTypeFullName()] = KnownDataType {
+        uavcan::DataTypeKindService,
+        [](uavcan::NodeID src, uavcan::NodeID dst, double rate, bool request)
+        {
+            return ResponseTimeAnalyzer::makeServiceStream<DataType>(src, dst, rate, request);
+        }
+    };
+}
+
+KnownDataTypes makeKnownDataTypes()
+{
+    KnownDataTypes table;
+    addMessageType<uavcan::protocol::NodeStatus>(table);
+    addMessageType<uavcan::protocol::GlobalTimeSync>(table);
+    addMessageType<uavcan::protocol::debug::LogMessage>(table);
+    addMessageType<uavcan::protocol::dynamic_node_id::Allocation>(table);
+    addMessageType<uavcan::protocol::dynamic_node_id::server::Discovery>(table);
+    addServiceType<uavcan::protocol::dynamic_node_id::server::AppendEntries>(table);
+    addServiceType<uavcan::protocol::dynamic_node_id::server::RequestVote>(table);
+    addServiceType<uavcan::protocol::GetNodeInfo>(table);
+    addServiceType<uavcan::protocol::GetDataTypeInfo>(table);
+    addServiceType<uavcan::protocol::GetTransportStats>(table);
+    addServiceType<uavcan::protocol::RestartNode>(table);
+    addServiceType<uavcan::protocol::param::GetSet>(table);
+    addServiceType<uavcan::protocol::param::ExecuteOpcode>(table);
+    addServiceType<uavcan::protocol::file::BeginFirmwareUpdate>(table);
+    addServiceType<uavcan::protocol::file::GetInfo>(table);
+    addServiceType<uavcan::protocol::file::Read>(table);
+    addServiceType<uavcan::protocol::file::Write>(table);
+    return table;
+}
+
+uavcan::NodeID parseNodeID(const std::string& str)
+{
+    if (str == "-")
+    {
+        return uavcan::NodeID::Broadcast;
+    }
+    const int value = std::stoi(str);
+    ENFORCE(value >= 0 && value <= uavcan::NodeID::Max);
+    return uavcan::NodeID(std::uint8_t(value));
+}
+
+/**
+ * Line format:
+ *   <kind> <data type> <source node ID> <destination node ID or -> <rate Hz> [priority] [jitter ms] [deadline ms]
+ * Where kind is one of: msg, req, resp; data type is either a full data type name or <ID>:<max payload bytes>.
+ */
+ResponseTimeAnalyzer::Stream parseStream(const std::string& line, const KnownDataTypes& known_types)
+{
+    std::istringstream is(line);
+    std::string kind;
+    std::string type;
+    std::string src;
+    std::string dst;
+    double rate_hz = 0;
+    if (!(is >> kind >> type >> src >> dst >> rate_hz))
+    {
+        throw std::runtime_error("Malformed line: " + line);
+    }
+
+    const bool is_message = kind == "msg";
+    const bool is_request = kind == "req";
+    if (!is_message && !is_request && kind != "resp")
+    {
+        throw std::runtime_error("Unknown transfer kind: " + kind);
+    }
+    const uavcan::DataTypeKind dtkind = is_message ? uavcan::DataTypeKindMessage : uavcan::DataTypeKindService;
+
+    ResponseTimeAnalyzer::Stream s;
+    const auto known = known_types.find(type);
+    if (known != known_types.end())
+    {
+        if (known->second.kind != dtkind)
+        {
+            throw std::runtime_error("Data type kind mismatch: " + line);
+        }
+        s = known->second.factory(parseNodeID(src), parseNodeID(dst), rate_hz, is_request);
+    }
+    else
+    {
+        const auto colon = type.find(':');
+        if (colon == std::string::npos)
+        {
+            throw std::runtime_error("Unknown data type: " + type);
+        }
+        s.name = type;
+        s.data_type_id = uavcan::DataTypeID(std::uint16_t(std::stoul(type.substr(0, colon))));
+        s.max_payload_len = unsigned(std::stoul(type.substr(colon + 1)));
+        s.transfer_type = is_message ? uavcan::TransferTypeMessageBroadcast :
+                          (is_request ? uavcan::TransferTypeServiceRequest : uavcan::TransferTypeServiceResponse);
+        s.src_node_id = parseNodeID(src);
+        s.dst_node_id = parseNodeID(dst);
+        s.period_usec = 1e6 / rate_hz;
+    }
+
+    int priority = -1;
+    double jitter_ms = 0;
+    double deadline_ms = 0;
+    if (is >> priority)
+    {
+        ENFORCE(priority >= 0 && priority <= uavcan::TransferPriority::NumericallyMax);
+        s.priority = uavcan::TransferPriority(std::uint8_t(priority));
+        if (is >> jitter_ms)
+        {
+            s.jitter_usec = jitter_ms * 1e3;
+            if (is >> deadline_ms)
+            {
+                s.deadline_usec = deadline_ms * 1e3;
+            }
+        }
+    }
+    return s;
+}
+
+void printReport(const ResponseTimeAnalyzer::Report& report, std::ostream& os)
+{
+    os << std::left
+       << std::setw(52) << "Stream" << std::setw(10) << "CAN ID"
+       << std::right
+       << std::setw(7) << "Frames" << std::setw(7) << "Bits"
+       << std::setw(11) << "C, ms" << std::setw(11) << "T, ms" << std::setw(11) << "D, ms"
+       << std::setw(11) << "R, ms" << "\n";
+
+    for (const auto& r : report.results)
+    {
+        std::ostringstream name;
+        name << r.stream.name << " " << int(r.stream.src_node_id.get());
+        if (!r.stream.dst_node_id.isBroadcast())
+        {
+            name << "->" << int(r.stream.dst_node_id.get());
+        }
+
+        std::ostringstream can_id;
+        can_id << std::hex << std::setfill('0') << std::setw(8) << (r.first_frame.id & uavcan::CanFrame::MaskExtID);
+
+        os << std::left << std::setw(52) << name.str() << std::setw(10) << can_id.str()
+           << std::right << std::fixed << std::setprecision(3)
+           << std::setw(7) << r.num_frames << std::setw(7) << r.num_bits
+           << std::setw(11) << r.transmission_time_usec * 1e-3
+           << std::setw(11) << r.stream.period_usec * 1e-3
+           << std::setw(11) << r.stream.getDeadlineUSec() * 1e-3
+           << std::setw(11) << r.response_time_usec * 1e-3
+           << (r.isSchedulable() ? "" : "  DEADLINE MISS") << "\n";
+    }
+
+    os << "\nWorst-case bus utilization: " << std::setprecision(1) << report.utilization * 100.0 << "%\n"
+       << (report.isSchedulable() ? "All deadlines are met" : "SOME DEADLINES ARE MISSED") << std::endl;
+}
+
+}
+
+int main(int argc, const char** argv)
+{
+    try
+    {
+        std::uint32_t bit_rate = uavcan::CanBusLoadEstimator::DefaultBitRate;
+        std::string plan_path;
+
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg(argv[i]);
+            if ((arg == "-b") && ((i + 1) < argc))
+            {
+                bit_rate = std::uint32_t(std::stoul(argv[++i]));
+            }
+            else if (plan_path.empty())
+            {
+                plan_path = arg;
+            }
+            else
+            {
+                plan_path.clear();
+                break;
+            }
+        }
+
+        if (plan_path.empty())
+        {
+            std::cerr << "Usage:\n\t" << argv[0] << " [-b <bit rate>] <traffic-plan-file>\n"
+                      << "Options:\n\t-b  CAN bit rate, default " << bit_rate << "\n"
+                      << "Traffic plan line format:\n"
+                      << "\t<msg|req|resp> <data type> <src node ID> <dst node ID or -> <rate Hz> "
+                      << "[priority] [jitter ms] [deadline ms]\n"
+                      << "Data type is either a full name of a standard type or <data type ID>:<max payload bytes>.\n"
+                      << "Lines that begin with # are ignored." << std::endl;
+            return 1;
+        }
+
+        std::ifstream in(plan_path);
+        ENFORCE(in.is_open());
+
+        const KnownDataTypes known_types = makeKnownDataTypes();
+        ResponseTimeAnalyzer analyzer(bit_rate);
+
+        std::string line;
+        while (std::getline(in, line))
+        {
+            const auto first = line.find_first_not_of(" \t\r");
+            if ((first == std::string::npos) || (line[first] == '#'))
+            {
+                continue;
+            }
+            analyzer.addStream(parseStream(line, known_types));
+        }
+
+        const ResponseTimeAnalyzer::Report report = analyzer.analyze();
+        printReport(report, std::cout);
+        return report.isSchedulable() ? 0 : 2;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+}
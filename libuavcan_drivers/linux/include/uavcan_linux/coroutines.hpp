@@ -0,0 +1,444 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#pragma once
+
+/*
+ * Unlike the rest of the driver, this header requires C++20, so it is not included from uavcan_linux.hpp.
+ * Libuavcan does not recognize C++20 yet, so UAVCAN_CPP_VERSION must be set to UAVCAN_CPP11 explicitly.
+ */
+#if (__cplusplus < 202002L) || !__has_include(<coroutine>)
+# error "uavcan_linux/coroutines.hpp requires C++20 coroutines"
+#endif
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+#include <uavcan/node/service_client.hpp>
+#include <uavcan/node/scheduler.hpp>
+#include <uavcan_linux/exception.hpp>
+
+namespace uavcan_linux
+{
+
+template <typename T>
+class Task;
+
+namespace detail
+{
+
+class TaskPromiseBase
+{
+    std::coroutine_handle<> continuation_;
+    std::exception_ptr exception_;
+
+public:
+    /**
+     * Once the coroutine is finished, control is transferred to the awaiting coroutine, if any.
+     */
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            const std::coroutine_handle<> cont = handle.promise().continuation_;
+            return cont ? cont : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept { }
+    };
+
+    std::suspend_never initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+
+    void unhandled_exception() { exception_ = std::current_exception(); }
+
+    void setContinuation(std::coroutine_handle<> cont) { continuation_ = cont; }
+
+    void rethrowIfFailed() const
+    {
+        if (exception_)
+        {
+            std::rethrow_exception(exception_);
+        }
+    }
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase
+{
+    std::optional<T> value_;
+
+public:
+    Task<T> get_return_object();
+
+    template <typename U>
+    void return_value(U&& value) { value_.emplace(std::forward<U>(value)); }
+
+    T takeResult()
+    {
+        rethrowIfFailed();
+        return std::move(*value_);
+    }
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase
+{
+public:
+    Task<void> get_return_object();
+
+    void return_void() { }
+
+    void takeResult() { rethrowIfFailed(); }
+};
+
+}
+
+/**
+ * Coroutine type for straight-line code that performs service calls via @ref AsyncServiceClient.
+ *
+ * The coroutine starts executing immediately when invoked, and runs until the first suspension point;
+ * after that it is resumed by the node thread from @ref uavcan::Scheduler::spin(). Use @ref spinUntilDone() to
+ * spin the node until the task is complete, or co_await the task from another task.
+ *
+ * The task object owns the coroutine frame; destroying the task cancels the coroutine.
+ * A task must not be destroyed while another coroutine is awaiting it.
+ *
+ * @tparam T    Type of the value returned via co_return.
+ */
+template <typename T = void>
+class Task
+{
+public:
+    typedef detail::TaskPromise<T> promise_type;
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) { }
+
+    friend class detail::TaskPromise<T>;
+
+public:
+    Task(Task&& rhs) noexcept : handle_(std::exchange(rhs.handle_, nullptr)) { }
+
+    Task& operator=(Task&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            if (handle_)
+            {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(rhs.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task()
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+        }
+    }
+
+    bool isDone() const { return handle_ && handle_.done(); }
+
+    /**
+     * Returns the value passed to co_return, or rethrows the exception that escaped the coroutine.
+     * The task must be done. For non-void tasks, this method can be called only once.
+     */
+    T getResult()
+    {
+        UAVCAN_ASSERT(isDone());
+        return handle_.promise().takeResult();
+    }
+
+    /**
+     * Awaiting a task from another task.
+     */
+    auto operator co_await() &
+    {
+        struct Awaiter
+        {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() const noexcept { return handle.done(); }
+            void await_suspend(std::coroutine_handle<> cont) noexcept { handle.promise().setContinuation(cont); }
+            T await_resume() { return handle.promise().takeResult(); }
+        };
+        UAVCAN_ASSERT(handle_);
+        return Awaiter{ handle_ };
+    }
+
+    auto operator co_await() && { return operator co_await(); }
+};
+
+namespace detail
+{
+
+template <typename T>
+inline Task<T> TaskPromise<T>::get_return_object()
+{
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+}
+
+/**
+ * Result of a service call performed via @ref AsyncServiceClient.
+ * Unlike @ref uavcan::ServiceCallResult, it owns a copy of the response, so it can be stored.
+ */
+template <typename DataType>
+class AsyncServiceCallResult
+{
+public:
+    typedef typename DataType::Response ResponseType;
+
+private:
+    int call_error_ = 0;
+    bool successful_ = false;
+    uavcan::ServiceCallID call_id_;
+    ResponseType response_;
+
+public:
+    AsyncServiceCallResult() { }
+
+    AsyncServiceCallResult(int call_error, uavcan::NodeID server_node_id)
+        : call_error_(call_error)
+        , call_id_(server_node_id, uavcan::TransferID())
+    { }
+
+    explicit AsyncServiceCallResult(const uavcan::ServiceCallResult<DataType>& result)
+        : successful_(result.isSuccessful())
+        , call_id_(result.getCallID())
+    {
+        if (successful_)
+        {
+            response_ = result.getResponse();
+        }
+    }
+
+    /**
+     * True if the response has been received. False if the request could not be sent, or if the call timed out.
+     */
+    bool isSuccessful() const { return successful_; }
+
+    /**
+     * Negative error code returned by @ref uavcan::ServiceClient::call(), if the request could not be sent.
+     * Zero if the request was sent, regardless of whether the response was received.
+     */
+    int getCallError() const { return call_error_; }
+
+    uavcan::ServiceCallID getCallID() const { return call_id_; }
+
+    /**
+     * The response is default-initialized if the call was not successful.
+     */
+    const ResponseType& getResponse() const { return response_; }
+    ResponseType& getResponse() { return response_; }
+};
+
+/**
+ * Awaitable service client, based on the concurrent call support of @ref uavcan::ServiceClient.
+ *
+ * Every call transmits the request immediately and returns an awaitable object; co_await-ing it suspends the
+ * calling coroutine until the response is received or the call times out. This allows to keep many calls
+ * in flight from straight-line code:
+ *
+ *      auto a = client.call(node_a, request);
+ *      auto b = client.call(node_b, request);
+ *      const auto result_a = co_await a;
+ *      const auto result_b = co_await b;
+ *
+ * Suspended coroutines are resumed by the node thread from @ref uavcan::Scheduler::spin(), after the IO
+ * processing, so they are allowed to make new calls via the same client.
+ *
+ * Coroutines that are suspended on this client when it is destroyed will never be resumed.
+ *
+ * This class is not thread safe; it must be used from the node thread only.
+ */
+template <typename DataType>
+class AsyncServiceClient : private uavcan::SpinHandler
+{
+public:
+    typedef typename DataType::Request RequestType;
+    typedef AsyncServiceCallResult<DataType> Result;
+
+private:
+    struct PendingCall
+    {
+        Result result;
+        bool done = false;
+        std::coroutine_handle<> waiter;
+    };
+
+    typedef std::shared_ptr<PendingCall> PendingCallPtr;
+    typedef std::pair<std::uint8_t, std::uint8_t> CallKey;       ///< Server node ID, transfer ID
+
+    uavcan::ServiceClient<DataType> client_;
+    std::map<CallKey, PendingCallPtr> pending_calls_;
+    std::vector<PendingCallPtr> ready_calls_;
+
+    static CallKey makeCallKey(const uavcan::ServiceCallID& id)
+    {
+        return CallKey(id.server_node_id.get(), id.transfer_id.get());
+    }
+
+    void handleCallResult(const uavcan::ServiceCallResult<DataType>& result)
+    {
+        const auto it = pending_calls_.find(makeCallKey(result.getCallID()));
+        if (it == pending_calls_.end())
+        {
+            return;
+        }
+        const PendingCallPtr call = it->second;
+        pending_calls_.erase(it);
+
+        call->result = Result(result);
+        call->done = true;
+        if (call->waiter)
+        {
+            ready_calls_.push_back(call);
+        }
+    }
+
+    void handleSpin(uavcan::MonotonicTime) override
+    {
+        std::vector<PendingCallPtr> calls;
+        calls.swap(ready_calls_);
+        for (auto& call : calls)
+        {
+            // The waiter may have been destroyed by the time we get here
+            const std::coroutine_handle<> waiter = std::exchange(call->waiter, nullptr);
+            if (waiter)
+            {
+                waiter.resume();
+            }
+        }
+    }
+
+public:
+    /**
+     * Awaitable handle of a call in progress.
+     * The call continues even if this object is destroyed; its result will be discarded.
+     */
+    class Call
+    {
+        PendingCallPtr call_;
+
+    public:
+        explicit Call(const PendingCallPtr& call) : call_(call) { }
+
+        Call(Call&&) = default;
+        Call& operator=(Call&&) = default;
+
+        ~Call()
+        {
+            if (call_)
+            {
+                call_->waiter = nullptr;
+            }
+        }
+
+        /**
+         * A moved-from object is never done; it cannot be awaited either.
+         */
+        bool isDone() const { return call_ && call_->done; }
+
+        bool await_ready() const noexcept
+        {
+            UAVCAN_ASSERT(call_);
+            return call_->done;
+        }
+        void await_suspend(std::coroutine_handle<> waiter) noexcept { call_->waiter = waiter; }
+        Result await_resume() { return std::move(call_->result); }
+    };
+
+    explicit AsyncServiceClient(uavcan::INode& node)
+        : uavcan::SpinHandler(node.getScheduler())
+        , client_(node)
+    {
+        client_.setCallback([this](const uavcan::ServiceCallResult<DataType>& result)
+                            {
+                                handleCallResult(result);
+                            });
+        uavcan::SpinHandler::start();
+    }
+
+    /**
+     * Shall be called before first use.
+     * Returns negative error code.
+     */
+    int init() { return client_.init(); }
+
+    /**
+     * Transmits the request immediately; the result can be obtained by co_await-ing the returned object.
+     * If the request could not be sent, the returned object is ready immediately,
+     * and @ref AsyncServiceCallResult::getCallError() returns the error code.
+     */
+    Call call(uavcan::NodeID server_node_id, const RequestType& request)
+    {
+        const PendingCallPtr call = std::make_shared<PendingCall>();
+        uavcan::ServiceCallID call_id;
+        const int res = client_.call(server_node_id, request, call_id);
+        if (res < 0)
+        {
+            call->result = Result(res, server_node_id);
+            call->done = true;
+        }
+        else
+        {
+            pending_calls_[makeCallKey(call_id)] = call;
+        }
+        return Call(call);
+    }
+
+    unsigned getNumPendingCalls() const { return unsigned(pending_calls_.size()); }
+
+    uavcan::MonotonicDuration getRequestTimeout() const { return client_.getRequestTimeout(); }
+    void setRequestTimeout(uavcan::MonotonicDuration timeout) { client_.setRequestTimeout(timeout); }
+
+    uavcan::TransferPriority getPriority() const { return client_.getPriority(); }
+    void setPriority(const uavcan::TransferPriority prio) { client_.setPriority(prio); }
+};
+
+/**
+ * Spins the node until the task is complete, then returns the result of the task.
+ * Errors returned by the node are reported via uavcan_linux::Exception.
+ * @throws uavcan_linux::Exception.
+ */
+template <typename T>
+T spinUntilDone(uavcan::INode& node, Task<T>& task)
+{
+    while (!task.isDone())
+    {
+        const int res = node.spin(node.getScheduler().getDeadlineResolution());
+        if (res < 0)
+        {
+            throw Exception("Spin failure [" + std::to_string(res) + "]");
+        }
+    }
+    return task.getResult();
+}
+
+}
@@ -8,10 +8,12 @@
 #include <string>
 #include <vector>
 #include <chrono>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <uavcan/uavcan.hpp>
 #include <uavcan/node/sub_node.hpp>
+#include <uavcan/helpers/instrumented_pool_allocator.hpp>
 
 namespace uavcan_linux
 {
@@ -163,11 +165,28 @@ using BlockingServiceClientPtr = std::shared_ptr<BlockingServiceClient<T>>;
 
 static constexpr std::size_t NodeMemPoolSize = 1024 * 512;  ///< This shall be enough for any possible use case
 
+/**
+ * Memory pool of the node with per-component memory accounting.
+ * This has to be a base class in order to be initialized before the node.
+ */
+class NodeMemoryPool
+{
+public:
+    typedef uavcan::InstrumentedPoolAllocator<> InstrumentedAllocator;
+
+protected:
+    uavcan::PoolAllocator<NodeMemPoolSize, uavcan::MemPoolBlockSize> memory_pool_;
+    InstrumentedAllocator instrumented_allocator_;
+
+    NodeMemoryPool() : instrumented_allocator_(memory_pool_) { }
+};
+
 /**
  * Generic wrapper for node objects with some additional convenience functions.
+ * The node type must accept a reference to the allocator, i.e. the memory pool size must be zero.
  */
 template <typename NodeType>
-class NodeBase : public NodeType
+class NodeBase : protected NodeMemoryPool, public NodeType
 {
 protected:
     DriverPackPtr driver_pack_;
@@ -193,14 +212,14 @@ public:
      * Simple forwarding constructor, compatible with uavcan::Node.
      */
     NodeBase(uavcan::ICanDriver& can_driver, uavcan::ISystemClock& clock) :
-        NodeType(can_driver, clock)
+        NodeType(can_driver, clock, instrumented_allocator_)
     { }
 
     /**
      * Takes ownership of the driver container via the shared pointer.
      */
     explicit NodeBase(DriverPackPtr driver_pack)
-        : NodeType(*driver_pack->can, driver_pack->clock)
+        : NodeType(*driver_pack->can, driver_pack->clock, instrumented_allocator_)
         , driver_pack_(driver_pack)
     { }
 
@@ -298,6 +317,32 @@ public:
 
     const DriverPackPtr& getDriverPack() const { return driver_pack_; }
     DriverPackPtr& getDriverPack() { return driver_pack_; }
+
+    /**
+     * Memory usage statistics per library component (TX queues, transfer buffers, receivers, etc.).
+     * An exhaustion listener can be installed via this object as well.
+     */
+    const InstrumentedAllocator& getInstrumentedAllocator() const { return instrumented_allocator_; }
+    InstrumentedAllocator& getInstrumentedAllocator() { return instrumented_allocator_; }
+
+    /**
+     * Prints the memory pool usage per library component into the stream, one component per line.
+     */
+    void printMemoryUsage(std::ostream& os) const
+    {
+        const auto& ia = instrumented_allocator_;
+        os << "Memory pool: used " << ia.getNumUsedBlocks() << " / " << ia.getBlockCapacity()
+           << " blocks, peak " << ia.getPeakNumUsedBlocks()
+           << ", failed allocations " << ia.getNumFailedAllocations() << "\n";
+        for (unsigned i = 0; i < ia.getNumOwners(); i++)
+        {
+            const uavcan::PoolAllocationOwnerStats stats = ia.getOwnerStatsByIndex(i);
+            os << "  " << std::left << std::setw(32) << stats.owner.toString() << std::right
+               << " used " << std::setw(5) << stats.num_used_blocks
+               << " peak " << std::setw(5) << stats.peak_num_used_blocks
+               << " failed " << stats.num_failed_allocations << "\n";
+        }
+    }
 };
 
 /**
@@ -305,9 +350,9 @@ public:
  * Note that this wrapper adds stderr log sink to @ref uavcan::Logger, which can be removed if needed.
  * Do not instantiate this class directly; instead use the factory functions defined below.
  */
-class Node : public NodeBase<uavcan::Node<NodeMemPoolSize>>
+class Node : public NodeBase<uavcan::Node<>>
 {
-    typedef NodeBase<uavcan::Node<NodeMemPoolSize>> Base;
+    typedef NodeBase<uavcan::Node<>> Base;
 
     DefaultLogSink log_sink_;
 
@@ -335,9 +380,9 @@ public:
  * Wrapper for uavcan::SubNode with some additional convenience functions.
  * Do not instantiate this class directly; instead use the factory functions defined below.
  */
-class SubNode : public NodeBase<uavcan::SubNode<NodeMemPoolSize>>
+class SubNode : public NodeBase<uavcan::SubNode<>>
 {
-    typedef NodeBase<uavcan::SubNode<NodeMemPoolSize>> Base;
+    typedef NodeBase<uavcan::SubNode<>> Base;
 
 public:
     /**
@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+#include <uavcan/transport/frame.hpp>
+#include <uavcan/transport/can_bus_load_estimator.hpp>
+#include <uavcan/marshal/type_util.hpp>
+#include <uavcan_linux/exception.hpp>
+
+namespace uavcan_linux
+{
+/**
+ * Offline worst-case response time analysis of a planned CAN traffic.
+ *
+ * Every transfer stream is described by its data type, transfer type, priority, source and destination nodes,
+ * worst-case payload length, and period. The CAN frames are built and compiled with the same code that is used
+ * by the transfer sender, so that the arbitration IDs and the number and lengths of the frames match the real
+ * traffic exactly. Every frame is assumed to take its worst-case length with bit stuffing.
+ *
+ * The analysis follows R. I. Davis, A. Burns, R. J. Bril, J. J. Lukkien, "Controller Area Network (CAN)
+ * schedulability analysis: Refuted, revisited and revised", Real-Time Systems 35(3), 2007. Multi-frame transfers
+ * are modeled as a sequence of frames with the same ID that are enqueued all at once; higher priority frames can
+ * interleave with them, whereas lower priority frames can block only the first one. The response time is measured
+ * from the moment the transfer is enqueued to the end of its last frame.
+ *
+ * The analysis assumes that the TX queues of all nodes are ordered by CAN ID and that there are no errors on the bus.
+ */
+class ResponseTimeAnalyzer
+{
+public:
+    struct Stream
+    {
+        std::string name;
+        uavcan::DataTypeID data_type_id;
+        uavcan::TransferType transfer_type;
+        uavcan::TransferPriority priority;
+        uavcan::NodeID src_node_id;
+        uavcan::NodeID dst_node_id;             ///< Broadcast for messages
+        unsigned max_payload_len;               ///< Bytes, see makeMessageStream()
+        double period_usec;
+        double jitter_usec;                     ///< Release jitter
+        double deadline_usec;                   ///< Zero means that the deadline equals the period
+
+        Stream()
+            : transfer_type(uavcan::TransferTypeMessageBroadcast)
+            , priority(uavcan::TransferPriority::Default)
+            , max_payload_len(0)
+            , period_usec(0)
+            , jitter_usec(0)
+            , deadline_usec(0)
+        { }
+
+        double getDeadlineUSec() const { return (deadline_usec > 0) ? deadline_usec : period_usec; }
+    };
+
+    struct Result
+    {
+        Stream stream;
+        uavcan::CanFrame first_frame;           ///< As emitted by the transfer sender
+        unsigned num_frames;
+        unsigned num_bits;                      ///< Worst case, all frames of the transfer
+        double transmission_time_usec;          ///< Worst case, all frames of the transfer
+        double response_time_usec;              ///< Infinity if the bus is overloaded
+        unsigned num_instances;                 ///< Number of instances in the priority level-m busy period
+
+        Result()
+            : num_frames(0)
+            , num_bits(0)
+            , transmission_time_usec(0)
+            , response_time_usec(0)
+            , num_instances(0)
+        { }
+
+        bool isSchedulable() const { return response_time_usec <= stream.getDeadlineUSec(); }
+    };
+
+    struct Report
+    {
+        std::vector<Result> results;            ///< Ordered by priority, highest first
+        double utilization;                     ///< Worst case, 1.0 means 100%
+
+        Report() : utilization(0) { }
+
+        bool isSchedulable() const
+        {
+            return std::all_of(results.begin(), results.end(), [](const Result& r) { return r.isSchedulable(); });
+        }
+    };
+
+private:
+    struct TransferFrames
+    {
+        uavcan::CanFrame first_frame;
+        std::vector<unsigned> frame_bits;
+    };
+
+    std::vector<Stream> streams_;
+    std::uint32_t bit_rate_;
+
+    static TransferFrames compileTransfer(const Stream& s)
+    {
+        TransferFrames out;
+
+        uavcan::Frame frame(s.data_type_id, s.transfer_type, s.src_node_id, s.dst_node_id, uavcan::TransferID());
+        frame.setPriority(s.priority);
+        frame.setStartOfTransfer(true);
+
+        auto add_frame = [&out](const uavcan::Frame& frame)
+        {
+            uavcan::CanFrame can_frame;
+            if (!frame.compile(can_frame))
+            {
+                throw Exception("Invalid frame");
+            }
+            if (out.frame_bits.empty())
+            {
+                out.first_frame = can_frame;
+            }
+            out.frame_bits.push_back(uavcan::CanBusLoadEstimator::computeWorstCaseFrameBitLength(can_frame.dlc,
+                                                                                                 true));
+        };
+
+        // The payload contents don't matter - worst case stuffing is assumed anyway
+        const std::vector<std::uint8_t> payload(s.max_payload_len + sizeof(uavcan::CanFrame::data), 0);
+
+        /*
+         * This logic mirrors uavcan::TransferSender
+         */
+        if (frame.getPayloadCapacity() >= s.max_payload_len)
+        {
+            (void)frame.setPayload(payload.data(), s.max_payload_len);
+            frame.setEndOfTransfer(true);
+            add_frame(frame);
+        }
+        else
+        {
+            if (!s.src_node_id.isUnicast())
+            {
+                throw Exception("Multi-frame transfers are not allowed for anonymous nodes: " + s.name);
+            }
+
+            // First frame carries the transfer CRC
+            const int first_res = frame.setPayload(payload.data(), sizeof(uavcan::CanFrame::data));
+            if (first_res < 2)
+            {
+                throw Exception("Frame payload write failure");
+            }
+            unsigned offset = unsigned(first_res) - 2U;
+
+            while (true)
+            {
+                add_frame(frame);
+                if (frame.isEndOfTransfer())
+                {
+                    break;
+                }
+                frame.setStartOfTransfer(false);
+                frame.flipToggle();
+
+                const int res = frame.setPayload(payload.data() + offset, s.max_payload_len - offset);
+                if (res <= 0)
+                {
+                    throw Exception("Frame payload write failure");
+                }
+                offset += unsigned(res);
+                if (offset >= s.max_payload_len)
+                {
+                    frame.setEndOfTransfer(true);
+                }
+            }
+        }
+
+        return out;
+    }
+
+    static std::uint64_t ceilDiv(double a, double b)
+    {
+        return (a <= 0) ? 0 : std::uint64_t(std::ceil(a / b));
+    }
+
+public:
+    explicit ResponseTimeAnalyzer(std::uint32_t bit_rate = uavcan::CanBusLoadEstimator::DefaultBitRate)
+        : bit_rate_(bit_rate)
+    {
+        if (bit_rate_ == 0)
+        {
+            throw Exception("Invalid bit rate");
+        }
+    }
+
+    /**
+     * Creates a stream description for a message type generated by the DSDL compiler.
+     * The worst-case payload length is derived from the max bit length of the type.
+     */
+    template <typename DataType>
+    static Stream makeMessageStream(uavcan::NodeID src_node_id, double rate_hz,
+                                    uavcan::TransferPriority priority = uavcan::TransferPriority::Default)
+    {
+        static_assert(int(DataType::DataTypeKind) == int(uavcan::DataTypeKindMessage), "Message type expected");
+        Stream s;
+        s.name = DataType::getDataTypeFullName();
+        s.data_type_id = uavcan::DataTypeID(DataType::DefaultDataTypeID);
+        s.transfer_type = uavcan::TransferTypeMessageBroadcast;
+        s.priority = priority;
+        s.src_node_id = src_node_id;
+        s.dst_node_id = uavcan::NodeID::Broadcast;
+        s.max_payload_len = uavcan::BitLenToByteLen<DataType::MaxBitLen>::Result;
+        s.period_usec = 1e6 / rate_hz;
+        return s;
+    }
+
+    /**
+     * Creates a stream description for requests (request_not_response = true) or responses of a service type
+     * generated by the DSDL compiler. The source node is the one that emits the transfers.
+     */
+    template <typename DataType>
+    static Stream makeServiceStream(uavcan::NodeID src_node_id, uavcan::NodeID dst_node_id, double rate_hz,
+                                    bool request_not_response,
+                                    uavcan::TransferPriority priority = uavcan::TransferPriority::Default)
+    {
+        static_assert(int(DataType::DataTypeKind) == int(uavcan::DataTypeKindService), "Service type expected");
+        Stream s;
+        s.name = std::string(DataType::getDataTypeFullName()) + (request_not_response ? ".Request" : ".Response");
+        s.data_type_id = uavcan::DataTypeID(DataType::DefaultDataTypeID);
+        s.transfer_type = request_not_response ? uavcan::TransferTypeServiceRequest :
+                                                 uavcan::TransferTypeServiceResponse;
+        s.priority = priority;
+        s.src_node_id = src_node_id;
+        s.dst_node_id = dst_node_id;
+        s.max_payload_len = request_not_response ?
+                            unsigned(uavcan::BitLenToByteLen<DataType::Request::MaxBitLen>::Result) :
+                            unsigned(uavcan::BitLenToByteLen<DataType::Response::MaxBitLen>::Result);
+        s.period_usec = 1e6 / rate_hz;
+        return s;
+    }
+
+    /**
+     * Throws if the stream description is invalid.
+     */
+    void addStream(const Stream& s)
+    {
+        const uavcan::DataTypeKind kind = (s.transfer_type == uavcan::TransferTypeMessageBroadcast) ?
+                                          uavcan::DataTypeKindMessage : uavcan::DataTypeKindService;
+        if (!s.data_type_id.isValidForDataTypeKind(kind))
+        {
+            throw Exception("Invalid data type ID: " + s.name);
+        }
+        if (!s.priority.isValid() || !s.src_node_id.isValid() || !(s.period_usec > 0) || (s.jitter_usec < 0) ||
+            ((s.transfer_type == uavcan::TransferTypeMessageBroadcast) != s.dst_node_id.isBroadcast()) ||
+            (s.src_node_id == s.dst_node_id))
+        {
+            throw Exception("Invalid stream: " + s.name);
+        }
+        streams_.push_back(s);
+    }
+
+    const std::vector<Stream>& getStreams() const { return streams_; }
+
+    std::uint32_t getBitRate() const { return bit_rate_; }
+
+    double getBitTimeUSec() const { return 1e6 / double(bit_rate_); }
+
+    Report analyze() const
+    {
+        const double bit_time = getBitTimeUSec();
+
+        struct Entry
+        {
+            Result result;
+            double last_frame_time;
+            double max_frame_time;
+        };
+        std::vector<Entry> entries;
+
+        for (const Stream& s : streams_)
+        {
+            const TransferFrames frames = compileTransfer(s);
+            Entry e;
+            e.result.stream = s;
+            e.result.first_frame = frames.first_frame;
+            e.result.num_frames = unsigned(frames.frame_bits.size());
+            for (unsigned bits : frames.frame_bits)
+            {
+                e.result.num_bits += bits;
+            }
+            e.result.transmission_time_usec = e.result.num_bits * bit_time;
+            e.last_frame_time = frames.frame_bits.back() * bit_time;
+            e.max_frame_time = *std::max_element(frames.frame_bits.begin(), frames.frame_bits.end()) * bit_time;
+            entries.push_back(e);
+        }
+
+        std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b)
+        {
+            return a.result.first_frame.priorityHigherThan(b.result.first_frame);
+        });
+
+        for (std::size_t i = 1; i < entries.size(); i++)
+        {
+            if (!entries[i - 1].result.first_frame.priorityHigherThan(entries[i].result.first_frame))
+            {
+                throw Exception("Streams " + entries[i - 1].result.stream.name + " and " +
+                                entries[i].result.stream.name + " have the same CAN ID");
+            }
+        }
+
+        Report report;
+        for (const Entry& e : entries)
+        {
+            report.utilization += e.result.transmission_time_usec / e.result.stream.period_usec;
+        }
+
+        const double infinity = std::numeric_limits<double>::infinity();
+
+        for (std::size_t m = 0; m < entries.size(); m++)
+        {
+            Result& res = entries[m].result;
+            const double C_m = res.transmission_time_usec;
+            const double T_m = res.stream.period_usec;
+            const double J_m = res.stream.jitter_usec;
+            const double D_m = res.stream.getDeadlineUSec();
+            const double C_last = entries[m].last_frame_time;
+
+            // Blocking by a lower priority frame that has just started the transmission
+            double B_m = 0;
+            for (std::size_t k = m + 1; k < entries.size(); k++)
+            {
+                B_m = std::max(B_m, entries[k].max_frame_time);
+            }
+
+            // Priority level-m busy period; unbounded if the higher or equal priority load saturates the bus
+            double hep_utilization = 0;
+            for (std::size_t k = 0; k <= m; k++)
+            {
+                hep_utilization += entries[k].result.transmission_time_usec / entries[k].result.stream.period_usec;
+            }
+            if (hep_utilization >= 1.0)
+            {
+                res.response_time_usec = infinity;
+                continue;
+            }
+
+            double t = C_m;
+            while (true)
+            {
+                double next = B_m;
+                for (std::size_t k = 0; k <= m; k++)
+                {
+                    const Stream& sk = entries[k].result.stream;
+                    next += double(ceilDiv(t + sk.jitter_usec, sk.period_usec)) *
+                            entries[k].result.transmission_time_usec;
+                }
+                if (next <= t)
+                {
+                    break;
+                }
+                t = next;
+            }
+            res.num_instances = unsigned(std::max<std::uint64_t>(1, ceilDiv(t + J_m, T_m)));
+
+            // Response time of every instance within the busy period, the worst one is reported
+            res.response_time_usec = 0;
+            for (unsigned q = 0; q < res.num_instances; q++)
+            {
+                const double w_base = B_m + q * C_m + (C_m - C_last);
+                double w = w_base;
+                bool overrun = false;
+                while (true)
+                {
+                    double next = w_base;
+                    for (std::size_t k = 0; k < m; k++)
+                    {
+                        const Stream& sk = entries[k].result.stream;
+                        next += double(ceilDiv(w + sk.jitter_usec + bit_time, sk.period_usec)) *
+                                entries[k].result.transmission_time_usec;
+                    }
+                    if (next <= w)
+                    {
+                        break;
+                    }
+                    w = next;
+                    if ((J_m + w - q * T_m + C_last) > D_m)
+                    {
+                        overrun = true;                         // No need to go further - deadline is missed
+                        break;
+                    }
+                }
+                res.response_time_usec = std::max(res.response_time_usec, J_m + w - q * T_m + C_last);
+                if (overrun)
+                {
+                    break;
+                }
+            }
+        }
+
+        for (const Entry& e : entries)
+        {
+            report.results.push_back(e.result);
+        }
+        return report;
+    }
+};
+
+}
@@ -0,0 +1,699 @@
+/*
+ * Copyright (C) 2015 Pavel Kirienko <pavel.kirienko@gmail.com>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include <uavcan/uavcan.hpp>
+#include <uavcan_linux/clock.hpp>
+#include <uavcan_linux/exception.hpp>
+
+namespace uavcan_linux
+{
+/**
+ * Bounded lock-free ring buffer for exactly one producer thread and exactly one consumer thread.
+ * Both push and pop are wait-free and O(1). Capacity must be a power of two.
+ */
+template <typename T, unsigned Capacity>
+class SpscRingBuffer : uavcan::Noncopyable
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    static constexpr unsigned CacheLineSize = 64;
+
+    // Indexes are kept in different cache lines in order to avoid false sharing between the threads
+    std::atomic<std::uint32_t> head_;                       ///< Written by consumer only
+    char padding_[CacheLineSize];
+    std::atomic<std::uint32_t> tail_;                       ///< Written by producer only
+    char padding2_[CacheLineSize];
+    T items_[Capacity];
+
+public:
+    SpscRingBuffer()
+        : head_(0)
+        , tail_(0)
+    { }
+
+    /**
+     * Producer side. Returns false if the buffer is full.
+     */
+    bool tryPush(const T& item)
+    {
+        const std::uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if ((tail - head_.load(std::memory_order_acquire)) >= Capacity)
+        {
+            return false;
+        }
+        items_[tail % Capacity] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Consumer side. Returns false if the buffer is empty.
+     */
+    bool tryPop(T& out_item)
+    {
+        const std::uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        out_item = items_[head % Capacity];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * These can be called from any thread; the result is only a snapshot.
+     */
+    bool isEmpty() const { return getSize() == 0; }
+    bool isFull() const { return getSize() >= Capacity; }
+    unsigned getSize() const
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    static constexpr unsigned getCapacity() { return Capacity; }
+};
+
+/**
+ * Bounded lock-free ring buffer for any number of producer threads and exactly one consumer thread.
+ * Every slot carries a sequence number, so that producers claim slots with a single CAS on the tail index,
+ * and the consumer never has to wait for producers other than the one that owns the slot at the head.
+ * Push is lock-free and O(1), pop is wait-free and O(1). Capacity must be a power of two.
+ */
+template <typename T, unsigned Capacity>
+class MpscRingBuffer : uavcan::Noncopyable
+{
+    static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    static constexpr unsigned CacheLineSize = 64;
+
+    struct Cell
+    {
+        std::atomic<std::uint32_t> sequence;
+        T item;
+    };
+
+    // Indexes are kept in different cache lines in order to avoid false sharing between the threads
+    std::atomic<std::uint32_t> tail_;                       ///< Shared among producers
+    char padding_[CacheLineSize];
+    std::atomic<std::uint32_t> head_;                       ///< Written by consumer only
+    char padding2_[CacheLineSize];
+    Cell cells_[Capacity];
+
+public:
+    MpscRingBuffer()
+        : tail_(0)
+        , head_(0)
+    {
+        for (unsigned i = 0; i < Capacity; i++)
+        {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Producer side; can be called concurrently from any number of threads. Returns false if the buffer is full.
+     */
+    bool tryPush(const T& item)
+    {
+        std::uint32_t pos = tail_.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+        while (true)
+        {
+            cell = &cells_[pos % Capacity];
+            const std::uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+            const std::int32_t diff = static_cast<std::int32_t>(seq - pos);
+            if (diff == 0)
+            {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->item = item;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Consumer side. Returns false if the buffer is empty, or if the producer that owns the head slot
+     * has not finished writing it yet.
+     */
+    bool tryPop(T& out_item)
+    {
+        const std::uint32_t pos = head_.load(std::memory_order_relaxed);
+        Cell& cell = cells_[pos % Capacity];
+        if (cell.sequence.load(std::memory_order_acquire) != (pos + 1))
+        {
+            return false;
+        }
+        out_item = cell.item;
+        cell.sequence.store(pos + Capacity, std::memory_order_release);
+        head_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * These can be called from any thread; the result is only a snapshot.
+     */
+    bool isEmpty() const { return getSize() == 0; }
+    bool isFull() const { return getSize() >= Capacity; }
+    unsigned getSize() const
+    {
+        const std::uint32_t head = head_.load(std::memory_order_acquire);
+        const std::uint32_t tail = tail_.load(std::memory_order_acquire);
+        return static_cast<std::int32_t>(tail - head) > 0 ? (tail - head) : 0;
+    }
+
+    static constexpr unsigned getCapacity() { return Capacity; }
+};
+
+/**
+ * Wakeup event based on eventfd.
+ * One thread blocks in @ref waitFor(), any other thread calls @ref signal() after it has produced data.
+ * The system call in @ref signal() is only made if the waiting thread is actually about to block, so the
+ * event costs nothing while the consumer keeps up with the producers.
+ */
+class EventFd : uavcan::Noncopyable
+{
+    const int fd_;
+    std::atomic<bool> waiting_;
+
+    static int openEventFd()
+    {
+        const int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0)
+        {
+            throw Exception("Failed to open eventfd");
+        }
+        return fd;
+    }
+
+    void drain()
+    {
+        std::uint64_t value = 0;
+        while (::read(fd_, &value, sizeof(value)) == sizeof(value)) { }
+    }
+
+public:
+    /**
+     * @throws uavcan_linux::Exception.
+     */
+    EventFd()
+        : fd_(openEventFd())
+        , waiting_(false)
+    { }
+
+    ~EventFd() { (void)::close(fd_); }
+
+    /**
+     * Wakes up the waiting thread, if any. Can be called from any thread.
+     * The caller must publish its data before calling this method.
+     */
+    void signal()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);    // Pairs with the fence in waitFor()
+        if (waiting_.load(std::memory_order_relaxed))
+        {
+            const std::uint64_t one = 1;
+            (void)::write(fd_, &one, sizeof(one));
+        }
+    }
+
+    /**
+     * Blocks until signaled, the timeout expires, or the predicate becomes true.
+     * The predicate is checked after the waiting flag is raised, so that a concurrent @ref signal() can not
+     * be lost. This method may return spuriously.
+     * @return Negative errno on failure, non-negative otherwise.
+     */
+    template <typename Predicate>
+    int waitFor(uavcan::MonotonicDuration timeout, Predicate ready)
+    {
+        waiting_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        int res = 0;
+        if (!ready() && timeout.isPositive())
+        {
+            const std::int64_t timeout_usec = timeout.toUSec();
+            auto ts = ::timespec();
+            ts.tv_sec = timeout_usec / 1000000LL;
+            ts.tv_nsec = (timeout_usec % 1000000LL) * 1000;
+
+            ::pollfd pfd = ::pollfd();
+            pfd.fd = fd_;
+            pfd.events = POLLIN;
+            res = ::ppoll(&pfd, 1, &ts, nullptr);
+            if (res < 0)
+            {
+                res = (errno == EINTR) ? 0 : -errno;
+            }
+        }
+
+        waiting_.store(false, std::memory_order_relaxed);
+        drain();
+        return res;
+    }
+
+    /**
+     * The descriptor becomes readable when the event is signaled; it can be added to an external poll set.
+     */
+    int getFd() const { return fd_; }
+};
+
+/**
+ * One CAN frame on its way from a sub-node to the main node.
+ */
+struct VirtualCanTxFrame
+{
+    uavcan::CanFrame frame;
+    uavcan::MonotonicTime deadline;
+    uavcan::CanIOFlags flags = 0;
+    std::uint8_t iface_mask = 0;
+};
+
+/**
+ * One CAN frame on its way from the main node to a sub-node.
+ */
+struct VirtualCanRxFrame
+{
+    uavcan::CanRxFrame frame;
+    uavcan::CanIOFlags flags = 0;
+};
+
+class VirtualCanDriver;
+
+/**
+ * Main node side of the virtual CAN bus that connects sub-nodes running in other threads to the main node.
+ *
+ * Frames transmitted by all sub-nodes are collected in one shared bounded lock-free MPSC ring; the main node
+ * thread periodically drains it into the TX queue of the main node using @ref injectTxFramesInto().
+ * Frames received by the main node are delivered to every attached sub-node via its own SPSC ring;
+ * this class implements @ref uavcan::IRxFrameListener for that purpose, so it should be installed into
+ * the main node via @ref uavcan::INode::installRxFrameListener().
+ *
+ * Usage:
+ *     uavcan_linux::VirtualCanBridge bridge;
+ *     main_node->installRxFrameListener(&bridge);
+ *     auto driver = std::make_shared<uavcan_linux::VirtualCanDriver>(bridge, main_node->getDispatcher()
+ *                                                                      .getCanIOManager().getNumIfaces());
+ *     auto sub_node = uavcan_linux::makeSubNode(driver);
+ *     // Main node thread:
+ *     main_node->spin(...);
+ *     bridge.injectTxFramesInto(*main_node);
+ *
+ * Drivers attach themselves to the bridge upon construction and detach upon destruction, so sub-nodes can be
+ * added and removed while the main node and the other sub-nodes keep running. A driver can be destroyed once its
+ * sub-node has stopped using it; the bridge can only be destroyed once all drivers are gone.
+ */
+class VirtualCanBridge : public uavcan::IRxFrameListener,
+                         uavcan::Noncopyable
+{
+public:
+    static constexpr unsigned TxQueueCapacity = 1024;       ///< Shared across all sub-nodes
+    static constexpr unsigned MaxDrivers = 32;
+
+private:
+    friend class VirtualCanDriver;
+
+    MpscRingBuffer<VirtualCanTxFrame, TxQueueCapacity> tx_queue_;
+    EventFd tx_event_;                                      ///< Wakes up the main node thread
+    std::atomic<bool> tx_queue_overflow_;                   ///< Sub-nodes are waiting for free space
+
+    std::mutex attach_mutex_;                               ///< Guards the driver list; contended only by (de)attach
+    VirtualCanDriver* drivers_[MaxDrivers];
+    std::atomic<unsigned> num_drivers_;
+
+    std::uint64_t num_injection_failures_ = 0;
+
+    /**
+     * Called by sub-node threads.
+     */
+    bool pushTxFrame(const VirtualCanTxFrame& frame)
+    {
+        if (!tx_queue_.tryPush(frame))
+        {
+            return false;
+        }
+        tx_event_.signal();
+        return true;
+    }
+
+    /**
+     * Called by sub-node threads when they need to block until the TX queue has free space.
+     */
+    void requestTxSpaceNotification() { tx_queue_overflow_.store(true); }
+
+    void attach(VirtualCanDriver& driver)
+    {
+        std::lock_guard<std::mutex> lock(attach_mutex_);
+        const unsigned index = num_drivers_.load(std::memory_order_relaxed);
+        if (index >= MaxDrivers)
+        {
+            throw Exception("Too many virtual CAN drivers");
+        }
+        drivers_[index] = &driver;
+        num_drivers_.store(index + 1, std::memory_order_release);
+    }
+
+    void detach(VirtualCanDriver& driver)
+    {
+        std::lock_guard<std::mutex> lock(attach_mutex_);
+        const unsigned num_drivers = num_drivers_.load(std::memory_order_relaxed);
+        for (unsigned i = 0; i < num_drivers; i++)
+        {
+            if (drivers_[i] == &driver)
+            {
+                drivers_[i] = drivers_[num_drivers - 1];
+                drivers_[num_drivers - 1] = nullptr;
+                num_drivers_.store(num_drivers - 1, std::memory_order_release);
+                break;
+            }
+        }
+    }
+
+    inline void notifyDriversTxSpaceAvailable();
+
+public:
+    VirtualCanBridge()
+        : tx_queue_overflow_(false)
+        , drivers_()
+        , num_drivers_(0)
+    { }
+
+    /**
+     * This handler will be invoked by the main node thread.
+     * The frame is delivered to every attached sub-node that has an interface with the same index.
+     * The driver list is locked during delivery, so that drivers can't be destroyed halfway.
+     */
+    inline void handleRxFrame(const uavcan::CanRxFrame& frame, uavcan::CanIOFlags flags) override;
+
+    /**
+     * Drains the shared TX queue, calling the handler for every frame in FIFO order.
+     * Handler signature: void (const VirtualCanTxFrame&).
+     * This method must be invoked by the main node thread only.
+     * @return Number of frames processed.
+     */
+    template <typename Handler>
+    unsigned drainTxQueue(Handler handler)
+    {
+        unsigned count = 0;
+        VirtualCanTxFrame item;
+        while (tx_queue_.tryPop(item))
+        {
+            handler(item);
+            count++;
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);    // Free space must be visible before the flag check
+        if (tx_queue_overflow_.load() && tx_queue_overflow_.exchange(false))
+        {
+            notifyDriversTxSpaceAvailable();
+        }
+        return count;
+    }
+
+    /**
+     * Moves all pending TX frames of all sub-nodes into the TX queue of the main node.
+     * The main node will prioritize them by CAN ID, as usual.
+     * This method must be invoked by the main node thread only.
+     * @return Number of frames processed.
+     */
+    unsigned injectTxFramesInto(uavcan::INode& main_node)
+    {
+        return drainTxQueue([this, &main_node](const VirtualCanTxFrame& e)
+            {
+                UAVCAN_TRACE("VirtualCanBridge", "TX injection [iface=0x%02x]: %s",
+                             unsigned(e.iface_mask), e.frame.toString().c_str());
+                const int res = main_node.injectTxFrame(e.frame, e.deadline, e.iface_mask,
+                                                        uavcan::CanTxQueue::Volatile, e.flags);
+                if (res <= 0)
+                {
+                    num_injection_failures_++;
+                }
+            });
+    }
+
+    /**
+     * Blocks the main node thread until any sub-node has transmitted a frame, or until the timeout expires.
+     * Alternatively, the descriptor returned by @ref getTxEventFd() can be added to an external poll set.
+     */
+    int waitForTxFrames(uavcan::MonotonicDuration timeout)
+    {
+        return tx_event_.waitFor(timeout, [this]() { return !tx_queue_.isEmpty(); });
+    }
+
+    int getTxEventFd() const { return tx_event_.getFd(); }
+
+    unsigned getNumAttachedDrivers() const { return num_drivers_.load(std::memory_order_acquire); }
+
+    /**
+     * Number of frames that were dropped because the TX queue of the main node was full.
+     */
+    std::uint64_t getNumInjectionFailures() const { return num_injection_failures_; }
+};
+
+/**
+ * Sub-node side of the virtual CAN bus; see @ref VirtualCanBridge.
+ * Objects of this class are owned by the sub-node thread. This class does not use heap memory.
+ *
+ * Transmission never blocks: frames are pushed into the shared lock-free TX queue of the bridge in O(1);
+ * if the queue is full, the interface reports that it is not ready to write, and the frames remain in the
+ * prioritized TX queue of the sub-node until the main node thread drains the bridge.
+ * Received frames are stored in a per-interface SPSC ring; if the ring is full, new frames are dropped.
+ * The sub-node thread sleeps on an eventfd while there is nothing to do.
+ */
+class VirtualCanDriver : public uavcan::ICanDriver,
+                         uavcan::Noncopyable
+{
+public:
+    static constexpr unsigned RxQueueCapacity = 512;        ///< Per interface
+
+private:
+    friend class VirtualCanBridge;
+
+    class Iface : public uavcan::ICanIface,
+                  uavcan::Noncopyable
+    {
+        friend class VirtualCanDriver;
+
+        VirtualCanBridge& bridge_;
+        const std::uint8_t iface_mask_;
+        SpscRingBuffer<VirtualCanRxFrame, RxQueueCapacity> rx_queue_;
+        std::atomic<std::uint64_t> num_rx_overflows_;
+
+        std::int16_t send(const uavcan::CanFrame& frame, uavcan::MonotonicTime tx_deadline,
+                          uavcan::CanIOFlags flags) override
+        {
+            VirtualCanTxFrame item;
+            item.frame = frame;
+            item.deadline = tx_deadline;
+            item.flags = flags;
+            item.iface_mask = iface_mask_;
+            return bridge_.pushTxFrame(item) ? 1 : 0;
+        }
+
+        std::int16_t receive(uavcan::CanFrame& out_frame, uavcan::MonotonicTime& out_ts_monotonic,
+                             uavcan::UtcTime& out_ts_utc, uavcan::CanIOFlags& out_flags) override
+        {
+            VirtualCanRxFrame item;
+            if (!rx_queue_.tryPop(item))
+            {
+                return 0;
+            }
+            out_frame = item.frame;
+            out_ts_monotonic = item.frame.ts_mono;
+            out_ts_utc = item.frame.ts_utc;
+            out_flags = item.flags;
+            return 1;
+        }
+
+        std::int16_t configureFilters(const uavcan::CanFilterConfig*, std::uint16_t) override
+        {
+            return -uavcan::ErrDriver;
+        }
+        std::uint16_t getNumFilters() const override { return 0; }
+        std::uint64_t getErrorCount() const override { return num_rx_overflows_.load(std::memory_order_relaxed); }
+
+    public:
+        Iface(VirtualCanBridge& bridge, std::uint8_t iface_index)
+            : bridge_(bridge)
+            , iface_mask_(static_cast<std::uint8_t>(1U << iface_index))
+            , num_rx_overflows_(0)
+        { }
+    };
+
+    VirtualCanBridge& bridge_;
+    EventFd event_;             ///< Used to unblock the select() call when IO happens.
+    uavcan::LazyConstructor<Iface> ifaces_[uavcan::MaxCanIfaces];
+    const std::uint8_t num_ifaces_;
+    SystemClock clock_;
+
+    /**
+     * Called by the main node thread.
+     */
+    void addRxFrame(const uavcan::CanRxFrame& frame, uavcan::CanIOFlags flags)
+    {
+        if (frame.iface_index >= num_ifaces_)
+        {
+            return;
+        }
+        Iface& iface = *ifaces_[frame.iface_index];
+        VirtualCanRxFrame item;
+        item.frame = frame;
+        item.flags = flags;
+        if (iface.rx_queue_.tryPush(item))
+        {
+            event_.signal();
+        }
+        else
+        {
+            iface.num_rx_overflows_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool hasReadyRx(std::uint8_t read_mask) const
+    {
+        for (std::uint8_t i = 0; i < num_ifaces_; i++)
+        {
+            if ((read_mask & (1U << i)) && !ifaces_[i]->rx_queue_.isEmpty())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uavcan::ICanIface* getIface(std::uint8_t iface_index) override
+    {
+        return (iface_index < num_ifaces_) ? static_cast<Iface*>(ifaces_[iface_index]) : nullptr;
+    }
+
+    std::uint8_t getNumIfaces() const override { return num_ifaces_; }
+
+    /**
+     * This and other methods of ICanDriver will be invoked by the sub-node thread.
+     */
+    std::int16_t select(uavcan::CanSelectMasks& inout_masks,
+                        const uavcan::CanFrame* (&)[uavcan::MaxCanIfaces],
+                        uavcan::MonotonicTime blocking_deadline) override
+    {
+        const std::uint8_t read_mask = inout_masks.read;
+        const bool need_write = inout_masks.write != 0;
+
+        auto ready = [this, read_mask, need_write]()
+        {
+            return hasReadyRx(read_mask) || (need_write && !bridge_.tx_queue_.isFull());
+        };
+
+        if (!ready())
+        {
+            if (need_write)
+            {
+                bridge_.requestTxSpaceNotification();
+            }
+            const int res = event_.waitFor(blocking_deadline - clock_.getMonotonic(), ready);
+            if (res < 0)
+            {
+                return static_cast<std::int16_t>(res);
+            }
+        }
+
+        inout_masks = uavcan::CanSelectMasks();
+        const bool can_write = !bridge_.tx_queue_.isFull();
+        for (std::uint8_t i = 0; i < num_ifaces_; i++)
+        {
+            const std::uint8_t iface_mask = static_cast<std::uint8_t>(1U << i);
+            if (can_write)
+            {
+                inout_masks.write |= iface_mask;
+            }
+            if (!ifaces_[i]->rx_queue_.isEmpty())
+            {
+                inout_masks.read |= iface_mask;
+            }
+        }
+        return num_ifaces_;
+    }
+
+public:
+    /**
+     * The driver attaches itself to the bridge; the bridge must outlive the driver.
+     * @throws uavcan_linux::Exception.
+     */
+    VirtualCanDriver(VirtualCanBridge& bridge, unsigned num_ifaces)
+        : bridge_(bridge)
+        , num_ifaces_(static_cast<std::uint8_t>(num_ifaces))
+    {
+        if (num_ifaces == 0 || num_ifaces > uavcan::MaxCanIfaces)
+        {
+            throw Exception("Invalid number of virtual CAN ifaces");
+        }
+        for (std::uint8_t i = 0; i < num_ifaces_; i++)
+        {
+            ifaces_[i].construct<VirtualCanBridge&, std::uint8_t>(bridge_, i);
+        }
+        bridge_.attach(*this);
+    }
+
+    /**
+     * Once this returns, the main node thread no longer delivers frames to this driver.
+     */
+    ~VirtualCanDriver() { bridge_.detach(*this); }
+
+    /**
+     * Number of received frames that were dropped because the RX queue of the sub-node was full.
+     */
+    std::uint64_t getNumRxOverflows() const
+    {
+        std::uint64_t sum = 0;
+        for (std::uint8_t i = 0; i < num_ifaces_; i++)
+        {
+            sum += ifaces_[i]->num_rx_overflows_.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+};
+
+inline void VirtualCanBridge::notifyDriversTxSpaceAvailable()
+{
+    std::lock_guard<std::mutex> lock(attach_mutex_);
+    const unsigned num_drivers = num_drivers_.load(std::memory_order_acquire);
+    for (unsigned i = 0; i < num_drivers; i++)
+    {
+        drivers_[i]->event_.signal();
+    }
+}
+
+inline void VirtualCanBridge::handleRxFrame(const uavcan::CanRxFrame& frame, uavcan::CanIOFlags flags)
+{
+    UAVCAN_TRACE("VirtualCanBridge", "RX [flags=%u]: %s", unsigned(flags), frame.toString().c_str());
+    std::lock_guard<std::mutex> lock(attach_mutex_);
+    const unsigned num_drivers = num_drivers_.load(std::memory_order_acquire);
+    for (unsigned i = 0; i < num_drivers; i++)
+    {
+        drivers_[i]->addRxFrame(frame, flags);
+    }
+}
+
+}
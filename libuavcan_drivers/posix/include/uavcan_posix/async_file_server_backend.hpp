@@ -0,0 +1,377 @@
+/****************************************************************************
+*
+*   Copyright (c) 2015 PX4 Development Team. All rights reserved.
+*      Author: Pavel Kirienko <pavel.kirienko@gmail.com>
+*
+****************************************************************************/
+
+#ifndef UAVCAN_POSIX_ASYNC_FILE_SERVER_BACKEND_HPP_INCLUDED
+#define UAVCAN_POSIX_ASYNC_FILE_SERVER_BACKEND_HPP_INCLUDED
+
+#include <pthread.h>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <uavcan/node/scheduler.hpp>
+#include <uavcan/protocol/file_server.hpp>
+#include <uavcan_posix/basic_file_server_backend.hpp>
+
+namespace uavcan_posix
+{
+/**
+ * This backend executes uavcan.protocol.file.Read requests in a pool of worker threads, so that the disk
+ * latency does not stall the node thread when many nodes are reading files at once (e.g. during a firmware
+ * update of the whole bus). The data is read with @ref readBlock() (or from the block cache, if enabled);
+ * every worker keeps its own file descriptor open while there are requests in the queue.
+ *
+ * Completed reads are passed back to the file server from the node thread, right after the IO processing
+ * (see @ref uavcan::SpinHandler); the worst case extra latency is defined by the deadline resolution of
+ * the scheduler. If all read slots are busy, the file server falls back to the synchronous read.
+ *
+ * All other operations are inherited from @ref BasicFileServerBackend and executed synchronously.
+ */
+class AsyncFileServerBackend : public BasicFileServerBackend,
+                               private uavcan::SpinHandler
+{
+public:
+    enum { DefaultNumWorkers = 4 };
+    enum { DefaultMaxPendingReads = 32 };
+
+private:
+    enum { MaxPathLength = uavcan::protocol::file::Path::FieldTypes::path::MaxSize };
+
+    struct ReadJob
+    {
+        ReadJob* next;
+        uavcan::IFileReadCompletionHandler* handler;   ///< NULL if the read was cancelled
+        uavcan::ServiceResponseToken token;
+        uavcan::uint64_t offset;
+        uavcan::int16_t error;
+        uavcan::uint16_t size;
+        char path[MaxPathLength + 1];
+        uavcan::uint8_t data[ReadSize];
+    };
+
+    struct JobQueue
+    {
+        ReadJob* head;
+        ReadJob* tail;
+
+        JobQueue() : head(NULL), tail(NULL) { }
+
+        void push(ReadJob* job)
+        {
+            job->next = NULL;
+            if (tail == NULL)
+            {
+                head = job;
+            }
+            else
+            {
+                tail->next = job;
+            }
+            tail = job;
+        }
+
+        ReadJob* pop()
+        {
+            ReadJob* const job = head;
+            if (job != NULL)
+            {
+                head = job->next;
+                if (head == NULL)
+                {
+                    tail = NULL;
+                }
+                job->next = NULL;
+            }
+            return job;
+        }
+    };
+
+    struct Worker
+    {
+        AsyncFileServerBackend* owner;
+        pthread_t thread;
+        int fd;
+        char path[MaxPathLength + 1];
+    };
+
+    const unsigned num_workers_;
+    const unsigned max_pending_reads_;
+
+    pthread_mutex_t mutex_;
+    pthread_cond_t cond_;                ///< Signaled when new requests are added or when stopping
+
+    Worker* workers_;
+    ReadJob* jobs_;
+    ReadJob* free_jobs_;
+    JobQueue requests_;
+    JobQueue completions_;
+    unsigned num_started_workers_;
+    bool stop_;
+
+    uavcan::uint32_t num_async_reads_;
+    uavcan::uint32_t num_sync_fallbacks_;
+
+    static void closeFile(Worker& worker)
+    {
+        if (worker.fd >= 0)
+        {
+            (void)::close(worker.fd);
+            worker.fd = -1;
+        }
+        worker.path[0] = '\0';
+    }
+
+    void execute(Worker& worker, ReadJob& job)
+    {
+        using namespace std;
+
+        job.size = 0;
+
+        if (job.path[0] == '\0')
+        {
+            job.error = uavcan::protocol::file::Error::INVALID_VALUE;
+            return;
+        }
+
+        if ((worker.fd < 0) || (0 != ::strcmp(worker.path, job.path)))
+        {
+            closeFile(worker);
+            worker.fd = ::open(job.path, O_RDONLY);
+            if (worker.fd < 0)
+            {
+                job.error = static_cast<uavcan::int16_t>(errno);
+                return;
+            }
+            (void)::strncpy(worker.path, job.path, MaxPathLength);
+            worker.path[MaxPathLength] = '\0';
+        }
+
+        job.size = ReadSize;
+        job.error = readCached(worker.fd, job.offset, job.data, job.size);
+        if (job.error != 0)
+        {
+            job.size = 0;
+            closeFile(worker);       // The file may have been replaced or removed
+        }
+    }
+
+    void runWorker(Worker& worker)
+    {
+        (void)pthread_mutex_lock(&mutex_);
+        while (!stop_)
+        {
+            ReadJob* const job = requests_.pop();
+            if (job == NULL)
+            {
+                if (worker.fd >= 0)
+                {
+                    // Not keeping the file open while idle, otherwise updated files would not be noticed
+                    (void)pthread_mutex_unlock(&mutex_);
+                    closeFile(worker);
+                    (void)pthread_mutex_lock(&mutex_);
+                }
+                else
+                {
+                    (void)pthread_cond_wait(&cond_, &mutex_);
+                }
+                continue;
+            }
+
+            (void)pthread_mutex_unlock(&mutex_);
+            execute(worker, *job);
+            (void)pthread_mutex_lock(&mutex_);
+
+            completions_.push(job);
+        }
+        (void)pthread_mutex_unlock(&mutex_);
+        closeFile(worker);
+    }
+
+    static void* workerEntryPoint(void* arg)
+    {
+        Worker* const worker = static_cast<Worker*>(arg);
+        worker->owner->runWorker(*worker);
+        return NULL;
+    }
+
+    virtual void handleSpin(uavcan::MonotonicTime)
+    {
+        (void)pthread_mutex_lock(&mutex_);
+        JobQueue completed = completions_;
+        completions_ = JobQueue();
+        (void)pthread_mutex_unlock(&mutex_);
+
+        // The handlers are invoked without the lock held, so they are free to start new reads
+        while (ReadJob* const job = completed.pop())
+        {
+            uavcan::IFileReadCompletionHandler* const handler = job->handler;
+            if (handler != NULL)
+            {
+                handler->handleReadCompletion(job->token, job->error, job->data, job->size);
+            }
+            (void)pthread_mutex_lock(&mutex_);
+            job->next = free_jobs_;
+            free_jobs_ = job;
+            (void)pthread_mutex_unlock(&mutex_);
+        }
+    }
+
+    void stopWorkers()
+    {
+        (void)pthread_mutex_lock(&mutex_);
+        stop_ = true;
+        (void)pthread_cond_broadcast(&cond_);
+        (void)pthread_mutex_unlock(&mutex_);
+
+        for (unsigned i = 0; i < num_started_workers_; i++)
+        {
+            (void)pthread_join(workers_[i].thread, NULL);
+        }
+        num_started_workers_ = 0;
+        uavcan::SpinHandler::stop();
+    }
+
+public:
+    /**
+     * @param block_cache_size  Same as for @ref BasicFileServerBackend; the cache is shared by all workers.
+     */
+    AsyncFileServerBackend(uavcan::INode& node,
+                           unsigned num_workers = DefaultNumWorkers,
+                           unsigned max_pending_reads = DefaultMaxPendingReads,
+                           std::size_t block_cache_size = 0)
+        : BasicFileServerBackend(node, block_cache_size)
+        , uavcan::SpinHandler(node.getScheduler())
+        , num_workers_((num_workers > 0) ? num_workers : 1)
+        , max_pending_reads_((max_pending_reads > 0) ? max_pending_reads : 1)
+        , workers_(NULL)
+        , jobs_(NULL)
+        , free_jobs_(NULL)
+        , num_started_workers_(0)
+        , stop_(false)
+        , num_async_reads_(0)
+        , num_sync_fallbacks_(0)
+    {
+        (void)pthread_mutex_init(&mutex_, NULL);
+        (void)pthread_cond_init(&cond_, NULL);
+    }
+
+    virtual ~AsyncFileServerBackend()
+    {
+        stopWorkers();
+        delete[] workers_;
+        delete[] jobs_;
+        (void)pthread_cond_destroy(&cond_);
+        (void)pthread_mutex_destroy(&mutex_);
+    }
+
+    /**
+     * Starts the worker threads. Until this method is called, all reads are executed synchronously.
+     * Returns negative error code.
+     */
+    int init()
+    {
+        if (num_started_workers_ > 0)
+        {
+            return 0;
+        }
+
+        if (jobs_ == NULL)
+        {
+            jobs_ = new ReadJob[max_pending_reads_];
+            workers_ = new Worker[num_workers_];
+            for (unsigned i = 0; i < max_pending_reads_; i++)
+            {
+                jobs_[i].next = free_jobs_;
+                free_jobs_ = &jobs_[i];
+            }
+        }
+
+        stop_ = false;
+        for (unsigned i = 0; i < num_workers_; i++)
+        {
+            workers_[i].owner = this;
+            workers_[i].fd = -1;
+            workers_[i].path[0] = '\0';
+            if (0 != pthread_create(&workers_[i].thread, NULL, &AsyncFileServerBackend::workerEntryPoint,
+                                    &workers_[i]))
+            {
+                stopWorkers();
+                return -uavcan::ErrFailure;
+            }
+            num_started_workers_++;
+        }
+
+        uavcan::SpinHandler::start();
+        return 0;
+    }
+
+    virtual bool isAsyncReadSupported() const { return num_started_workers_ > 0; }
+
+    virtual bool startRead(const Path& path, const uavcan::uint64_t offset, const uavcan::ServiceResponseToken& token,
+                           uavcan::IFileReadCompletionHandler& handler)
+    {
+        if (num_started_workers_ == 0)
+        {
+            return false;
+        }
+
+        (void)pthread_mutex_lock(&mutex_);
+        ReadJob* const job = free_jobs_;
+        if (job == NULL)
+        {
+            num_sync_fallbacks_++;
+            (void)pthread_mutex_unlock(&mutex_);
+            return false;
+        }
+        free_jobs_ = job->next;
+
+        job->handler = &handler;
+        job->token = token;
+        job->offset = offset;
+        job->error = 0;
+        job->size = 0;
+        (void)std::strncpy(job->path, path.c_str(), MaxPathLength);
+        job->path[MaxPathLength] = '\0';
+
+        requests_.push(job);
+        num_async_reads_++;
+        (void)pthread_cond_signal(&cond_);
+        (void)pthread_mutex_unlock(&mutex_);
+        return true;
+    }
+
+    virtual void cancelReads(uavcan::IFileReadCompletionHandler& handler)
+    {
+        (void)pthread_mutex_lock(&mutex_);
+        for (unsigned i = 0; i < max_pending_reads_ && jobs_ != NULL; i++)
+        {
+            if (jobs_[i].handler == &handler)
+            {
+                jobs_[i].handler = NULL;
+            }
+        }
+        (void)pthread_mutex_unlock(&mutex_);
+    }
+
+    /**
+     * Number of reads that were executed by the worker threads.
+     */
+    uavcan::uint32_t getNumAsyncReads() const { return num_async_reads_; }
+
+    /**
+     * Number of reads that were executed synchronously because all read slots were busy.
+     */
+    uavcan::uint32_t getNumSyncFallbacks() const { return num_sync_fallbacks_; }
+
+    unsigned getNumWorkers() const { return num_workers_; }
+    unsigned getMaxPendingReads() const { return max_pending_reads_; }
+};
+
+}
+
+#endif // Include guard
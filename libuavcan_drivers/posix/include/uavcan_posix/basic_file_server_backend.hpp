@@ -26,6 +26,7 @@
 #include <uavcan/protocol/file/Read.hpp>
 #include <uavcan/protocol/file_server.hpp>
 #include <uavcan/data_type.hpp>
+#include <uavcan_posix/file_block_cache.hpp>
 
 namespace uavcan_posix
 {
@@ -315,6 +316,7 @@ protected:
 
     FDCacheBase* fdcache_;
     uavcan::INode& node_;
+    FileBlockCache block_cache_;
 
     FDCacheBase& getFDCache()
     {
@@ -332,6 +334,71 @@ protected:
         return *fdcache_;
     }
 
+    /**
+     * Reads up to inout_size bytes at the given offset; returns zero or errno.
+     * This method does not change the file offset, so it can be invoked from multiple threads concurrently;
+     * overrides must be thread safe as well.
+     */
+    virtual uavcan::int16_t readBlock(int fd, uavcan::uint64_t offset, uavcan::uint8_t* out_buffer,
+                                      uavcan::uint16_t& inout_size)
+    {
+        using namespace std;
+
+        uavcan::uint16_t total_read = 0;
+        while (total_read < inout_size)
+        {
+            const ssize_t nread = ::pread(fd, &out_buffer[total_read], inout_size - total_read,
+                                          static_cast<off_t>(offset + total_read));
+            if (nread < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                inout_size = 0;
+                return static_cast<uavcan::int16_t>(errno);
+            }
+            if (nread == 0)
+            {
+                break;
+            }
+            total_read = static_cast<uavcan::uint16_t>(total_read + nread);
+        }
+        inout_size = total_read;
+        return 0;
+    }
+
+    /**
+     * Same as @ref readBlock(), but whole aligned blocks are served from the block cache when possible.
+     * Thread safe.
+     */
+    uavcan::int16_t readCached(int fd, uavcan::uint64_t offset, uavcan::uint8_t* out_buffer,
+                               uavcan::uint16_t& inout_size)
+    {
+        using namespace std;
+
+        struct stat sb;
+        const bool cacheable = block_cache_.isEnabled() && FileBlockCache::isCacheable(offset, inout_size) &&
+                               (::fstat(fd, &sb) == 0);
+        if (!cacheable)
+        {
+            return readBlock(fd, offset, out_buffer, inout_size);
+        }
+
+        const FileBlockCache::Key key(sb, offset);
+        if (block_cache_.read(key, out_buffer, inout_size))
+        {
+            return 0;
+        }
+
+        const uavcan::int16_t rv = readBlock(fd, offset, out_buffer, inout_size);
+        if (rv == 0)
+        {
+            block_cache_.write(key, out_buffer, inout_size);
+        }
+        return rv;
+    }
+
     /**
      * Back-end for uavcan.protocol.file.GetInfo.
      * Implementation of this method is required.
@@ -397,34 +464,9 @@ protected:
             }
             else
             {
-                ssize_t total_read = 0;
+                uavcan::uint16_t total_read = inout_size;
 
-                rv = ::lseek(fd, offset, SEEK_SET);
-
-                if (rv < 0)
-                {
-                    rv = errno;
-                }
-                else
-                {
-                    rv = 0;
-                    ssize_t remaining = inout_size;
-                    ssize_t nread = 0;
-                    do
-                    {
-                        nread = ::read(fd, &out_buffer[total_read], remaining);
-                        if (nread < 0)
-                        {
-                            rv = errno;
-                        }
-                        else
-                        {
-                            remaining -= nread,
-                            total_read += nread;
-                        }
-                    }
-                    while (nread > 0 && remaining > 0);
-                }
+                rv = readCached(fd, offset, out_buffer, total_read);
 
                 (void)cache.close(fd, rv != 0 || total_read != inout_size);
                 inout_size = total_read;
@@ -434,11 +476,18 @@ protected:
     }
 
 public:
-    BasicFileServerBackend(uavcan::INode& node) :
+    /**
+     * @param block_cache_size      Memory budget of the block cache in bytes, see @ref FileBlockCache.
+     *                              The cache is disabled by default.
+     */
+    BasicFileServerBackend(uavcan::INode& node, std::size_t block_cache_size = 0) :
         fdcache_(NULL),
-        node_(node)
+        node_(node),
+        block_cache_(block_cache_size)
     { }
 
+    const FileBlockCache& getBlockCache() const { return block_cache_; }
+
     ~BasicFileServerBackend()
     {
         if (fdcache_ != &fallback_)
@@ -0,0 +1,386 @@
+/****************************************************************************
+*
+*   Copyright (c) 2015 PX4 Development Team. All rights reserved.
+*      Author: Pavel Kirienko <pavel.kirienko@gmail.com>
+*
+****************************************************************************/
+
+#ifndef UAVCAN_POSIX_DYNAMIC_NODE_ID_SERVER_BUFFERED_FILE_EVENT_TRACER_HPP_INCLUDED
+#define UAVCAN_POSIX_DYNAMIC_NODE_ID_SERVER_BUFFERED_FILE_EVENT_TRACER_HPP_INCLUDED
+
+#include <sys/stat.h>
+#include <pthread.h>
+#include <cstring>
+#include <cerrno>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <uavcan/protocol/dynamic_node_id_server/event.hpp>
+#include <uavcan/time.hpp>
+
+namespace uavcan_posix
+{
+namespace dynamic_node_id_server
+{
+/**
+ * One event in the binary trace file written by @ref BufferedFileEventTracer.
+ * The file starts with the signature (see @ref getFileSignature()), followed by records of @ref Size bytes.
+ * All fields are little endian.
+ */
+struct EventTraceRecord
+{
+    enum { Size = 18 };
+    enum { SignatureLength = 8 };
+
+    uavcan::uint64_t timestamp_usec;    ///< Real time, microseconds since the epoch
+    uavcan::int64_t argument;
+    uavcan::uint16_t code;
+
+    EventTraceRecord()
+        : timestamp_usec(0)
+        , argument(0)
+        , code(0)
+    { }
+
+    static const char* getFileSignature() { return "UCEVTRC1"; }
+
+    void serialize(uavcan::uint8_t* out) const
+    {
+        const uavcan::uint64_t arg = static_cast<uavcan::uint64_t>(argument);
+        for (unsigned i = 0; i < 8; i++)
+        {
+            out[i] = static_cast<uavcan::uint8_t>(timestamp_usec >> (i * 8U));
+            out[8 + i] = static_cast<uavcan::uint8_t>(arg >> (i * 8U));
+        }
+        out[16] = static_cast<uavcan::uint8_t>(code);
+        out[17] = static_cast<uavcan::uint8_t>(code >> 8U);
+    }
+
+    void deserialize(const uavcan::uint8_t* in)
+    {
+        uavcan::uint64_t arg = 0;
+        timestamp_usec = 0;
+        for (unsigned i = 0; i < 8; i++)
+        {
+            timestamp_usec |= static_cast<uavcan::uint64_t>(in[i]) << (i * 8U);
+            arg |= static_cast<uavcan::uint64_t>(in[8 + i]) << (i * 8U);
+        }
+        argument = static_cast<uavcan::int64_t>(arg);
+        code = static_cast<uavcan::uint16_t>(in[16] | (in[17] << 8U));
+    }
+
+    timespec getTimestamp() const
+    {
+        timespec ts = timespec();
+        ts.tv_sec = static_cast<time_t>(timestamp_usec / 1000000U);
+        ts.tv_nsec = static_cast<long>((timestamp_usec % 1000000U) * 1000U);
+        return ts;
+    }
+};
+
+/**
+ * This IEventTracer implementation does not touch the file system from the node thread.
+ * Events are stored as binary records in a preallocated in-memory ring, which is written to the file by a
+ * background thread once it is half full, or once per flush interval, whichever happens first.
+ * The file is opened once per flush rather than once per event, so it is still recreated if removed.
+ *
+ * If the ring overflows (i.e. the file system cannot keep up), new events are dropped and counted.
+ * The binary trace can be converted to the text format of @ref FileEventTracer offline, see @ref EventTraceRecord.
+ */
+class BufferedFileEventTracer : public uavcan::dynamic_node_id_server::IEventTracer
+{
+public:
+    enum { DefaultCapacity = 1024 };
+    enum { DefaultFlushIntervalMs = 1000 };
+
+private:
+    /**
+     * Maximum length of full path to log file
+     */
+    enum { MaxPathLength = 128 };
+
+    enum { FilePermissions = 438 };     ///< 0o666
+
+    /**
+     * This type is used for the path
+     */
+    typedef uavcan::MakeString<MaxPathLength>::Type PathString;
+
+    const unsigned capacity_;
+    const uavcan::MonotonicDuration flush_interval_;
+
+    PathString path_;
+
+    mutable pthread_mutex_t mutex_;     ///< Protects the ring and the counters
+    pthread_cond_t cond_;               ///< Signaled when the ring is half full or when stopping
+    pthread_mutex_t flush_mutex_;       ///< Serializes the writers of the file
+
+    EventTraceRecord* ring_;
+    unsigned ring_head_;
+    unsigned ring_size_;
+    uavcan::uint8_t* write_buffer_;
+
+    pthread_t thread_;
+    bool thread_started_;
+    bool stop_;
+
+    uavcan::uint32_t num_dropped_events_;
+    uavcan::uint32_t num_flushes_;
+
+    static int writeAll(int fd, const uavcan::uint8_t* data, unsigned size)
+    {
+        while (size > 0)
+        {
+            const ssize_t written = ::write(fd, data, size);
+            if (written <= 0)
+            {
+                if ((written < 0) && (errno == EINTR))
+                {
+                    continue;
+                }
+                return -uavcan::ErrFailure;
+            }
+            data += written;
+            size -= static_cast<unsigned>(written);
+        }
+        return 0;
+    }
+
+    /**
+     * Moves the pending records from the ring into the write buffer and writes them to the file.
+     */
+    void flushImpl()
+    {
+        (void)pthread_mutex_lock(&flush_mutex_);
+
+        (void)pthread_mutex_lock(&mutex_);
+        const unsigned num_records = ring_size_;
+        for (unsigned i = 0; i < num_records; i++)
+        {
+            ring_[(ring_head_ + i) % capacity_].serialize(&write_buffer_[i * EventTraceRecord::Size]);
+        }
+        ring_head_ = (ring_head_ + num_records) % capacity_;
+        ring_size_ = 0;
+        (void)pthread_mutex_unlock(&mutex_);
+
+        if (num_records > 0)
+        {
+            const int fd = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, FilePermissions);
+            if (fd >= 0)
+            {
+                // The file may have been removed in the meantime, in which case the signature must be rewritten
+                struct stat st;
+                if ((::fstat(fd, &st) == 0) && (st.st_size == 0))
+                {
+                    (void)writeAll(fd, reinterpret_cast<const uavcan::uint8_t*>(EventTraceRecord::getFileSignature()),
+                                   EventTraceRecord::SignatureLength);
+                }
+                (void)writeAll(fd, write_buffer_, num_records * EventTraceRecord::Size);
+                (void)::close(fd);
+            }
+
+            (void)pthread_mutex_lock(&mutex_);
+            num_flushes_++;
+            (void)pthread_mutex_unlock(&mutex_);
+        }
+
+        (void)pthread_mutex_unlock(&flush_mutex_);
+    }
+
+    void run()
+    {
+        (void)pthread_mutex_lock(&mutex_);
+        while (!stop_)
+        {
+            if (ring_size_ < (capacity_ / 2U))
+            {
+                timespec deadline = timespec();
+                (void)clock_gettime(CLOCK_REALTIME, &deadline);
+                const uavcan::int64_t nsec = deadline.tv_nsec + flush_interval_.toUSec() * 1000;
+                deadline.tv_sec += static_cast<time_t>(nsec / 1000000000LL);
+                deadline.tv_nsec = static_cast<long>(nsec % 1000000000LL);
+                (void)pthread_cond_timedwait(&cond_, &mutex_, &deadline);
+            }
+            (void)pthread_mutex_unlock(&mutex_);
+            flushImpl();
+            (void)pthread_mutex_lock(&mutex_);
+        }
+        (void)pthread_mutex_unlock(&mutex_);
+    }
+
+    static void* threadEntryPoint(void* arg)
+    {
+        static_cast<BufferedFileEventTracer*>(arg)->run();
+        return NULL;
+    }
+
+    void stopThread()
+    {
+        if (thread_started_)
+        {
+            (void)pthread_mutex_lock(&mutex_);
+            stop_ = true;
+            (void)pthread_cond_signal(&cond_);
+            (void)pthread_mutex_unlock(&mutex_);
+
+            (void)pthread_join(thread_, NULL);
+            thread_started_ = false;
+        }
+    }
+
+protected:
+    virtual void onEvent(uavcan::dynamic_node_id_server::TraceCode code, uavcan::int64_t argument)
+    {
+        timespec ts = timespec();               // If clock_gettime() fails, zero time will be used
+        (void)clock_gettime(CLOCK_REALTIME, &ts);
+
+        EventTraceRecord record;
+        record.timestamp_usec = static_cast<uavcan::uint64_t>(ts.tv_sec) * 1000000U +
+                                static_cast<uavcan::uint64_t>(ts.tv_nsec / 1000L);
+        record.argument = argument;
+        record.code = static_cast<uavcan::uint16_t>(code);
+
+        (void)pthread_mutex_lock(&mutex_);
+        if (ring_ == NULL)
+        {
+            ;   // Not initialized
+        }
+        else if (ring_size_ >= capacity_)
+        {
+            num_dropped_events_++;
+        }
+        else
+        {
+            ring_[(ring_head_ + ring_size_) % capacity_] = record;
+            ring_size_++;
+            if (ring_size_ == (capacity_ / 2U))
+            {
+                (void)pthread_cond_signal(&cond_);
+            }
+        }
+        (void)pthread_mutex_unlock(&mutex_);
+    }
+
+public:
+    /**
+     * @param capacity          Maximum number of events that can be buffered.
+     * @param flush_interval    Maximum time an event can stay in the buffer, unless the file system is too slow.
+     *                          Must be positive, otherwise @ref init() will fail.
+     */
+    explicit BufferedFileEventTracer(unsigned capacity = DefaultCapacity,
+                                     uavcan::MonotonicDuration flush_interval =
+                                         uavcan::MonotonicDuration::fromMSec(DefaultFlushIntervalMs))
+        : capacity_((capacity > 1) ? capacity : 2)
+        , flush_interval_(flush_interval)
+        , ring_(NULL)
+        , ring_head_(0)
+        , ring_size_(0)
+        , write_buffer_(NULL)
+        , thread_()
+        , thread_started_(false)
+        , stop_(false)
+        , num_dropped_events_(0)
+        , num_flushes_(0)
+    {
+        (void)pthread_mutex_init(&mutex_, NULL);
+        (void)pthread_cond_init(&cond_, NULL);
+        (void)pthread_mutex_init(&flush_mutex_, NULL);
+    }
+
+    /**
+     * The buffered events are written to the file before destruction.
+     */
+    virtual ~BufferedFileEventTracer()
+    {
+        stopThread();
+        if (ring_ != NULL)
+        {
+            flushImpl();
+        }
+        delete[] ring_;
+        delete[] write_buffer_;
+        (void)pthread_mutex_destroy(&flush_mutex_);
+        (void)pthread_cond_destroy(&cond_);
+        (void)pthread_mutex_destroy(&mutex_);
+    }
+
+    /**
+     * Truncates the trace file, allocates the buffer and starts the background thread.
+     * Events reported before initialization are ignored.
+     * Returns -ErrInvalidParam if the flush interval is not positive, since the flusher thread would never sleep.
+     */
+    int init(const PathString& path)
+    {
+        using namespace std;
+
+        if ((path.size() == 0) || thread_started_ || !flush_interval_.isPositive())
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+        path_ = path.c_str();
+
+        const int fd = ::open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, FilePermissions);
+        if (fd >= 0)
+        {
+            (void)::close(fd);
+        }
+
+        if (ring_ == NULL)
+        {
+            write_buffer_ = new uavcan::uint8_t[capacity_ * EventTraceRecord::Size];
+            EventTraceRecord* const ring = new EventTraceRecord[capacity_];
+            (void)pthread_mutex_lock(&mutex_);
+            ring_ = ring;
+            (void)pthread_mutex_unlock(&mutex_);
+        }
+
+        stop_ = false;
+        if (0 != pthread_create(&thread_, NULL, &BufferedFileEventTracer::threadEntryPoint, this))
+        {
+            return -uavcan::ErrFailure;
+        }
+        thread_started_ = true;
+        return 0;
+    }
+
+    /**
+     * Writes the buffered events to the file from the calling thread.
+     */
+    void flush()
+    {
+        if (ring_ != NULL)
+        {
+            flushImpl();
+        }
+    }
+
+    /**
+     * Number of events that were lost because the buffer was full.
+     */
+    uavcan::uint32_t getNumDroppedEvents() const
+    {
+        (void)pthread_mutex_lock(&mutex_);
+        const uavcan::uint32_t ret = num_dropped_events_;
+        (void)pthread_mutex_unlock(&mutex_);
+        return ret;
+    }
+
+    /**
+     * Number of times the buffered events were written to the file.
+     */
+    uavcan::uint32_t getNumFlushes() const
+    {
+        (void)pthread_mutex_lock(&mutex_);
+        const uavcan::uint32_t ret = num_flushes_;
+        (void)pthread_mutex_unlock(&mutex_);
+        return ret;
+    }
+
+    unsigned getCapacity() const { return capacity_; }
+};
+
+}
+}
+
+#endif // Include guard
@@ -38,6 +38,23 @@ class FileEventTracer : public uavcan::dynamic_node_id_server::IEventTracer
 
     PathString path_;
 
+public:
+    enum { MaxLineLength = 63 };
+
+    /**
+     * Formats one line of the trace file; the buffer must be at least MaxLineLength + 1 bytes long.
+     * Returns the length of the line.
+     */
+    static int formatLine(char* buffer, const timespec& ts, uavcan::dynamic_node_id_server::TraceCode code,
+                          uavcan::int64_t argument)
+    {
+        using namespace std;
+        const int len = snprintf(buffer, MaxLineLength + 1, "%ld.%06ld\t%d\t%lld\n",
+                                 static_cast<long>(ts.tv_sec), static_cast<long>(ts.tv_nsec / 1000L),
+                                 static_cast<int>(code), static_cast<long long>(argument));
+        return (len < 0) ? 0 : ((len > MaxLineLength) ? MaxLineLength : len);
+    }
+
 protected:
     virtual void onEvent(uavcan::dynamic_node_id_server::TraceCode code, uavcan::int64_t argument)
     {
@@ -49,11 +66,8 @@ protected:
         int fd = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, FilePermissions);
         if (fd >= 0)
         {
-            const int FormatBufferLength = 63;
-            char buffer[FormatBufferLength + 1];
-            ssize_t remaining = snprintf(buffer, FormatBufferLength, "%ld.%06ld\t%d\t%lld\n",
-                                         static_cast<long>(ts.tv_sec), static_cast<long>(ts.tv_nsec / 1000L),
-                                         static_cast<int>(code), static_cast<long long>(argument));
+            char buffer[MaxLineLength + 1];
+            ssize_t remaining = formatLine(buffer, ts, code, argument);
 
             ssize_t total_written = 0;
             ssize_t written = 0;
@@ -0,0 +1,665 @@
+/****************************************************************************
+*
+*   Copyright (c) 2015 PX4 Development Team. All rights reserved.
+*      Author: Pavel Kirienko <pavel.kirienko@gmail.com>
+*
+****************************************************************************/
+
+#ifndef UAVCAN_POSIX_DYNAMIC_NODE_ID_SERVER_JOURNALED_FILE_STORAGE_BACKEND_HPP_INCLUDED
+#define UAVCAN_POSIX_DYNAMIC_NODE_ID_SERVER_JOURNALED_FILE_STORAGE_BACKEND_HPP_INCLUDED
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <uavcan/protocol/dynamic_node_id_server/storage_backend.hpp>
+#include <uavcan/transport/crc.hpp>
+#include <uavcan/time.hpp>
+
+namespace uavcan_posix
+{
+namespace dynamic_node_id_server
+{
+/**
+ * This IStorageBackend implementation keeps all key/value pairs in a single append-only journal file,
+ * which is much cheaper to update than one file per key (see @ref FileStorageBackend):
+ *  - Every update is one write() of a small record at the end of the journal, followed by fsync().
+ *  - Reads are served from the in-memory index, so the read-back performed by the server after every
+ *    write does not touch the file system at all.
+ *
+ * Every record is protected with a CRC. If the journal ends with a torn or corrupted record (e.g. power was lost
+ * during a write), the journal is truncated at the last valid record during initialization. Since the records
+ * are never reordered, the storage always contains a consistent prefix of the history of updates.
+ *
+ * Once the journal grows much larger than the number of live keys, it is compacted: live pairs are written
+ * into a temporary file, which then atomically replaces the journal.
+ *
+ * Group commit: if the commit interval is non-zero, @ref set() invokes fsync() only if the previous commit
+ * is at least one interval old; otherwise the record stays pending. There is no timer behind this - pending
+ * records are committed by a later set() or by @ref flush() only, so without flush() the last records of a burst
+ * stay uncommitted indefinitely. The records are passed to the OS immediately, so nothing is lost if the process
+ * crashes, but a power failure loses all pending records. Therefore the caller must call flush() before any
+ * response that depends on the update leaves the node. The allocation servers respond from within
+ * uavcan::Node::spin(), so they can't do that; a Raft cluster member must keep the commit interval zero.
+ * By default the commit interval is zero, i.e. every update is committed before set() returns.
+ */
+class JournaledFileStorageBackend : public uavcan::dynamic_node_id_server::IStorageBackend
+{
+    /**
+     * Maximum length of full path including / and file name
+     */
+    enum { MaxPathLength = 128 };
+
+    enum { FilePermissions = 438 };     ///< 0o666
+
+    enum { RecordMagic = 0x4A };        ///< 'J'
+    enum { RecordHeaderSize = 3 };      ///< Magic, key length, value length
+    enum { RecordMaxSize = RecordHeaderSize + MaxStringLength * 2 + uavcan::TransferCRC::NumBytes };
+
+    enum { NumBuckets = 128 };
+    enum { InvalidIndex = 0xFFFF };
+
+    /**
+     * The journal is compacted once the number of records exceeds the number of live pairs this many times.
+     */
+    enum { CompactionRatio = 4 };
+    enum { MinRecordsBeforeCompaction = MaxKeyValuePairs };
+
+    /**
+     * This type is used for the path
+     */
+    typedef uavcan::MakeString<MaxPathLength>::Type PathString;
+
+    struct Pair
+    {
+        String key;
+        String value;
+        uavcan::uint16_t next;
+    };
+
+    PathString base_path_;
+    PathString journal_path_;
+    PathString temp_path_;
+
+    const uavcan::MonotonicDuration commit_interval_;
+
+    int fd_;
+    off_t journal_size_;
+    uavcan::uint64_t last_commit_at_usec_;
+    bool commit_pending_;
+
+    Pair* pairs_;
+    uavcan::uint16_t buckets_[NumBuckets];
+    uavcan::uint16_t free_list_;
+    unsigned num_pairs_;
+
+    unsigned num_records_;
+    unsigned num_commits_;
+    unsigned num_compactions_;
+    unsigned num_discarded_bytes_;
+
+    static uavcan::uint64_t getMonotonicUSec()
+    {
+        timespec ts = timespec();
+        (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uavcan::uint64_t>(ts.tv_sec) * 1000000ULL + static_cast<uavcan::uint64_t>(ts.tv_nsec / 1000);
+    }
+
+    static unsigned computeBucketIndex(const String& key)
+    {
+        unsigned hash = 2166136261U;                    // FNV-1a
+        for (unsigned i = 0; i < key.size(); i++)
+        {
+            hash = (hash ^ static_cast<uavcan::uint8_t>(key[i])) * 16777619U;
+        }
+        return hash & (NumBuckets - 1U);
+    }
+
+    static uavcan::uint16_t computeRecordCRC(const uavcan::uint8_t* data, unsigned len)
+    {
+        uavcan::TransferCRC crc;
+        crc.add(data, len);
+        return crc.get();
+    }
+
+    /**
+     * Returns the record size, or zero if the buffer does not start with a valid record.
+     * If the buffer is too short to contain the whole record, the required size is returned via out_needed.
+     */
+    static unsigned parseRecord(const uavcan::uint8_t* data, unsigned len, String& out_key, String& out_value,
+                                unsigned& out_needed)
+    {
+        out_needed = RecordHeaderSize;
+        if (len < RecordHeaderSize)
+        {
+            return 0;
+        }
+        const unsigned key_len = data[1];
+        const unsigned value_len = data[2];
+        if ((data[0] != RecordMagic) || (key_len == 0) || (key_len > MaxStringLength) ||
+            (value_len > MaxStringLength))
+        {
+            out_needed = 0;
+            return 0;
+        }
+
+        const unsigned payload_len = RecordHeaderSize + key_len + value_len;
+        out_needed = payload_len + uavcan::TransferCRC::NumBytes;
+        if (len < out_needed)
+        {
+            return 0;
+        }
+
+        const uavcan::uint16_t crc = static_cast<uavcan::uint16_t>(data[payload_len] |
+                                                                   (data[payload_len + 1] << 8));
+        if (crc != computeRecordCRC(data, payload_len))
+        {
+            out_needed = 0;
+            return 0;
+        }
+
+        out_key.clear();
+        out_value.clear();
+        for (unsigned i = 0; i < key_len; i++)
+        {
+            out_key.push_back(static_cast<char>(data[RecordHeaderSize + i]));
+        }
+        for (unsigned i = 0; i < value_len; i++)
+        {
+            out_value.push_back(static_cast<char>(data[RecordHeaderSize + key_len + i]));
+        }
+        return out_needed;
+    }
+
+    static unsigned serializeRecord(const String& key, const String& value, uavcan::uint8_t* out_data)
+    {
+        out_data[0] = RecordMagic;
+        out_data[1] = static_cast<uavcan::uint8_t>(key.size());
+        out_data[2] = static_cast<uavcan::uint8_t>(value.size());
+        unsigned len = RecordHeaderSize;
+        for (unsigned i = 0; i < key.size(); i++)
+        {
+            out_data[len++] = static_cast<uavcan::uint8_t>(key[i]);
+        }
+        for (unsigned i = 0; i < value.size(); i++)
+        {
+            out_data[len++] = static_cast<uavcan::uint8_t>(value[i]);
+        }
+        const uavcan::uint16_t crc = computeRecordCRC(out_data, len);
+        out_data[len++] = static_cast<uavcan::uint8_t>(crc & 0xFFU);
+        out_data[len++] = static_cast<uavcan::uint8_t>(crc >> 8);
+        return len;
+    }
+
+    static int writeAll(int fd, const uavcan::uint8_t* data, unsigned len)
+    {
+        unsigned total_written = 0;
+        while (total_written < len)
+        {
+            const ssize_t written = ::write(fd, &data[total_written], len - total_written);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return -uavcan::ErrFailure;
+            }
+            if (written == 0)
+            {
+                return -uavcan::ErrFailure;
+            }
+            total_written += static_cast<unsigned>(written);
+        }
+        return 0;
+    }
+
+    /*
+     * Index
+     */
+    Pair* findPair(const String& key) const
+    {
+        for (uavcan::uint16_t i = buckets_[computeBucketIndex(key)]; i != InvalidIndex; i = pairs_[i].next)
+        {
+            if (pairs_[i].key == key)
+            {
+                return &pairs_[i];
+            }
+        }
+        return NULL;
+    }
+
+    void clearIndex()
+    {
+        for (unsigned i = 0; i < NumBuckets; i++)
+        {
+            buckets_[i] = InvalidIndex;
+        }
+        free_list_ = InvalidIndex;
+        for (unsigned i = MaxKeyValuePairs; i > 0; i--)
+        {
+            pairs_[i - 1].next = free_list_;
+            free_list_ = static_cast<uavcan::uint16_t>(i - 1);
+        }
+        num_pairs_ = 0;
+    }
+
+    /**
+     * Returns false if the index is full.
+     */
+    bool updateIndex(const String& key, const String& value)
+    {
+        const unsigned bucket = computeBucketIndex(key);
+        uavcan::uint16_t* link = &buckets_[bucket];
+        while ((*link != InvalidIndex) && !(pairs_[*link].key == key))
+        {
+            link = &pairs_[*link].next;
+        }
+
+        if (*link != InvalidIndex)
+        {
+            const uavcan::uint16_t index = *link;
+            if (value.empty())                  // Deletion
+            {
+                *link = pairs_[index].next;
+                pairs_[index].next = free_list_;
+                free_list_ = index;
+                num_pairs_--;
+            }
+            else
+            {
+                pairs_[index].value = value;
+            }
+            return true;
+        }
+
+        if (value.empty())
+        {
+            return true;                        // Deleting a non-existent key
+        }
+        if (free_list_ == InvalidIndex)
+        {
+            return false;
+        }
+
+        const uavcan::uint16_t index = free_list_;
+        free_list_ = pairs_[index].next;
+        pairs_[index].key = key;
+        pairs_[index].value = value;
+        pairs_[index].next = buckets_[bucket];
+        buckets_[bucket] = index;
+        num_pairs_++;
+        return true;
+    }
+
+    /*
+     * Journal
+     */
+    int loadJournal()
+    {
+        clearIndex();
+        num_records_ = 0;
+        journal_size_ = 0;
+
+        uavcan::uint8_t buffer[RecordMaxSize * 8];
+        unsigned buffer_len = 0;
+        bool eof = false;
+
+        while (true)
+        {
+            if (!eof && (buffer_len < RecordMaxSize))
+            {
+                const ssize_t nread = ::read(fd_, &buffer[buffer_len], sizeof(buffer) - buffer_len);
+                if (nread < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return -uavcan::ErrFailure;
+                }
+                eof = (nread == 0);
+                buffer_len += static_cast<unsigned>(nread);
+                continue;
+            }
+
+            String key;
+            String value;
+            unsigned needed = 0;
+            const unsigned record_size = parseRecord(buffer, buffer_len, key, value, needed);
+            if (record_size == 0)
+            {
+                break;          // Corrupted or incomplete record, or the end of the journal
+            }
+
+            (void)updateIndex(key, value);
+            num_records_++;
+            journal_size_ += static_cast<off_t>(record_size);
+
+            buffer_len -= record_size;
+            (void)std::memmove(buffer, &buffer[record_size], buffer_len);
+        }
+
+        /*
+         * Anything after the last valid record is discarded, otherwise new records would be appended after garbage
+         */
+        struct stat sb;
+        if (::fstat(fd_, &sb) != 0)
+        {
+            return -uavcan::ErrFailure;
+        }
+        if (sb.st_size > journal_size_)
+        {
+            num_discarded_bytes_ += static_cast<unsigned>(sb.st_size - journal_size_);
+            if ((::ftruncate(fd_, journal_size_) != 0) || (::fsync(fd_) != 0))
+            {
+                return -uavcan::ErrFailure;
+            }
+        }
+        return (::lseek(fd_, journal_size_, SEEK_SET) == journal_size_) ? 0 : -uavcan::ErrFailure;
+    }
+
+    int commit()
+    {
+        if (::fsync(fd_) != 0)
+        {
+            return -uavcan::ErrFailure;
+        }
+        commit_pending_ = false;
+        last_commit_at_usec_ = getMonotonicUSec();
+        num_commits_++;
+        return 0;
+    }
+
+    bool isCompactionNeeded() const
+    {
+        return (num_records_ >= MinRecordsBeforeCompaction) && (num_records_ > (num_pairs_ * CompactionRatio));
+    }
+
+    void syncDirectory() const
+    {
+        const int dir_fd = ::open(base_path_.c_str(), O_RDONLY);
+        if (dir_fd >= 0)
+        {
+            (void)::fsync(dir_fd);      // Not supported by some file systems
+            (void)::close(dir_fd);
+        }
+    }
+
+protected:
+    virtual String get(const String& key) const
+    {
+        if (pairs_ == NULL)
+        {
+            return String();
+        }
+        const Pair* const pair = findPair(key);
+        return (pair != NULL) ? pair->value : String();
+    }
+
+    virtual void set(const String& key, const String& value)
+    {
+        if ((fd_ < 0) || key.empty())
+        {
+            return;
+        }
+
+        const Pair* const existing = findPair(key);
+        if ((existing != NULL) ? (existing->value == value) : value.empty())
+        {
+            return;                     // Nothing to change
+        }
+
+        if ((existing == NULL) && (free_list_ == InvalidIndex))
+        {
+            return;                     // Index is full; the server will detect this via read-back
+        }
+
+        uavcan::uint8_t record[RecordMaxSize];
+        const unsigned record_size = serializeRecord(key, value, record);
+
+        int res = writeAll(fd_, record, record_size);
+        if (res >= 0)
+        {
+            commit_pending_ = true;
+            const uavcan::uint64_t since_last_commit_usec = getMonotonicUSec() - last_commit_at_usec_;
+            if (commit_interval_.isZero() ||
+                (since_last_commit_usec >= static_cast<uavcan::uint64_t>(commit_interval_.toUSec())))
+            {
+                res = commit();
+            }
+        }
+
+        if (res < 0)
+        {
+            // Rolling back, so that the journal does not contain the record that was not added to the index
+            (void)::ftruncate(fd_, journal_size_);
+            (void)::lseek(fd_, journal_size_, SEEK_SET);
+            return;
+        }
+
+        (void)updateIndex(key, value);
+        num_records_++;
+        journal_size_ += static_cast<off_t>(record_size);
+
+        if (isCompactionNeeded())
+        {
+            (void)compact();
+        }
+    }
+
+public:
+    /**
+     * @param commit_interval   Group commit interval, see the class description. Zero by default.
+     */
+    explicit JournaledFileStorageBackend(uavcan::MonotonicDuration commit_interval = uavcan::MonotonicDuration())
+        : commit_interval_(commit_interval)
+        , fd_(-1)
+        , journal_size_(0)
+        , last_commit_at_usec_(0)
+        , commit_pending_(false)
+        , pairs_(NULL)
+        , free_list_(InvalidIndex)
+        , num_pairs_(0)
+        , num_records_(0)
+        , num_commits_(0)
+        , num_compactions_(0)
+        , num_discarded_bytes_(0)
+    {
+        for (unsigned i = 0; i < NumBuckets; i++)
+        {
+            buckets_[i] = InvalidIndex;
+        }
+    }
+
+    virtual ~JournaledFileStorageBackend()
+    {
+        if (fd_ >= 0)
+        {
+            (void)flush();
+            (void)::close(fd_);
+        }
+        delete[] pairs_;
+    }
+
+    /**
+     * Initializes the journal in the specified directory; the directory will be created if it doesn't exist.
+     * The journal is loaded into memory; if it ends with a corrupted record, it will be truncated.
+     * The return value should be 0 on success.
+     * If it is -ErrInvalidConfiguration then the path name is too long.
+     */
+    int init(const PathString& path)
+    {
+        using namespace std;
+
+        if (path.empty())
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+        if (fd_ >= 0)
+        {
+            (void)flush();
+            (void)::close(fd_);
+            fd_ = -1;
+        }
+
+        base_path_ = path.c_str();
+        if (base_path_.back() == '/')
+        {
+            base_path_.pop_back();
+        }
+
+        struct stat sb;
+        if (::stat(base_path_.c_str(), &sb) != 0 || !S_ISDIR(sb.st_mode))
+        {
+            // coverity[toctou]
+            if (::mkdir(base_path_.c_str(), S_IRWXU | S_IRWXG | S_IRWXO) != 0)
+            {
+                return -uavcan::ErrFailure;
+            }
+        }
+
+        const char* const JournalName = "/journal";
+        const char* const TempSuffix = ".tmp";
+        if ((base_path_.size() + std::strlen(JournalName) + std::strlen(TempSuffix)) > MaxPathLength)
+        {
+            return -uavcan::ErrInvalidConfiguration;
+        }
+        journal_path_ = base_path_.c_str();
+        journal_path_ += JournalName;
+        temp_path_ = journal_path_.c_str();
+        temp_path_ += TempSuffix;
+
+        (void)::unlink(temp_path_.c_str());      // Left over from an interrupted compaction
+
+        if (pairs_ == NULL)
+        {
+            pairs_ = new Pair[MaxKeyValuePairs];
+        }
+
+        fd_ = ::open(journal_path_.c_str(), O_RDWR | O_CREAT, FilePermissions);
+        if (fd_ < 0)
+        {
+            return -uavcan::ErrFailure;
+        }
+
+        const int res = loadJournal();
+        if (res < 0)
+        {
+            (void)::close(fd_);
+            fd_ = -1;
+            return res;
+        }
+        last_commit_at_usec_ = getMonotonicUSec();
+
+        return isCompactionNeeded() ? compact() : 0;
+    }
+
+    /**
+     * Commits the records that were written since the last commit, if any.
+     * With a non-zero commit interval, this must be called before any response that depends on the pending
+     * records is transmitted.
+     * Returns negative error code.
+     */
+    int flush()
+    {
+        if ((fd_ < 0) || !commit_pending_)
+        {
+            return 0;
+        }
+        return commit();
+    }
+
+    /**
+     * Rewrites the journal so that it contains only the live pairs.
+     * This is done automatically when the journal grows too large; normally there is no need to call it directly.
+     * Returns negative error code.
+     */
+    int compact()
+    {
+        if (fd_ < 0)
+        {
+            return -uavcan::ErrNotInited;
+        }
+
+        const int temp_fd = ::open(temp_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, FilePermissions);
+        if (temp_fd < 0)
+        {
+            return -uavcan::ErrFailure;
+        }
+
+        off_t new_size = 0;
+        int res = 0;
+        for (unsigned bucket = 0; (bucket < NumBuckets) && (res >= 0); bucket++)
+        {
+            for (uavcan::uint16_t i = buckets_[bucket]; (i != InvalidIndex) && (res >= 0); i = pairs_[i].next)
+            {
+                uavcan::uint8_t record[RecordMaxSize];
+                const unsigned record_size = serializeRecord(pairs_[i].key, pairs_[i].value, record);
+                res = writeAll(temp_fd, record, record_size);
+                new_size += static_cast<off_t>(record_size);
+            }
+        }
+
+        if ((res < 0) || (::fsync(temp_fd) != 0))
+        {
+            (void)::close(temp_fd);
+            (void)::unlink(temp_path_.c_str());
+            return -uavcan::ErrFailure;
+        }
+        (void)::close(temp_fd);
+
+        if (::rename(temp_path_.c_str(), journal_path_.c_str()) != 0)
+        {
+            (void)::unlink(temp_path_.c_str());
+            return -uavcan::ErrFailure;
+        }
+        syncDirectory();
+
+        (void)::close(fd_);
+        fd_ = ::open(journal_path_.c_str(), O_RDWR, FilePermissions);
+        if ((fd_ < 0) || (::lseek(fd_, new_size, SEEK_SET) != new_size))
+        {
+            return -uavcan::ErrFailure;
+        }
+
+        journal_size_ = new_size;
+        num_records_ = num_pairs_;
+        commit_pending_ = false;
+        num_compactions_++;
+        return 0;
+    }
+
+    uavcan::MonotonicDuration getCommitInterval() const { return commit_interval_; }
+
+    /**
+     * Number of live key/value pairs.
+     */
+    unsigned getNumPairs() const { return num_pairs_; }
+
+    /**
+     * Number of records in the journal; equals the number of pairs right after compaction.
+     */
+    unsigned getNumRecords() const { return num_records_; }
+
+    off_t getJournalSize() const { return journal_size_; }
+
+    unsigned getNumCommits() const { return num_commits_; }
+    unsigned getNumCompactions() const { return num_compactions_; }
+
+    /**
+     * Number of bytes of corrupted or incomplete records that were truncated during initialization.
+     */
+    unsigned getNumDiscardedBytes() const { return num_discarded_bytes_; }
+};
+
+}
+}
+
+#endif // Include guard
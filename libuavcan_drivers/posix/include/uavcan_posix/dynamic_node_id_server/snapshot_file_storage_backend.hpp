@@ -0,0 +1,558 @@
+/****************************************************************************
+*
+*   Copyright (c) 2015 PX4 Development Team. All rights reserved.
+*      Author: Pavel Kirienko <pavel.kirienko@gmail.com>
+*
+****************************************************************************/
+
+#ifndef UAVCAN_POSIX_DYNAMIC_NODE_ID_SERVER_SNAPSHOT_FILE_STORAGE_BACKEND_HPP_INCLUDED
+#define UAVCAN_POSIX_DYNAMIC_NODE_ID_SERVER_SNAPSHOT_FILE_STORAGE_BACKEND_HPP_INCLUDED
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <uavcan_posix/dynamic_node_id_server/file_storage_backend.hpp>
+#include <uavcan/transport/crc.hpp>
+
+namespace uavcan_posix
+{
+namespace dynamic_node_id_server
+{
+/**
+ * This IStorageBackend implementation keeps the key-per-file layout of @ref FileStorageBackend, and additionally
+ * maintains a snapshot of all key/value pairs in a single file, so that the storage can be loaded with one read()
+ * instead of one open()/read()/close() per key. This greatly reduces the time the server needs to start.
+ *
+ * Updates are written to the key files immediately, while the snapshot is rewritten only by @ref flush(),
+ * so that a burst of updates (e.g. one Raft log append changes several keys) costs one snapshot write:
+ *  - The first update after a flush removes the snapshot file before the key file is written.
+ *  - @ref flush() writes the snapshot into a temporary file, which then atomically replaces the old snapshot.
+ *  - The snapshot is protected with a CRC.
+ * Therefore the snapshot is never older than the key files; if the process dies before the flush, the next
+ * initialization loads the key files. The application should call @ref flush() after processing a batch of
+ * updates, e.g. once per spin; the destructor flushes as well.
+ *
+ * A key file is replaced atomically via a temporary file, and the in-memory copy is updated only once the new key
+ * file has been committed to the disk. If the write fails, the old value is retained both on the disk and in
+ * memory, so that the read-back performed by the server detects the failure.
+ *
+ * During initialization, the snapshot is loaded if it is valid; otherwise the key files are loaded instead,
+ * and a new snapshot is created from them. Reads are served from memory.
+ * If the snapshot cannot be updated, it is removed and the backend falls back to the key files until
+ * the next initialization.
+ *
+ * The key files must not be modified by other means while the snapshot exists, otherwise the changes will be
+ * ignored on the next initialization. Remove the snapshot file to make the backend reload the key files.
+ */
+class SnapshotFileStorageBackend : public FileStorageBackend
+{
+    /**
+     * Maximum length of full path including / and key max
+     */
+    enum { MaxPathLength = 128 };
+
+    enum { FilePermissions = 438 };     ///< 0o666
+
+    enum { SignatureLength = 8 };
+    enum { HeaderSize = SignatureLength + 2 };  ///< Signature, number of pairs
+    enum { PairHeaderSize = 2 };                ///< Key length, value length
+    enum { MaxSnapshotSize = HeaderSize + MaxKeyValuePairs * (PairHeaderSize + MaxStringLength * 2) +
+                             uavcan::TransferCRC::NumBytes };
+
+    /**
+     * This type is used for the path
+     */
+    typedef uavcan::MakeString<MaxPathLength>::Type PathString;
+
+    struct Pair
+    {
+        String key;
+        String value;
+    };
+
+    PathString dir_path_;
+    PathString snapshot_path_;
+    PathString temp_path_;
+
+    Pair* pairs_;                       ///< NULL if the snapshot is not used
+    unsigned num_pairs_;
+    uavcan::uint8_t* buffer_;
+
+    bool loaded_from_snapshot_;
+    bool snapshot_dirty_;               ///< The snapshot file has been removed and must be rewritten by flush()
+    unsigned num_snapshot_writes_;
+
+    static const char* getSignature() { return "UCSNAP01"; }
+
+    static const char* getSnapshotName() { return ".snapshot"; }
+    static const char* getTempName() { return ".snapshot.tmp"; }
+    static const char* getKeyTempName() { return ".key.tmp"; }     // Shorter than the above
+
+    static uavcan::uint16_t computeCRC(const uavcan::uint8_t* data, unsigned len)
+    {
+        uavcan::TransferCRC crc;
+        crc.add(data, len);
+        return crc.get();
+    }
+
+    static int writeAll(int fd, const uavcan::uint8_t* data, unsigned len)
+    {
+        unsigned total_written = 0;
+        while (total_written < len)
+        {
+            const ssize_t written = ::write(fd, &data[total_written], len - total_written);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return -uavcan::ErrFailure;
+            }
+            if (written == 0)
+            {
+                return -uavcan::ErrFailure;
+            }
+            total_written += static_cast<unsigned>(written);
+        }
+        return 0;
+    }
+
+    Pair* findPair(const String& key) const
+    {
+        for (unsigned i = 0; i < num_pairs_; i++)
+        {
+            if (pairs_[i].key == key)
+            {
+                return &pairs_[i];
+            }
+        }
+        return NULL;
+    }
+
+    /**
+     * Returns false if the table is full.
+     */
+    bool updatePair(const String& key, const String& value)
+    {
+        Pair* const pair = findPair(key);
+        if (pair != NULL)
+        {
+            if (value.empty())                  // Deletion - the last pair takes the place of the removed one
+            {
+                *pair = pairs_[num_pairs_ - 1];
+                num_pairs_--;
+            }
+            else
+            {
+                pair->value = value;
+            }
+            return true;
+        }
+
+        if (value.empty())
+        {
+            return true;                        // Deleting a non-existent key
+        }
+        if (num_pairs_ >= MaxKeyValuePairs)
+        {
+            return false;
+        }
+        pairs_[num_pairs_].key = key;
+        pairs_[num_pairs_].value = value;
+        num_pairs_++;
+        return true;
+    }
+
+    /**
+     * Returns true if the snapshot was valid and has been loaded.
+     */
+    bool loadSnapshot()
+    {
+        const int fd = ::open(snapshot_path_.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        // One read() is normally enough, since the buffer is large enough to contain the largest snapshot
+        unsigned len = 0;
+        while (len <= MaxSnapshotSize)
+        {
+            const ssize_t nread = ::read(fd, &buffer_[len], MaxSnapshotSize + 1U - len);
+            if (nread < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                break;
+            }
+            if (nread == 0)
+            {
+                break;
+            }
+            len += static_cast<unsigned>(nread);
+        }
+        (void)::close(fd);
+
+        if ((len < (HeaderSize + uavcan::TransferCRC::NumBytes)) || (len > MaxSnapshotSize) ||
+            (0 != std::memcmp(buffer_, getSignature(), SignatureLength)))
+        {
+            return false;
+        }
+
+        const unsigned payload_len = len - uavcan::TransferCRC::NumBytes;
+        const uavcan::uint16_t crc = static_cast<uavcan::uint16_t>(buffer_[payload_len] |
+                                                                   (buffer_[payload_len + 1] << 8));
+        if (crc != computeCRC(buffer_, payload_len))
+        {
+            return false;
+        }
+
+        const unsigned num_pairs = static_cast<unsigned>(buffer_[SignatureLength] |
+                                                         (buffer_[SignatureLength + 1] << 8));
+        if (num_pairs > MaxKeyValuePairs)
+        {
+            return false;
+        }
+
+        unsigned offset = HeaderSize;
+        num_pairs_ = 0;
+        for (unsigned i = 0; i < num_pairs; i++)
+        {
+            if ((offset + PairHeaderSize) > payload_len)
+            {
+                return false;
+            }
+            const unsigned key_len = buffer_[offset];
+            const unsigned value_len = buffer_[offset + 1];
+            offset += PairHeaderSize;
+            if ((key_len == 0) || (key_len > MaxStringLength) || (value_len == 0) ||
+                (value_len > MaxStringLength) || ((offset + key_len + value_len) > payload_len))
+            {
+                return false;
+            }
+
+            Pair& pair = pairs_[num_pairs_++];
+            pair.key.clear();
+            pair.value.clear();
+            for (unsigned k = 0; k < key_len; k++)
+            {
+                pair.key.push_back(static_cast<char>(buffer_[offset++]));
+            }
+            for (unsigned k = 0; k < value_len; k++)
+            {
+                pair.value.push_back(static_cast<char>(buffer_[offset++]));
+            }
+        }
+        return offset == payload_len;
+    }
+
+    /**
+     * Reads all key files of the directory, as @ref FileStorageBackend would do.
+     * Returns false if the directory cannot be read or contains too many keys.
+     */
+    bool loadKeyFiles()
+    {
+        DIR* const dir = ::opendir(dir_path_.c_str());
+        if (dir == NULL)
+        {
+            return false;
+        }
+
+        bool success = true;
+        num_pairs_ = 0;
+        while (const dirent* const entry = ::readdir(dir))
+        {
+            const std::size_t name_len = std::strlen(entry->d_name);
+            if ((entry->d_name[0] == '.') || (name_len > MaxStringLength))
+            {
+                continue;               // Skipping the snapshot files, the dot entries and anything that is not a key
+            }
+
+            const String key(entry->d_name);
+            const String value = FileStorageBackend::get(key);
+            if (!updatePair(key, value))
+            {
+                success = false;
+                break;
+            }
+        }
+        (void)::closedir(dir);
+        return success;
+    }
+
+    int writeSnapshot()
+    {
+        std::memcpy(buffer_, getSignature(), SignatureLength);
+        buffer_[SignatureLength] = static_cast<uavcan::uint8_t>(num_pairs_ & 0xFFU);
+        buffer_[SignatureLength + 1] = static_cast<uavcan::uint8_t>(num_pairs_ >> 8);
+        unsigned len = HeaderSize;
+        for (unsigned i = 0; i < num_pairs_; i++)
+        {
+            const Pair& pair = pairs_[i];
+            buffer_[len++] = static_cast<uavcan::uint8_t>(pair.key.size());
+            buffer_[len++] = static_cast<uavcan::uint8_t>(pair.value.size());
+            (void)std::memcpy(&buffer_[len], pair.key.c_str(), pair.key.size());
+            len += pair.key.size();
+            (void)std::memcpy(&buffer_[len], pair.value.c_str(), pair.value.size());
+            len += pair.value.size();
+        }
+        const uavcan::uint16_t crc = computeCRC(buffer_, len);
+        buffer_[len++] = static_cast<uavcan::uint8_t>(crc & 0xFFU);
+        buffer_[len++] = static_cast<uavcan::uint8_t>(crc >> 8);
+
+        const int fd = ::open(temp_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, FilePermissions);
+        if (fd < 0)
+        {
+            return -uavcan::ErrFailure;
+        }
+        if ((writeAll(fd, buffer_, len) < 0) || (::fsync(fd) != 0))
+        {
+            (void)::close(fd);
+            (void)::unlink(temp_path_.c_str());
+            return -uavcan::ErrFailure;
+        }
+        (void)::close(fd);
+
+        if (::rename(temp_path_.c_str(), snapshot_path_.c_str()) != 0)
+        {
+            (void)::unlink(temp_path_.c_str());
+            return -uavcan::ErrFailure;
+        }
+        syncDirectory();
+
+        num_snapshot_writes_++;
+        return 0;
+    }
+
+    /**
+     * Unlike @ref FileStorageBackend::set(), this method reports errors, and the old key file is left intact
+     * if the new value could not be written.
+     */
+    int writeKeyFile(const String& key, const String& value)
+    {
+        PathString path = dir_path_.c_str();
+        path += getKeyTempName();
+
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, FilePermissions);
+        if (fd < 0)
+        {
+            return -uavcan::ErrFailure;
+        }
+        if ((writeAll(fd, reinterpret_cast<const uavcan::uint8_t*>(value.c_str()), value.size()) < 0) ||
+            (::fsync(fd) != 0))
+        {
+            (void)::close(fd);
+            (void)::unlink(path.c_str());
+            return -uavcan::ErrFailure;
+        }
+        (void)::close(fd);
+
+        PathString key_path = dir_path_.c_str();
+        key_path += key;
+        if (::rename(path.c_str(), key_path.c_str()) != 0)
+        {
+            (void)::unlink(path.c_str());
+            return -uavcan::ErrFailure;
+        }
+        syncDirectory();
+        return 0;
+    }
+
+    void syncDirectory() const
+    {
+        const int dir_fd = ::open(dir_path_.c_str(), O_RDONLY);
+        if (dir_fd >= 0)
+        {
+            (void)::fsync(dir_fd);      // Not supported by some file systems
+            (void)::close(dir_fd);
+        }
+    }
+
+    /**
+     * Removes the snapshot and switches to the key files until the next initialization.
+     */
+    void disableSnapshot()
+    {
+        (void)::unlink(snapshot_path_.c_str());
+        syncDirectory();
+        delete[] pairs_;
+        pairs_ = NULL;
+        num_pairs_ = 0;
+        snapshot_dirty_ = false;
+    }
+
+protected:
+    virtual String get(const String& key) const
+    {
+        if (pairs_ == NULL)
+        {
+            return FileStorageBackend::get(key);
+        }
+        const Pair* const pair = findPair(key);
+        return (pair != NULL) ? pair->value : String();
+    }
+
+    virtual void set(const String& key, const String& value)
+    {
+        if (pairs_ == NULL)
+        {
+            FileStorageBackend::set(key, value);        // Read-back goes to the key file as well
+            return;
+        }
+        if (key.empty())
+        {
+            return;
+        }
+
+        const Pair* const existing = findPair(key);
+        const bool changed = (existing != NULL) ? !(existing->value == value) : !value.empty();
+        if (!changed)
+        {
+            return;
+        }
+
+        if (!snapshot_dirty_)
+        {
+            // The snapshot must not outlive the key file update, it will be rewritten by flush()
+            (void)::unlink(snapshot_path_.c_str());
+            syncDirectory();
+            snapshot_dirty_ = true;
+        }
+
+        if (writeKeyFile(key, value) < 0)
+        {
+            return;                                     // The old value stays in memory, the server will notice
+        }
+
+        if (!updatePair(key, value))
+        {
+            disableSnapshot();                          // The key file is already written, so nothing is lost
+        }
+    }
+
+public:
+    SnapshotFileStorageBackend()
+        : pairs_(NULL)
+        , num_pairs_(0)
+        , buffer_(NULL)
+        , loaded_from_snapshot_(false)
+        , snapshot_dirty_(false)
+        , num_snapshot_writes_(0)
+    { }
+
+    virtual ~SnapshotFileStorageBackend()
+    {
+        (void)flush();
+        delete[] pairs_;
+        delete[] buffer_;
+    }
+
+    /**
+     * Initializes the storage in the specified directory; the directory will be created if it doesn't exist.
+     * The snapshot is loaded if it is valid, otherwise it is recreated from the key files.
+     * The return value should be 0 on success.
+     * If it is -ErrInvalidConfiguration then the the path name is too long to
+     * accommodate the trailing slash and max key length.
+     */
+    int init(const PathString& path)
+    {
+        const int res = FileStorageBackend::init(path.c_str());
+        if (res < 0)
+        {
+            return res;
+        }
+
+        dir_path_ = path.c_str();
+        if (dir_path_.back() != '/')
+        {
+            dir_path_.push_back('/');
+        }
+        if ((dir_path_.size() + std::strlen(getTempName())) > MaxPathLength)
+        {
+            return -uavcan::ErrInvalidConfiguration;
+        }
+        snapshot_path_ = dir_path_.c_str();
+        snapshot_path_ += getSnapshotName();
+        temp_path_ = dir_path_.c_str();
+        temp_path_ += getTempName();
+
+        (void)::unlink(temp_path_.c_str());     // Left over from an interrupted update
+        {
+            PathString key_temp_path = dir_path_.c_str();
+            key_temp_path += getKeyTempName();
+            (void)::unlink(key_temp_path.c_str());
+        }
+
+        if (buffer_ == NULL)
+        {
+            buffer_ = new uavcan::uint8_t[MaxSnapshotSize + 1];
+        }
+        if (pairs_ == NULL)
+        {
+            pairs_ = new Pair[MaxKeyValuePairs];
+        }
+
+        snapshot_dirty_ = false;
+        loaded_from_snapshot_ = loadSnapshot();
+        if (!loaded_from_snapshot_)
+        {
+            if (!loadKeyFiles() || (writeSnapshot() < 0))
+            {
+                disableSnapshot();
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Rewrites the snapshot if there were updates since the last flush; otherwise does nothing.
+     * If the snapshot cannot be written, the backend falls back to the key files.
+     * Returns negative error code.
+     */
+    int flush()
+    {
+        if ((pairs_ == NULL) || !snapshot_dirty_)
+        {
+            return 0;
+        }
+        snapshot_dirty_ = false;
+        const int res = writeSnapshot();
+        if (res < 0)
+        {
+            disableSnapshot();
+        }
+        return res;
+    }
+
+    /**
+     * Whether there are updates that are not in the snapshot yet.
+     */
+    bool isFlushPending() const { return (pairs_ != NULL) && snapshot_dirty_; }
+
+    /**
+     * Whether the last initialization was done from the snapshot rather than from the key files.
+     */
+    bool wasLoadedFromSnapshot() const { return loaded_from_snapshot_; }
+
+    /**
+     * Whether the snapshot is maintained; false if the backend has fallen back to the key files.
+     */
+    bool isSnapshotEnabled() const { return pairs_ != NULL; }
+
+    unsigned getNumPairs() const { return num_pairs_; }
+    unsigned getNumSnapshotWrites() const { return num_snapshot_writes_; }
+};
+
+}
+}
+
+#endif // Include guard
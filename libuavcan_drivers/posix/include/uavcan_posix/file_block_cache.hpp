@@ -0,0 +1,338 @@
+/****************************************************************************
+*
+*   Copyright (c) 2015 PX4 Development Team. All rights reserved.
+*      Author: Pavel Kirienko <pavel.kirienko@gmail.com>
+*
+****************************************************************************/
+
+#ifndef UAVCAN_POSIX_FILE_BLOCK_CACHE_HPP_INCLUDED
+#define UAVCAN_POSIX_FILE_BLOCK_CACHE_HPP_INCLUDED
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <cstddef>
+#include <cstring>
+
+#include <uavcan/protocol/file_server.hpp>
+
+namespace uavcan_posix
+{
+/**
+ * LRU cache of file blocks, used by the file server backends to serve repeated reads from memory
+ * (e.g. when many nodes are downloading the same firmware image).
+ *
+ * Blocks are @ref BlockSize bytes long and aligned at @ref BlockSize, i.e. they match the read requests that
+ * are issued by well-behaving clients that read files sequentially. A block is identified by the device,
+ * inode, size, modification and status change times of the file, plus the offset; therefore blocks of modified
+ * or replaced files are never returned, they are just evicted eventually. The times are compared with nanosecond
+ * resolution, so that a file rewritten within the same second is not mistaken for the cached one.
+ *
+ * The memory is allocated at once, when the first block is added. Lookups and updates are O(1).
+ * This class is thread safe.
+ */
+class FileBlockCache : uavcan::Noncopyable
+{
+public:
+    enum { BlockSize = uavcan::IFileServerBackend::ReadSize };
+
+    struct Key
+    {
+        dev_t dev;
+        ino_t ino;
+        off_t file_size;
+        struct timespec mtime;
+        struct timespec ctime;
+        uavcan::uint64_t offset;
+
+        Key()
+            : dev(0)
+            , ino(0)
+            , file_size(0)
+            , offset(0)
+        {
+            mtime.tv_sec = ctime.tv_sec = 0;
+            mtime.tv_nsec = ctime.tv_nsec = 0;
+        }
+
+        Key(const struct stat& st, uavcan::uint64_t arg_offset)
+            : dev(st.st_dev)
+            , ino(st.st_ino)
+            , file_size(st.st_size)
+            , mtime(st.st_mtim)
+            , ctime(st.st_ctim)
+            , offset(arg_offset)
+        { }
+
+        bool operator==(const Key& rhs) const
+        {
+            return (dev == rhs.dev) && (ino == rhs.ino) && (file_size == rhs.file_size) &&
+                   (mtime.tv_sec == rhs.mtime.tv_sec) && (mtime.tv_nsec == rhs.mtime.tv_nsec) &&
+                   (ctime.tv_sec == rhs.ctime.tv_sec) && (ctime.tv_nsec == rhs.ctime.tv_nsec) &&
+                   (offset == rhs.offset);
+        }
+    };
+
+private:
+    struct Block
+    {
+        Block* lru_prev;        ///< Towards the most recently used
+        Block* lru_next;        ///< Towards the least recently used
+        Block* bucket_next;
+        Key key;
+        uavcan::uint16_t size;
+        uavcan::uint8_t data[BlockSize];
+    };
+
+    const unsigned capacity_;
+    const unsigned num_buckets_;
+
+    mutable pthread_mutex_t mutex_;
+    Block* blocks_;
+    Block** buckets_;
+    Block* lru_head_;
+    Block* lru_tail_;
+    unsigned num_used_blocks_;
+
+    uavcan::uint64_t num_hits_;
+    uavcan::uint64_t num_misses_;
+
+    static unsigned computeNumBuckets(unsigned capacity)
+    {
+        unsigned n = 1;
+        while (n < capacity * 2U)
+        {
+            n <<= 1;
+        }
+        return n;
+    }
+
+    unsigned computeBucketIndex(const Key& key) const
+    {
+        uavcan::uint64_t h = key.offset / BlockSize;
+        h = h * 0x9E3779B97F4A7C15ULL + static_cast<uavcan::uint64_t>(key.ino);
+        h = h * 0x9E3779B97F4A7C15ULL + static_cast<uavcan::uint64_t>(key.dev);
+        h ^= h >> 29;
+        return static_cast<unsigned>(h) & (num_buckets_ - 1U);
+    }
+
+    Block* find(const Key& key) const
+    {
+        for (Block* b = buckets_[computeBucketIndex(key)]; b != NULL; b = b->bucket_next)
+        {
+            if (b->key == key)
+            {
+                return b;
+            }
+        }
+        return NULL;
+    }
+
+    void unlinkLru(Block* b)
+    {
+        (b->lru_prev != NULL) ? (b->lru_prev->lru_next = b->lru_next) : (lru_head_ = b->lru_next);
+        (b->lru_next != NULL) ? (b->lru_next->lru_prev = b->lru_prev) : (lru_tail_ = b->lru_prev);
+        b->lru_prev = NULL;
+        b->lru_next = NULL;
+    }
+
+    void linkLruHead(Block* b)
+    {
+        b->lru_prev = NULL;
+        b->lru_next = lru_head_;
+        if (lru_head_ != NULL)
+        {
+            lru_head_->lru_prev = b;
+        }
+        lru_head_ = b;
+        if (lru_tail_ == NULL)
+        {
+            lru_tail_ = b;
+        }
+    }
+
+    void unlinkBucket(Block* b)
+    {
+        Block** pp = &buckets_[computeBucketIndex(b->key)];
+        while (*pp != b)
+        {
+            pp = &(*pp)->bucket_next;
+        }
+        *pp = b->bucket_next;
+        b->bucket_next = NULL;
+    }
+
+    /**
+     * The buckets are allocated first, so that a non-null blocks_ always implies valid buckets_,
+     * even if one of the allocations threw.
+     */
+    void allocate()
+    {
+        if (buckets_ == NULL)
+        {
+            buckets_ = new Block*[num_buckets_];
+            std::memset(buckets_, 0, sizeof(Block*) * num_buckets_);
+        }
+        if (blocks_ == NULL)
+        {
+            blocks_ = new Block[capacity_];
+        }
+    }
+
+    struct LockGuard
+    {
+        pthread_mutex_t& mutex;
+        explicit LockGuard(pthread_mutex_t& m) : mutex(m) { (void)pthread_mutex_lock(&mutex); }
+        ~LockGuard() { (void)pthread_mutex_unlock(&mutex); }
+    };
+
+public:
+    /**
+     * @param memory_budget     Maximum amount of memory to use for the cached blocks, in bytes.
+     *                          Budgets smaller than one block disable the cache.
+     */
+    explicit FileBlockCache(std::size_t memory_budget)
+        : capacity_(static_cast<unsigned>(memory_budget / sizeof(Block)))
+        , num_buckets_(computeNumBuckets(capacity_))
+        , blocks_(NULL)
+        , buckets_(NULL)
+        , lru_head_(NULL)
+        , lru_tail_(NULL)
+        , num_used_blocks_(0)
+        , num_hits_(0)
+        , num_misses_(0)
+    {
+        (void)pthread_mutex_init(&mutex_, NULL);
+    }
+
+    ~FileBlockCache()
+    {
+        delete[] blocks_;
+        delete[] buckets_;
+        (void)pthread_mutex_destroy(&mutex_);
+    }
+
+    bool isEnabled() const { return capacity_ > 0; }
+
+    /**
+     * Only reads of whole blocks at aligned offsets can be served from the cache.
+     */
+    static bool isCacheable(uavcan::uint64_t offset, uavcan::uint16_t size)
+    {
+        return (size == BlockSize) && ((offset % BlockSize) == 0);
+    }
+
+    /**
+     * Copies the block into the buffer and marks it as most recently used.
+     * The size of the buffer must be at least @ref BlockSize; the size of the block is returned via out_size.
+     * Returns false if the block is not cached.
+     */
+    bool read(const Key& key, uavcan::uint8_t* out_buffer, uavcan::uint16_t& out_size)
+    {
+        LockGuard guard(mutex_);
+        Block* const b = (blocks_ != NULL) ? find(key) : NULL;
+        if (b == NULL)
+        {
+            num_misses_++;
+            return false;
+        }
+        num_hits_++;
+        if (b != lru_head_)
+        {
+            unlinkLru(b);
+            linkLruHead(b);
+        }
+        std::memcpy(out_buffer, b->data, b->size);
+        out_size = b->size;
+        return true;
+    }
+
+    /**
+     * Adds or updates the block; evicts the least recently used block if the cache is full.
+     * Blocks that are longer than @ref BlockSize are ignored.
+     */
+    void write(const Key& key, const uavcan::uint8_t* data, uavcan::uint16_t size)
+    {
+        if ((capacity_ == 0) || (size > BlockSize))
+        {
+            return;
+        }
+
+        LockGuard guard(mutex_);
+        allocate();
+
+        Block* b = find(key);
+        if (b != NULL)
+        {
+            unlinkLru(b);
+        }
+        else if (num_used_blocks_ < capacity_)
+        {
+            b = &blocks_[num_used_blocks_++];
+            b->bucket_next = buckets_[computeBucketIndex(key)];
+            buckets_[computeBucketIndex(key)] = b;
+        }
+        else
+        {
+            b = lru_tail_;
+            unlinkLru(b);
+            unlinkBucket(b);
+            b->bucket_next = buckets_[computeBucketIndex(key)];
+            buckets_[computeBucketIndex(key)] = b;
+        }
+
+        b->key = key;
+        b->size = size;
+        std::memcpy(b->data, data, size);
+        linkLruHead(b);
+    }
+
+    /**
+     * Drops all blocks; the statistics are not reset.
+     */
+    void clear()
+    {
+        LockGuard guard(mutex_);
+        if (buckets_ != NULL)
+        {
+            std::memset(buckets_, 0, sizeof(Block*) * num_buckets_);
+        }
+        lru_head_ = NULL;
+        lru_tail_ = NULL;
+        num_used_blocks_ = 0;
+    }
+
+    unsigned getCapacity() const { return capacity_; }
+
+    unsigned getNumUsedBlocks() const
+    {
+        LockGuard guard(mutex_);
+        return num_used_blocks_;
+    }
+
+    uavcan::uint64_t getNumHits() const
+    {
+        LockGuard guard(mutex_);
+        return num_hits_;
+    }
+
+    uavcan::uint64_t getNumMisses() const
+    {
+        LockGuard guard(mutex_);
+        return num_misses_;
+    }
+
+    /**
+     * Ratio of hits to lookups, in the range [0, 1]; zero if there were no lookups.
+     */
+    float getHitRate() const
+    {
+        LockGuard guard(mutex_);
+        const uavcan::uint64_t total = num_hits_ + num_misses_;
+        return (total > 0) ? (static_cast<float>(num_hits_) / static_cast<float>(total)) : 0.0F;
+    }
+};
+
+}
+
+#endif // Include guard
@@ -0,0 +1,277 @@
+/****************************************************************************
+*
+*   Copyright (c) 2015 PX4 Development Team. All rights reserved.
+*      Author: Pavel Kirienko <pavel.kirienko@gmail.com>
+*
+****************************************************************************/
+
+#ifndef UAVCAN_POSIX_FILE_NODE_INFO_CACHE_HPP_INCLUDED
+#define UAVCAN_POSIX_FILE_NODE_INFO_CACHE_HPP_INCLUDED
+
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <uavcan/protocol/node_info_retriever.hpp>
+#include <uavcan/transport/transfer_buffer.hpp>
+#include <uavcan/transport/crc.hpp>
+#include <uavcan/marshal/bit_stream.hpp>
+#include <uavcan/marshal/scalar_codec.hpp>
+
+namespace uavcan_posix
+{
+/**
+ * This class implements a POSIX compliant INodeInfoCache interface.
+ * Every node has its own file in the cache directory, named after the node ID. The file contains the serialized
+ * GetNodeInfo response, the UTC time of caching in microseconds, and the CRC; all integers are little endian.
+ * The CRC is initialized with the data type signature and the file format version, so that the cached responses
+ * get discarded if the data type definition or the file format changes.
+ * Files are replaced atomically via rename, hence a crash in the middle of a write can't corrupt the cache.
+ */
+class FileNodeInfoCache : public uavcan::INodeInfoCache
+{
+    typedef uavcan::protocol::GetNodeInfo::Response Response;
+
+    /**
+     * Maximum length of full path including / and the file name
+     */
+    enum { MaxPathLength = 128 };
+
+    enum { FilePermissions = 438 };     ///< 0o666
+
+    enum { MaxEncodedSize = uavcan::BitLenToByteLen<Response::MaxBitLen>::Result };
+    enum { TimestampSize = 8 };
+    enum { CRCSize = 2 };
+    enum { TrailerSize = TimestampSize + CRCSize };
+    enum { MaxFileSize = MaxEncodedSize + TrailerSize };
+
+    enum { FormatVersion = 2 };         ///< Version 1 didn't have the timestamp
+
+    /**
+     * This type is used for the path
+     */
+    typedef uavcan::MakeString<MaxPathLength>::Type PathString;
+
+    PathString base_path_;
+    uavcan::uint32_t num_writes_;
+
+    PathString makePath(uavcan::NodeID node_id) const
+    {
+        PathString path = base_path_.c_str();
+        path.appendFormatted("%d", int(node_id.get()));
+        return path;
+    }
+
+    static uavcan::uint16_t computeCRC(const uavcan::uint8_t* data, unsigned len)
+    {
+        uavcan::TransferCRC crc = uavcan::protocol::GetNodeInfo::getDataTypeSignature().toTransferCRC();
+        crc.add(uavcan::uint8_t(FormatVersion));
+        crc.add(data, len);
+        return crc.get();
+    }
+
+    /**
+     * Returns the number of bytes read or negative error.
+     */
+    static int readFile(const char* path, uavcan::uint8_t* data, unsigned max_len)
+    {
+        using namespace std;
+        const int fd = open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            return -uavcan::ErrFailure;
+        }
+        unsigned total_read = 0;
+        ssize_t nread = 0;
+        do
+        {
+            nread = ::read(fd, &data[total_read], max_len - total_read);
+            if (nread > 0)
+            {
+                total_read += static_cast<unsigned>(nread);
+            }
+        }
+        while ((nread > 0) && (total_read < max_len));
+        (void)close(fd);
+        return (nread < 0) ? -uavcan::ErrFailure : int(total_read);
+    }
+
+    static int writeFile(const char* path, const uavcan::uint8_t* data, unsigned len)
+    {
+        using namespace std;
+        const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, FilePermissions);
+        if (fd < 0)
+        {
+            return -uavcan::ErrFailure;
+        }
+        unsigned total_written = 0;
+        ssize_t written = 0;
+        do
+        {
+            written = ::write(fd, &data[total_written], len - total_written);
+            if (written > 0)
+            {
+                total_written += static_cast<unsigned>(written);
+            }
+        }
+        while ((written > 0) && (total_written < len));
+        (void)fsync(fd);
+        (void)close(fd);
+        return (total_written == len) ? 0 : -uavcan::ErrFailure;
+    }
+
+public:
+    FileNodeInfoCache()
+        : num_writes_(0)
+    { }
+
+    /**
+     * Initializes the cache by passing a path to the directory where the files will be stored.
+     * The directory will be created if it does not exist.
+     * The return value should be 0 on success.
+     */
+    int init(const PathString& path)
+    {
+        using namespace std;
+
+        int rv = -uavcan::ErrInvalidParam;
+
+        if (path.size() > 0)
+        {
+            base_path_ = path.c_str();
+
+            if (base_path_.back() == '/')
+            {
+                base_path_.pop_back();
+            }
+
+            rv = 0;
+            struct stat sb;
+            if (stat(base_path_.c_str(), &sb) != 0 || !S_ISDIR(sb.st_mode))
+            {
+                // coverity[toctou]
+                rv = mkdir(base_path_.c_str(), S_IRWXU | S_IRWXG | S_IRWXO);
+            }
+            if (rv >= 0)
+            {
+                base_path_.push_back('/');
+                if ((base_path_.size() + 8) > MaxPathLength)        // Node ID and the suffix of the temporary file
+                {
+                    rv = -uavcan::ErrInvalidConfiguration;
+                }
+            }
+        }
+        return rv;
+    }
+
+    virtual int get(uavcan::NodeID node_id, Response& out_node_info, uavcan::UtcTime& out_cached_at)
+    {
+        if (base_path_.empty() || !node_id.isUnicast())
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+
+        uavcan::uint8_t data[MaxFileSize + 1];          // One extra byte to detect files that are too long
+        const int len = readFile(makePath(node_id).c_str(), data, sizeof(data));
+        if ((len <= TrailerSize) || (len > MaxFileSize))
+        {
+            return -uavcan::ErrFailure;
+        }
+
+        const unsigned crc_offset = unsigned(len) - CRCSize;
+        const uavcan::uint16_t crc = static_cast<uavcan::uint16_t>(data[crc_offset] | (data[crc_offset + 1] << 8));
+        if (crc != computeCRC(data, crc_offset))
+        {
+            UAVCAN_TRACE("FileNodeInfoCache", "Bad CRC, node ID %d", int(node_id.get()));
+            return -uavcan::ErrFailure;
+        }
+
+        const unsigned payload_len = crc_offset - TimestampSize;
+        uavcan::uint64_t cached_at_usec = 0;
+        for (unsigned i = 0; i < TimestampSize; i++)
+        {
+            cached_at_usec |= uavcan::uint64_t(data[payload_len + i]) << (8 * i);
+        }
+
+        uavcan::StaticTransferBuffer<MaxEncodedSize> buffer;
+        if (buffer.write(0, data, payload_len) != int(payload_len))
+        {
+            return -uavcan::ErrFailure;
+        }
+        uavcan::BitStream bitstream(buffer);
+        uavcan::ScalarCodec codec(bitstream);
+        if (Response::decode(out_node_info, codec) <= 0)
+        {
+            return -uavcan::ErrInvalidMarshalData;
+        }
+        out_cached_at = uavcan::UtcTime::fromUSec(cached_at_usec);
+        return 0;
+    }
+
+    virtual int put(uavcan::NodeID node_id, const Response& node_info, uavcan::UtcTime cached_at)
+    {
+        if (base_path_.empty() || !node_id.isUnicast())
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+
+        uavcan::StaticTransferBuffer<MaxEncodedSize> buffer;
+        {
+            uavcan::BitStream bitstream(buffer);
+            uavcan::ScalarCodec codec(bitstream);
+            if (Response::encode(node_info, codec) <= 0)
+            {
+                return -uavcan::ErrInvalidMarshalData;
+            }
+        }
+
+        uavcan::uint8_t data[MaxFileSize];
+        const unsigned payload_len = buffer.getMaxWritePos();
+        (void)std::memcpy(data, buffer.getRawPtr(), payload_len);
+        for (unsigned i = 0; i < TimestampSize; i++)
+        {
+            data[payload_len + i] = static_cast<uavcan::uint8_t>(cached_at.toUSec() >> (8 * i));
+        }
+        const unsigned crc_offset = payload_len + TimestampSize;
+        const uavcan::uint16_t crc = computeCRC(data, crc_offset);
+        data[crc_offset] = static_cast<uavcan::uint8_t>(crc);
+        data[crc_offset + 1] = static_cast<uavcan::uint8_t>(crc >> 8);
+
+        const PathString path = makePath(node_id);
+        PathString tmp_path = path;
+        tmp_path += ".tmp";
+
+        int res = writeFile(tmp_path.c_str(), data, crc_offset + CRCSize);
+        if (res >= 0)
+        {
+            res = (std::rename(tmp_path.c_str(), path.c_str()) == 0) ? 0 : -uavcan::ErrFailure;
+        }
+        if (res < 0)
+        {
+            (void)::unlink(tmp_path.c_str());
+            return res;
+        }
+
+        num_writes_++;
+        return 0;
+    }
+
+    /**
+     * Removes the cached response of the specified node, if any.
+     */
+    void remove(uavcan::NodeID node_id)
+    {
+        if (!base_path_.empty() && node_id.isUnicast())
+        {
+            (void)::unlink(makePath(node_id).c_str());
+        }
+    }
+
+    uavcan::uint32_t getNumWrites() const { return num_writes_; }
+};
+}
+
+#endif // Include guard